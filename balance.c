@@ -33,15 +33,17 @@
 #include "log.h"
 #include "cline.h"
 #include "profile.h"
+#include "plans.h"
+#include "samples.h"
 
 int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*buffer;
+	sampleType			*buffer;
 	long int		buffersize = 0;
 	windowManager	windows;
-	double			*windowUsed = NULL;
+	sampleType			*windowUsed = NULL;
 	long int		loadedBlockSize = 0, i = 0, matchIndex = 0;
 	struct timespec	start, end;
 	int				leftover = 0, discardBytes = 0;
@@ -77,7 +79,7 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 	}
 
 	buffersize = SecondsToSamples(Signal->header.fmt.SamplesPerSec, longest, Signal->AudioChannels, Signal->bytesPerSample, NULL, NULL, NULL);
-	buffer = (double*)malloc(sizeof(double)*buffersize);
+	buffer = (sampleType*)malloc(sizeof(sampleType)*buffersize);
 	if(!buffer)
 	{
 		logmsg("\tmalloc failed\n");
@@ -123,7 +125,7 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 				break;
 			}
 			
-			memcpy(buffer, Signal->Samples + pos, sizeof(double)*(loadedBlockSize-difference));
+			CopySamples(&Signal->Samples, pos, loadedBlockSize-difference, buffer);
 	
 			if(!ExecuteBalanceDFFT(&Channels[0], buffer, (loadedBlockSize-difference), Signal->header.fmt.SamplesPerSec, windowUsed, CHANNEL_LEFT, config))
 				return 0;
@@ -295,13 +297,13 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 	return 1;
 }
 
-int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, long samplerate, double *window, char channel, parameters *config)
+int ExecuteBalanceDFFT(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, char channel, parameters *config)
 {
-	fftw_plan		p = NULL;
+	FFTWPlan		p = NULL;
 	long		  	stereoSignalSize = 0;	
 	long		  	i = 0, monoSignalSize = 0, zeropadding = 0;
-	double		  	*signal = NULL;
-	fftw_complex  	*spectrum = NULL;
+	sampleType		  	*signal = NULL;
+	FFTWComplex  	*spectrum = NULL;
 	double		 	seconds = 0;
 	
 	if(!AudioArray)
@@ -317,42 +319,26 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, lo
 	if(config->ZeroPad)  /* disabled by default */
 		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate);
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	p = getPlanBySize(&config->plans, monoSignalSize, FFTW_PLAN_R2C);
+	if(!p)
+		return 0;
+
+	signal = (sampleType*)FFTW(malloc)(sizeof(sampleType)*(monoSignalSize+1));
 	if(!signal)
 	{
 		logmsg("Not enough memory\n");
 		return(0);
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	spectrum = (FFTWComplex*)FFTW(malloc)(sizeof(FFTWComplex)*(monoSignalSize/2+1));
 	if(!spectrum)
 	{
 		logmsg("Not enough memory\n");
+		FFTW(free)(signal);
 		return(0);
 	}
 
-	if(!config->model_plan)
-	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
-	}
-
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
-	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
-		return 0;
-	}
-
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
+	memset(signal, 0, sizeof(sampleType)*(monoSignalSize+1));
+	memset(spectrum, 0, sizeof(FFTWComplex)*(monoSignalSize/2+1));
 
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
@@ -365,11 +351,9 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, lo
 			signal[i] *= window[i];
 	}
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
-	p = NULL;
+	FFTW(execute_dft_r2c)(p, signal, spectrum);
 
-	free(signal);
+	FFTW(free)(signal);
 	signal = NULL;
 
 	AudioArray->fftwValues.spectrum = spectrum;
@@ -379,26 +363,14 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, lo
 	return(1);
 }
 
+// The ratio is applied when blocks are converted from the native samples
 void BalanceAudioChannel(AudioSignal *Signal, char channel, double ratio)
 {
-	long int 	i = 0, start = 0, end = 0;
-	double		*samples = NULL;
-
 	if(!Signal)
 		return;
 
-	if(!Signal->Samples)
+	if(!Signal->Samples.data)
 		return;
 
-	samples = Signal->Samples;
-	start = Signal->startOffset;
-	end = Signal->endOffset;
-
-	for(i = start; i < end; i+=2)
-	{
-		if(channel == CHANNEL_LEFT)
-			samples[i] = samples[i]*ratio;
-		if(channel == CHANNEL_RIGHT)
-			samples[i+1] = samples[i+1]*ratio;
-	}
+	ApplySampleGain(&Signal->Samples, channel, ratio);
 }
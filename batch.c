@@ -0,0 +1,736 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "batch.h"
+#include "log.h"
+#include "cline.h"
+#include "diff.h"
+#include "threads.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+#include <sys/wait.h>
+#endif
+
+/*
+	Batch mode compares one reference against a folder or list of files.
+	Each comparison is a regular mdfourier run in its own process, with
+	the same options, so results folders and logs are the same as today
+	and a failure in one file can't take the others down. The reference
+	is only decoded and analyzed once: the first comparison runs alone
+	and fills the sync and spectral caches, the rest run in parallel and
+	load the reference from them. Match totals come back through a
+	precision summary (-G) per comparison, and end up in a CSV.
+
+	Matrix mode (-2) compares every pair of files once. A first round
+	of pairs that share no file analyzes each file and fills its caches,
+	with an odd count the last file gets a pair of its own after it.
+	The remaining pairs still decode both files, but take the sync
+	offsets and spectra from the caches. With mixed frame rates a file
+	is cut differently depending on its partner, the spectral cache
+	keeps one entry per cut so those are only analyzed once each. Pairs
+	are not plotted unless -4 is given.
+*/
+
+static int IsBatchAudioFile(char *name)
+{
+	char	ext[8];
+	char	*dot = NULL;
+	int		len = 0;
+
+	dot = strrchr(name, '.');
+	if(!dot)
+		return 0;
+	len = strlen(dot+1);
+	if(len < 3 || len > 4)
+		return 0;
+	for(int i = 0; i <= len; i++)
+		ext[i] = toupper((unsigned char)dot[1+i]);
+	return(strcmp(ext, "WAV") == 0 || strcmp(ext, "FLAC") == 0);
+}
+
+static int IsRegularFile(char *name)
+{
+	struct stat	st;
+
+	if(stat(name, &st) != 0)
+		return 0;
+	return(S_ISREG(st.st_mode));
+}
+
+static int AddBatchFile(char *name, char *referenceFile, batchJob **jobs, long int *count, long int *size)
+{
+	if(strcmp(name, referenceFile) == 0)
+		return 1;
+
+	if(*count == *size)
+	{
+		batchJob	*grown = NULL;
+
+		*size = *size ? *size*2 : 32;
+		grown = (batchJob*)realloc(*jobs, sizeof(batchJob)*(*size));
+		if(!grown)
+		{
+			logmsg("ERROR: Not enough memory for batch list\n");
+			return 0;
+		}
+		*jobs = grown;
+	}
+
+	memset(&(*jobs)[*count], 0, sizeof(batchJob));
+	sprintf((*jobs)[*count].referenceFile, "%s", referenceFile);
+	sprintf((*jobs)[*count].comparisonFile, "%s", name);
+	(*jobs)[*count].status = BATCH_STATUS_NORUN;
+	(*count)++;
+	return 1;
+}
+
+static int CompareBatchJobs(const void *a, const void *b)
+{
+	return(strcmp(((batchJob*)a)->comparisonFile, ((batchJob*)b)->comparisonFile));
+}
+
+// A folder adds every WAV and FLAC file in it, sorted by name. Anything else is a list with one file per line
+int CollectBatchFiles(char *source, char *referenceFile, batchJob **jobs, long int *count)
+{
+	long int	size = 0;
+	char		name[BUFFER_SIZE*2];
+	DIR			*dir = NULL;
+
+	*jobs = NULL;
+	*count = 0;
+
+	dir = opendir(source);
+	if(dir)
+	{
+		struct dirent	*entry = NULL;
+
+		while((entry = readdir(dir)) != NULL)
+		{
+			if(!IsBatchAudioFile(entry->d_name))
+				continue;
+			if(strlen(source) + strlen(entry->d_name) + 2 > BUFFER_SIZE)
+				continue;
+			if(source[strlen(source)-1] == FOLDERCHAR || source[strlen(source)-1] == '/')
+				sprintf(name, "%s%s", source, entry->d_name);
+			else
+				sprintf(name, "%s%c%s", source, FOLDERCHAR, entry->d_name);
+			if(!IsRegularFile(name))
+				continue;
+			if(!AddBatchFile(name, referenceFile, jobs, count, &size))
+			{
+				closedir(dir);
+				return 0;
+			}
+		}
+		closedir(dir);
+
+		if(*count)
+			qsort(*jobs, *count, sizeof(batchJob), CompareBatchJobs);
+	}
+	else
+	{
+		FILE	*list = NULL;
+
+		list = fopen(source, "r");
+		if(!list)
+		{
+			logmsg("ERROR: Could not open batch folder or list '%s'\n", source);
+			return 0;
+		}
+
+		while(fgets(name, BUFFER_SIZE, list))
+		{
+			int len = strlen(name);
+
+			while(len && (name[len-1] == '\n' || name[len-1] == '\r' || name[len-1] == ' ' || name[len-1] == '\t'))
+				name[--len] = '\0';
+			if(!len || name[0] == '#')
+				continue;
+			if(!IsRegularFile(name))
+			{
+				logmsg(" - WARNING: Skipping '%s' from batch list, file not found\n", name);
+				continue;
+			}
+			if(!AddBatchFile(name, referenceFile, jobs, count, &size))
+			{
+				fclose(list);
+				return 0;
+			}
+		}
+		fclose(list);
+	}
+
+	if(!*count)
+	{
+		logmsg("ERROR: No WAV or FLAC files to compare in '%s'\n", source);
+		return 0;
+	}
+	return 1;
+}
+
+static int OptionHasArgument(char option)
+{
+	char *pos = NULL;
+
+	pos = strchr(MDF_OPTIONS, option);
+	return(pos && pos[1] == ':');
+}
+
+static int AddBatchArgument(batchRun *batch, char *arg)
+{
+	if(batch->argCount == BATCH_MAX_ARGS - 1)
+	{
+		logmsg("ERROR: Too many arguments for batch mode\n");
+		return 0;
+	}
+	batch->args[batch->argCount] = strdup(arg);
+	if(!batch->args[batch->argCount])
+		return 0;
+	batch->argCount++;
+	return 1;
+}
+
+/*
+	Rebuilds the command line without the options in drop, for batch
+	mode the batch source, file and summary options, everything else
+	is passed as is. Grouped options are split, since -1 may be in a group.
+*/
+int FilterBatchArguments(int argc, char *argv[], char *drop, batchRun *batch)
+{
+	batch->argCount = 0;
+	if(!AddBatchArgument(batch, argv[0]))
+		return 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		char	*arg = argv[i];
+		int		len = strlen(arg);
+
+		if(arg[0] != '-' || len < 2 || strcmp(arg, "--") == 0)
+		{
+			if(!AddBatchArgument(batch, arg))
+				return 0;
+			continue;
+		}
+
+		for(int c = 1; c < len; c++)
+		{
+			char	option[3] = { '-', arg[c], '\0' };
+			char	*value = NULL;
+			int		keep = 0;
+
+			keep = !strchr(drop, arg[c]);
+			if(arg[c] == 'm')
+				batch->hasThreads = 1;
+			if(arg[c] == '4')
+				batch->hasPlotLimit = 1;
+
+			if(OptionHasArgument(arg[c]))
+			{
+				if(c + 1 < len)
+					value = arg + c + 1;
+				else if(i + 1 < argc)
+					value = argv[++i];
+				if(keep && (!AddBatchArgument(batch, option) || (value && !AddBatchArgument(batch, value))))
+					return 0;
+				break;
+			}
+			if(keep && !AddBatchArgument(batch, option))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static void AppendQuoted(char *command, char *arg)
+{
+	char *pos = command + strlen(command);
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	pos += sprintf(pos, " \"%s\"", arg);
+#else
+	*pos++ = ' ';
+	*pos++ = '\'';
+	for(; *arg; arg++)
+	{
+		if(*arg == '\'')
+		{
+			strcpy(pos, "'\\''");
+			pos += 4;
+		}
+		else
+			*pos++ = *arg;
+	}
+	*pos++ = '\'';
+	*pos = '\0';
+#endif
+}
+
+static char *BuildBatchCommand(batchRun *batch, batchJob *job, int threads)
+{
+	char		*command = NULL;
+	size_t		size = 64;
+	char		threadCount[16];
+
+	for(int i = 0; i < batch->argCount; i++)
+		size += strlen(batch->args[i])*4 + 3;
+	size += (strlen(job->referenceFile) + strlen(job->comparisonFile) + strlen(job->summaryFile))*4 + 64;
+
+	command = (char*)malloc(size);
+	if(!command)
+		return NULL;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	// cmd.exe strips the outer quotes if the command starts with one
+	sprintf(command, "\"");
+#else
+	command[0] = '\0';
+#endif
+	for(int i = 0; i < batch->argCount; i++)
+		AppendQuoted(command, batch->args[i]);
+	AppendQuoted(command, "-r");
+	AppendQuoted(command, job->referenceFile);
+	AppendQuoted(command, "-c");
+	AppendQuoted(command, job->comparisonFile);
+	AppendQuoted(command, "-G");
+	AppendQuoted(command, job->summaryFile);
+	if(!batch->hasThreads)
+	{
+		sprintf(threadCount, "%d", threads);
+		AppendQuoted(command, "-m");
+		AppendQuoted(command, threadCount);
+	}
+	if(batch->config->matrixMode && !batch->hasPlotLimit)
+	{
+		AppendQuoted(command, "-4");
+		AppendQuoted(command, "0");
+	}
+	strcat(command, " 2>&1");
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	strcat(command, "\"");
+#endif
+	return command;
+}
+
+static void ReadBatchTotals(batchJob *job)
+{
+	FILE	*file = NULL;
+	char	precision[64];
+	int		blocks = 0;
+
+	file = fopen(job->summaryFile, "r");
+	if(!file)
+		return;
+	job->hasTotals = ReadPrecisionTotals(file, precision, &blocks, &job->totals, &job->average) == 1;
+	fclose(file);
+	remove(job->summaryFile);
+}
+
+int RunBatchJob(long int index, int thread, void *data)
+{
+	batchRun	*batch = (batchRun*)data;
+	batchJob	*job = &batch->jobs[batch->first + index];
+	char		*command = NULL, line[BUFFER_SIZE];
+	char		*results = "Results stored in ";
+	FILE		*output = NULL;
+	int			status = 0;
+	long int	done = 0;
+
+	command = BuildBatchCommand(batch, job, batch->childThreads);
+	if(!command)
+	{
+		sprintf(job->error, "Not enough memory");
+		return 1;
+	}
+
+	remove(job->summaryFile);
+	fflush(stdout);
+	output = popen(command, "r");
+	free(command);
+	if(!output)
+	{
+		sprintf(job->error, "Could not start comparison");
+		return 1;
+	}
+
+	// The output is already in each comparison's log, keep what the summary needs
+	while(fgets(line, BUFFER_SIZE, output))
+	{
+		int len = strlen(line);
+
+		while(len && (line[len-1] == '\n' || line[len-1] == '\r'))
+			line[--len] = '\0';
+		if(strncmp(line, results, strlen(results)) == 0)
+			sprintf(job->resultFolder, "%s", line + strlen(results));
+		if(strstr(line, "ERROR"))
+			sprintf(job->error, "%s", line);
+	}
+	status = pclose(output);
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+	if(status != -1 && WIFEXITED(status))
+		status = WEXITSTATUS(status);
+	else
+		status = -1;
+#endif
+	job->status = status == 0 ? BATCH_STATUS_OK : BATCH_STATUS_FAILED;
+	ReadBatchTotals(job);
+
+	pthread_mutex_lock(&batch->lock);
+	done = ++batch->done;
+	if(batch->config->matrixMode)
+		logmsg(" - [%ld/%ld] %s vs %s: ", done, batch->count, job->referenceFile, job->comparisonFile);
+	else
+		logmsg(" - [%ld/%ld] %s: ", done, batch->count, job->comparisonFile);
+	if(job->status == BATCH_STATUS_OK && job->hasTotals)
+		logmsg("%0.4f%% matched\n", MatchPercent(job->totals.cntTotalCompared, job->totals.cntTotalAudioDiff));
+	else
+		logmsg("FAILED %s\n", job->error);
+	pthread_mutex_unlock(&batch->lock);
+	return 1;
+}
+
+static void WriteCSVField(FILE *csv, char *text)
+{
+	fputc('"', csv);
+	for(; *text; text++)
+	{
+		if(*text == '"')
+			fputc('"', csv);
+		fputc(*text, csv);
+	}
+	fputc('"', csv);
+}
+
+static FILE *CreateBatchCSV(char *prefix, char *name, parameters *config)
+{
+	FILE	*csv = NULL;
+	char	subname[BUFFER_SIZE+64];
+	char	*mainDir = NULL;
+
+	sprintf(subname, "%s%s", prefix, config->compareName);
+	mainDir = PushMainPath(config);
+	ComposeFileName(name, subname, ".csv", config);
+	csv = fopen(name, "wb");
+	PopMainPath(&mainDir);
+	if(!csv)
+		logmsg("ERROR: Could not create batch summary %s\n", name);
+	return csv;
+}
+
+int WriteBatchSummary(batchRun *batch, char *prefix, parameters *config)
+{
+	FILE	*csv = NULL;
+	char	name[BUFFER_SIZE*4+256];
+
+	csv = CreateBatchCSV(prefix, name, config);
+	if(!csv)
+		return 0;
+
+	fprintf(csv, "Reference, Comparison, Status, Matched(%%), Compared, Different, Not Found, Amplitude Differences, Perfect Matches, Average Difference(dbfs), Results\n");
+	for(long int j = 0; j < batch->count; j++)
+	{
+		batchJob *job = &batch->jobs[j];
+
+		WriteCSVField(csv, job->referenceFile);
+		fprintf(csv, ", ");
+		WriteCSVField(csv, job->comparisonFile);
+		if(job->status == BATCH_STATUS_OK && job->hasTotals)
+		{
+			fprintf(csv, ", OK, %0.4f, %ld, %ld, %ld, %ld, %ld, %g, ",
+				MatchPercent(job->totals.cntTotalCompared, job->totals.cntTotalAudioDiff),
+				job->totals.cntTotalCompared, job->totals.cntTotalAudioDiff,
+				job->totals.cntFreqAudioDiff, job->totals.cntAmplAudioDiff,
+				job->totals.cntPerfectAmplMatch, job->average);
+			WriteCSVField(csv, job->resultFolder);
+		}
+		else
+		{
+			fprintf(csv, ", FAILED, , , , , , , , ");
+			WriteCSVField(csv, job->error);
+		}
+		fprintf(csv, "\n");
+	}
+	fclose(csv);
+
+	logmsg("\n* Batch summary saved to %s%s\n", config->outputPath, name);
+	return 1;
+}
+
+// Rows and columns follow the file order, pairs are compared once and mirrored
+int WriteMatrixSummary(batchRun *batch, parameters *config)
+{
+	FILE	*csv = NULL;
+	char	name[BUFFER_SIZE*4+256];
+	long int	n = batch->fileCount;
+	batchJob	**pairs = NULL;
+
+	pairs = (batchJob**)malloc(sizeof(batchJob*)*n*n);
+	if(!pairs)
+		return 0;
+	memset(pairs, 0, sizeof(batchJob*)*n*n);
+	for(long int j = 0; j < batch->count; j++)
+	{
+		batchJob *job = &batch->jobs[j];
+
+		pairs[job->refIndex*n + job->compIndex] = job;
+		pairs[job->compIndex*n + job->refIndex] = job;
+	}
+
+	csv = CreateBatchCSV("", name, config);
+	if(!csv)
+	{
+		free(pairs);
+		return 0;
+	}
+
+	for(int table = 0; table < 2; table++)
+	{
+		fprintf(csv, "%s", table == 0 ? "Matched(%)" : "Average Difference(dbfs)");
+		for(long int c = 0; c < n; c++)
+		{
+			fprintf(csv, ", ");
+			WriteCSVField(csv, batch->files[c].comparisonFile);
+		}
+		fprintf(csv, "\n");
+
+		for(long int r = 0; r < n; r++)
+		{
+			WriteCSVField(csv, batch->files[r].comparisonFile);
+			for(long int c = 0; c < n; c++)
+			{
+				batchJob *job = pairs[r*n + c];
+
+				if(r == c)
+					fprintf(csv, ", %s", table == 0 ? "100" : "0");
+				else if(!job || job->status != BATCH_STATUS_OK || !job->hasTotals)
+					fprintf(csv, ", ");
+				else if(table == 0)
+					fprintf(csv, ", %0.4f", MatchPercent(job->totals.cntTotalCompared, job->totals.cntTotalAudioDiff));
+				else
+					fprintf(csv, ", %g", job->average);
+			}
+			fprintf(csv, "\n");
+		}
+		fprintf(csv, "\n");
+	}
+	fclose(csv);
+	free(pairs);
+
+	logmsg("* Matrix saved to %s%s\n", config->outputPath, name);
+	return 1;
+}
+
+/*
+	Pairs are ordered so that the first round uses each file only once,
+	(0,1) (2,3)... which lets them run in parallel while every file is
+	analyzed for the first time. With an odd count the last file is
+	left out of it, so the next job pairs it with file 0, and has to
+	run on its own before the rest. Returns the size of the first round.
+*/
+int CreateMatrixJobs(batchRun *batch, parameters *config)
+{
+	long int	n = batch->fileCount, pos = 0, first = 0;
+
+	batch->count = n*(n-1)/2;
+	batch->jobs = (batchJob*)malloc(sizeof(batchJob)*batch->count);
+	if(!batch->jobs)
+	{
+		logmsg("ERROR: Not enough memory for batch list\n");
+		return 0;
+	}
+	memset(batch->jobs, 0, sizeof(batchJob)*batch->count);
+
+	for(int round = 0; round < 3; round++)
+	{
+		for(long int r = 0; r < n; r++)
+		{
+			for(long int c = r + 1; c < n; c++)
+			{
+				batchJob	*job = NULL;
+				int			pairRound = 2;
+
+				if(r % 2 == 0 && c == r + 1)
+					pairRound = 0;
+				else if(n % 2 && r == 0 && c == n - 1)
+					pairRound = 1;
+				if(pairRound != round)
+					continue;
+
+				job = &batch->jobs[pos++];
+				sprintf(job->referenceFile, "%s", batch->files[r].comparisonFile);
+				sprintf(job->comparisonFile, "%s", batch->files[c].comparisonFile);
+				job->refIndex = r;
+				job->compIndex = c;
+				job->status = BATCH_STATUS_NORUN;
+			}
+		}
+		if(round == 0)
+			first = pos;
+	}
+	return first;
+}
+
+// Comparisons split the cores, unless -m says how many each one gets
+int RunBatchJobs(batchRun *batch, long int first, long int count)
+{
+	int	workers = 0, cores = 0;
+
+	if(count <= 0)
+		return 1;
+
+	cores = GetProcessorCount();
+	if(batch->hasThreads)
+		workers = cores/batch->config->threads;
+	else
+		workers = cores;
+	if(workers > count)
+		workers = count;
+	if(workers > MAX_THREADS)
+		workers = MAX_THREADS;
+	if(workers < 1)
+		workers = 1;
+
+	batch->childThreads = cores/workers > 1 ? cores/workers : 1;
+	batch->first = first;
+	return(RunParallelJobs(count, workers, RunBatchJob, batch));
+}
+
+static void ReleaseBatch(batchRun *batch)
+{
+	for(int i = 0; i < batch->argCount; i++)
+	{
+		free(batch->args[i]);
+		batch->args[i] = NULL;
+	}
+	batch->argCount = 0;
+
+	if(batch->files)
+	{
+		free(batch->files);
+		batch->files = NULL;
+	}
+	if(batch->jobs)
+	{
+		free(batch->jobs);
+		batch->jobs = NULL;
+	}
+	pthread_mutex_destroy(&batch->lock);
+}
+
+int RunBatch(int argc, char *argv[], parameters *config)
+{
+	batchRun	batch;
+	long int	failed = 0, firstRound = 1;
+
+	memset(&batch, 0, sizeof(batchRun));
+	pthread_mutex_init(&batch.lock, NULL);
+	batch.config = config;
+
+	if(!FilterBatchArguments(argc, argv, "12rcG", &batch))
+	{
+		ReleaseBatch(&batch);
+		return 0;
+	}
+
+	if(config->matrixMode)
+	{
+		if(!CollectBatchFiles(config->batchSource, "", &batch.files, &batch.fileCount))
+		{
+			ReleaseBatch(&batch);
+			return 0;
+		}
+		if(batch.fileCount < 2)
+		{
+			logmsg("ERROR: Matrix mode needs at least two files\n");
+			ReleaseBatch(&batch);
+			return 0;
+		}
+		firstRound = CreateMatrixJobs(&batch, config);
+		if(!firstRound)
+		{
+			ReleaseBatch(&batch);
+			return 0;
+		}
+		logmsg("\n* Comparing %ld files from %s against each other, %ld pairs\n",
+			batch.fileCount, config->batchSource, batch.count);
+	}
+	else
+	{
+		if(!CollectBatchFiles(config->batchSource, config->referenceFile, &batch.jobs, &batch.count))
+		{
+			ReleaseBatch(&batch);
+			return 0;
+		}
+		logmsg("\n* Comparing '%s' against %ld file%s from %s\n", config->referenceFile,
+			batch.count, batch.count == 1 ? "" : "s", config->batchSource);
+	}
+
+	for(long int j = 0; j < batch.count; j++)
+	{
+		int len = 0;
+
+		len = snprintf(batch.jobs[j].summaryFile, BUFFER_SIZE, "%s%s%cBatch_%ld_%ld.txt",
+			config->outputPath, config->folderName, FOLDERCHAR, (long int)getpid(), j);
+		if(len < 0 || len >= BUFFER_SIZE)
+		{
+			logmsg("ERROR: Output path too long for batch summaries %s%s\n", config->outputPath, config->folderName);
+			ReleaseBatch(&batch);
+			return 0;
+		}
+	}
+
+	// The first round fills the caches, one job for a single reference
+	RunBatchJobs(&batch, 0, firstRound);
+	if(config->matrixMode && batch.fileCount % 2)
+	{
+		RunBatchJobs(&batch, firstRound, 1);
+		firstRound++;
+	}
+	RunBatchJobs(&batch, firstRound, batch.count - firstRound);
+
+	for(long int j = 0; j < batch.count; j++)
+	{
+		if(batch.jobs[j].status != BATCH_STATUS_OK)
+			failed++;
+	}
+
+	if(config->matrixMode)
+	{
+		WriteBatchSummary(&batch, "Pairs_", config);
+		WriteMatrixSummary(&batch, config);
+	}
+	else
+		WriteBatchSummary(&batch, "Batch_", config);
+	if(failed)
+		logmsg(" - %ld of %ld comparisons failed, check their logs\n", failed, batch.count);
+	ReleaseBatch(&batch);
+	return(failed == 0);
+}
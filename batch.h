@@ -0,0 +1,79 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_BATCH_H
+#define MDFOURIER_BATCH_H
+
+#include "mdfourier.h"
+#include <pthread.h>
+
+#define BATCH_MAX_ARGS			256
+#define BATCH_STATUS_OK			0
+#define BATCH_STATUS_FAILED		1
+#define BATCH_STATUS_NORUN		2
+
+typedef struct batch_job_st {
+	char			referenceFile[BUFFER_SIZE];
+	char			comparisonFile[BUFFER_SIZE];
+	char			summaryFile[BUFFER_SIZE];
+	char			resultFolder[BUFFER_SIZE];
+	char			error[BUFFER_SIZE];
+	long int		refIndex;
+	long int		compIndex;
+	int				status;
+	int				hasTotals;
+	AudioDifference	totals;
+	double			average;
+} batchJob;
+
+typedef struct batch_run_st {
+	char			*args[BATCH_MAX_ARGS];
+	int				argCount;
+	int				hasThreads;
+	int				hasPlotLimit;
+	int				childThreads;
+	batchJob		*files;
+	long int		fileCount;
+	batchJob		*jobs;
+	long int		count;
+	long int		first;
+	long int		done;
+	pthread_mutex_t	lock;
+	parameters		*config;
+} batchRun;
+
+int CollectBatchFiles(char *source, char *referenceFile, batchJob **jobs, long int *count);
+int FilterBatchArguments(int argc, char *argv[], char *drop, batchRun *batch);
+int RunBatchJob(long int job, int thread, void *data);
+int RunBatchJobs(batchRun *batch, long int first, long int count);
+int WriteBatchSummary(batchRun *batch, char *prefix, parameters *config);
+int WriteMatrixSummary(batchRun *batch, parameters *config);
+int CreateMatrixJobs(batchRun *batch, parameters *config);
+int RunBatch(int argc, char *argv[], parameters *config);
+
+#endif
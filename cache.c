@@ -0,0 +1,821 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "cache.h"
+#include "log.h"
+#include "loadfile.h"
+#include "profile.h"
+#include "kernels.h"
+
+/*
+	Fast 64 bit content hash, four independent multiply/rotate lanes so
+	the loads stay in flight, mixed down with the murmur3 finalizer.
+	It only needs to tell files apart, it is not cryptographic.
+*/
+
+#define HASH_PRIME1	0x9E3779B185EBCA87ULL
+#define HASH_PRIME2	0xC2B2AE3D27D4EB4FULL
+
+static inline uint64_t HashRound(uint64_t lane, uint64_t value)
+{
+	lane ^= value*HASH_PRIME2;
+	lane = (lane << 31) | (lane >> 33);
+	return lane*HASH_PRIME1;
+}
+
+static inline uint64_t HashFinalize(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed)
+{
+	const uint8_t	*bytes = (const uint8_t*)data;
+	uint64_t		lane[4], value = 0, h = 0;
+	size_t			pos = 0;
+
+	lane[0] = seed + HASH_PRIME1;
+	lane[1] = seed + HASH_PRIME2;
+	lane[2] = seed;
+	lane[3] = seed - HASH_PRIME1;
+
+	for(; pos + 32 <= size; pos += 32)
+	{
+		for(int l = 0; l < 4; l++)
+		{
+			memcpy(&value, bytes + pos + l*8, sizeof(uint64_t));
+			lane[l] = HashRound(lane[l], value);
+		}
+	}
+
+	h = (uint64_t)size;
+	for(int l = 0; l < 4; l++)
+		h = HashRound(h, lane[l]);
+
+	for(; pos + 8 <= size; pos += 8)
+	{
+		memcpy(&value, bytes + pos, sizeof(uint64_t));
+		h = HashRound(h, value);
+	}
+
+	value = 0;
+	for(int b = 0; pos < size; pos++, b++)
+		value |= (uint64_t)bytes[pos] << (b*8);
+	h = HashRound(h, value);
+
+	return HashFinalize(h);
+}
+
+int HashAudioFile(char *fileName, uint64_t *hash, long int *size)
+{
+	mappedFile	map;
+
+	if(!MapAudioFile(fileName, &map))
+		return 0;
+
+	*hash = HashBytes(map.data, map.size, 0);
+	*size = (long int)map.size;
+	UnmapAudioFile(&map);
+	return 1;
+}
+
+// Everything in the profile that affects where the syncs are found
+uint64_t HashSyncProfile(int videoFormat, parameters *config)
+{
+	uint64_t		h = 0;
+	double			version = PROFILE_VER;
+	VideoBlockDef	*format = NULL;
+
+	h = HashBytes(config->types.Name, strlen(config->types.Name), 0);
+	h = HashBytes(MDVERSION, strlen(MDVERSION), h);
+	h = HashBytes(&version, sizeof(double), h);
+
+	format = &config->types.SyncFormat[videoFormat];
+	h = HashBytes(&format->MSPerFrame, sizeof(double), h);
+	h = HashBytes(&format->LineCount, sizeof(double), h);
+	h = HashBytes(&format->pulseSyncFreq, sizeof(int), h);
+	h = HashBytes(&format->pulseFrameLen, sizeof(int), h);
+	h = HashBytes(&format->pulseCount, sizeof(int), h);
+
+	for(int i = 0; i < config->types.typeCount; i++)
+	{
+		AudioBlockType	*type = &config->types.typeArray[i];
+
+		h = HashBytes(&type->type, sizeof(int), h);
+		h = HashBytes(&type->elementCount, sizeof(int), h);
+		h = HashBytes(&type->frames, sizeof(int), h);
+		h = HashBytes(&type->cutFrames, sizeof(int), h);
+		h = HashBytes(&type->syncTone, sizeof(int), h);
+		h = HashBytes(&type->syncLen, sizeof(double), h);
+	}
+	return h;
+}
+
+/*
+	Sync offsets are kept in a text sidecar next to the audio file, with
+	one entry per profile, video format and -T combination. An entry is
+	only used when the content hash and size of the file, the profile
+	fingerprint (which includes the program version) and the options all
+	match, and its offsets make sense for the file. Anything else is a
+	miss, and the entry gets replaced once detection succeeds. -q disables
+	the cache.
+*/
+
+static int SameSyncCacheKey(syncCacheEntry *a, syncCacheEntry *b)
+{
+	return(a->contentHash == b->contentHash && a->profileHash == b->profileHash &&
+			a->fileSize == b->fileSize && a->videoFormat == b->videoFormat &&
+			a->syncTolerance == b->syncTolerance);
+}
+
+static void GetSyncCacheName(AudioSignal *Signal, char *name)
+{
+	sprintf(name, "%s%s", Signal->SourceFile, SYNC_CACHE_EXT);
+}
+
+// Returns the amount of entries read, entries must hold SYNC_CACHE_MAX_ENTRIES
+static int ReadSyncCacheFile(char *name, syncCacheEntry *entries)
+{
+	FILE			*file = NULL;
+	char			line[512];
+	int				count = 0, version = 0;
+	char			program[64];
+	syncCacheEntry	*entry = NULL;
+
+	file = fopen(name, "r");
+	if(!file)
+		return 0;
+
+	if(!fgets(line, sizeof(line), file) ||
+		sscanf(line, "MDFourierSyncCache %d %63s", &version, program) != 2 ||
+		version != SYNC_CACHE_VERSION || strcmp(program, MDVERSION) != 0)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), file))
+	{
+		unsigned long long	content = 0, profile = 0;
+		syncCacheInternal	internal;
+
+		if(strncmp(line, "entry ", 6) == 0)
+		{
+			if(count == SYNC_CACHE_MAX_ENTRIES)
+				break;
+
+			entry = &entries[count];
+			memset(entry, 0, sizeof(syncCacheEntry));
+			if(sscanf(line, "entry %llx %llx %ld %d %d %ld %ld %lf",
+					&content, &profile, &entry->fileSize, &entry->videoFormat,
+					&entry->syncTolerance, &entry->startOffset, &entry->endOffset,
+					&entry->framerate) != 8)
+			{
+				entry = NULL;
+				continue;
+			}
+			entry->contentHash = (uint64_t)content;
+			entry->profileHash = (uint64_t)profile;
+			count++;
+		}
+		else if(entry && strncmp(line, "internal ", 9) == 0)
+		{
+			if(entry->internalCount == SYNC_CACHE_MAX_INTERNAL)
+				continue;
+			if(sscanf(line, "internal %ld %ld %ld %ld %d", &internal.element, &internal.pos,
+					&internal.offset, &internal.endPulse, &internal.toleranceIssue) == 5)
+				entry->internal[entry->internalCount++] = internal;
+		}
+	}
+	fclose(file);
+	return count;
+}
+
+static int WriteSyncCacheFile(char *name, syncCacheEntry *entries, int count, int role)
+{
+	FILE	*file = NULL;
+	char	tmpName[BUFFER_SIZE+64];
+
+	// Written aside and renamed, so readers never see half a file
+	sprintf(tmpName, "%s.%ld.%d.tmp", name, (long int)getpid(), role);
+	file = fopen(tmpName, "w");
+	if(!file)
+		return 0;
+
+	fprintf(file, "MDFourierSyncCache %d %s\n", SYNC_CACHE_VERSION, MDVERSION);
+	for(int e = 0; e < count; e++)
+	{
+		fprintf(file, "entry %016llx %016llx %ld %d %d %ld %ld %.17g\n",
+			(unsigned long long)entries[e].contentHash, (unsigned long long)entries[e].profileHash,
+			entries[e].fileSize, entries[e].videoFormat, entries[e].syncTolerance,
+			entries[e].startOffset, entries[e].endOffset, entries[e].framerate);
+		for(int i = 0; i < entries[e].internalCount; i++)
+			fprintf(file, "internal %ld %ld %ld %ld %d\n", entries[e].internal[i].element,
+				entries[e].internal[i].pos, entries[e].internal[i].offset,
+				entries[e].internal[i].endPulse, entries[e].internal[i].toleranceIssue);
+	}
+
+	if(fclose(file) != 0)
+	{
+		remove(tmpName);
+		return 0;
+	}
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	remove(name);
+#endif
+	if(rename(tmpName, name) != 0)
+	{
+		remove(tmpName);
+		return 0;
+	}
+	return 1;
+}
+
+// Returns 1 if the offsets for this file, profile and options were cached
+int LoadSyncCache(AudioSignal *Signal, parameters *config)
+{
+	syncCacheEntry	*key = NULL, *entries = NULL;
+	char			name[BUFFER_SIZE+16];
+	int				count = 0;
+
+	ReleaseSyncCache(Signal);
+	if(!config->syncCache)
+		return 0;
+
+	key = (syncCacheEntry*)malloc(sizeof(syncCacheEntry));
+	if(!key)
+		return 0;
+	memset(key, 0, sizeof(syncCacheEntry));
+
+	if(!HashAudioFile(Signal->SourceFile, &key->contentHash, &key->fileSize))
+	{
+		free(key);
+		return 0;
+	}
+	key->videoFormat = Signal->role == ROLE_REF ? config->videoFormatRef : config->videoFormatCom;
+	key->profileHash = HashSyncProfile(key->videoFormat, config);
+	key->syncTolerance = config->syncTolerance;
+	Signal->syncCache = key;
+
+	entries = (syncCacheEntry*)malloc(sizeof(syncCacheEntry)*SYNC_CACHE_MAX_ENTRIES);
+	if(!entries)
+		return 0;
+
+	GetSyncCacheName(Signal, name);
+	count = ReadSyncCacheFile(name, entries);
+	for(int e = 0; e < count; e++)
+	{
+		syncCacheEntry *entry = &entries[e];
+
+		if(!SameSyncCacheKey(entry, key))
+			continue;
+
+		if(entry->startOffset < 0 || entry->endOffset <= entry->startOffset ||
+			entry->endOffset > Signal->numSamples ||
+			entry->startOffset % Signal->AudioChannels || entry->endOffset % Signal->AudioChannels)
+		{
+			logmsgFileOnly("Ignoring invalid sync cache entry in %s\n", name);
+			break;
+		}
+
+		*key = *entry;
+		key->hit = 1;
+		break;
+	}
+	free(entries);
+
+	if(key->hit && config->verbose)
+		logmsg(" - Using cached sync offsets from %s\n", name);
+	return key->hit;
+}
+
+int SaveSyncCache(AudioSignal *Signal, parameters *config)
+{
+	syncCacheEntry	*entries = NULL;
+	char			name[BUFFER_SIZE+16];
+	int				count = 0, pos = 0, ok = 0;
+
+	if(!config->syncCache || !Signal->syncCache)
+		return 0;
+
+	entries = (syncCacheEntry*)malloc(sizeof(syncCacheEntry)*SYNC_CACHE_MAX_ENTRIES);
+	if(!entries)
+		return 0;
+
+	GetSyncCacheName(Signal, name);
+	count = ReadSyncCacheFile(name, entries);
+	for(pos = 0; pos < count; pos++)
+	{
+		if(SameSyncCacheKey(&entries[pos], Signal->syncCache))
+			break;
+	}
+	if(pos == count)
+	{
+		// Drop the oldest one when full
+		if(count == SYNC_CACHE_MAX_ENTRIES)
+		{
+			memmove(&entries[0], &entries[1], sizeof(syncCacheEntry)*(count-1));
+			pos = count - 1;
+		}
+		else
+			count++;
+	}
+	entries[pos] = *Signal->syncCache;
+	entries[pos].hit = 0;
+
+	ok = WriteSyncCacheFile(name, entries, count, Signal->role);
+	if(!ok && config->verbose)
+		logmsg(" - WARNING: Could not write sync cache %s\n", name);
+	free(entries);
+	return ok;
+}
+
+int GetCachedInternalSync(AudioSignal *Signal, long int element, long int pos, long int *offset, long int *endPulse, int *toleranceIssue)
+{
+	syncCacheEntry	*entry = Signal->syncCache;
+
+	if(!entry || !entry->hit)
+		return 0;
+
+	for(int i = 0; i < entry->internalCount; i++)
+	{
+		if(entry->internal[i].element == element && entry->internal[i].pos == pos)
+		{
+			*offset = entry->internal[i].offset;
+			*endPulse = entry->internal[i].endPulse;
+			*toleranceIssue = entry->internal[i].toleranceIssue;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int StoreCachedInternalSync(AudioSignal *Signal, long int element, long int pos, long int offset, long int endPulse, int toleranceIssue, parameters *config)
+{
+	syncCacheEntry		*entry = Signal->syncCache;
+	syncCacheInternal	*internal = NULL;
+
+	// Internal syncs are only stored once the start and end offsets are known
+	if(!entry || entry->endOffset <= entry->startOffset)
+		return 0;
+
+	for(int i = 0; i < entry->internalCount; i++)
+	{
+		if(entry->internal[i].element == element && entry->internal[i].pos == pos)
+			internal = &entry->internal[i];
+	}
+	if(!internal)
+	{
+		if(entry->internalCount == SYNC_CACHE_MAX_INTERNAL)
+			return 0;
+		internal = &entry->internal[entry->internalCount++];
+	}
+	internal->element = element;
+	internal->pos = pos;
+	internal->offset = offset;
+	internal->endPulse = endPulse;
+	internal->toleranceIssue = toleranceIssue;
+	return SaveSyncCache(Signal, config);
+}
+
+void ReleaseSyncCache(AudioSignal *Signal)
+{
+	if(!Signal || !Signal->syncCache)
+		return;
+
+	free(Signal->syncCache);
+	Signal->syncCache = NULL;
+}
+
+/*
+	Spectral cache: the top frequencies of every block after the FFT
+	pass, in a little endian binary sidecar that can be mapped and read
+	in place. The header describes the analysis options so the file can
+	be inspected, but the match is done on two hashes, one of the audio
+	file and one of everything the FFT pass reads (block positions and
+	sizes, windows, gain and options), computed by the caller.
+
+	A file can be cut differently depending on what it is compared
+	against, so the sidecar holds up to SPECTRAL_CACHE_MAX_ENTRIES
+	entries back to back, oldest first, each a header and its blocks.
+	Entries for other contents of the audio file are dropped on save.
+
+	Header (SPECTRAL_HEADER_SIZE bytes)
+		0	magic[8], 8 version, 12 header size		(u32)
+		16	content hash, 24 input hash, 32 file size	(u64)
+		40	sample rate, 44 channels, 48 MaxFreq,
+		52	block count, 56 clk block or -1			(u32)
+		60	window, zero pad, sample bits, nyquist	(u8)
+		64	start Hz, 72 end Hz, 80 frame rate,
+		88	smaller frame rate						(f64)
+		96	entry size, header included				(u64)
+		104	kernel name[24], 128 profile name[128]
+	Per block (SPECTRAL_BLOCK_SIZE), then the frequencies
+		0	index, 4 left count, 8 right count, 12 reserved	(u32)
+		16	size, 24 right size (u64), 32 seconds (f64)
+		left and right count x hertz, magnitude, phase (f64)
+*/
+
+#define SPECTRAL_NO_CLK	0xFFFFFFFF
+
+static void PutLE32(uint8_t *p, uint32_t value)
+{
+	for(int b = 0; b < 4; b++)
+		p[b] = (uint8_t)(value >> (b*8));
+}
+
+static void PutLE64(uint8_t *p, uint64_t value)
+{
+	for(int b = 0; b < 8; b++)
+		p[b] = (uint8_t)(value >> (b*8));
+}
+
+static void PutLEDouble(uint8_t *p, double value)
+{
+	uint64_t bits = 0;
+
+	memcpy(&bits, &value, sizeof(double));
+	PutLE64(p, bits);
+}
+
+// Zero terminated, p must be zeroed and hold max bytes
+static void PutText(uint8_t *p, const char *text, size_t max)
+{
+	size_t	len = strlen(text);
+
+	if(len > max - 1)
+		len = max - 1;
+	memcpy(p, text, len);
+}
+
+static uint32_t GetLE32(const uint8_t *p)
+{
+	uint32_t value = 0;
+
+	for(int b = 0; b < 4; b++)
+		value |= (uint32_t)p[b] << (b*8);
+	return value;
+}
+
+static uint64_t GetLE64(const uint8_t *p)
+{
+	uint64_t value = 0;
+
+	for(int b = 0; b < 8; b++)
+		value |= (uint64_t)p[b] << (b*8);
+	return value;
+}
+
+static double GetLEDouble(const uint8_t *p)
+{
+	uint64_t	bits = GetLE64(p);
+	double		value = 0;
+
+	memcpy(&value, &bits, sizeof(double));
+	return value;
+}
+
+int GetAudioContentHash(AudioSignal *Signal, uint64_t *hash, long int *size)
+{
+	// The sync cache already hashed the file
+	if(Signal->syncCache)
+	{
+		*hash = Signal->syncCache->contentHash;
+		*size = Signal->syncCache->fileSize;
+		return 1;
+	}
+	return(HashAudioFile(Signal->SourceFile, hash, size));
+}
+
+static void GetSpectralCacheName(AudioSignal *Signal, char *name)
+{
+	sprintf(name, "%s%s", Signal->SourceFile, SPECTRAL_CACHE_EXT);
+}
+
+// Entries past the last one written by the FFT pass are still clean
+static long int CountStoredFrequencies(Frequency *freq, parameters *config)
+{
+	long int count = 0;
+
+	if(!freq)
+		return 0;
+
+	for(long int i = 0; i < config->MaxFreq; i++)
+	{
+		if(freq[i].hertz != 0 || freq[i].magnitude != 0 || freq[i].phase != 0)
+			count = i + 1;
+	}
+	return count;
+}
+
+static uint8_t *PutSpectralBlock(uint8_t *p, AudioBlocks *block, long int index, parameters *config)
+{
+	long int	count = 0, countRight = 0;
+
+	count = CountStoredFrequencies(block->freq, config);
+	countRight = CountStoredFrequencies(block->freqRight, config);
+
+	PutLE32(p, (uint32_t)index);
+	PutLE32(p+4, (uint32_t)count);
+	PutLE32(p+8, (uint32_t)countRight);
+	PutLE32(p+12, 0);
+	PutLE64(p+16, (uint64_t)block->fftwValues.size);
+	PutLE64(p+24, (uint64_t)block->fftwValuesRight.size);
+	PutLEDouble(p+32, block->seconds);
+	p += SPECTRAL_BLOCK_SIZE;
+
+	for(long int i = 0; i < count; i++, p += SPECTRAL_FREQ_SIZE)
+	{
+		PutLEDouble(p, block->freq[i].hertz);
+		PutLEDouble(p+8, block->freq[i].magnitude);
+		PutLEDouble(p+16, block->freq[i].phase);
+	}
+	for(long int i = 0; i < countRight; i++, p += SPECTRAL_FREQ_SIZE)
+	{
+		PutLEDouble(p, block->freqRight[i].hertz);
+		PutLEDouble(p+8, block->freqRight[i].magnitude);
+		PutLEDouble(p+16, block->freqRight[i].phase);
+	}
+	return p;
+}
+
+static size_t GetSpectralBlockSize(AudioBlocks *block, parameters *config)
+{
+	return(SPECTRAL_BLOCK_SIZE + SPECTRAL_FREQ_SIZE*
+		(CountStoredFrequencies(block->freq, config) + CountStoredFrequencies(block->freqRight, config)));
+}
+
+/*
+	Checks one block record against the signal, and only copies it when
+	apply is set, so a damaged file never leaves half loaded blocks.
+	Returns the position of the next record or NULL.
+*/
+static const uint8_t *GetSpectralBlock(const uint8_t *p, const uint8_t *end, AudioBlocks *block, long int index, int apply, parameters *config)
+{
+	uint32_t	count = 0, countRight = 0;
+
+	if(end - p < SPECTRAL_BLOCK_SIZE || GetLE32(p) != (uint32_t)index)
+		return NULL;
+
+	count = GetLE32(p+4);
+	countRight = GetLE32(p+8);
+	if(count > (uint32_t)config->MaxFreq || countRight > (uint32_t)config->MaxFreq ||
+		(countRight && !block->freqRight) || (count && !block->freq))
+		return NULL;
+	if((size_t)(end - p) < SPECTRAL_BLOCK_SIZE + (size_t)SPECTRAL_FREQ_SIZE*(count + countRight))
+		return NULL;
+
+	if(apply)
+	{
+		block->fftwValues.size = (size_t)GetLE64(p+16);
+		block->fftwValuesRight.size = (size_t)GetLE64(p+24);
+		block->seconds = GetLEDouble(p+32);
+	}
+	p += SPECTRAL_BLOCK_SIZE;
+
+	for(uint32_t i = 0; i < count + countRight; i++, p += SPECTRAL_FREQ_SIZE)
+	{
+		Frequency *freq = i < count ? &block->freq[i] : &block->freqRight[i - count];
+
+		if(!apply)
+			continue;
+		freq->hertz = GetLEDouble(p);
+		freq->magnitude = GetLEDouble(p+8);
+		freq->amplitude = NO_AMPLITUDE;
+		freq->phase = GetLEDouble(p+16);
+		freq->matched = 0;
+	}
+	return p;
+}
+
+static const uint8_t *GetSpectralBlocks(const uint8_t *p, const uint8_t *end, AudioSignal *Signal, long int blocks, int apply, parameters *config)
+{
+	for(long int b = 0; b < blocks && p; b++)
+		p = GetSpectralBlock(p, end, &Signal->Blocks[b], b, apply, config);
+	if(p && config->clkMeasure)
+		p = GetSpectralBlock(p, end, &Signal->clkFrequencies, config->clkBlock, apply, config);
+	return p;
+}
+
+// Returns the size of the entry at p, or 0 if there is none
+static size_t GetSpectralEntrySize(const uint8_t *p, const uint8_t *end)
+{
+	uint64_t	size = 0;
+
+	if(end - p < SPECTRAL_HEADER_SIZE || memcmp(p, SPECTRAL_CACHE_MAGIC, 8) != 0 ||
+		GetLE32(p+8) != SPECTRAL_CACHE_VERSION || GetLE32(p+12) != SPECTRAL_HEADER_SIZE)
+		return 0;
+
+	size = GetLE64(p+96);
+	if(size < SPECTRAL_HEADER_SIZE || size > (uint64_t)(end - p))
+		return 0;
+	return (size_t)size;
+}
+
+static int SameSpectralFile(const uint8_t *p, uint64_t contentHash, long int fileSize)
+{
+	return(GetLE64(p+16) == contentHash && GetLE64(p+32) == (uint64_t)fileSize);
+}
+
+static int SameSpectralKey(const uint8_t *p, uint64_t contentHash, long int fileSize, uint64_t inputHash, long int blocks, parameters *config)
+{
+	return(SameSpectralFile(p, contentHash, fileSize) && GetLE64(p+24) == inputHash &&
+		GetLE32(p+48) == (uint32_t)config->MaxFreq && GetLE32(p+52) == (uint32_t)blocks &&
+		GetLE32(p+56) == (config->clkMeasure ? (uint32_t)config->clkBlock : SPECTRAL_NO_CLK));
+}
+
+// Returns 1 if the spectra for these FFT inputs were loaded
+int LoadSpectralCache(AudioSignal *Signal, long int blocks, uint64_t inputHash, parameters *config)
+{
+	mappedFile		map;
+	const uint8_t	*data = NULL, *end = NULL;
+	char			name[BUFFER_SIZE+16];
+	uint64_t		contentHash = 0;
+	long int		fileSize = 0;
+	size_t			entrySize = 0;
+	int				valid = 0;
+
+	if(!config->spectralCache)
+		return 0;
+
+	GetSpectralCacheName(Signal, name);
+	if(access(name, R_OK) != 0)
+		return 0;
+	if(!GetAudioContentHash(Signal, &contentHash, &fileSize))
+		return 0;
+	if(!MapAudioFile(name, &map))
+		return 0;
+
+	data = (const uint8_t*)map.data;
+	end = data + map.size;
+	while((entrySize = GetSpectralEntrySize(data, end)) != 0)
+	{
+		const uint8_t *next = data + entrySize;
+
+		if(SameSpectralKey(data, contentHash, fileSize, inputHash, blocks, config))
+		{
+			if(GetSpectralBlocks(data+SPECTRAL_HEADER_SIZE, next, Signal, blocks, 0, config) == next)
+			{
+				GetSpectralBlocks(data+SPECTRAL_HEADER_SIZE, next, Signal, blocks, 1, config);
+				valid = 1;
+			}
+			else
+				logmsgFileOnly("Ignoring damaged spectral cache %s\n", name);
+			break;
+		}
+		data = next;
+	}
+	UnmapAudioFile(&map);
+
+	if(valid && config->verbose)
+		logmsg(" - Using cached spectra from %s\n", name);
+	return valid;
+}
+
+int SaveSpectralCache(AudioSignal *Signal, long int blocks, uint64_t inputHash, parameters *config)
+{
+	uint8_t			*data = NULL, *p = NULL;
+	const uint8_t	*kept[SPECTRAL_CACHE_MAX_ENTRIES];
+	size_t			keptSize[SPECTRAL_CACHE_MAX_ENTRIES];
+	size_t			size = SPECTRAL_HEADER_SIZE;
+	char			name[BUFFER_SIZE+16], tmpName[BUFFER_SIZE+64];
+	uint64_t		contentHash = 0;
+	long int		fileSize = 0;
+	mappedFile		map;
+	FILE			*file = NULL;
+	int				ok = 0, count = 0, mapped = 0;
+
+	if(!config->spectralCache)
+		return 0;
+	if(!GetAudioContentHash(Signal, &contentHash, &fileSize))
+		return 0;
+
+	for(long int b = 0; b < blocks; b++)
+		size += GetSpectralBlockSize(&Signal->Blocks[b], config);
+	if(config->clkMeasure)
+		size += GetSpectralBlockSize(&Signal->clkFrequencies, config);
+
+	data = (uint8_t*)malloc(size);
+	if(!data)
+		return 0;
+	memset(data, 0, SPECTRAL_HEADER_SIZE);
+
+	memcpy(data, SPECTRAL_CACHE_MAGIC, strlen(SPECTRAL_CACHE_MAGIC));
+	PutLE32(data+8, SPECTRAL_CACHE_VERSION);
+	PutLE32(data+12, SPECTRAL_HEADER_SIZE);
+	PutLE64(data+16, contentHash);
+	PutLE64(data+24, inputHash);
+	PutLE64(data+32, (uint64_t)fileSize);
+	PutLE32(data+40, (uint32_t)Signal->header.fmt.SamplesPerSec);
+	PutLE32(data+44, (uint32_t)Signal->AudioChannels);
+	PutLE32(data+48, (uint32_t)config->MaxFreq);
+	PutLE32(data+52, (uint32_t)blocks);
+	PutLE32(data+56, config->clkMeasure ? (uint32_t)config->clkBlock : SPECTRAL_NO_CLK);
+	data[60] = (uint8_t)config->window;
+	data[61] = (uint8_t)config->ZeroPad;
+	data[62] = (uint8_t)(sizeof(sampleType)*8);
+	data[63] = (uint8_t)Signal->nyquistLimit;
+	PutLEDouble(data+64, config->startHz);
+	PutLEDouble(data+72, config->endHz);
+	PutLEDouble(data+80, Signal->framerate);
+	PutLEDouble(data+88, config->smallerFramerate);
+	PutLE64(data+96, (uint64_t)size);
+	PutText(data+104, GetKernelName(), 24);
+	PutText(data+128, config->types.Name, 128);
+
+	p = data+SPECTRAL_HEADER_SIZE;
+	for(long int b = 0; b < blocks; b++)
+		p = PutSpectralBlock(p, &Signal->Blocks[b], b, config);
+	if(config->clkMeasure)
+		p = PutSpectralBlock(p, &Signal->clkFrequencies, config->clkBlock, config);
+
+	GetSpectralCacheName(Signal, name);
+	if(access(name, R_OK) == 0 && MapAudioFile(name, &map))
+	{
+		const uint8_t	*old = (const uint8_t*)map.data, *end = old + map.size;
+		size_t			entrySize = 0;
+
+		mapped = 1;
+		// Keep the other cuts of the same file, dropping the oldest when full
+		while((entrySize = GetSpectralEntrySize(old, end)) != 0)
+		{
+			if(SameSpectralFile(old, contentHash, fileSize) &&
+				!SameSpectralKey(old, contentHash, fileSize, inputHash, blocks, config))
+			{
+				if(count == SPECTRAL_CACHE_MAX_ENTRIES - 1)
+				{
+					memmove(&kept[0], &kept[1], sizeof(const uint8_t*)*(count-1));
+					memmove(&keptSize[0], &keptSize[1], sizeof(size_t)*(count-1));
+					count--;
+				}
+				kept[count] = old;
+				keptSize[count] = entrySize;
+				count++;
+			}
+			old += entrySize;
+		}
+	}
+
+	sprintf(tmpName, "%s.%ld.%d.tmp", name, (long int)getpid(), Signal->role);
+	file = fopen(tmpName, "wb");
+	if(file)
+	{
+		ok = 1;
+		for(int e = 0; e < count && ok; e++)
+			ok = fwrite(kept[e], 1, keptSize[e], file) == keptSize[e];
+		if(ok)
+			ok = fwrite(data, 1, size, file) == size;
+		if(fclose(file) != 0)
+			ok = 0;
+	}
+	// Unmapped before replacing it
+	if(mapped)
+		UnmapAudioFile(&map);
+	if(file)
+	{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		if(ok)
+			remove(name);
+#endif
+		if(ok && rename(tmpName, name) != 0)
+			ok = 0;
+		if(!ok)
+			remove(tmpName);
+	}
+	free(data);
+
+	if(!ok && config->verbose)
+		logmsg(" - WARNING: Could not write spectral cache %s\n", name);
+	return ok;
+}
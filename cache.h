@@ -0,0 +1,83 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_CACHE_H
+#define MDFOURIER_CACHE_H
+
+#include "mdfourier.h"
+
+#define SYNC_CACHE_VERSION		1
+#define SYNC_CACHE_EXT			".mdfsync"
+#define SYNC_CACHE_MAX_ENTRIES	32
+#define SYNC_CACHE_MAX_INTERNAL	64
+
+#define SPECTRAL_CACHE_VERSION	1
+#define SPECTRAL_CACHE_EXT		".mdfspec"
+#define SPECTRAL_CACHE_MAGIC	"MDFSPEC"
+#define SPECTRAL_CACHE_MAX_ENTRIES	8
+#define SPECTRAL_HEADER_SIZE	256
+#define SPECTRAL_BLOCK_SIZE		40
+#define SPECTRAL_FREQ_SIZE		24
+
+typedef struct sync_cache_internal_st {
+	long int	element;
+	long int	pos;
+	long int	offset;
+	long int	endPulse;
+	int			toleranceIssue;
+} syncCacheInternal;
+
+typedef struct sync_cache_entry_st {
+	uint64_t			contentHash;
+	uint64_t			profileHash;
+	long int			fileSize;
+	int					videoFormat;
+	int					syncTolerance;
+	int					hit;
+	long int			startOffset;
+	long int			endOffset;
+	double				framerate;
+	int					internalCount;
+	syncCacheInternal	internal[SYNC_CACHE_MAX_INTERNAL];
+} syncCacheEntry;
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed);
+int HashAudioFile(char *fileName, uint64_t *hash, long int *size);
+uint64_t HashSyncProfile(int videoFormat, parameters *config);
+
+int LoadSyncCache(AudioSignal *Signal, parameters *config);
+int SaveSyncCache(AudioSignal *Signal, parameters *config);
+int GetCachedInternalSync(AudioSignal *Signal, long int element, long int pos, long int *offset, long int *endPulse, int *toleranceIssue);
+int StoreCachedInternalSync(AudioSignal *Signal, long int element, long int pos, long int offset, long int endPulse, int toleranceIssue, parameters *config);
+void ReleaseSyncCache(AudioSignal *Signal);
+
+int GetAudioContentHash(AudioSignal *Signal, uint64_t *hash, long int *size);
+int LoadSpectralCache(AudioSignal *Signal, long int blocks, uint64_t inputHash, parameters *config);
+int SaveSpectralCache(AudioSignal *Signal, long int blocks, uint64_t inputHash, parameters *config);
+
+#endif
@@ -30,6 +30,8 @@
 #include "log.h"
 #include "plot.h"
 #include "profile.h"
+#include "server.h"
+#include "threads.h"
 
 #define CHAR_FOLDER_REMOVE		0
 #define CHAR_FOLDER_OK			1
@@ -53,13 +55,25 @@ void PrintUsage()
 	logmsg("		'n' No normalization\n");
 	logmsg("	 -B: Do not do stereo channel audio <B>alancing\n");
 	logmsg("	 -I: <I>gnore frame rate difference for analysis\n");
+	logmsg("	 -J: Match frequencies to the nearest FFT bin within one bin\n");
 	logmsg("	 -p: Define the noise floor value in dBFS (0 to disable auto adjust)\n");
 	logmsg("	 -T: Increase Sync detection <T>olerance (ignore frequency for pulses)\n");
+	logmsg("	 -q: Don't use the sync and spectral caches (<file>.mdfsync/.mdfspec)\n");
 	logmsg("	 -Y: Define the Reference Video Format from the profile\n");
 	logmsg("	 -Z: Define the Comparison Video Format from the profile\n");
 	logmsg("	 -R: Adjust sample <R>ate if duration difference is found\n");
 	logmsg("	 -j: Ad<j>ust clock (profile defined) via FFTW if difference is found\n");
 	logmsg("	 -k: cloc<k> FFTW operations\n");
+	logmsg("	 -K: Use <K> as the FFTW wisdom file (default in user cache folder)\n");
+	logmsg("	 -m: Number of threads for FFTW analysis, default is one per core\n");
+	logmsg("	 -7: Number of threads for plotting PNGs, default is the same as -m\n");
+	logmsg("	 -5: Verify the MD5 signature of FLAC files\n");
+	logmsg("	 -G: Save match summary to <G>, or validate against it if it exists\n");
+	logmsg("	 -1: Compare the reference against every file in a folder or list (1 vs many)\n");
+	logmsg("	 -2: Compare every file in a folder or list against each other (matrix)\n");
+	logmsg("	 -4: Only plot results with less than <4>%% matched frequencies (0 for no plots)\n");
+	logmsg("	 -6: Run as a job server on local socket <6>, jobs are sent with mdfclient\n");
+	logmsg("	 -3: MB of memory for References kept loaded by the job server (default %d)\n", SERVER_MEMORY_MB);
 	logmsg("	 -X: Do not use E<x>tra Data from the Profile\n");
 	logmsg("   Output options:\n");
 	logmsg("	 -l: Do not <l>og output to file [reference]_vs_[compare].txt\n");
@@ -96,7 +110,7 @@ void PrintUsage()
 
 int Header(int log, int argc, char *argv[])
 {
-	char title1[] = "MDFourier " MDVERSION " [240p Test Suite Fourier Audio compare tool] " BITS_MDF "\n";
+	char title1[] = "MDFourier " MDVERSION " [240p Test Suite Fourier Audio compare tool] " BITS_MDF PRECISION_TITLE "\n";
 	char title2[] = "Artemio Urbina 2019-2020 free software under GPL - http://junkerhq.net/MDFourier\n";
 
 	if(argc == 2 && !strncmp(argv[1], "-V", 2))
@@ -120,6 +134,11 @@ void CleanParameters(parameters *config)
 
 	sprintf(config->outputFolder, OUTPUT_FOLDER);
 	config->outputPath[0] = '\0';
+	config->batchSource[0] = '\0';
+	config->matrixMode = 0;
+	config->plotMatchLimit = -1;
+	config->serverSocket[0] = '\0';
+	config->serverMemory = SERVER_MEMORY_MB;
 
 	config->startHz = START_HZ;
 	config->endHz = END_HZ;
@@ -132,6 +151,12 @@ void CleanParameters(parameters *config)
 	config->window = 't';
 	config->MaxFreq = FREQ_COUNT;
 	config->clock = 0;
+	config->threads = 0;
+	config->plotThreads = 0;
+	config->verifyFLAC = 0;
+	config->matchTolerance = 0;
+	config->syncCache = 1;
+	config->spectralCache = 1;
 	config->showAll = 0;
 	config->ignoreFloor = 0;
 	config->outputFilterFunction = 3;
@@ -173,7 +198,7 @@ void CleanParameters(parameters *config)
 	config->stereoBalanceBlock = 0;
 	config->internalSyncTolerance = 0;
 	config->zoomWaveForm = 0;
-	config->trimmingNeeded = 0;
+	memset(config->trimmingNeeded, 0, sizeof(config->trimmingNeeded));
 	config->highestValueBitDepth = 0;
 	config->lowestValueBitDepth = 0;
 	config->lowestDBFS = 0;
@@ -231,9 +256,11 @@ void CleanParameters(parameters *config)
 	config->thresholdMissingHiDif = MISS_HIDIFF;
 	config->thresholdExtraHiDif = EXTRA_HIDIFF;
 
-	config->sync_plan = NULL;
-	config->model_plan = NULL;
-	config->reverse_plan = NULL;
+	config->plans.planArray = NULL;
+	config->plans.planCount = 0;
+	config->plans.MaxPlan = 0;
+	config->wisdomFile[0] = '\0';
+	config->precisionFile[0] = '\0';
 
 	config->referenceSignal = NULL;
 	config->comparisonSignal = NULL;
@@ -273,8 +300,8 @@ int commandline(int argc , char *argv[], parameters *config)
 	
 	CleanParameters(config);
 
-	// Available: GJKmq1234567
-	while ((c = getopt (argc, argv, "Aa:Bb:Cc:Dd:Ee:Ff:gHhIijkL:lMNn:Oo:P:p:QRr:Ss:TtUuVvWw:XxY:yZ:z0:89")) != -1)
+	// Available: none
+	while ((c = getopt (argc, argv, MDF_OPTIONS)) != -1)
 	switch (c)
 	  {
 	  case 'A':
@@ -381,6 +408,10 @@ int commandline(int argc , char *argv[], parameters *config)
 		config->ignoreFloor = 1;
 		logmsg("\t -Ignoring Silence block noise floor\n");
 		break;
+	  case 'J':
+		config->matchTolerance = 1;
+		logmsg("\t - Frequencies will be matched within one FFT bin\n");
+		break;
 	  case 'j':
 		config->doClkAdjust = 1;
 		logmsg("\tAdjusting Clock\n");
@@ -388,6 +419,12 @@ int commandline(int argc , char *argv[], parameters *config)
 	  case 'k':
 		config->clock = 1;
 		break;
+	  case 'G':
+		sprintf(config->precisionFile, "%s", optarg);
+		break;
+	  case 'K':
+		sprintf(config->wisdomFile, "%s", optarg);
+		break;
 	  case 'L':
 		switch(atoi(optarg))
 		{
@@ -428,6 +465,22 @@ int commandline(int argc , char *argv[], parameters *config)
 	  case 'M':
 		config->plotMissing = 0;
 		break;
+	  case 'm':
+		config->threads = atoi(optarg);
+		if(config->threads < 1 || config->threads > 128)
+		{
+			logmsg("-ERROR: Thread count must be between %d and %d\n", 1, 128);
+			return 0;
+		}
+		break;
+	  case '7':
+		config->plotThreads = atoi(optarg);
+		if(config->plotThreads < 1 || config->plotThreads > MAX_THREADS)
+		{
+			logmsg("-ERROR: Plot thread count must be between %d and %d\n", 1, MAX_THREADS);
+			return 0;
+		}
+		break;
 	  case 'N':
 		config->logScale = 0;
 		logmsg("\tPlots will not be adjusted to log scale\n");
@@ -491,6 +544,11 @@ int commandline(int argc , char *argv[], parameters *config)
 	  case 'Q':
 		config->plotTimeDomain = 0;
 		break;
+	  case 'q':
+		config->syncCache = 0;
+		config->spectralCache = 0;
+		logmsg("\t - Not using the sync and spectral caches\n");
+		break;
 	  case 'R':
 		config->doSamplerateAdjust = 1;
 		logmsg("\t- Adjusting sample rate if inconsistency found\n");
@@ -585,6 +643,46 @@ int commandline(int argc , char *argv[], parameters *config)
 	  case '0':
 		sprintf(config->outputPath, "%s", optarg);
 		break;
+	  case '1':
+	  case '2':
+		if(config->batchSource[0])
+		{
+			logmsg("-ERROR: Only one of -1 and -2 can be used\n");
+			return 0;
+		}
+		sprintf(config->batchSource, "%s", optarg);
+		// basename() needs the folder name without the separator
+		while(strlen(config->batchSource) > 1 && config->batchSource[strlen(config->batchSource)-1] == FOLDERCHAR)
+			config->batchSource[strlen(config->batchSource)-1] = '\0';
+		config->matrixMode = c == '2';
+		break;
+	  case '4':
+		config->plotMatchLimit = atof(optarg);
+		if(config->plotMatchLimit < 0 || config->plotMatchLimit > 100)
+		{
+			logmsg("-ERROR: Plot match limit must be between 0 and 100%%\n");
+			return 0;
+		}
+		break;
+	  case '5':
+		config->verifyFLAC = 1;
+		break;
+	  case '6':
+		if(!optarg || !strlen(optarg))
+		{
+			logmsg("-ERROR: Job server -6 requires a socket file argument\n");
+			return 0;
+		}
+		sprintf(config->serverSocket, "%s", optarg);
+		break;
+	  case '3':
+		config->serverMemory = atoi(optarg);
+		if(config->serverMemory < 1)
+		{
+			logmsg("-ERROR: Job server memory must be at least 1 MB\n");
+			return 0;
+		}
+		break;
 	  case '8':
 		config->logScaleTS = 1;
 		logmsg("\t - Using linear scale for Time Spectrogram plots\n");
@@ -603,8 +701,16 @@ int commandline(int argc , char *argv[], parameters *config)
 		  logmsg("\t ERROR: Max frequency range for FFTW -%c requires an argument: %d-%d\n", START_HZ*2, END_HZ, optopt);
 		else if (optopt == 'f')
 		  logmsg("\t ERROR: Max # of frequencies to use from FFTW -%c requires an argument: 1-%d\n", optopt, MAX_FREQ_COUNT);
+		else if (optopt == 'G')
+		  logmsg("\t ERROR: Precision validation -%c requires a file argument\n", optopt);
+		else if (optopt == 'K')
+		  logmsg("\t ERROR: FFTW wisdom -%c requires a file argument\n", optopt);
 		else if (optopt == 'L')
 		  logmsg("\t ERROR: Plot Resolution -%c requires an argument: 1-6\n", optopt);
+		else if (optopt == 'm')
+		  logmsg("\t ERROR: Thread count -%c requires an argument: 1-128\n", optopt);
+		else if (optopt == '7')
+		  logmsg("\t ERROR: Plot thread count -%c requires an argument: 1-%d\n", optopt, MAX_THREADS);
 		else if (optopt == 'n')
 		  logmsg("\t ERROR: Normalization type -%c requires an argument:\n\tUse 't' Time Domain Max, 'f' Frequency Domain Max or 'a' Average\n");
 		else if (optopt == 'o')
@@ -625,6 +731,14 @@ int commandline(int argc , char *argv[], parameters *config)
 		  logmsg("\t ERROR: Comparison format: needs a number with a selection from the profile\n");
 		else if (optopt == '0')
 		  logmsg("\t ERROR: Output folder argument -%c requires a valid path.\n", optopt);
+		else if (optopt == '1' || optopt == '2')
+		  logmsg("\t ERROR: Batch mode -%c requires a folder or a list file.\n", optopt);
+		else if (optopt == '4')
+		  logmsg("\t ERROR: Plot match limit -%c requires a percentage: 0-100\n", optopt);
+		else if (optopt == '6')
+		  logmsg("\t ERROR: Job server -%c requires a socket file argument\n", optopt);
+		else if (optopt == '3')
+		  logmsg("\t ERROR: Job server memory -%c requires a size in MB\n", optopt);
 		else if (isprint (optopt))
 		  logmsg("\t ERROR: Unknown option `-%c'.\n", optopt);
 		else
@@ -643,7 +757,46 @@ int commandline(int argc , char *argv[], parameters *config)
 		return 0;
 	}
 
-	if(!ref || !tar)
+	if(config->serverSocket[0])
+	{
+		if(ref || tar || config->batchSource[0])
+		{
+			logmsg("  usage: mdfourier -6 socket [-3 MB]\n");
+			logmsg("  ERROR: Jobs are sent to the server with mdfclient, don't use -r, -c, -1 or -2\n");
+			return 0;
+		}
+		return 1;
+	}
+
+	if(config->matrixMode)
+	{
+		if(ref || tar)
+		{
+			logmsg("  usage: mdfourier -P profile.mdf -2 folder|list.txt\n");
+			logmsg("  ERROR: Matrix mode compares the files in the folder or list, don't use -r or -c\n");
+			return 0;
+		}
+		if(config->precisionFile[0])
+		{
+			logmsg("  ERROR: -G can't be used in batch mode, each comparison gets its own summary\n");
+			return 0;
+		}
+	}
+	else if(config->batchSource[0])
+	{
+		if(!ref || tar)
+		{
+			logmsg("  usage: mdfourier -P profile.mdf -r reference.wav -1 folder|list.txt\n");
+			logmsg("  ERROR: Batch mode needs a reference file and no compare file\n");
+			return 0;
+		}
+		if(config->precisionFile[0])
+		{
+			logmsg("  ERROR: -G can't be used in batch mode, each comparison gets its own summary\n");
+			return 0;
+		}
+	}
+	else if(!ref || !tar)
 	{
 		logmsg("  usage: mdfourier -P profile.mdf -r reference.wav -c compare.wav\n");
 		logmsg("  ERROR: Please define both reference and compare audio files\n");
@@ -677,21 +830,27 @@ int commandline(int argc , char *argv[], parameters *config)
 	}
 	fclose(file);
 
-	file = fopen(config->referenceFile, "rb");
-	if(!file)
+	if(!config->matrixMode)
 	{
-		logmsg("- ERROR: Could not open REFERENCE file: \"%s\"\n", config->referenceFile);
-		return 0;
+		file = fopen(config->referenceFile, "rb");
+		if(!file)
+		{
+			logmsg("- ERROR: Could not open REFERENCE file: \"%s\"\n", config->referenceFile);
+			return 0;
+		}
+		fclose(file);
 	}
-	fclose(file);
 
-	file = fopen(config->comparisonFile, "rb");
-	if(!file)
+	if(!config->batchSource[0])
 	{
-		logmsg("- ERROR: Could not open COMPARE file: \"%s\"\n", config->comparisonFile);
-		return 0;
+		file = fopen(config->comparisonFile, "rb");
+		if(!file)
+		{
+			logmsg("- ERROR: Could not open COMPARE file: \"%s\"\n", config->comparisonFile);
+			return 0;
+		}
+		fclose(file);
 	}
-	fclose(file);
 
 	if(config->verbose)
 	{
@@ -859,8 +1018,9 @@ void ShortenFileName(char *filename, char *copy)
 
 	sprintf(copy, "%s", filename);
 	len = strlen(copy);
-	ext = getExtensionLength(copy)+1;
-	copy[len-ext] = '\0';
+	ext = getExtensionLength(copy);
+	if(ext)
+		copy[len-ext-1] = '\0';
 	len = strlen(copy);
 
 #if defined (WIN32)
@@ -970,7 +1130,13 @@ int CreateFolderName(char *mainfolder, parameters *config)
 	srand(time(NULL));
 #endif
 
-	ShortenFileName(basename(config->referenceFile), tmp);
+	if(config->matrixMode)
+	{
+		ShortenFileName(basename(config->batchSource), fn);
+		snprintf(tmp, sizeof(tmp), "Matrix_%.*s", (int)sizeof(tmp) - 8, fn);
+	}
+	else
+		ShortenFileName(basename(config->referenceFile), tmp);
 	len = strlen(tmp);
 	if(strlen(config->comparisonFile))
 	{
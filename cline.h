@@ -31,6 +31,9 @@
 
 #include "mdfourier.h"
 
+// getopt options for mdfourier, batch mode filters arguments with it
+#define MDF_OPTIONS	"Aa:Bb:Cc:Dd:Ee:Ff:gG:HhIiJjkK:L:lMm:Nn:Oo:P:p:QqRr:Ss:TtUuVvWw:XxY:yZ:z0:1:2:3:4:56:7:89"
+
 #if defined (WIN32)
 	#include <direct.h>
 	#define GetCurrentDir _getcwd
@@ -991,3 +991,156 @@ int FindPerfectMatches(int type, long int *inside, long int *count, parameters *
 
 	return 1;
 }
+
+/*
+	Precision validation: the first run with -G saves the match totals,
+	later runs (typically a SINGLE_PRECISION build against a double one)
+	report how far their matches drift from the saved ones.
+*/
+
+#define PRECISION_SUMMARY_ID	"MDFourier precision summary 1"
+
+double MatchPercent(long int compared, long int different)
+{
+	if(!compared)
+		return 0;
+	return 100.0 - (double)different*100.0/(double)compared;
+}
+
+int SavePrecisionSummary(parameters *config)
+{
+	FILE	*file = NULL;
+
+	file = fopen(config->precisionFile, "w");
+	if(!file)
+	{
+		logmsg("ERROR: Could not create precision summary %s\n", config->precisionFile);
+		return 0;
+	}
+
+	fprintf(file, "%s\n", PRECISION_SUMMARY_ID);
+	fprintf(file, "precision %s\n", PRECISION_MDF);
+	fprintf(file, "blocks %d\n", config->types.totalBlocks);
+	fprintf(file, "totals %ld %ld %ld %ld %ld %.17g\n",
+		config->Differences.cntTotalCompared, config->Differences.cntTotalAudioDiff,
+		config->Differences.cntPerfectAmplMatch, config->Differences.cntFreqAudioDiff,
+		config->Differences.cntAmplAudioDiff, FindDifferenceAverage(config));
+	for(int b = 0; b < config->types.totalBlocks; b++)
+	{
+		BlockDifference *blk = &config->Differences.BlockDiffArray[b];
+
+		fprintf(file, "block %d %ld %ld %ld %ld %ld\n", b,
+			blk->cmpFreqBlkDiff, blk->cntFreqBlkDiff,
+			blk->cmpAmplBlkDiff, blk->cntAmplBlkDiff, blk->perfectAmplMatch);
+	}
+	fclose(file);
+
+	logmsg(" - Match summary (%s precision) saved to %s\n", PRECISION_MDF, config->precisionFile);
+	return 1;
+}
+
+// Reads the header and totals, returns 0 if it is not a summary and -1 if it is damaged
+int ReadPrecisionTotals(FILE *file, char *precision, int *blocks, AudioDifference *totals, double *average)
+{
+	char	line[BUFFER_SIZE];
+
+	memset(totals, 0, sizeof(AudioDifference));
+	if(!fgets(line, BUFFER_SIZE, file) || strncmp(line, PRECISION_SUMMARY_ID, strlen(PRECISION_SUMMARY_ID)) != 0)
+		return 0;
+	if(fscanf(file, "precision %63s\n", precision) != 1 || fscanf(file, "blocks %d\n", blocks) != 1)
+		return -1;
+	if(fscanf(file, "totals %ld %ld %ld %ld %ld %lg\n",
+		&totals->cntTotalCompared, &totals->cntTotalAudioDiff, &totals->cntPerfectAmplMatch,
+		&totals->cntFreqAudioDiff, &totals->cntAmplAudioDiff, average) != 6)
+		return -1;
+	return 1;
+}
+
+int ComparePrecisionSummary(FILE *file, parameters *config)
+{
+	char			precision[64];
+	int				blocks = 0, changed = 0, read = 0;
+	double			average = 0, current = 0;
+	AudioDifference	saved;
+
+	read = ReadPrecisionTotals(file, precision, &blocks, &saved, &average);
+	if(read == 0)
+	{
+		logmsg("ERROR: %s is not a precision summary\n", config->precisionFile);
+		return 0;
+	}
+	if(read == -1)
+	{
+		logmsg("ERROR: Invalid precision summary %s\n", config->precisionFile);
+		return 0;
+	}
+	if(blocks != config->types.totalBlocks)
+	{
+		logmsg("ERROR: Precision summary %s was created with a different profile\n", config->precisionFile);
+		return 0;
+	}
+
+	current = FindDifferenceAverage(config);
+	logmsg("\n* Precision validation: %s (this run) vs %s (%s)\n", PRECISION_MDF, precision, config->precisionFile);
+	logmsg(" - Matched frequencies: %0.4f%% vs %0.4f%% (%+0.4f%%)\n",
+		MatchPercent(config->Differences.cntTotalCompared, config->Differences.cntTotalAudioDiff),
+		MatchPercent(saved.cntTotalCompared, saved.cntTotalAudioDiff),
+		MatchPercent(config->Differences.cntTotalCompared, config->Differences.cntTotalAudioDiff) -
+		MatchPercent(saved.cntTotalCompared, saved.cntTotalAudioDiff));
+	logmsg(" - Perfect amplitude matches: %ld vs %ld\n",
+		config->Differences.cntPerfectAmplMatch, saved.cntPerfectAmplMatch);
+	logmsg(" - Frequencies not found: %ld vs %ld\n",
+		config->Differences.cntFreqAudioDiff, saved.cntFreqAudioDiff);
+	logmsg(" - Amplitudes not matched: %ld vs %ld\n",
+		config->Differences.cntAmplAudioDiff, saved.cntAmplAudioDiff);
+	logmsg(" - Average amplitude difference: %g dBFS vs %g dBFS\n", current, average);
+
+	for(int b = 0; b < blocks; b++)
+	{
+		int				index = 0;
+		BlockDifference	blk, *cur = NULL;
+
+		memset(&blk, 0, sizeof(BlockDifference));
+		if(fscanf(file, "block %d %ld %ld %ld %ld %ld\n", &index,
+			&blk.cmpFreqBlkDiff, &blk.cntFreqBlkDiff, &blk.cmpAmplBlkDiff,
+			&blk.cntAmplBlkDiff, &blk.perfectAmplMatch) != 6 || index != b)
+		{
+			logmsg("ERROR: Invalid block %d in precision summary\n", b);
+			return 0;
+		}
+
+		cur = &config->Differences.BlockDiffArray[b];
+		if(cur->cntFreqBlkDiff == blk.cntFreqBlkDiff && cur->cntAmplBlkDiff == blk.cntAmplBlkDiff &&
+			cur->perfectAmplMatch == blk.perfectAmplMatch)
+			continue;
+
+		changed++;
+		logmsgFileOnly("Block: %s# %d (%d) Not Found: %ld vs %ld Differences: %ld vs %ld Perfect: %ld vs %ld\n",
+				GetBlockName(config, b), GetBlockSubIndex(config, b), b,
+				cur->cntFreqBlkDiff, blk.cntFreqBlkDiff,
+				cur->cntAmplBlkDiff, blk.cntAmplBlkDiff,
+				cur->perfectAmplMatch, blk.perfectAmplMatch);
+	}
+	logmsg(" - Blocks with different results: %d of %d\n", changed, blocks);
+	return 1;
+}
+
+int ValidatePrecision(parameters *config)
+{
+	FILE	*file = NULL;
+	int		ret = 0;
+
+	if(!config || !config->precisionFile[0])
+		return 1;
+
+	if(!config->Differences.BlockDiffArray)
+		return 0;
+
+	file = fopen(config->precisionFile, "r");
+	if(!file)
+		return(SavePrecisionSummary(config));
+
+	ret = ComparePrecisionSummary(file, config);
+	fclose(file);
+	return ret;
+}
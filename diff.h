@@ -55,5 +55,8 @@ int FindDifferenceTypeTotals(int type, long int *cntAmplBlkDiff, long int *cmpAm
 int FindMissingTypeTotals(int type, long int *cntFreqBlkDiff, long int *cmpFreqBlkDiff, parameters *config);
 int FindDifferenceWithinInterval(int type, long int *inside, long int *count, double MaxInterval, parameters *config);
 int FindPerfectMatches(int type, long int *inside, long int *count, parameters *config);
+int ValidatePrecision(parameters *config);
+int ReadPrecisionTotals(FILE *file, char *precision, int *blocks, AudioDifference *totals, double *average);
+double MatchPercent(long int compared, long int different);
 
 #endif
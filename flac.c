@@ -43,21 +43,25 @@
 #include "flac.h"
 #include "log.h"
 #include "freq.h"
+#include "samples.h"
+#include "threads.h"
 #include "FLAC/stream_decoder.h"
 
 #include <ctype.h>
 
-int flacInternalMDFErrors = 0;
-
 extern char *getFilenameExtension(char *filename);
 extern int getExtensionLength(char *filename);
 static FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data);
 static void error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__StreamDecoderWriteStatus slice_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+static FLAC__StreamDecoderWriteStatus md5_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+static void slice_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static void md5_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
 
-int flacErrorReported()
+int flacErrorReported(AudioSignal *Signal)
 {
-	return(flacInternalMDFErrors);
+	return(Signal->errorFLACReported);
 }
 
 char *strtoupper(char *str)
@@ -117,42 +121,87 @@ int FillRIFFHeader(wav_hdr *header)
 	return 1;
 }
 
-int FLACtoSignal(char *input, AudioSignal *Signal, parameters *config)
+/*
+	Files are decoded by several decoder instances, each one seeks to
+	the start of its own sample range and writes a disjoint slice of
+	the sample store. STREAMINFO is read first so the store can be
+	allocated before any of them start. Short files, a single thread
+	or a failed seek use the original single stream decoder.
+
+	Decoding is split in three steps so it can run in the background
+	while sync detection reads the samples as they are published:
+	FLACPrepare reads STREAMINFO and allocates, FLACDecode fills the
+	store and FLACFinish validates the result once it is done.
+*/
+
+// Returns the number of slices to decode, 0 on error
+int FLACPrepare(char *input, AudioSignal *Signal, parameters *config)
 {
-	FLAC__bool ok = true;
-	FLAC__StreamDecoder *decoder = 0;
-	FLAC__StreamDecoderInitStatus init_status;
+	int		slices = 0;
 
 	if(!Signal) {
 		logmsg("ERROR: opening empty Data Structure\n");
 		return 0;
 	}
 
-	if((decoder = FLAC__stream_decoder_new()) == NULL) {
-		logmsg("ERROR: allocating decoder\n");
+	if(!FLACReadStreamInfo(input, Signal))
 		return 0;
-	}
 
-	(void)FLAC__stream_decoder_set_md5_checking(decoder, true);
+	if(!CheckFLACFormat(Signal))
+		return 0;
 
-	init_status = FLAC__stream_decoder_init_file(decoder, input, write_callback, metadata_callback, error_callback, /*client_data=*/Signal);
-	if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
-		logmsg("ERROR: Initializing FLAC decoder: %s\n", FLAC__StreamDecoderInitStatusString[init_status]);
-		ok = false;
-	}
+	slices = GetThreadCount((Signal->numSamples/Signal->header.fmt.NumOfChan + FLAC_MIN_SLICE - 1)/FLAC_MIN_SLICE, config);
+	if(slices < 1)
+		slices = 1;
+	return slices;
+}
 
-	if(ok) {
-		ok = FLAC__stream_decoder_process_until_end_of_stream(decoder);
-		if(!ok)
+int FLACDecode(char *input, AudioSignal *Signal, int slices, parameters *config)
+{
+	int			ok = 0;
+	flacMD5		md5;
+
+	memset(&md5, 0, sizeof(flacMD5));
+	if(slices > 1)
+	{
+		if(config->verifyFLAC)
 		{
-			if(!flacInternalMDFErrors)
-				logmsg("ERROR: (FLAC) %s\n", FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(decoder)]);
-			Signal->errorFLAC++;
+			md5.fileName = input;
+			md5.Signal = Signal;
+			if(pthread_create(&md5.thread, NULL, VerifyFLACMD5, &md5) == 0)
+				md5.started = 1;
+			else
+				logmsg(" - WARNING: Could not start FLAC MD5 verification\n");
+		}
+
+		ok = FLACDecodeSlices(input, Signal, slices, config);
+		if(ok == FLAC_SEEK_FAILED && !SampleStreamCancelled(&Signal->Samples))
+		{
+			if(config->verbose) { logmsg(" - FLAC seek failed, decoding as a single stream\n"); }
+			Signal->samplesPosFLAC = 0;
+			Signal->errorFLAC = 0;
+			ok = FLACDecodeStream(input, Signal, 0);
+		}
+
+		if(md5.started)
+		{
+			pthread_join(md5.thread, NULL);
+			if(!md5.result && !SampleStreamCancelled(&Signal->Samples))
+			{
+				logmsg("ERROR: (FLAC) MD5 signature verification failed\n");
+				Signal->errorFLACReported = 1;
+				Signal->errorFLAC++;
+			}
 		}
 	}
+	else
+		ok = FLACDecodeStream(input, Signal, config->verifyFLAC);
 
-	FLAC__stream_decoder_delete(decoder);
+	return ok == 1 ? 1 : 0;
+}
 
+int FLACFinish(AudioSignal *Signal, int ok)
+{
 	if(Signal->header.data.DataSize != Signal->samplesPosFLAC*Signal->bytesPerSample)
 	{
 		if(Signal->samplesPosFLAC > Signal->header.data.DataSize)  // Buffer overflow!!!
@@ -162,7 +211,7 @@ int FLACtoSignal(char *input, AudioSignal *Signal, parameters *config)
 			return 0;
 		}
 		//if(config->verbose)
-		if(!flacInternalMDFErrors)
+		if(!Signal->errorFLACReported)
 			logmsg(" - WARNING: FLAC decoder got %ld bytes and expected %ld bytes (fixed internally)\n",
 				Signal->samplesPosFLAC*Signal->bytesPerSample, Signal->header.data.DataSize);
 		Signal->header.data.DataSize = Signal->samplesPosFLAC;
@@ -176,6 +225,234 @@ int FLACtoSignal(char *input, AudioSignal *Signal, parameters *config)
 	return ok ? 1 : 0;
 }
 
+int FLACReadStreamInfo(char *input, AudioSignal *Signal)
+{
+	FLAC__bool ok = true;
+	FLAC__StreamDecoder *decoder = 0;
+	FLAC__StreamDecoderInitStatus init_status;
+
+	if((decoder = FLAC__stream_decoder_new()) == NULL) {
+		logmsg("ERROR: allocating decoder\n");
+		return 0;
+	}
+
+	init_status = FLAC__stream_decoder_init_file(decoder, input, write_callback, metadata_callback, error_callback, /*client_data=*/Signal);
+	if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		logmsg("ERROR: Initializing FLAC decoder: %s\n", FLAC__StreamDecoderInitStatusString[init_status]);
+		ok = false;
+	}
+
+	if(ok) {
+		ok = FLAC__stream_decoder_process_until_end_of_metadata(decoder);
+		if(!ok)
+			logmsg("ERROR: (FLAC) %s\n", FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(decoder)]);
+	}
+
+	FLAC__stream_decoder_delete(decoder);
+	return ok ? 1 : 0;
+}
+
+// The original decoder, a single stream from start to end. STREAMINFO
+// was already read, the header is not touched while sync reads it
+int FLACDecodeStream(char *input, AudioSignal *Signal, int md5)
+{
+	FLAC__bool ok = true;
+	FLAC__StreamDecoder *decoder = 0;
+	FLAC__StreamDecoderInitStatus init_status;
+
+	if((decoder = FLAC__stream_decoder_new()) == NULL) {
+		logmsg("ERROR: allocating decoder\n");
+		return 0;
+	}
+
+	(void)FLAC__stream_decoder_set_md5_checking(decoder, md5 ? true : false);
+
+	// a single range for the whole file, the slices are not used
+	SetStreamRange(&Signal->Samples, 0, 0, Signal->numSamples);
+	for(int i = 1; Signal->Samples.stream && i < Signal->Samples.stream->count; i++)
+		SetStreamRange(&Signal->Samples, i, 0, 0);
+
+	init_status = FLAC__stream_decoder_init_file(decoder, input, write_callback, NULL, error_callback, /*client_data=*/Signal);
+	if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		logmsg("ERROR: Initializing FLAC decoder: %s\n", FLAC__StreamDecoderInitStatusString[init_status]);
+		ok = false;
+	}
+
+	if(ok) {
+		ok = FLAC__stream_decoder_process_until_end_of_stream(decoder);
+		if(!ok)
+		{
+			if(!Signal->errorFLACReported)
+				logmsg("ERROR: (FLAC) %s\n", FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(decoder)]);
+			Signal->errorFLAC++;
+		}
+	}
+
+	// finish reports an MD5 mismatch
+	if(ok && md5 && !FLAC__stream_decoder_finish(decoder))
+	{
+		logmsg("ERROR: (FLAC) MD5 signature verification failed\n");
+		Signal->errorFLACReported = 1;
+		Signal->errorFLAC++;
+	}
+
+	FLAC__stream_decoder_delete(decoder);
+	return ok ? 1 : 0;
+}
+
+int FLACDecodeSlices(char *input, AudioSignal *Signal, int slices, parameters *config)
+{
+	flacJobs		fj;
+	FLAC__uint64	total = 0, length = 0;
+	int				ok = 1;
+
+	if(!CheckFLACFormat(Signal))
+		return 0;
+
+	memset(&fj, 0, sizeof(flacJobs));
+	fj.fileName = input;
+	fj.Signal = Signal;
+	fj.count = slices;
+	fj.slices = (flacSlice*)malloc(sizeof(flacSlice)*slices);
+	if(!fj.slices)
+	{
+		logmsg("\tERROR: FLAC slices malloc failed!\n");
+		return 0;
+	}
+	memset(fj.slices, 0, sizeof(flacSlice)*slices);
+
+	total = Signal->numSamples/Signal->header.fmt.NumOfChan;
+	length = (total + slices - 1)/slices;
+	for(int i = 0; i < slices; i++)
+	{
+		fj.slices[i].Signal = Signal;
+		fj.slices[i].index = i;
+		fj.slices[i].start = i*length;
+		fj.slices[i].end = fj.slices[i].start + length;
+		if(fj.slices[i].end > total)
+			fj.slices[i].end = total;
+		fj.slices[i].next = fj.slices[i].start;
+		SetStreamRange(&Signal->Samples, i, fj.slices[i].start*Signal->header.fmt.NumOfChan, fj.slices[i].end*Signal->header.fmt.NumOfChan);
+	}
+
+	if(!RunParallelJobs(slices, slices, DecodeFLACSlice, &fj))
+		ok = 0;
+
+	Signal->samplesPosFLAC = 0;
+	for(int i = 0; i < slices; i++)
+	{
+		if(fj.slices[i].seekFailed)
+			ok = FLAC_SEEK_FAILED;
+		Signal->errorFLAC += fj.slices[i].errors;
+		Signal->samplesPosFLAC += fj.slices[i].written*Signal->header.fmt.NumOfChan;
+	}
+	if(!ok && !Signal->errorFLACReported && !SampleStreamCancelled(&Signal->Samples))
+	{
+		logmsg("ERROR: (FLAC) Parallel decoding failed\n");
+		Signal->errorFLAC++;
+	}
+
+	free(fj.slices);
+	return ok;
+}
+
+int DecodeFLACSlice(long int job, int thread, void *data)
+{
+	flacJobs			*fj = (flacJobs*)data;
+	flacSlice			*slice = &fj->slices[job];
+	FLAC__StreamDecoder *decoder = 0;
+	FLAC__StreamDecoderInitStatus init_status;
+
+	if(slice->start >= slice->end)
+		return 1;
+
+	if((decoder = FLAC__stream_decoder_new()) == NULL) {
+		logmsg("ERROR: allocating decoder\n");
+		return 0;
+	}
+
+	(void)FLAC__stream_decoder_set_md5_checking(decoder, false);
+	init_status = FLAC__stream_decoder_init_file(decoder, fj->fileName, slice_write_callback, NULL, slice_error_callback, /*client_data=*/slice);
+	if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		logmsg("ERROR: Initializing FLAC decoder: %s\n", FLAC__StreamDecoderInitStatusString[init_status]);
+		FLAC__stream_decoder_delete(decoder);
+		return 0;
+	}
+
+	// the seek delivers the frame holding start through the write callback
+	if(!FLAC__stream_decoder_seek_absolute(decoder, slice->start))
+	{
+		if(!slice->aborted)
+			slice->seekFailed = 1;
+		FLAC__stream_decoder_delete(decoder);
+		return 0;
+	}
+
+	while(slice->next < slice->end && !slice->aborted)
+	{
+		if(!FLAC__stream_decoder_process_single(decoder))
+			break;
+		if(FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+			break;
+	}
+
+	FLAC__stream_decoder_delete(decoder);
+	return slice->aborted ? 0 : 1;
+}
+
+void *VerifyFLACMD5(void *data)
+{
+	flacMD5				*md5 = (flacMD5*)data;
+	FLAC__StreamDecoder *decoder = 0;
+	FLAC__bool			ok = true;
+
+	md5->result = 0;
+	if((decoder = FLAC__stream_decoder_new()) == NULL)
+		return NULL;
+
+	(void)FLAC__stream_decoder_set_md5_checking(decoder, true);
+	if(FLAC__stream_decoder_init_file(decoder, md5->fileName, md5_write_callback, NULL, md5_error_callback, /*client_data=*/md5) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		ok = false;
+	if(ok)
+		ok = FLAC__stream_decoder_process_until_end_of_stream(decoder);
+	if(ok)
+		ok = FLAC__stream_decoder_finish(decoder);
+
+	FLAC__stream_decoder_delete(decoder);
+	md5->result = ok ? 1 : 0;
+	return NULL;
+}
+
+// STREAMINFO checks, done before the first frame is stored
+int CheckFLACFormat(AudioSignal *Signal)
+{
+	if(Signal->header.data.DataSize == 0) {
+		logmsg("ERROR: MDFourier only works for FLAC files that have total_samples count in STREAMINFO\n");
+		Signal->errorFLACReported = 1;
+		return 0;
+	}
+	if(Signal->header.fmt.bitsPerSample != 16 && Signal->header.fmt.bitsPerSample != 24) {
+		logmsg("ERROR: Only 16/24 bit flac supported.\n\tPlease convert file to 16/24 bit flac.\n");
+		Signal->errorFLACReported = 1;
+		return 0;
+	}
+	if(Signal->header.fmt.NumOfChan != 2 && Signal->header.fmt.NumOfChan != 1) {
+		logmsg("ERROR: Only Mono and Stereo files are supported.\n");
+		Signal->errorFLACReported = 1;
+		return 0;
+	}
+	if(Signal->Samples.data)
+		return 1;
+	if(!AllocateSamples(&Signal->Samples, SampleFormatForBits(Signal->header.fmt.bitsPerSample, 0),
+			Signal->numSamples, Signal->header.fmt.NumOfChan))
+	{
+		logmsg("\tERROR: FLAC data chunks malloc failed!\n");
+		Signal->errorFLACReported = 1;
+		return 0;
+	}
+	return 1;
+}
+
 FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	AudioSignal *Signal = (AudioSignal*)client_data;
@@ -186,63 +463,68 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 
 	if(!Signal) {
 		logmsg("ERROR: Got empty Signal structure for FLAC decoding\n");
-		flacInternalMDFErrors = 1;
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 	}
 
 	if(Signal->header.fmt.NumOfChan != frame->header.channels) {
 		logmsg("ERROR: FLAC Channel definition discrepancy %d vs %d\n", Signal->header.fmt.NumOfChan, frame->header.channels);
-		flacInternalMDFErrors = 1;
+		Signal->errorFLACReported = 1;
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 	}
 	if(buffer[0] == NULL) {
 		logmsg("ERROR: FLAC buffer[0] is NULL\n");
-		flacInternalMDFErrors = 1;
+		Signal->errorFLACReported = 1;
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 	}
 	if(Signal->header.fmt.NumOfChan == 2 && buffer[1] == NULL) {
 		logmsg("ERROR: FLAC buffer[1] is NULL\n");
-		flacInternalMDFErrors = 1;
+		Signal->errorFLACReported = 1;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	if(SampleStreamCancelled(&Signal->Samples)) {
+		Signal->errorFLACReported = 1;
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 	}
 
 	/* write header data before we write the first frame */
 	if(frame->header.number.sample_number == 0) 
 	{
-		if(Signal->header.data.DataSize == 0) {
-			logmsg("ERROR: MDFourier only works for FLAC files that have total_samples count in STREAMINFO\n");
-			flacInternalMDFErrors = 1;
-			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		}
-		if(Signal->header.fmt.bitsPerSample != 16 && Signal->header.fmt.bitsPerSample != 24) {
-			logmsg("ERROR: Only 16/24 bit flac supported.\n\tPlease convert file to 16/24 bit flac.\n");
-			flacInternalMDFErrors = 1;
+		if(!CheckFLACFormat(Signal))
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		}
-		if(Signal->header.fmt.NumOfChan != 2 && Signal->header.fmt.NumOfChan != 1) {
-			logmsg("ERROR: Only Mono and Stereo files are supported.\n");
-			flacInternalMDFErrors = 1;
-			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		}
-		Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
-		if(!Signal->Samples)
-		{
-			logmsg("\tERROR: FLAC data chunks malloc failed!\n");
-			flacInternalMDFErrors = 1;
-			return(FLAC__STREAM_DECODER_WRITE_STATUS_ABORT);
-		}
-		memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
 	}
 
-	/* save decoded PCM samples */
+	/* save decoded PCM samples in their native width */
 	pos = Signal->samplesPosFLAC;
-	for(i = 0; i < frame->header.blocksize; i++)
+	if(pos + (long int)frame->header.blocksize*Signal->header.fmt.NumOfChan > Signal->Samples.count) {
+		logmsg("ERROR: FLAC decodes more samples than STREAMINFO declares (%ld)\n", Signal->Samples.count);
+		Signal->errorFLACReported = 1;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+	if(Signal->Samples.format == SAMPLE_INT16)
 	{
-		Signal->Samples[pos++] = (double)(FLAC__int32)buffer[0][i];
-		if(Signal->header.fmt.NumOfChan == 2)
-			Signal->Samples[pos++] = (double)(FLAC__int32)buffer[1][i];
+		int16_t	*samples = (int16_t*)Signal->Samples.data;
+
+		for(i = 0; i < frame->header.blocksize; i++)
+		{
+			samples[pos++] = (int16_t)buffer[0][i];
+			if(Signal->header.fmt.NumOfChan == 2)
+				samples[pos++] = (int16_t)buffer[1][i];
+		}
+	}
+	else
+	{
+		int32_t	*samples = (int32_t*)Signal->Samples.data;
+
+		for(i = 0; i < frame->header.blocksize; i++)
+		{
+			samples[pos++] = (int32_t)buffer[0][i];
+			if(Signal->header.fmt.NumOfChan == 2)
+				samples[pos++] = (int32_t)buffer[1][i];
+		}
 	}
 	Signal->samplesPosFLAC = pos;
+	PublishSamples(&Signal->Samples, 0, pos);
 
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -289,3 +571,99 @@ void error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderError
 	if(Signal)
 		Signal->errorFLAC ++;
 }
+
+/* Writes the part of each frame that falls inside the slice */
+FLAC__StreamDecoderWriteStatus slice_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	flacSlice		*slice = (flacSlice*)client_data;
+	AudioSignal		*Signal = slice->Signal;
+	FLAC__uint64	first = 0, from = 0, to = 0;
+	long int		pos = 0;
+	int				channels = 0;
+
+	(void)decoder;
+
+	if(SampleStreamCancelled(&Signal->Samples)) {
+		slice->aborted = 1;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	channels = Signal->header.fmt.NumOfChan;
+	if(channels != (int)frame->header.channels || buffer[0] == NULL || (channels == 2 && buffer[1] == NULL)) {
+		logmsg("ERROR: FLAC frame does not match STREAMINFO\n");
+		slice->aborted = 1;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	first = frame->header.number.sample_number;
+	slice->next = first + frame->header.blocksize;
+
+	// Frames can land outside the slice, after a corrupt one is dropped
+	if(first >= slice->end || slice->next <= slice->start)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+
+	from = first < slice->start ? slice->start : first;
+	to = slice->next > slice->end ? slice->end : slice->next;
+
+	pos = (long int)from*channels;
+	if(Signal->Samples.format == SAMPLE_INT16)
+	{
+		int16_t	*samples = (int16_t*)Signal->Samples.data;
+
+		for(FLAC__uint64 i = from - first; i < to - first; i++)
+		{
+			samples[pos++] = (int16_t)buffer[0][i];
+			if(channels == 2)
+				samples[pos++] = (int16_t)buffer[1][i];
+		}
+	}
+	else
+	{
+		int32_t	*samples = (int32_t*)Signal->Samples.data;
+
+		for(FLAC__uint64 i = from - first; i < to - first; i++)
+		{
+			samples[pos++] = (int32_t)buffer[0][i];
+			if(channels == 2)
+				samples[pos++] = (int32_t)buffer[1][i];
+		}
+	}
+
+	slice->written += to - from;
+	PublishSamples(&Signal->Samples, slice->index, (long int)to*channels);
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+/* The MD5 thread only needs libFLAC to see the samples */
+FLAC__StreamDecoderWriteStatus md5_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	flacMD5 *md5 = (flacMD5*)client_data;
+
+	(void)decoder;
+	(void)frame;
+	(void)buffer;
+
+	if(SampleStreamCancelled(&md5->Signal->Samples))
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void md5_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	(void)decoder;
+	(void)client_data;
+
+	logmsgFileOnly("Got error while verifying FLAC MD5: %s\n", FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+void slice_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	flacSlice *slice = (flacSlice*)client_data;
+
+	(void)decoder;
+
+	logmsgFileOnly("Got error while decoding FLAC: %s\n", FLAC__StreamDecoderErrorStatusString[status]);
+	if(slice)
+		slice->errors ++;
+}
@@ -30,10 +30,49 @@
 #define MDFOURIER_FLAC_H
 
 #include "mdfourier.h"
+#include <pthread.h>
 
-int flacErrorReported();
+#define FLAC_MIN_SLICE		1048576
+#define FLAC_SEEK_FAILED	-1
+
+typedef struct flac_slice_st {
+	AudioSignal		*Signal;
+	uint64_t		start;
+	uint64_t		end;
+	uint64_t		next;
+	uint64_t		written;
+	int				index;
+	int				errors;
+	int				seekFailed;
+	int				aborted;
+} flacSlice;
+
+typedef struct flac_jobs_st {
+	char		*fileName;
+	AudioSignal	*Signal;
+	flacSlice	*slices;
+	int			count;
+} flacJobs;
+
+typedef struct flac_md5_st {
+	char		*fileName;
+	AudioSignal	*Signal;
+	pthread_t	thread;
+	int			started;
+	int			result;
+} flacMD5;
+
+int flacErrorReported(AudioSignal *Signal);
 int IsFlac(char *name);
 void renameFLAC(char *flac, char *wav, char *path);
-int FLACtoSignal(char *input, AudioSignal *Signal, parameters *config);
+int FLACPrepare(char *input, AudioSignal *Signal, parameters *config);
+int FLACDecode(char *input, AudioSignal *Signal, int slices, parameters *config);
+int FLACFinish(AudioSignal *Signal, int ok);
+int FLACReadStreamInfo(char *input, AudioSignal *Signal);
+int FLACDecodeStream(char *input, AudioSignal *Signal, int md5);
+int FLACDecodeSlices(char *input, AudioSignal *Signal, int slices, parameters *config);
+int DecodeFLACSlice(long int job, int thread, void *data);
+void *VerifyFLACMD5(void *data);
+int CheckFLACFormat(AudioSignal *Signal);
 
 #endif
@@ -32,11 +32,13 @@
 #include "plot.h"
 #include "float.h"
 #include "profile.h"
+#include "plans.h"
+#include "kernels.h"
+#include "samples.h"
+#include "sync.h"
+#include "cache.h"
 
-#define SORT_NAME FFT_Frequency_Magnitude
-#define SORT_TYPE Frequency
-#define SORT_CMP(x, y)  ((x).magnitude > (y).magnitude ? -1 : ((x).magnitude == (y).magnitude ? 0 : 1))
-#include "sort.h"  // https://github.com/swenson/sort/
+#include <pthread.h>
 
 inline int areDoublesEqual(double a, double b)
 {
@@ -380,12 +382,13 @@ void InitAudio(AudioSignal *Signal, parameters *config)
 	Signal->floorFreq = 0.0;
 	Signal->floorAmplitude = 0.0;	
 
-	Signal->Samples = NULL;
+	InitSamples(&Signal->Samples);
 	Signal->numSamples = 0;
 	Signal->framerate = 0.0;
 
 	Signal->startOffset = 0;
 	Signal->endOffset = 0;
+	Signal->syncCache = NULL;
 
 	memset(&Signal->MaxMagnitude, 0, sizeof(MaxMagn));
 	Signal->MinAmplitude = 0;
@@ -463,14 +466,16 @@ void ReleaseFFTW(AudioBlocks * AudioArray)
 
 	if(AudioArray->fftwValues.spectrum)
 	{
-		fftw_free(AudioArray->fftwValues.spectrum);
+		FFTW(free)(AudioArray->fftwValues.spectrum);
 		AudioArray->fftwValues.spectrum = NULL;
 	}
 
 	if(AudioArray->fftwValuesRight.spectrum)
 	{
-		fftw_free(AudioArray->fftwValuesRight.spectrum);
+		if(!AudioArray->fftwValuesRight.shared)
+			FFTW(free)(AudioArray->fftwValuesRight.spectrum);
 		AudioArray->fftwValuesRight.spectrum = NULL;
+		AudioArray->fftwValuesRight.shared = 0;
 	}
 }
 
@@ -562,11 +567,7 @@ void ReleasePCM(AudioSignal *Signal)
 	if(!Signal)
 		return;
 
-	if(Signal->Samples)
-	{
-		free(Signal->Samples);
-		Signal->Samples = NULL;
-	}
+	ReleaseSampleStore(&Signal->Samples);
 }
 
 void ReleaseAudio(AudioSignal *Signal, parameters *config)
@@ -586,6 +587,7 @@ void ReleaseAudio(AudioSignal *Signal, parameters *config)
 	if(config->clkMeasure)
 		ReleaseBlock(&Signal->clkFrequencies);
 	ReleasePCM(Signal);
+	ReleaseSyncCache(Signal);
 
 	InitAudio(Signal, config);
 }
@@ -599,23 +601,11 @@ void ReleaseAudioBlockStructure(parameters *config)
 		config->types.typeCount = 0;
 	}
 
-	if(config->model_plan)
-	{
-		fftw_export_wisdom_to_filename("wisdom.fftw");
-
-		fftw_destroy_plan(config->model_plan);
-		config->model_plan = NULL;
-	}
-	if(config->reverse_plan)
-	{
-		fftw_destroy_plan(config->reverse_plan);
-		config->reverse_plan = NULL;
-	}
-	if(config->sync_plan)
-	{
-		fftw_destroy_plan(config->sync_plan);
-		config->sync_plan = NULL;
-	}
+	ReportPlanTimes(config);
+	ExportWisdom(config);
+	freePlans(&config->plans);
+	ReleasePeakScratch();
+	ReleaseSyncPool();
 }
 
 int CalculateTimeDurations(AudioSignal *Signal, parameters *config)
@@ -2087,38 +2077,10 @@ void GlobalNormalize(AudioSignal *Signal, parameters *config)
 		type = GetBlockType(config, block);
 		if(type >= TYPE_SILENCE)
 		{
-			for(int i = 0; i < config->MaxFreq; i++)
-			{
-				if(!Signal->Blocks[block].freq[i].hertz)
-					break;
-	
-				Signal->Blocks[block].freq[i].amplitude = 
-					CalculateAmplitude(Signal->Blocks[block].freq[i].magnitude, MaxMagnitude);
-				
-				if(Signal->Blocks[block].freq[i].amplitude != NO_AMPLITUDE)
-				{
-					if(Signal->Blocks[block].freq[i].amplitude < MinAmplitude)
-						MinAmplitude = Signal->Blocks[block].freq[i].amplitude;
-				}
-			}
+			CalculateFrequencyAmplitudes(Signal->Blocks[block].freq, config->MaxFreq, MaxMagnitude, &MinAmplitude);
 
 			if(Signal->Blocks[block].freqRight)
-			{
-				for(int i = 0; i < config->MaxFreq; i++)
-				{
-					if(!Signal->Blocks[block].freqRight[i].hertz)
-						break;
-		
-					Signal->Blocks[block].freqRight[i].amplitude = 
-						CalculateAmplitude(Signal->Blocks[block].freqRight[i].magnitude, MaxMagnitude);
-					
-					if(Signal->Blocks[block].freqRight[i].amplitude != NO_AMPLITUDE)
-					{
-						if(Signal->Blocks[block].freqRight[i].amplitude < MinAmplitude)
-							MinAmplitude = Signal->Blocks[block].freqRight[i].amplitude;
-					}
-				}
-			}
+				CalculateFrequencyAmplitudes(Signal->Blocks[block].freqRight, config->MaxFreq, MaxMagnitude, &MinAmplitude);
 		}
 	}
 	Signal->MinAmplitude = MinAmplitude;
@@ -2197,6 +2159,24 @@ void FindMaxMagnitude(AudioSignal *Signal, parameters *config)
 	}
 }
 
+// Amplitudes in dBFS for the used entries of a block, tracks the minimum
+void CalculateFrequencyAmplitudes(Frequency *freq, int MaxFreq, double MaxMagnitude, double *MinAmplitude)
+{
+	int	count = 0;
+
+	while(count < MaxFreq && freq[count].hertz)
+		count++;
+
+	CalculateAmplitudesStrided(&freq[0].magnitude, count,
+		sizeof(Frequency)/sizeof(double), MaxMagnitude, &freq[0].amplitude);
+
+	for(int i = 0; i < count; i++)
+	{
+		if(freq[i].amplitude != NO_AMPLITUDE && freq[i].amplitude < *MinAmplitude)
+			*MinAmplitude = freq[i].amplitude;
+	}
+}
+
 void CalculateAmplitudes(AudioSignal *Signal, double ZeroDbMagReference, parameters *config)
 {
 	double MinAmplitude = 0;
@@ -2212,38 +2192,10 @@ void CalculateAmplitudes(AudioSignal *Signal, double ZeroDbMagReference, paramet
 		type = GetBlockType(config, block);
 		if(type >= TYPE_SILENCE || type == TYPE_WATERMARK)
 		{
-			for(int i = 0; i < config->MaxFreq; i++)
-			{
-				if(!Signal->Blocks[block].freq[i].hertz)
-					break;
-	
-				Signal->Blocks[block].freq[i].amplitude = 
-					CalculateAmplitude(Signal->Blocks[block].freq[i].magnitude, ZeroDbMagReference);
-	
-				if(Signal->Blocks[block].freq[i].amplitude != NO_AMPLITUDE)
-				{
-					if(Signal->Blocks[block].freq[i].amplitude < MinAmplitude)
-						MinAmplitude = Signal->Blocks[block].freq[i].amplitude;
-				}
-			}
+			CalculateFrequencyAmplitudes(Signal->Blocks[block].freq, config->MaxFreq, ZeroDbMagReference, &MinAmplitude);
 
 			if(Signal->Blocks[block].freqRight)
-			{
-				for(int i = 0; i < config->MaxFreq; i++)
-				{
-					if(!Signal->Blocks[block].freqRight[i].hertz)
-						break;
-		
-					Signal->Blocks[block].freqRight[i].amplitude = 
-						CalculateAmplitude(Signal->Blocks[block].freqRight[i].magnitude, ZeroDbMagReference);
-
-					if(Signal->Blocks[block].freqRight[i].amplitude != NO_AMPLITUDE)
-					{
-						if(Signal->Blocks[block].freqRight[i].amplitude < MinAmplitude)
-							MinAmplitude = Signal->Blocks[block].freqRight[i].amplitude;
-					}
-				}
-			}
+				CalculateFrequencyAmplitudes(Signal->Blocks[block].freqRight, config->MaxFreq, ZeroDbMagReference, &MinAmplitude);
 		}
 	}
 
@@ -2395,7 +2347,7 @@ void PrintFrequencies(AudioSignal *Signal, parameters *config)
 }
 
 /* check ProcessSamples in mdwave if changed, for reverse FFTW */
-inline double CalculateMagnitude(fftw_complex value, long int size)
+inline double CalculateMagnitude(FFTWComplex value, long int size)
 {
 	double r1 = 0;
 	double i1 = 0;
@@ -2407,7 +2359,7 @@ inline double CalculateMagnitude(fftw_complex value, long int size)
 	return magnitude;
 }
 
-inline double CalculatePhase(fftw_complex value)
+inline double CalculatePhase(FFTWComplex value)
 {
 	double r1 = 0;
 	double i1 = 0;
@@ -2471,13 +2423,332 @@ int FillFrequencyStructures(AudioSignal *Signal, AudioBlocks *AudioArray, parame
 	return 1;
 }
 
+/*
+	Only the loudest MaxFreq bins are kept. Instead of sorting every
+	bin, a bounded min-heap holds the best candidates seen so far.
+	Ties are broken by bin order, so results match a stable sort by
+	magnitude. Magnitudes are computed in one batch by the vector
+	kernels. Candidates and batch values live in a per-thread scratch
+	arena.
+*/
+
+pthread_key_t	peakScratchKey;
+pthread_once_t	peakScratchOnce = PTHREAD_ONCE_INIT;
+
+void FreePeakScratch(void *data)
+{
+	peakScratch *scratch = (peakScratch*)data;
+
+	if(!scratch)
+		return;
+	if(scratch->peaks)
+		free(scratch->peaks);
+	if(scratch->values)
+		free(scratch->values);
+	free(scratch);
+}
+
+void CreatePeakScratchKey()
+{
+	pthread_key_create(&peakScratchKey, FreePeakScratch);
+}
+
+peakScratch *GetPeakScratch(long int count, long int values)
+{
+	peakScratch *scratch = NULL;
+
+	pthread_once(&peakScratchOnce, CreatePeakScratchKey);
+	scratch = (peakScratch*)pthread_getspecific(peakScratchKey);
+	if(!scratch)
+	{
+		scratch = (peakScratch*)malloc(sizeof(peakScratch));
+		if(!scratch)
+			return NULL;
+		memset(scratch, 0, sizeof(peakScratch));
+		pthread_setspecific(peakScratchKey, scratch);
+	}
+
+	if(scratch->size < count)
+	{
+		SpectralPeak *peaks = NULL;
+
+		peaks = (SpectralPeak*)realloc(scratch->peaks, sizeof(SpectralPeak)*count);
+		if(!peaks)
+			return NULL;
+		scratch->peaks = peaks;
+		scratch->size = count;
+	}
+
+	if(scratch->valuesSize < values)
+	{
+		double *buffer = NULL;
+
+		buffer = (double*)realloc(scratch->values, sizeof(double)*values);
+		if(!buffer)
+			return NULL;
+		scratch->values = buffer;
+		scratch->valuesSize = values;
+	}
+	return scratch;
+}
+
+// Per-thread buffer for batched magnitudes outside FillFrequencyStructures
+double *GetMagnitudeScratch(long int count)
+{
+	peakScratch *scratch = NULL;
+
+	scratch = GetPeakScratch(0, count);
+	if(!scratch)
+		return NULL;
+	return scratch->values;
+}
+
+void ReleasePeakScratch()
+{
+	pthread_once(&peakScratchOnce, CreatePeakScratchKey);
+	FreePeakScratch(pthread_getspecific(peakScratchKey));
+	pthread_setspecific(peakScratchKey, NULL);
+}
+
+// a is a worse candidate than b: lower magnitude, or same and later bin
+static inline int IsWorsePeak(SpectralPeak *a, SpectralPeak *b)
+{
+	if(a->magnitude != b->magnitude)
+		return a->magnitude < b->magnitude;
+	return a->bin > b->bin;
+}
+
+void SiftDownPeak(SpectralPeak *heap, long int count, long int pos)
+{
+	SpectralPeak	item = heap[pos];
+
+	while(1)
+	{
+		long int child = pos*2+1;
+
+		if(child >= count)
+			break;
+		if(child+1 < count && IsWorsePeak(&heap[child+1], &heap[child]))
+			child++;
+		if(!IsWorsePeak(&heap[child], &item))
+			break;
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = item;
+}
+
+void SiftUpPeak(SpectralPeak *heap, long int pos)
+{
+	SpectralPeak	item = heap[pos];
+
+	while(pos > 0)
+	{
+		long int parent = (pos-1)/2;
+
+		if(!IsWorsePeak(&item, &heap[parent]))
+			break;
+		heap[pos] = heap[parent];
+		pos = parent;
+	}
+	heap[pos] = item;
+}
+
+// Returns the amount of peaks, ordered by magnitude from highest
+// magnitudes[0] belongs to startBin
+long int SelectTopPeaks(double *magnitudes, long int startBin, long int endBin, long int amount, SpectralPeak *heap)
+{
+	long int	count = 0;
+
+	for(long int i = startBin; i < endBin; i++)
+	{
+		SpectralPeak	peak;
+
+		peak.magnitude = magnitudes[i-startBin];
+		peak.bin = i;
+		if(count < amount)
+		{
+			heap[count] = peak;
+			SiftUpPeak(heap, count);
+			count++;
+		}
+		else if(IsWorsePeak(&heap[0], &peak))
+		{
+			heap[0] = peak;
+			SiftDownPeak(heap, count, 0);
+		}
+	}
+
+	// Heap sort in place, worst candidates go to the end
+	for(long int last = count - 1; last > 0; last--)
+	{
+		SpectralPeak	worst = heap[0];
+
+		heap[0] = heap[last];
+		heap[last] = worst;
+		SiftDownPeak(heap, last, 0);
+	}
+	return count;
+}
+
+int CompareFrequencyKeys(const void *a, const void *b)
+{
+	const frequencyKey	*ka = (const frequencyKey*)a;
+	const frequencyKey	*kb = (const frequencyKey*)b;
+
+	if(ka->bin != kb->bin)
+		return ka->bin < kb->bin ? -1 : 1;
+	return ka->index - kb->index;
+}
+
+// First key position with a bin equal or higher than the requested one
+long int FindFrequencyKey(frequencyKey *keys, long int count, long int bin)
+{
+	long int	low = 0, high = count;
+
+	while(low < high)
+	{
+		long int mid = low + (high - low)/2;
+
+		if(keys[mid].bin < bin)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+// Lowest unmatched comparison index with the same frequency, -1 if none
+// Neighbour bins are checked as well, in case the rounding fell on the edge
+int FindExactFrequency(Frequency *ref, Frequency *freqComp, frequencyKey *keys, int testSize, long int bin)
+{
+	int		found = -1;
+
+	for(long int pos = FindFrequencyKey(keys, testSize, bin - 1); pos < testSize && keys[pos].bin <= bin + 1; pos++)
+	{
+		int comp = keys[pos].index;
+
+		if(found != -1 && comp > found)
+			continue;
+		if(!freqComp[comp].matched && areDoublesEqual(ref->hertz, freqComp[comp].hertz))
+			found = comp;
+	}
+	return found;
+}
+
+// Nearest unmatched comparison frequency no further than one bin away, -1 if none
+// Ties go to the lowest index
+int FindNearestFrequency(Frequency *ref, Frequency *freqComp, frequencyKey *keys, int testSize, long int bin, double binWidth)
+{
+	int		found = -1;
+	double	distance = 0;
+
+	for(long int pos = FindFrequencyKey(keys, testSize, bin - 1); pos < testSize && keys[pos].bin <= bin + 1; pos++)
+	{
+		int		comp = keys[pos].index;
+		double	diff = 0;
+
+		if(freqComp[comp].matched)
+			continue;
+		diff = fabs(ref->hertz - freqComp[comp].hertz);
+		if(diff > binWidth && !areDoublesEqual(diff, binWidth))
+			continue;
+		if(found == -1 || diff < distance || (diff == distance && comp < found))
+		{
+			found = comp;
+			distance = diff;
+		}
+	}
+	return found;
+}
+
+/*
+	Matches each reference frequency against the comparison ones, leaving
+	the comparison index in matches or -1 when not found. Frequencies are
+	keyed by their bin in the reference grid and looked up in sorted order,
+	instead of scanning all comparison frequencies for each reference one.
+	The first unmatched comparison frequency wins as before, and the matched
+	back-pointers are set in both arrays.
+	With tolerance, the references left without an exact match take the
+	nearest unmatched frequency within one bin, for 44.1 vs 48 kHz grids.
+*/
+int MatchFrequencies(Frequency *freqRef, int refSize, Frequency *freqComp, int testSize, double boxsize, int tolerance, int *matches)
+{
+	frequencyKey	*keys = NULL;
+
+	if(boxsize <= 0)
+		boxsize = 1;
+
+	if(testSize > 0)
+	{
+		keys = (frequencyKey*)malloc(sizeof(frequencyKey)*testSize);
+		if(!keys)
+		{
+			logmsg("ERROR: Not enough memory (frequency keys)\n");
+			return 0;
+		}
+
+		for(int comp = 0; comp < testSize; comp++)
+		{
+			keys[comp].bin = llround(freqComp[comp].hertz*boxsize);
+			keys[comp].index = comp;
+		}
+		qsort(keys, testSize, sizeof(frequencyKey), CompareFrequencyKeys);
+	}
+
+	for(int freq = 0; freq < refSize; freq++)
+	{
+		int comp = -1;
+
+		matches[freq] = -1;
+		if(!keys || freqRef[freq].matched)
+			continue;
+
+		comp = FindExactFrequency(&freqRef[freq], freqComp, keys, testSize, llround(freqRef[freq].hertz*boxsize));
+		if(comp != -1)
+		{
+			freqComp[comp].matched = freq + 1;
+			freqRef[freq].matched = comp + 1;
+			matches[freq] = comp;
+		}
+	}
+
+	// Exact matches go first, so a close neighbour can't take them away
+	if(tolerance && keys)
+	{
+		for(int freq = 0; freq < refSize; freq++)
+		{
+			int comp = -1;
+
+			if(freqRef[freq].matched)
+				continue;
+
+			comp = FindNearestFrequency(&freqRef[freq], freqComp, keys, testSize, llround(freqRef[freq].hertz*boxsize), 1.0/boxsize);
+			if(comp != -1)
+			{
+				freqComp[comp].matched = freq + 1;
+				freqRef[freq].matched = comp + 1;
+				matches[freq] = comp;
+			}
+		}
+	}
+
+	if(keys)
+		free(keys);
+	return 1;
+}
+
 int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray, char channel, parameters *config)
 {
-	long int 		i = 0, startBin= 0, endBin = 0, count = 0, size = 0, amount = 0;
+	long int 		i = 0, startBin= 0, endBin = 0, size = 0, amount = 0;
 	double 			boxsize = 0;
 	int				nyquistLimit = 0;
-	Frequency		*f_array = NULL, *targetFreq = NULL;
+	Frequency		*targetFreq = NULL;
 	FFTWSpectrum	*fftw = NULL;
+	SpectralPeak	*peaks = NULL;
+	peakScratch		*scratch = NULL;
+	FFTWComplex	*values = NULL;
+	double			*phases = NULL;
 
 	if(channel == CHANNEL_LEFT)
 	{
@@ -2520,37 +2791,40 @@ int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray
 	logmsgFileOnly("Size: %ld BoxSize: %g StartBin: %ld EndBin %ld\n",
 		 size, boxsize, startBin, endBin);
 	*/
-	f_array = (Frequency*)malloc(sizeof(Frequency)*(endBin-startBin));
-	if(!f_array)
-	{
-		logmsg("ERROR: Not enough memory (f_array)\n");
-		return 0;
-	}
-	memset(f_array, 0, sizeof(Frequency)*(endBin-startBin));
+	if(endBin <= startBin)
+		return 1;
+
+	amount = endBin-startBin;
+	if(config->MaxFreq < amount)
+		amount = config->MaxFreq;
 
-	for(i = startBin; i < endBin; i++)
+	// values holds the bin magnitudes, and later the survivors' bins and phases
+	scratch = GetPeakScratch(amount, endBin-startBin > 3*amount ? endBin-startBin : 3*amount);
+	if(!scratch)
 	{
-		f_array[count].hertz = CalculateFrequency(i, boxsize);
-		f_array[count].magnitude = CalculateMagnitude(fftw->spectrum[i], size);
-		f_array[count].amplitude = NO_AMPLITUDE;
-		f_array[count].phase = CalculatePhase(fftw->spectrum[i]);
-		f_array[count].matched = 0;
-		count++;
+		logmsg("ERROR: Not enough memory (peaks)\n");
+		return 0;
 	}
+	peaks = scratch->peaks;
 
-	if(config->MaxFreq > count)
-		amount = count;
-	else
-		amount = config->MaxFreq;
+	CalculateMagnitudes(fftw->spectrum+startBin, endBin-startBin, size, scratch->values);
+	amount = SelectTopPeaks(scratch->values, startBin, endBin, amount, peaks);
 
-	// Sort the array by top magnitudes
-	FFT_Frequency_Magnitude_tim_sort(f_array, count);
-	// Only copy Top amount frequencies
-	memcpy(targetFreq, f_array, sizeof(Frequency)*amount);
+	// Only the Top amount frequencies need phase
+	values = (FFTWComplex*)scratch->values;
+	phases = scratch->values+2*amount;
+	for(i = 0; i < amount; i++)
+		values[i] = fftw->spectrum[peaks[i].bin];
+	CalculatePhases(values, amount, phases);
 
-	// release temporal storage
-	free(f_array);
-	f_array = NULL;
+	for(i = 0; i < amount; i++)
+	{
+		targetFreq[i].hertz = CalculateFrequency(peaks[i].bin, boxsize);
+		targetFreq[i].magnitude = peaks[i].magnitude;
+		targetFreq[i].amplitude = NO_AMPLITUDE;
+		targetFreq[i].phase = phases[i];
+		targetFreq[i].matched = 0;
+	}
 
 	return 1;
 }
@@ -2716,9 +2990,9 @@ double CalculateWeightedError(double pError, parameters *config)
 
 	if(pError < 0.0)  // this should never happen
 	{
-		if(!config->pErrorReport)
+		// plot tasks share config
+		if(__sync_fetch_and_add(&config->pErrorReport, 1) == 0)
 			logmsg("pERROR < 0! (%g)\n", pError);
-		config->pErrorReport++;
 
 		pError = fabs(pError);
 		if(pError > 1)
@@ -3017,7 +3291,7 @@ double CalculateFrameRateAndCheckSamplerate(AudioSignal *Signal, parameters *con
 			else
 				config->ComCentsDifferenceSR = centsDifferenceSR;
 			
-			config->SRNoMatch |= Signal->role;
+			SetRoleFlag(config->SRNoMatch, Signal->role);
 		}
 	}
 
@@ -62,6 +62,8 @@ char *GetTypeColor(parameters *config, int type);
 char *GetTypeName(parameters *config, int type);
 char *GetTypeDisplayName(parameters *config, int type);
 void ReleaseAudioBlockStructure(parameters *config);
+void ReleasePeakScratch();
+double *GetMagnitudeScratch(long int count);
 void PrintAudioBlocks(parameters *config);
 void ReleasePCM(AudioSignal *Signal);
 long int GetLastSyncFrameOffset(wav_hdr header, parameters *config);
@@ -109,6 +111,7 @@ void PrintFrequenciesBlockMagnitude(AudioSignal *Signal, Frequency *freq, int ty
 void GlobalNormalize(AudioSignal *Signal, parameters *config);
 void FindMaxMagnitude(AudioSignal *Signal, parameters *config);
 void CalculateAmplitudes(AudioSignal *Signal, double ZeroDbMagReference, parameters *config);
+void CalculateFrequencyAmplitudes(Frequency *freq, int MaxFreq, double MaxMagnitude, double *MinAmplitude);
 void FindFloor(AudioSignal *Signal, parameters *config);
 void FindStandAloneFloor(AudioSignal *Signal, parameters *config);
 double GetLowerFrameRate(double framerateA, double framerateB);
@@ -139,9 +142,9 @@ long int SamplesForDisplay(long int samples, int AudioChannels);
 int DetectWatermark(AudioSignal *Signal, parameters *config);
 int DetectWatermarkIssue(char *msg, parameters *config);
 
-double CalculateMagnitude(fftw_complex value, long int size);
+double CalculateMagnitude(FFTWComplex value, long int size);
 double CalculateAmplitude(double magnitude, double MaxMagnitude);
-double CalculatePhase(fftw_complex value);
+double CalculatePhase(FFTWComplex value);
 double CalculateFrequency(double boxindex, double boxsize);
 double CalculateFrameRate(AudioSignal *Signal, parameters *config);
 double CalculateFrameRateNS(AudioSignal *Signal, double Frames, parameters *config);
@@ -155,6 +158,7 @@ void CalcuateFrequencyBrackets(AudioSignal *signal, parameters *config);
 double FindFrequencyBracket(double frequency, size_t size, int AudioChannels, long samplerate, parameters *config);
 double FindFrequencyBracketForSync(double frequency, size_t size, int AudioChannels, long samplerate, parameters *config);
 double FindFundamentalAmplitudeAverage(AudioSignal *Signal, parameters *config);
+int MatchFrequencies(Frequency *freqRef, int refSize, Frequency *freqComp, int testSize, double boxsize, int tolerance, int *matches);
 
 char GetTypeProfileName(int type);
 int GetPulseSyncFreq(int role, parameters *config);
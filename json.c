@@ -0,0 +1,273 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "json.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/*
+	Job server requests and replies are single line JSON objects.
+	Strings are UTF-8 and only control characters, quotes and
+	backslashes are escaped, so paths go through unchanged.
+*/
+
+void JSONWriteString(FILE *file, char *text)
+{
+	fputc('"', file);
+	for(; *text; text++)
+	{
+		unsigned char c = (unsigned char)*text;
+
+		if(c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if(c == '\n')
+			fprintf(file, "\\n");
+		else if(c == '\r')
+			fprintf(file, "\\r");
+		else if(c == '\t')
+			fprintf(file, "\\t");
+		else if(c < 0x20)
+			fprintf(file, "\\u%04x", c);
+		else
+			fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+char *JSONSkipSpace(char *pos)
+{
+	while(pos && *pos && isspace((unsigned char)*pos))
+		pos++;
+	return pos;
+}
+
+static int AppendStringChar(char *dest, size_t size, size_t *len, unsigned int c)
+{
+	char	utf8[3];
+	int		count = 0;
+
+	if(c < 0x80)
+		utf8[count++] = c;
+	else if(c < 0x800)
+	{
+		utf8[count++] = 0xC0 | (c >> 6);
+		utf8[count++] = 0x80 | (c & 0x3F);
+	}
+	else
+	{
+		utf8[count++] = 0xE0 | (c >> 12);
+		utf8[count++] = 0x80 | ((c >> 6) & 0x3F);
+		utf8[count++] = 0x80 | (c & 0x3F);
+	}
+
+	if(!dest)
+		return 1;
+	if(*len + count >= size)
+		return 0;
+	memcpy(dest + *len, utf8, count);
+	*len += count;
+	return 1;
+}
+
+// Reads a quoted string, dest can be NULL to skip it. NULL on errors
+char *JSONReadString(char *pos, char *dest, size_t size)
+{
+	size_t len = 0;
+
+	pos = JSONSkipSpace(pos);
+	if(!pos || *pos != '"')
+		return NULL;
+	pos++;
+
+	while(*pos && *pos != '"')
+	{
+		unsigned int c = (unsigned char)*pos++;
+
+		if(c < 0x20)
+			return NULL;
+		if(c == '\\')
+		{
+			c = (unsigned char)*pos++;
+			switch(c)
+			{
+				case '"':
+				case '\\':
+				case '/':
+					break;
+				case 'b':
+					c = '\b';
+					break;
+				case 'f':
+					c = '\f';
+					break;
+				case 'n':
+					c = '\n';
+					break;
+				case 'r':
+					c = '\r';
+					break;
+				case 't':
+					c = '\t';
+					break;
+				case 'u':
+				{
+					char	hex[5];
+					char	*end = NULL;
+
+					for(int i = 0; i < 4; i++)
+					{
+						if(!isxdigit((unsigned char)pos[i]))
+							return NULL;
+						hex[i] = pos[i];
+					}
+					hex[4] = '\0';
+					c = strtoul(hex, &end, 16);
+					if(*end != '\0')
+						return NULL;
+					pos += 4;
+					break;
+				}
+				default:
+					return NULL;
+			}
+			if(!AppendStringChar(dest, size, &len, c))
+				return NULL;
+			continue;
+		}
+
+		// UTF-8 bytes are copied as they are
+		if(dest)
+		{
+			if(len + 1 >= size)
+				return NULL;
+			dest[len++] = c;
+		}
+	}
+
+	if(*pos != '"')
+		return NULL;
+	if(dest)
+		dest[len] = '\0';
+	return pos + 1;
+}
+
+char *JSONSkipValue(char *pos)
+{
+	pos = JSONSkipSpace(pos);
+	if(!pos || !*pos)
+		return NULL;
+
+	if(*pos == '"')
+		return JSONReadString(pos, NULL, 0);
+
+	if(*pos == '{' || *pos == '[')
+	{
+		char close = *pos == '{' ? '}' : ']';
+
+		pos = JSONSkipSpace(pos + 1);
+		if(*pos == close)
+			return pos + 1;
+		while(pos && *pos)
+		{
+			if(close == '}')
+			{
+				pos = JSONReadString(pos, NULL, 0);
+				pos = JSONSkipSpace(pos);
+				if(!pos || *pos != ':')
+					return NULL;
+				pos++;
+			}
+			pos = JSONSkipSpace(JSONSkipValue(pos));
+			if(!pos)
+				return NULL;
+			if(*pos == close)
+				return pos + 1;
+			if(*pos != ',')
+				return NULL;
+			pos++;
+		}
+		return NULL;
+	}
+
+	// numbers, true, false and null
+	while(*pos && (isalnum((unsigned char)*pos) || *pos == '-' || *pos == '+' || *pos == '.'))
+		pos++;
+	return pos;
+}
+
+// Returns the value for a key of a top level object
+char *JSONFindKey(char *object, char *key)
+{
+	char	name[256];
+	char	*pos = NULL;
+
+	pos = JSONSkipSpace(object);
+	if(!pos || *pos != '{')
+		return NULL;
+	pos = JSONSkipSpace(pos + 1);
+	if(*pos == '}')
+		return NULL;
+
+	while(pos && *pos)
+	{
+		pos = JSONReadString(pos, name, sizeof(name));
+		pos = JSONSkipSpace(pos);
+		if(!pos || *pos != ':')
+			return NULL;
+		pos = JSONSkipSpace(pos + 1);
+		if(strcmp(name, key) == 0)
+			return pos;
+		pos = JSONSkipSpace(JSONSkipValue(pos));
+		if(!pos || *pos != ',')
+			return NULL;
+		pos = JSONSkipSpace(pos + 1);
+	}
+	return NULL;
+}
+
+int JSONGetString(char *object, char *key, char *dest, size_t size)
+{
+	char *pos = NULL;
+
+	pos = JSONFindKey(object, key);
+	if(!pos)
+		return 0;
+	return(JSONReadString(pos, dest, size) != NULL);
+}
+
+int JSONGetNumber(char *object, char *key, double *value)
+{
+	char	*pos = NULL, *end = NULL;
+
+	pos = JSONFindKey(object, key);
+	if(!pos)
+		return 0;
+	*value = strtod(pos, &end);
+	return(end != pos);
+}
@@ -0,0 +1,394 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "kernels.h"
+#include "freq.h"
+
+#include <stdint.h>
+#include <float.h>
+#include <pthread.h>
+
+/*
+	Each kernel body is written once as branch free C and inlined into
+	wrappers compiled for different instruction sets, the compiler
+	vectorizes each copy for its target. The best one the CPU supports
+	is picked on first use. This file is built with -fno-math-errno
+	and -fno-trapping-math so sqrt and the selects vectorize, and with
+	-ffp-contract=off so magnitudes stay bit exact against the scalar
+	path. None of them change the results.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_DISPATCH
+#define KERNEL_TARGET(isa)	__attribute__((target(isa)))
+#endif
+
+#define KERNEL_INLINE	inline __attribute__((always_inline))
+// min/max only vectorize when NaNs and signed zeros can be ignored, samples are always finite
+#define KERNEL_FINITE	__attribute__((optimize("finite-math-only", "no-signed-zeros")))
+
+// Cephes rational approximation for atan in [-tan(pi/8), tan(pi/8)]
+#define ATAN_P0	-8.750608600031904122785E-1
+#define ATAN_P1	-1.615753718733365076637E1
+#define ATAN_P2	-7.500855792314704667340E1
+#define ATAN_P3	-1.228866684490136173410E2
+#define ATAN_P4	-6.485021904942025371773E1
+#define ATAN_Q0	2.485846490142306297962E1
+#define ATAN_Q1	1.650270098316988542046E2
+#define ATAN_Q2	4.328810604912902668951E2
+#define ATAN_Q3	4.853903996359136964868E2
+#define ATAN_Q4	1.945506571482613964425E2
+#define TAN_PI_8	0.41421356237309504880
+
+// Cephes rational approximation for log(1+x) in [sqrt(0.5)-1, sqrt(2)-1]
+#define LOG_P0	1.01875663804580931796E-4
+#define LOG_P1	4.97494994976747001425E-1
+#define LOG_P2	4.70579119878881725854E0
+#define LOG_P3	1.44989225341610930846E1
+#define LOG_P4	1.79368678507819816313E1
+#define LOG_P5	7.70838733755885391666E0
+#define LOG_Q0	1.12873587189167450590E1
+#define LOG_Q1	4.52279145837532221105E1
+#define LOG_Q2	8.29875266912776603211E1
+#define LOG_Q3	7.11544750618563894466E1
+#define LOG_Q4	2.31251620126765340583E1
+#define LOG_C1	2.121944400546905827679E-4
+#define LOG_C2	0.693359375
+#define TWO_52	4503599627370496.0
+#define TWO_54	18014398509481984.0
+
+typedef void (*magnitudeKernel)(sampleType *, long int, double, double *);
+typedef void (*phaseKernel)(sampleType *, long int, double *);
+typedef void (*amplitudeKernel)(double *, long int, long int, double, double *);
+typedef void (*pcm24Kernel)(const uint8_t *, long int, int32_t *);
+typedef void (*envelopeKernel)(const sampleType *, const long int *, long int, double *, double *);
+
+static magnitudeKernel	magnitudeFunc = NULL;
+static phaseKernel		phaseFunc = NULL;
+static amplitudeKernel	amplitudeFunc = NULL;
+static pcm24Kernel		pcm24Func = NULL;
+static envelopeKernel	envelopeFunc = NULL;
+static const char		*kernelName = "Scalar";
+static pthread_once_t	kernelOnce = PTHREAD_ONCE_INIT;
+
+static KERNEL_INLINE void MagnitudeKernel(sampleType * restrict spectrum, long int count, double size, double * restrict magnitudes)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		double r1 = spectrum[2*i], i1 = spectrum[2*i+1];
+
+		magnitudes[i] = sqrt(r1*r1 + i1*i1)/size;
+	}
+}
+
+static KERNEL_INLINE void PhaseKernel(sampleType * restrict values, long int count, double * restrict phases)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		double	r1 = values[2*i], i1 = values[2*i+1];
+		double	ar = fabs(r1), ai = fabs(i1);
+		double	big = 0, small = 0, t = 0, u = 0, z = 0, p = 0, q = 0, angle = 0;
+		int		swap = 0, reduce = 0, negative = 0;
+
+		// reduce to atan(t) with t in [0, 1]
+		negative = copysign(1.0, r1) < 0;
+		swap = ai > ar;
+		big = swap ? ai : ar;
+		small = swap ? ar : ai;
+		t = small/(big > 0 ? big : 1);
+
+		// and then to u in [-tan(pi/8), tan(pi/8)]
+		reduce = t > TAN_PI_8;
+		u = (t - (reduce ? 1 : 0))/((reduce ? t : 0) + 1);
+
+		z = u*u;
+		p = (((ATAN_P0*z + ATAN_P1)*z + ATAN_P2)*z + ATAN_P3)*z + ATAN_P4;
+		q = ((((z + ATAN_Q0)*z + ATAN_Q1)*z + ATAN_Q2)*z + ATAN_Q3)*z + ATAN_Q4;
+		angle = u + u*z*p/q;
+
+		// undo the reductions into the atan2 quadrant
+		angle = angle + (reduce ? M_PI_4 : 0);
+		angle = (swap ? -angle : angle) + (swap ? M_PI_2 : 0);
+		angle = (negative ? -angle : angle) + (negative ? M_PI : 0);
+		angle = copysign(angle, i1);
+
+		phases[i] = angle*180/M_PI;
+	}
+}
+
+static KERNEL_INLINE void AmplitudeKernel(double * restrict magnitudes, long int count, long int stride, double MaxMagnitude, double * restrict amplitudes)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		double		magnitude = magnitudes[i*stride];
+		double		ratio = 0, e = 0, x = 0, z = 0, y = 0, p = 0, q = 0;
+		uint64_t	bits = 0, exponent = 0;
+		int			subnormal = 0, low = 0;
+
+		ratio = magnitude/MaxMagnitude;
+		subnormal = ratio < DBL_MIN;
+		ratio = ratio*(subnormal ? TWO_54 : 1);
+
+		// split into mantissa in [0.5, 1) and exponent
+		memcpy(&bits, &ratio, sizeof(double));
+		exponent = (bits >> 52) | 0x4330000000000000ULL;
+		memcpy(&e, &exponent, sizeof(double));
+		e = e - TWO_52 - 1022;
+		e = e - (subnormal ? 54 : 0);
+		bits = (bits & 0x000fffffffffffffULL) | 0x3fe0000000000000ULL;
+		memcpy(&x, &bits, sizeof(double));
+
+		low = x < M_SQRT1_2;
+		e = e - (low ? 1 : 0);
+		x = x + (low ? x : 0) - 1;
+
+		z = x*x;
+		p = ((((LOG_P0*x + LOG_P1)*x + LOG_P2)*x + LOG_P3)*x + LOG_P4)*x + LOG_P5;
+		q = ((((x + LOG_Q0)*x + LOG_Q1)*x + LOG_Q2)*x + LOG_Q3)*x + LOG_Q4;
+		y = x*(z*p/q) - e*LOG_C1 - 0.5*z;
+		y = x + y + e*LOG_C2;
+
+		amplitudes[i*stride] = (magnitude == 0.0 || MaxMagnitude == 0.0) ? NO_AMPLITUDE : 20*(y*M_LOG10E);
+	}
+}
+
+// little endian 24 bit samples, the arithmetic shift does the sign extension
+static KERNEL_INLINE void PCM24Kernel(const uint8_t * restrict bytes, long int count, int32_t * restrict samples)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		uint32_t value = (uint32_t)bytes[3*i] << 8 | (uint32_t)bytes[3*i+1] << 16 | (uint32_t)bytes[3*i+2] << 24;
+
+		samples[i] = (int32_t)value >> 8;
+	}
+}
+
+// column c spans samples first[c] to first[c+1], both included
+static KERNEL_INLINE KERNEL_FINITE void EnvelopeKernel(const sampleType * restrict samples, const long int * restrict first, long int columns, double * restrict minimum, double * restrict maximum)
+{
+	for(long int c = 0; c < columns; c++)
+	{
+		sampleType	low = samples[first[c]], high = samples[first[c]];
+
+		for(long int i = first[c]; i <= first[c+1]; i++)
+		{
+			low = samples[i] < low ? samples[i] : low;
+			high = samples[i] > high ? samples[i] : high;
+		}
+		minimum[c] = low;
+		maximum[c] = high;
+	}
+}
+
+#define KERNEL_SET(name, attr) \
+attr static void Magnitudes##name(sampleType *spectrum, long int count, double size, double *magnitudes) \
+{ MagnitudeKernel(spectrum, count, size, magnitudes); } \
+attr static void Phases##name(sampleType *values, long int count, double *phases) \
+{ PhaseKernel(values, count, phases); } \
+attr static void Amplitudes##name(double *magnitudes, long int count, long int stride, double MaxMagnitude, double *amplitudes) \
+{ AmplitudeKernel(magnitudes, count, stride, MaxMagnitude, amplitudes); } \
+attr static void PCM24##name(const uint8_t *bytes, long int count, int32_t *samples) \
+{ PCM24Kernel(bytes, count, samples); } \
+attr KERNEL_FINITE static void Envelope##name(const sampleType *samples, const long int *first, long int columns, double *minimum, double *maximum) \
+{ EnvelopeKernel(samples, first, columns, minimum, maximum); }
+
+#ifdef KERNEL_DISPATCH
+KERNEL_SET(AVX512, KERNEL_TARGET("avx512f"))
+KERNEL_SET(AVX2, KERNEL_TARGET("avx2"))
+KERNEL_SET(SSE2, KERNEL_TARGET("sse2"))
+#else
+KERNEL_SET(Generic, )
+#endif
+
+// Reference path, the same per bin functions used elsewhere
+static void MagnitudesScalar(sampleType *spectrum, long int count, double size, double *magnitudes)
+{
+	FFTWComplex *values = (FFTWComplex*)spectrum;
+
+	for(long int i = 0; i < count; i++)
+		magnitudes[i] = CalculateMagnitude(values[i], (long int)size);
+}
+
+static void PhasesScalar(sampleType *values, long int count, double *phases)
+{
+	FFTWComplex *complexValues = (FFTWComplex*)values;
+
+	for(long int i = 0; i < count; i++)
+		phases[i] = CalculatePhase(complexValues[i]);
+}
+
+static void AmplitudesScalar(double *magnitudes, long int count, long int stride, double MaxMagnitude, double *amplitudes)
+{
+	for(long int i = 0; i < count; i++)
+		amplitudes[i*stride] = CalculateAmplitude(magnitudes[i*stride], MaxMagnitude);
+}
+
+static void PCM24Scalar(const uint8_t *bytes, long int count, int32_t *samples)
+{
+	for(long int i = 0; i < count; i++)
+	{
+		int32_t	sample = 0;
+
+		if((int8_t)bytes[3*i+2] < 0)
+			sample = 0xff000000;
+		sample |= (bytes[3*i+2] << 16) | (bytes[3*i+1] << 8) | bytes[3*i];
+		samples[i] = sample;
+	}
+}
+
+static void EnvelopeScalar(const sampleType *samples, const long int *first, long int columns, double *minimum, double *maximum)
+{
+	for(long int c = 0; c < columns; c++)
+	{
+		minimum[c] = maximum[c] = samples[first[c]];
+		for(long int i = first[c]; i <= first[c+1]; i++)
+		{
+			if(samples[i] < minimum[c])
+				minimum[c] = samples[i];
+			if(samples[i] > maximum[c])
+				maximum[c] = samples[i];
+		}
+	}
+}
+
+typedef struct kernel_set_st {
+	const char		*name;
+	int				(*supported)();
+	magnitudeKernel	magnitude;
+	phaseKernel		phase;
+	amplitudeKernel	amplitude;
+	pcm24Kernel		pcm24;
+	envelopeKernel	envelope;
+} kernelSet;
+
+static int SupportsAlways() { return 1; }
+#ifdef KERNEL_DISPATCH
+static int SupportsAVX512() { return __builtin_cpu_supports("avx512f"); }
+static int SupportsAVX2() { return __builtin_cpu_supports("avx2"); }
+static int SupportsSSE2() { return __builtin_cpu_supports("sse2"); }
+#endif
+
+// Best first, the scalar reference path goes last
+static const kernelSet kernelSets[] = {
+#ifdef KERNEL_DISPATCH
+	{ "AVX-512", SupportsAVX512, MagnitudesAVX512, PhasesAVX512, AmplitudesAVX512, PCM24AVX512, EnvelopeAVX512 },
+	{ "AVX2", SupportsAVX2, MagnitudesAVX2, PhasesAVX2, AmplitudesAVX2, PCM24AVX2, EnvelopeAVX2 },
+	{ "SSE2", SupportsSSE2, MagnitudesSSE2, PhasesSSE2, AmplitudesSSE2, PCM24SSE2, EnvelopeSSE2 },
+#else
+	// Whatever the baseline provides, NEON on ARM64
+	{ "Generic", SupportsAlways, MagnitudesGeneric, PhasesGeneric, AmplitudesGeneric, PCM24Generic, EnvelopeGeneric },
+#endif
+	{ "Scalar", SupportsAlways, MagnitudesScalar, PhasesScalar, AmplitudesScalar, PCM24Scalar, EnvelopeScalar },
+};
+
+#define KERNEL_SETS	(int)(sizeof(kernelSets)/sizeof(kernelSets[0]))
+
+static void ApplyKernelSet(int index)
+{
+	magnitudeFunc = kernelSets[index].magnitude;
+	phaseFunc = kernelSets[index].phase;
+	amplitudeFunc = kernelSets[index].amplitude;
+	pcm24Func = kernelSets[index].pcm24;
+	envelopeFunc = kernelSets[index].envelope;
+	kernelName = kernelSets[index].name;
+}
+
+static void SelectKernels()
+{
+#ifdef KERNEL_DISPATCH
+	__builtin_cpu_init();
+#endif
+	for(int i = 0; i < KERNEL_SETS; i++)
+	{
+		if(kernelSets[i].supported())
+		{
+			ApplyKernelSet(i);
+			return;
+		}
+	}
+}
+
+int GetKernelSetCount()
+{
+	return KERNEL_SETS;
+}
+
+const char *GetKernelSetName(int index)
+{
+	if(index < 0 || index >= KERNEL_SETS)
+		return NULL;
+	return kernelSets[index].name;
+}
+
+// For kerneltest, not thread safe against kernels in use
+int UseKernelSet(int index)
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	if(index < 0 || index >= KERNEL_SETS || !kernelSets[index].supported())
+		return 0;
+	ApplyKernelSet(index);
+	return 1;
+}
+
+void CalculateMagnitudes(FFTWComplex *spectrum, long int count, long int size, double *magnitudes)
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	magnitudeFunc((sampleType*)spectrum, count, (double)size, magnitudes);
+}
+
+void CalculatePhases(FFTWComplex *values, long int count, double *phases)
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	phaseFunc((sampleType*)values, count, phases);
+}
+
+// stride is in doubles, so it can walk the magnitude field of a Frequency array
+void CalculateAmplitudesStrided(double *magnitudes, long int count, long int stride, double MaxMagnitude, double *amplitudes)
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	amplitudeFunc(magnitudes, count, stride, MaxMagnitude, amplitudes);
+}
+
+void DecodePCM24(const uint8_t *bytes, long int count, int32_t *samples)
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	pcm24Func(bytes, count, samples);
+}
+
+void CalculateEnvelope(const sampleType *samples, const long int *first, long int columns, double *minimum, double *maximum)
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	envelopeFunc(samples, first, columns, minimum, maximum);
+}
+
+const char *GetKernelName()
+{
+	pthread_once(&kernelOnce, SelectKernels);
+	return kernelName;
+}
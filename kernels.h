@@ -0,0 +1,57 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_KERNELS_H
+#define MDFOURIER_KERNELS_H
+
+#include "mdfourier.h"
+
+/*
+	Batched versions of CalculateMagnitude, CalculatePhase and
+	CalculateAmplitude. Magnitudes are bit exact, phase and amplitude
+	use rational approximations that stay within KERNEL_TOLERANCE
+	(degrees and dBFS) of the libm based scalar functions. DecodePCM24
+	sign extends packed 24 bit WAV samples into 32 bits.
+	CalculateEnvelope finds the min and max of each column of samples
+	for waveform plots, column c spans first[c] to first[c+1].
+*/
+#define KERNEL_TOLERANCE	1e-9
+
+void CalculateMagnitudes(FFTWComplex *spectrum, long int count, long int size, double *magnitudes);
+void CalculatePhases(FFTWComplex *values, long int count, double *phases);
+void CalculateAmplitudesStrided(double *magnitudes, long int count, long int stride, double MaxMagnitude, double *amplitudes);
+void DecodePCM24(const uint8_t *bytes, long int count, int32_t *samples);
+void CalculateEnvelope(const sampleType *samples, const long int *first, long int columns, double *minimum, double *maximum);
+const char *GetKernelName();
+
+// Every kernel set built in, to check them against the scalar path
+int GetKernelSetCount();
+const char *GetKernelSetName(int index);
+int UseKernelSet(int index);
+
+#endif
@@ -0,0 +1,460 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "kernels.h"
+#include "freq.h"
+#include "log.h"
+
+#include <stdint.h>
+#include <float.h>
+
+/*
+	Runs every kernel set this CPU supports over random and edge case
+	data, and checks it against libm and the scalar path. Magnitudes,
+	PCM decoding and waveform envelopes must be bit exact, phases and
+	amplitudes within KERNEL_TOLERANCE. Built and run with "make test".
+*/
+
+#define	TEST_RANDOM		4093	// odd, so the vector tails get exercised
+#define	TEST_SIZE		4096
+#define	TEST_STRIDE		3
+#define	TEST_REPORT		5		// mismatches shown per check
+#define	TEST_COLUMNS	1021	// waveform envelope columns
+#define	TAN_PI_8_TEST	0.41421356237309504880	// where the atan kernel changes its reduction
+
+static uint64_t	randomState = 0x2545F4914F6CDD1DULL;
+
+static uint64_t NextRandom()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+// Uniform in [-1, 1) scaled by 2^[-40, 40], spans the dynamic range of a spectrum
+static double RandomValue()
+{
+	double	value = 0;
+
+	value = (double)(NextRandom() >> 11)/9007199254740992.0*2.0 - 1.0;
+	return ldexp(value, (int)(NextRandom() % 81) - 40);
+}
+
+static const double edgeValues[] = {
+	0.0, -0.0, 1.0, -1.0, 0.5, -2.0,
+	TAN_PI_8_TEST, -TAN_PI_8_TEST,
+	1e-40, -1e-40,		// subnormal as float
+	1e-310, -1e-310,	// subnormal as double
+	FLT_MIN, 1e38, -1e38, 1e-30, 3.0e30
+};
+
+#define EDGE_COUNT	(long int)(sizeof(edgeValues)/sizeof(edgeValues[0]))
+
+// Fills with every edge value pair first, then random values
+static long int FillSpectrum(FFTWComplex *values, long int size)
+{
+	long int	count = 0;
+	sampleType	*data = (sampleType*)values;
+
+	for(long int r = 0; r < EDGE_COUNT && count < size; r++)
+	{
+		for(long int i = 0; i < EDGE_COUNT && count < size; i++)
+		{
+			data[2*count] = (sampleType)edgeValues[r];
+			data[2*count+1] = (sampleType)edgeValues[i];
+			count++;
+		}
+	}
+
+	// atan reduction boundaries, one ulp on each side
+	for(int s = 0; s < 4 && count + 4 <= size; s++)
+	{
+		double	r = s & 1 ? -1.0 : 1.0, t = s & 2 ? -TAN_PI_8_TEST : TAN_PI_8_TEST;
+
+		data[2*count] = (sampleType)r;
+		data[2*count+1] = (sampleType)nextafter(t, 0);
+		count++;
+		data[2*count] = (sampleType)r;
+		data[2*count+1] = (sampleType)nextafter(t, 2*t);
+		count++;
+		data[2*count] = (sampleType)nextafter(t, 0);
+		data[2*count+1] = (sampleType)r;
+		count++;
+		data[2*count] = (sampleType)nextafter(t, 2*t);
+		data[2*count+1] = (sampleType)r;
+		count++;
+	}
+
+	while(count < size)
+	{
+		data[2*count] = (sampleType)RandomValue();
+		data[2*count+1] = (sampleType)RandomValue();
+		count++;
+	}
+	return count;
+}
+
+static int CheckMagnitudes(FFTWComplex *values, long int count, double *results)
+{
+	long int	failed = 0;
+
+	CalculateMagnitudes(values, count, TEST_SIZE, results);
+	for(long int i = 0; i < count; i++)
+	{
+		double	r1 = creal(values[i]), i1 = cimag(values[i]);
+		double	expected = sqrt(r1*r1 + i1*i1)/(double)TEST_SIZE;
+
+		if(results[i] != expected || results[i] != CalculateMagnitude(values[i], TEST_SIZE))
+		{
+			if(failed++ < TEST_REPORT)
+				logmsg("\tMagnitude (%g, %g): %.17g expected %.17g\n", r1, i1, results[i], expected);
+		}
+	}
+	if(failed)
+		logmsg("\tMagnitudes: %ld of %ld are not bit exact\n", failed, count);
+	return failed == 0;
+}
+
+static int CheckPhases(FFTWComplex *values, long int count, double *results)
+{
+	long int	failed = 0;
+	double		maxError = 0;
+
+	CalculatePhases(values, count, results);
+	for(long int i = 0; i < count; i++)
+	{
+		double	r1 = creal(values[i]), i1 = cimag(values[i]);
+		double	expected = atan2(i1, r1)*180/M_PI;
+		double	error = fabs(results[i] - expected);
+
+		if(fabs(results[i] - CalculatePhase(values[i])) > error)
+			error = fabs(results[i] - CalculatePhase(values[i]));
+		if(error > maxError || isnan(error))
+			maxError = error;
+		if(!(error <= KERNEL_TOLERANCE))
+		{
+			if(failed++ < TEST_REPORT)
+				logmsg("\tPhase (%g, %g): %.17g expected %.17g\n", r1, i1, results[i], expected);
+		}
+	}
+	if(failed)
+		logmsg("\tPhases: %ld of %ld off by more than %g degrees\n", failed, count, KERNEL_TOLERANCE);
+	logmsg("\tPhases: max error %g degrees\n", maxError);
+	return failed == 0;
+}
+
+static int CheckAmplitudes(double *magnitudes, long int count, double *results)
+{
+	long int	failed = 0;
+	double		maxError = 0, MaxMagnitude = 0;
+
+	for(long int i = 0; i < count; i++)
+	{
+		if(magnitudes[i*TEST_STRIDE] > MaxMagnitude)
+			MaxMagnitude = magnitudes[i*TEST_STRIDE];
+		results[i*TEST_STRIDE+1] = 1.0;	// must not be touched
+	}
+
+	CalculateAmplitudesStrided(magnitudes, count, TEST_STRIDE, MaxMagnitude, results);
+	for(long int i = 0; i < count; i++)
+	{
+		double	magnitude = magnitudes[i*TEST_STRIDE];
+		double	result = results[i*TEST_STRIDE];
+		double	expected = NO_AMPLITUDE, error = 0;
+
+		if(magnitude != 0)
+			expected = 20*log10(magnitude/MaxMagnitude);
+		error = fabs(result - expected);
+		if(fabs(result - CalculateAmplitude(magnitude, MaxMagnitude)) > error)
+			error = fabs(result - CalculateAmplitude(magnitude, MaxMagnitude));
+		if(error > maxError || isnan(error))
+			maxError = error;
+		if(!(error <= KERNEL_TOLERANCE) || results[i*TEST_STRIDE+1] != 1.0)
+		{
+			if(failed++ < TEST_REPORT)
+				logmsg("\tAmplitude %.17g/%.17g: %.17g expected %.17g\n", magnitude, MaxMagnitude, result, expected);
+		}
+	}
+	if(failed)
+		logmsg("\tAmplitudes: %ld of %ld off by more than %g dBFS\n", failed, count, KERNEL_TOLERANCE);
+	logmsg("\tAmplitudes: max error %g dBFS\n", maxError);
+	return failed == 0;
+}
+
+static int CheckPCM24(long int count)
+{
+	long int	failed = 0;
+	uint8_t		*bytes = NULL;
+	int32_t		*samples = NULL;
+	const int32_t	edges[] = { 0, 1, -1, 0x7fffff, -0x800000, 0x400000, -0x400000 };
+
+	bytes = (uint8_t*)malloc(sizeof(uint8_t)*count*3);
+	samples = (int32_t*)malloc(sizeof(int32_t)*count);
+	if(!bytes || !samples)
+	{
+		logmsg("\tNot enough memory for PCM24\n");
+		free(bytes);
+		free(samples);
+		return 0;
+	}
+
+	for(long int i = 0; i < count; i++)
+	{
+		int32_t	value = 0;
+
+		if(i < (long int)(sizeof(edges)/sizeof(edges[0])))
+			value = edges[i];
+		else
+			value = (int32_t)(NextRandom() & 0xffffff) - 0x800000;
+		bytes[3*i] = value & 0xff;
+		bytes[3*i+1] = (value >> 8) & 0xff;
+		bytes[3*i+2] = (value >> 16) & 0xff;
+	}
+
+	DecodePCM24(bytes, count, samples);
+	for(long int i = 0; i < count; i++)
+	{
+		int32_t	expected = bytes[3*i] | (bytes[3*i+1] << 8) | (bytes[3*i+2] << 16);
+
+		if(expected & 0x800000)
+			expected -= 0x1000000;
+		if(samples[i] != expected)
+		{
+			if(failed++ < TEST_REPORT)
+				logmsg("\tPCM24 %02X %02X %02X: %d expected %d\n", bytes[3*i], bytes[3*i+1], bytes[3*i+2], samples[i], expected);
+		}
+	}
+	if(failed)
+		logmsg("\tPCM24: %ld of %ld decoded wrong\n", failed, count);
+
+	free(bytes);
+	free(samples);
+	return failed == 0;
+}
+
+typedef struct envelope_test_st {
+	sampleType	*samples;
+	long int	*first;
+	double		*minimum, *maximum;		// from the scalar set
+	double		*resultMin, *resultMax;
+} envelopeTest;
+
+static void ReleaseEnvelopeTest(envelopeTest *test)
+{
+	free(test->samples);
+	free(test->first);
+	free(test->minimum);
+	free(test->maximum);
+	free(test->resultMin);
+	free(test->resultMax);
+	memset(test, 0, sizeof(envelopeTest));
+}
+
+/*
+	Columns as PlotTimeDomain builds them, each spans first[c] to
+	first[c+1] both included. Many are a single sample apart or empty,
+	first[c] == first[c+1], and some are long enough to vectorize.
+*/
+static int CreateEnvelopeTest(envelopeTest *test)
+{
+	long int	numSamples = 0;
+
+	memset(test, 0, sizeof(envelopeTest));
+	test->first = (long int*)malloc(sizeof(long int)*(TEST_COLUMNS+1));
+	test->minimum = (double*)malloc(sizeof(double)*TEST_COLUMNS);
+	test->maximum = (double*)malloc(sizeof(double)*TEST_COLUMNS);
+	test->resultMin = (double*)malloc(sizeof(double)*TEST_COLUMNS);
+	test->resultMax = (double*)malloc(sizeof(double)*TEST_COLUMNS);
+	if(!test->first || !test->minimum || !test->maximum || !test->resultMin || !test->resultMax)
+	{
+		ReleaseEnvelopeTest(test);
+		return 0;
+	}
+
+	test->first[0] = 0;
+	for(long int c = 1; c <= TEST_COLUMNS; c++)
+	{
+		long int	width = 0;
+
+		switch(NextRandom() % 4)
+		{
+			case 0:
+				width = 0;
+				break;
+			case 1:
+				width = 1;
+				break;
+			case 2:
+				width = (long int)(NextRandom() % 8);
+				break;
+			default:
+				width = (long int)(NextRandom() % 200);
+				break;
+		}
+		test->first[c] = test->first[c-1] + width;
+	}
+
+	numSamples = test->first[TEST_COLUMNS] + 1;
+	test->samples = (sampleType*)malloc(sizeof(sampleType)*numSamples);
+	if(!test->samples)
+	{
+		ReleaseEnvelopeTest(test);
+		return 0;
+	}
+	for(long int i = 0; i < numSamples; i++)
+	{
+		switch(NextRandom() % 8)
+		{
+			case 0:
+				test->samples[i] = 0;
+				break;
+			case 1:
+				test->samples[i] = (sampleType)(NextRandom() % 2 ? 1.0 : -1.0);
+				break;
+			default:
+				test->samples[i] = (sampleType)((double)(NextRandom() >> 11)/9007199254740992.0*2.0 - 1.0);
+				break;
+		}
+	}
+
+	if(!UseKernelSet(GetKernelSetCount() - 1))
+	{
+		ReleaseEnvelopeTest(test);
+		return 0;
+	}
+	CalculateEnvelope(test->samples, test->first, TEST_COLUMNS, test->minimum, test->maximum);
+	return 1;
+}
+
+static int CheckEnvelope(envelopeTest *test)
+{
+	long int	failed = 0;
+
+	CalculateEnvelope(test->samples, test->first, TEST_COLUMNS, test->resultMin, test->resultMax);
+	for(long int c = 0; c < TEST_COLUMNS; c++)
+	{
+		if(test->resultMin[c] != test->minimum[c] || test->resultMax[c] != test->maximum[c])
+		{
+			if(failed++ < TEST_REPORT)
+				logmsg("\tEnvelope column %ld [%ld, %ld]: %g/%g expected %g/%g\n", c,
+					test->first[c], test->first[c+1], test->resultMin[c], test->resultMax[c],
+					test->minimum[c], test->maximum[c]);
+		}
+	}
+	if(failed)
+		logmsg("\tEnvelope: %ld of %d columns differ from the scalar path\n", failed, TEST_COLUMNS);
+	return failed == 0;
+}
+
+static int TestKernelSet(FFTWComplex *values, long int count, envelopeTest *envelope)
+{
+	int		passed = 1;
+	double	*magnitudes = NULL, *results = NULL;
+
+	magnitudes = (double*)malloc(sizeof(double)*count*TEST_STRIDE);
+	results = (double*)malloc(sizeof(double)*count*TEST_STRIDE);
+	if(!magnitudes || !results)
+	{
+		logmsg("\tNot enough memory\n");
+		free(magnitudes);
+		free(results);
+		return 0;
+	}
+
+	if(!CheckMagnitudes(values, count, results))
+		passed = 0;
+	if(!CheckPhases(values, count, results))
+		passed = 0;
+
+	// Spread the magnitudes with a stride, as in a Frequency array
+	for(long int i = 0; i < count; i++)
+	{
+		magnitudes[i*TEST_STRIDE] = CalculateMagnitude(values[i], TEST_SIZE);
+		magnitudes[i*TEST_STRIDE+1] = magnitudes[i*TEST_STRIDE+2] = -1.0;
+	}
+	if(!CheckAmplitudes(magnitudes, count, results))
+		passed = 0;
+	if(!CheckPCM24(count))
+		passed = 0;
+	if(!CheckEnvelope(envelope))
+		passed = 0;
+
+	free(magnitudes);
+	free(results);
+	return passed;
+}
+
+int main(int argc , char *argv[])
+{
+	int				failed = 0;
+	long int		count = 0;
+	FFTWComplex		*values = NULL;
+	envelopeTest	envelope;
+
+	count = EDGE_COUNT*EDGE_COUNT + 16 + TEST_RANDOM;
+	values = (FFTWComplex*)malloc(sizeof(FFTWComplex)*count);
+	if(!values)
+	{
+		logmsg("ERROR: Not enough memory\n");
+		return 1;
+	}
+
+	// The scalar set goes last, its envelopes are the reference
+	if(!CreateEnvelopeTest(&envelope))
+	{
+		logmsg("ERROR: Not enough memory\n");
+		free(values);
+		return 1;
+	}
+
+	for(int set = 0; set < GetKernelSetCount(); set++)
+	{
+		if(!UseKernelSet(set))
+		{
+			logmsg("- %s: not supported by this CPU, skipped\n", GetKernelSetName(set));
+			continue;
+		}
+
+		randomState = 0x2545F4914F6CDD1DULL;
+		count = FillSpectrum(values, count);
+		logmsg("* %s\n", GetKernelName());
+		if(TestKernelSet(values, count, &envelope))
+			logmsg("- %s: passed\n", GetKernelName());
+		else
+		{
+			logmsg("- %s: FAILED\n", GetKernelName());
+			failed++;
+		}
+	}
+
+	ReleaseEnvelopeTest(&envelope);
+	free(values);
+	return failed ? 1 : 0;
+}
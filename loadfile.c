@@ -31,12 +31,32 @@
 #include "cline.h"
 #include "flac.h"
 #include "freq.h"
+#include "samples.h"
 #include "loadfile.h"
 #include "profile.h"
 #include "sync.h"
+#include "threads.h"
+#include "kernels.h"
+#include "cache.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+	Decoding runs on its own thread while sync detection reads the
+	samples as they are published, the pulse train only needs the
+	first seconds of the file. If detection fails the decoder is
+	cancelled instead of finishing a file that will not be used.
+*/
 
 int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 {
+	audioLoader	loader;
+
 	*Signal = CreateAudioSignal(config);
 	if(!*Signal)
 		return 0;
@@ -44,75 +64,295 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 
 	logmsg("\n* Loading '%s' audio file %s\n", role == ROLE_REF ? "Reference" : "Comparison", fileName);
 
-	if(IsFlac(fileName))
+	memset(&loader, 0, sizeof(audioLoader));
+	loader.Signal = *Signal;
+	loader.fileName = fileName;
+	loader.config = config;
+	if(!OpenAudioFile(&loader))
 	{
-		struct	timespec	start, end;
+		UnmapAudioFile(&loader.map);
+		return 0;
+	}
 
-		if(config->clock)
-			clock_gettime(CLOCK_MONOTONIC, &start);
+	if(!StartAudioDecoder(&loader))
+		return 0;
+
+	if(!AdjustSignalValues(*Signal, config))
+	{
+		StopAudioDecoder(&loader, 1);
+		return 0;
+	}
+
+	sprintf((*Signal)->SourceFile, "%s", fileName);
 
+	if(!DetectSync(*Signal, config))
+	{
+		StopAudioDecoder(&loader, 1);
+		return 0;
+	}
+
+	return(StopAudioDecoder(&loader, 0));
+}
+
+// Reads the headers and allocates the sample store, nothing is decoded yet
+int OpenAudioFile(audioLoader *loader)
+{
+	AudioSignal	*Signal = loader->Signal;
+	parameters	*config = loader->config;
+
+	if(config->clock)
+		clock_gettime(CLOCK_MONOTONIC, &loader->start);
+
+	if(IsFlac(loader->fileName))
+	{
+		loader->isFlac = 1;
 		if(config->verbose) { logmsg(" - Decoding FLAC\n"); }
-		if(!FLACtoSignal(fileName, *Signal, config))
+		loader->ranges = FLACPrepare(loader->fileName, Signal, config);
+		if(!loader->ranges)
 		{
-			if(!flacErrorReported())
-				logmsg("\nERROR: Invalid FLAC file %s\n", fileName);
+			if(!flacErrorReported(Signal))
+				logmsg("\nERROR: Invalid FLAC file %s\n", loader->fileName);
 			return 0;
 		}
-		if(config->clock)
-		{
-			double	elapsedSeconds;
-			clock_gettime(CLOCK_MONOTONIC, &end);
-			elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
-			logmsg(" - clk: Decoding FLAC took %0.2fs\n", elapsedSeconds);
-		}
 	}
 	else
 	{
-		FILE	*file = NULL;
-
-		file = fopen(fileName, "rb");
-		if(!file)
+		if(!MapAudioFile(loader->fileName, &loader->map))
 		{
-			logmsg("\tERROR: Could not open 'Reference' file:\n\t\"%s\"\n", fileName);
+			logmsg("\tERROR: Could not open '%s' file:\n\t\"%s\"\n", Signal->role == ROLE_REF ? "Reference" : "Comparison", loader->fileName);
 			return 0;
 		}
 
-		if(!LoadWAVFile(file, *Signal, config, fileName))
+		if(!LoadWAVFile(&loader->map, Signal, config, &loader->wav))
+			return 0;
+		loader->ranges = (loader->wav.count + WAV_DECODE_CHUNK - 1)/WAV_DECODE_CHUNK;
+	}
+
+	if(!BeginSampleStream(&Signal->Samples, loader->ranges))
+	{
+		logmsg("\tERROR: Could not create sample stream\n");
+		return 0;
+	}
+	return 1;
+}
+
+void *AudioDecoderThread(void *data)
+{
+	audioLoader *loader = (audioLoader*)data;
+
+	// kept apart and replayed into the loading thread log once joined
+	SetThreadLogBuffer(&loader->log);
+	loader->result = DecodeAudioFile(loader);
+	SetThreadLogBuffer(NULL);
+	return NULL;
+}
+
+int DecodeAudioFile(audioLoader *loader)
+{
+	AudioSignal	*Signal = loader->Signal;
+	parameters	*config = loader->config;
+	int			ok = 0;
+
+	if(loader->isFlac)
+		ok = FLACDecode(loader->fileName, Signal, loader->ranges, config);
+	else
+		ok = DecodeWAVFile(&loader->wav, config);
+	FinishSampleStream(&Signal->Samples, !ok);
+
+	if(ok && config->clock)
+	{
+		double			elapsedSeconds;
+		struct timespec	end;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&loader->start);
+		if(loader->isFlac)
+			logmsg(" - clk: Decoding FLAC took %0.2fs (%0.1f MB/s of PCM)\n", elapsedSeconds,
+				elapsedSeconds > 0 ? Signal->numSamples*Signal->bytesPerSample/(1024.0*1024.0)/elapsedSeconds : 0);
+		else
+			logmsg(" - clk: Loading Audio took %0.2fs (%0.1f MB/s)\n", elapsedSeconds,
+				elapsedSeconds > 0 ? Signal->header.data.DataSize/(1024.0*1024.0)/elapsedSeconds : 0);
+	}
+	return ok;
+}
+
+int StartAudioDecoder(audioLoader *loader)
+{
+	InitLogBuffer(&loader->log);
+	if(pthread_create(&loader->thread, NULL, AudioDecoderThread, loader) == 0)
+	{
+		loader->started = 1;
+		return 1;
+	}
+
+	// No thread, decode everything before sync detection as before
+	loader->result = DecodeAudioFile(loader);
+	if(!loader->result)
+		return(StopAudioDecoder(loader, 0));
+	return 1;
+}
+
+// Waits for the decoder, cancel when its samples are no longer needed
+int StopAudioDecoder(audioLoader *loader, int cancel)
+{
+	AudioSignal	*Signal = loader->Signal;
+
+	if(loader->started)
+	{
+		if(cancel)
+			CancelSampleStream(&Signal->Samples);
+		pthread_join(loader->thread, NULL);
+		loader->started = 0;
+		ReplayLogBuffer(&loader->log);
+	}
+	EndSampleStream(&Signal->Samples);
+	UnmapAudioFile(&loader->map);
+
+	if(cancel)
+		return 0;
+
+	if(loader->isFlac)
+	{
+		if(!FLACFinish(Signal, loader->result))
 		{
-			fclose(file);
+			if(!flacErrorReported(Signal))
+				logmsg("\nERROR: Invalid FLAC file %s\n", loader->fileName);
 			return 0;
 		}
+		return 1;
+	}
+
+	if(!loader->result)
+	{
+		logmsg("ERROR: Unsupported audio format, samples were not loaded\n");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	The WAV file is mapped read only and the RIFF chunks are parsed in
+	place, the sample data is then decoded straight from the mapping
+	into the sample store. Platforms without mmap read the whole file
+	into memory instead.
+*/
+
+int MapAudioFile(char *fileName, mappedFile *map)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	FILE	*file = NULL;
+	long	size = 0;
+#else
+	int			fd = -1;
+	struct stat	st;
+#endif
+
+	if(!map)
+		return 0;
+
+	memset(map, 0, sizeof(mappedFile));
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	file = fopen(fileName, "rb");
+	if(!file)
+		return 0;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if(size <= 0)
+	{
 		fclose(file);
-		file = NULL;
+		return 0;
 	}
 
-	if(!AdjustSignalValues(*Signal, config))
+	map->data = (uint8_t*)malloc(sizeof(uint8_t)*size);
+	if(!map->data)
+	{
+		fclose(file);
 		return 0;
+	}
 
-	sprintf((*Signal)->SourceFile, "%s", fileName);
+	if(fread(map->data, 1, size, file) != (size_t)size)
+	{
+		free(map->data);
+		map->data = NULL;
+		fclose(file);
+		return 0;
+	}
+	fclose(file);
+	map->size = size;
+	map->mapped = 0;
+#else
+	fd = open(fileName, O_RDONLY);
+	if(fd == -1)
+		return 0;
 
-	if(!DetectSync(*Signal, config))
-		return 0;	
+	if(fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	map->data = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map->data == MAP_FAILED)
+	{
+		map->data = NULL;
+		return 0;
+	}
+	madvise(map->data, st.st_size, MADV_SEQUENTIAL);
+	map->size = st.st_size;
+	map->mapped = 1;
+#endif
 	return 1;
 }
 
-// no endianess considerations, PCM in RIFF is little endian and this code is little endian
-void ConvertByteArrayToIEEESample(const void *buf, void *target)
+void UnmapAudioFile(mappedFile *map)
 {
-	const unsigned char *b = (const unsigned char *)buf;
-	unsigned char *t = (unsigned char *)target;
+	if(!map || !map->data)
+		return;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	free(map->data);
+#else
+	if(map->mapped)
+		munmap(map->data, map->size);
+	else
+		free(map->data);
+#endif
+	memset(map, 0, sizeof(mappedFile));
+}
+
+// fread equivalent over the mapping, returns the bytes copied
+size_t ReadMapped(mappedFile *map, size_t *offset, void *dest, size_t size)
+{
+	if(*offset >= map->size)
+		return 0;
+	if(*offset + size > map->size)
+		size = map->size - *offset;
+
+	memcpy(dest, map->data + *offset, size);
+	*offset += size;
+	return size;
+}
 
-	t[0] = b[0];
-	t[1] = b[1];
-	t[2] = b[2];
-	t[3] = b[3];
+// fseek SEEK_CUR equivalent, clamped to the mapping
+void SeekMapped(mappedFile *map, size_t *offset, long int delta)
+{
+	if(delta < 0 && (size_t)(-delta) > *offset)
+		*offset = 0;
+	else if(delta > 0 && *offset + delta > map->size)
+		*offset = map->size;
+	else
+		*offset += delta;
 }
 
-int CheckFactChunk(FILE *file, AudioSignal *Signal)
+int CheckFactChunk(mappedFile *map, size_t *offset, AudioSignal *Signal)
 {
 	size_t				bytesRead = 0;
 
-	bytesRead = fread(&Signal->fact, 1, sizeof(fact_ck), file);
+	bytesRead = ReadMapped(map, offset, &Signal->fact, sizeof(fact_ck));
 	if(bytesRead == sizeof(fact_ck))
 		Signal->factExists = 1;
 	else
@@ -135,21 +375,40 @@ int CheckFactChunk(FILE *file, AudioSignal *Signal)
 	return 1;
 }
 
-int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileName)
+// no endianess considerations, PCM in RIFF is little endian and this code is little endian
+int DecodeWAVChunk(long int chunk, int thread, void *data)
 {
-	int					found = 0, samplesLoaded = 0;
-	size_t				bytesRead = 0;
-	struct timespec		start, end;
-	long int			samplePos = 0, srcPos = 0, byteOffset = 0;
-	uint8_t				*fileBytes = NULL;
+	wavDecodeJobs	*wd = (wavDecodeJobs*)data;
+	long int		first = 0, count = 0;
+	const uint8_t	*bytes = NULL;
 
-	if(config->clock)
-		clock_gettime(CLOCK_MONOTONIC, &start);
+	if(SampleStreamCancelled(wd->store))
+		return 0;
 
-	if(!file)
+	first = chunk*WAV_DECODE_CHUNK;
+	count = WAV_DECODE_CHUNK;
+	if(first + count > wd->count)
+		count = wd->count - first;
+
+	bytes = wd->bytes + first*wd->bytesPerSample;
+	if(wd->bytesPerSample == 3)
+		DecodePCM24(bytes, count, ((int32_t*)wd->store->data) + first);
+	else  // 16 and 32 bit PCM and IEEE float are stored as they are in the file
+		memcpy((uint8_t*)wd->store->data + first*wd->bytesPerSample, bytes, count*wd->bytesPerSample);
+	PublishSamples(wd->store, chunk, first + count);
+	return 1;
+}
+
+// Parses the RIFF chunks and allocates the store, DecodeWAVFile fills it
+int LoadWAVFile(mappedFile *map, AudioSignal *Signal, parameters *config, wavDecodeJobs *wd)
+{
+	int					found = 0;
+	size_t				offset = 0;
+
+	if(!map || !map->data || !wd)
 		return 0;
 
-	if(fread(&Signal->header.riff, 1, sizeof(riff_hdr), file) != sizeof(riff_hdr))
+	if(ReadMapped(map, &offset, &Signal->header.riff, sizeof(riff_hdr)) != sizeof(riff_hdr))
 	{
 		logmsg("\tERROR: Invalid Audio file. File too small. (RIFF not found)\n");
 		return(0);
@@ -175,21 +434,21 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 	{
 		sub_chunk	schunk;
 
-		if(fread(&schunk, 1, sizeof(sub_chunk), file) != sizeof(sub_chunk))
+		if(ReadMapped(map, &offset, &schunk, sizeof(sub_chunk)) != sizeof(sub_chunk))
 		{
 			logmsg("\tERROR: Invalid Audio file. File too small. (Sub chunk not found)\n");
 			return(0);
 		}
 		if(strncmp((char*)schunk.chunkID, "fmt", 3) != 0)
-			fseek(file, schunk.Size*sizeof(uint8_t), SEEK_CUR);
+			SeekMapped(map, &offset, schunk.Size*sizeof(uint8_t));
 		else
 		{
-			fseek(file, -1*(long int)sizeof(sub_chunk), SEEK_CUR);
+			SeekMapped(map, &offset, -1*(long int)sizeof(sub_chunk));
 			found = 1;
 		}
 	}while(!found);
 
-	if(fread(&Signal->header.fmt, 1, sizeof(fmt_hdr), file) != sizeof(fmt_hdr))
+	if(ReadMapped(map, &offset, &Signal->header.fmt, sizeof(fmt_hdr)) != sizeof(fmt_hdr))
 	{
 		logmsg("\tERROR: Invalid Audio file. File too small. (fmt chunk not found)\n");
 		return(0);
@@ -201,7 +460,7 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 			Signal->fmtType = FMT_TYPE_1_SIZE;
 			break;
 		case FMT_TYPE_2:
-			if(fread(&Signal->fmtExtra, 1, sizeof(fmt_hdr_ext1), file) != sizeof(fmt_hdr_ext1))
+			if(ReadMapped(map, &offset, &Signal->fmtExtra, sizeof(fmt_hdr_ext1)) != sizeof(fmt_hdr_ext1))
 			{
 				logmsg("\tERROR: Invalid Audio file. File too small. (fmt chunk ext1)\n");
 				return(0);
@@ -209,7 +468,7 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 			Signal->fmtType = FMT_TYPE_2_SIZE;
 			break;
 		case FMT_TYPE_3:
-			if(fread(&Signal->fmtExtra, 1, sizeof(fmt_hdr_ext2), file) != sizeof(fmt_hdr_ext2))
+			if(ReadMapped(map, &offset, &Signal->fmtExtra, sizeof(fmt_hdr_ext2)) != sizeof(fmt_hdr_ext2))
 			{
 				logmsg("\tERROR: Invalid Audio file. File too small. (fmt chunk ext2)\n");
 				return(0);
@@ -218,7 +477,7 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 			break;
 		default:
 			if(Signal->header.fmt.Subchunk1Size + 8 > sizeof(fmt_hdr))  // Add the fmt and chunksize length: 8 bytes
-				fseek(file, Signal->header.fmt.Subchunk1Size + 8 - sizeof(fmt_hdr), SEEK_CUR);
+				SeekMapped(map, &offset, Signal->header.fmt.Subchunk1Size + 8 - sizeof(fmt_hdr));
 			if(config->verbose)
 				logmsg("- WARNING: Unknown fmt chunk size: %lu\n", Signal->header.fmt.Subchunk1Size);
 			break;
@@ -230,16 +489,16 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 	{
 		sub_chunk	schunk;
 
-		if(fread(&schunk, 1, sizeof(sub_chunk), file) != sizeof(sub_chunk))
+		if(ReadMapped(map, &offset, &schunk, sizeof(sub_chunk)) != sizeof(sub_chunk))
 		{
 			logmsg("\tERROR: Invalid Audio file. File too small. (data chunk not found)\n");
 			return(0);
 		}
 		if(strncmp((char*)schunk.chunkID, "data", 4) != 0)
-			fseek(file, schunk.Size*sizeof(uint8_t), SEEK_CUR);
+			SeekMapped(map, &offset, schunk.Size*sizeof(uint8_t));
 		else
 		{
-			fseek(file, -1*(long int)sizeof(sub_chunk), SEEK_CUR);
+			SeekMapped(map, &offset, -1*(long int)sizeof(sub_chunk));
 			found = 1;
 		}
 
@@ -249,16 +508,16 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 			if(strncmp((char*)schunk.chunkID, "fact", 4) == 0)
 			{
 				// rewind the block and read it
-				fseek(file, -1*(long int)(sizeof(sub_chunk)+schunk.Size*sizeof(uint8_t)), SEEK_CUR);
+				SeekMapped(map, &offset, -1*(long int)(sizeof(sub_chunk)+schunk.Size*sizeof(uint8_t)));
 
 				// fact chunk read
-				if(!CheckFactChunk(file, Signal))
+				if(!CheckFactChunk(map, &offset, Signal))
 					return 0;
 			}
 		}
 	}while(!found);
 
-	if(fread(&Signal->header.data, 1, sizeof(data_hdr), file) != sizeof(data_hdr))
+	if(ReadMapped(map, &offset, &Signal->header.data, sizeof(data_hdr)) != sizeof(data_hdr))
 	{
 		logmsg("\tERROR: Invalid Audio file. File too small. 5\n");
 		return(0);
@@ -301,30 +560,24 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 			logmsg("\tWARNING: Header byte count and fact chunk sample count are not consistent\n");
 	}
 
-	byteOffset = ftell(file);
-	Signal->SamplesStart = byteOffset;
+	Signal->SamplesStart = offset;
 
-	fileBytes = (uint8_t*)malloc(sizeof(uint8_t)*Signal->header.data.DataSize);
-	if(!fileBytes)
+	if(offset + Signal->header.data.DataSize > map->size)
 	{
-		logmsg("\tERROR: All Chunks malloc failed! [Signal->header.data.DataSize]\n");
-		return(0);
-	}
-
-	memset(fileBytes, 0, sizeof(uint8_t)*Signal->header.data.DataSize);
-
-	bytesRead = fread(fileBytes, 1, sizeof(uint8_t)*Signal->header.data.DataSize, file);
-	if(bytesRead != sizeof(uint8_t)*Signal->header.data.DataSize)
-	{
-		free(fileBytes);
 		logmsg("\tERROR: Corrupt RIFF Header\n\tCould not read the whole sample block from disk to RAM.\n\tBytes Read: %ld Expected: %ld\n",
-			bytesRead, sizeof(int8_t)*Signal->header.data.DataSize);
+			(long int)(map->size - offset), sizeof(int8_t)*Signal->header.data.DataSize);
 		return(0);
 	}
 
+	memset(wd, 0, sizeof(wavDecodeJobs));
+	wd->bytes = map->data + offset;
+	wd->count = Signal->numSamples;
+	wd->bytesPerSample = Signal->bytesPerSample;
+	SeekMapped(map, &offset, Signal->header.data.DataSize);
+
 	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_EXTENSIBLE)
 	{
-		if(!CheckFactChunk(file, Signal))
+		if(!CheckFactChunk(map, &offset, Signal))
 			return 0;
 	}
 
@@ -335,92 +588,38 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileN
 		return(0);
 	}
 
-	// Convert samples to internal double ones
-	Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples);
-	if(!Signal->Samples)
+	// Keep samples in their native width, blocks are converted when read
+	if(!AllocateSamples(&Signal->Samples,
+			SampleFormatForBits(Signal->header.fmt.bitsPerSample, Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT),
+			Signal->numSamples, Signal->AudioChannels))
 	{
-		free(fileBytes);
 		logmsg("\tERROR: Internal sample array malloc failed! [Signal->numSamples]\n");
 		return(0);
 	}
-	memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples);
-
-	// no endianess considerations, PCM in RIFF is little endian and this code is little endian
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_PCM)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			int32_t	sample = 0;
-			int8_t	signSample = 0;
-	
-			switch(Signal->bytesPerSample)
-			{
-				case 2:
-					signSample = fileBytes[srcPos+1];
-					if(signSample < 0)
-						sample = 0xffff0000;
-					sample |= (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				case 3:
-					signSample = fileBytes[srcPos+2];
-					if(signSample < 0)
-						sample = 0xff000000;
-					sample |= (fileBytes[srcPos+2] << 16) | (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				case 4:
-					sample = (fileBytes[srcPos+3] << 24) | (fileBytes[srcPos+2] << 16) | (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				default:
-					logmsg("ERROR: Unsupported audio format (bits per sample)\n");
-					free(fileBytes);
-					return 0;
-			}
-			srcPos += Signal->bytesPerSample;
-	
-			Signal->Samples[samplePos] = (double)sample;
-		}
-
-		samplesLoaded = 1;
-	}
-
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			float	sample = 0;
-	
-			ConvertByteArrayToIEEESample(fileBytes+srcPos, &sample);
-			Signal->Samples[samplePos] = (double)sample;
-			srcPos += 4;
-		}
-
-		samplesLoaded = 1;
-	}
+	wd->store = &Signal->Samples;
+	return 1;
+}
 
-	free(fileBytes);
-	fileBytes = NULL;
+// Chunks are independent, so they are decoded across threads
+int DecodeWAVFile(wavDecodeJobs *wd, parameters *config)
+{
+	long int	jobs = 0;
 
-	if(!samplesLoaded)
+	jobs = (wd->count + WAV_DECODE_CHUNK - 1)/WAV_DECODE_CHUNK;
+	for(long int i = 0; i < jobs; i++)
 	{
-		logmsg("ERROR: Unsupported audio format, samples were not loaded\n");
-		return 0;
-	}
+		long int first = i*WAV_DECODE_CHUNK;
 
-	if(config->clock)
-	{
-		double	elapsedSeconds;
-		clock_gettime(CLOCK_MONOTONIC, &end);
-		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
-		logmsg(" - clk: Loading Audio took %0.2fs\n", elapsedSeconds);
+		SetStreamRange(wd->store, i, first, first + WAV_DECODE_CHUNK > wd->count ? wd->count : first + WAV_DECODE_CHUNK);
 	}
-
-	return 1;
+	return(RunParallelJobs(jobs, GetThreadCount(jobs, config), DecodeWAVChunk, wd));
 }
 
 int DetectSync(AudioSignal *Signal, parameters *config)
 {
 	struct	timespec	start, end;
 	double				seconds = 0;
+	int					cached = 0;
 
 	Signal->framerate = GetMSPerFrame(Signal, config);
 	if(GetFirstSyncIndex(config) != NO_INDEX && !config->noSyncProfile)
@@ -428,11 +627,16 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 		if(config->clock)
 			clock_gettime(CLOCK_MONOTONIC, &start);
 
+		cached = LoadSyncCache(Signal, config);
+
 		/* Find the start offset */
 		if(config->verbose) { 
 			logmsg(" - Sync pulse train: "); 
 		}
-		Signal->startOffset = DetectPulse(Signal->Samples, Signal->header, Signal->role, config);
+		if(cached)
+			Signal->startOffset = Signal->syncCache->startOffset;
+		else
+			Signal->startOffset = DetectPulse(&Signal->Samples, Signal->header, Signal->role, config);
 		if(Signal->startOffset == -1)
 		{
 			int format = 0;
@@ -449,7 +653,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 			if((format != 0 || config->smallFile) && config->types.syncCount != 1)
 				logmsg(" - This signal is configured as '%s'%s, check if that is not the issue.\n", 
 							config->types.SyncFormat[format].syncName, config->smallFile ? " and is smaller than expected" : "");
-			if(config->trimmingNeeded)
+			if(config->trimmingNeeded[Signal->role])
 				logmsg(" - Leading/tailing silence too long, if sync detection fails please consider trimming\n");
 			return 0;
 		}
@@ -472,7 +676,10 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 			if(config->verbose) { 
 				logmsg("\t to");
 			}
-			Signal->endOffset = DetectEndPulse(Signal->Samples, Signal->startOffset, Signal->header, Signal->role, config);
+			if(cached)
+				Signal->endOffset = Signal->syncCache->endOffset;
+			else
+				Signal->endOffset = DetectEndPulse(&Signal->Samples, Signal->startOffset, Signal->header, Signal->role, config);
 			if(Signal->endOffset == -1)
 			{
 				int format = 0;
@@ -528,6 +735,14 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 					return 0;
 				}
 			}
+
+			if(Signal->syncCache && (!cached || Signal->syncCache->framerate != Signal->framerate))
+			{
+				Signal->syncCache->startOffset = Signal->startOffset;
+				Signal->syncCache->endOffset = Signal->endOffset;
+				Signal->syncCache->framerate = Signal->framerate;
+				SaveSyncCache(Signal, config);
+			}
 		}
 		else
 		{
@@ -554,7 +769,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				/* Find the start offset */
 				
 				logmsg(" - Detecting audio signal: ");
-				Signal->startOffset = DetectSignalStart(Signal->Samples, Signal->header, 0, 0, 0, NULL, NULL, config);
+				Signal->startOffset = DetectSignalStart(&Signal->Samples, Signal->header, 0, 0, 0, NULL, NULL, config);
 				if(Signal->startOffset == -1)
 				{
 					logmsg("\nERROR: Starting position was not detected.\n");
@@ -628,7 +843,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 
 					for(ac = 0; ac < Signal->AudioChannels; ac++)
 					{
-						if(Signal->Samples[i+ac] != 0)
+						if(GetSample(&Signal->Samples, i+ac) != 0)
 						{
 							startOffset = i;
 							found = 1;
@@ -711,14 +926,14 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 	{
 		logmsg(" - WARNING: Estimated file length is shorter than the expected %g seconds\n",
 				GetSignalTotalDuration(Signal->framerate, config));
-		config->smallFile |= Signal->role;
+		SetRoleFlag(config->smallFile, Signal->role);
 	}
 
 	if(config->usesStereo && Signal->AudioChannels != 2)
 	{
 		if(!config->allowStereoVsMono)
 		{
-			config->stereoNotFound |= Signal->role;
+			SetRoleFlag(config->stereoNotFound, Signal->role);
 			logmsg(" - ERROR: Profile requests Stereo and file is Mono\n");
 			return 0;
 		}
@@ -729,7 +944,6 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 
 int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config)
 {
-	double		*sampleBuffer = NULL;
 	double		signalLengthSeconds = 0;
 	long int	signalLengthFrames = 0, signalLengthSamples = 0;
 
@@ -758,15 +972,6 @@ int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos,
 				SamplesForDisplay(signalLengthSamples, Signal->AudioChannels));
 	}
 
-	sampleBuffer = (double*)malloc(sizeof(double)*signalLengthSamples);
-	if(!sampleBuffer)
-	{
-		logmsg("\tERROR: Out of memory [signalLengthSamples]\n");
-		return 0;
-	}
-
-	memset(sampleBuffer, 0, sizeof(double)*signalLengthSamples);
-
 	/*
 	if(config->verbose)
 	{
@@ -783,17 +988,24 @@ int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos,
 	}
 	*/
 
-	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(double));
-	memset(Signal->Samples + pos + signalStartOffset, 0, signalLengthSamples*sizeof(double));
-	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(double));
+	// Samples are moved in their native format, then the vacated tail is cleared
+	if(signalLengthSamples > 0)
+	{
+		long int zeroStart = 0;
 
-	free(sampleBuffer);
+		if(!MoveSamples(&Signal->Samples, pos, pos + signalStartOffset, signalLengthSamples))
+		{
+			logmsg("\tERROR: Invalid Internal Sync block move\n");
+			return 0;
+		}
+		zeroStart = pos + (signalStartOffset > signalLengthSamples ? signalStartOffset : signalLengthSamples);
+		ZeroSamples(&Signal->Samples, zeroStart, pos + signalStartOffset + signalLengthSamples - zeroStart);
+	}
 	return 1;
 }
 
 int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, long int internalSyncToneSize, parameters *config)
 {
-	double		*sampleBuffer = NULL;
 	double		signalLengthSeconds = 0;
 	long int	signalLengthFrames = 0, signalLengthSamples = 0;
 
@@ -821,14 +1033,6 @@ int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos,
 				SamplesForDisplay(signalLengthSamples, Signal->AudioChannels));
 	}
 
-	sampleBuffer = (double*)malloc(sizeof(double)*signalLengthSamples);
-	if(!sampleBuffer)
-	{
-		logmsg("\tERROR: Out of memory while performing internal Sync adjustments. [signalLengthSamples]\n");
-		return 0;
-	}
-	memset(sampleBuffer, 0, sizeof(double)*signalLengthSamples);
-
 	/*
 	if(config->verbose)
 	{
@@ -845,11 +1049,12 @@ int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos,
 	}
 	*/
 
-	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(double));
-	memset(Signal->Samples + pos, 0, (Signal->numSamples-pos)*sizeof(double));
-	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(double));
-
-	free(sampleBuffer);
+	if(signalLengthSamples > 0 && !MoveSamples(&Signal->Samples, pos, pos + signalStartOffset, signalLengthSamples))
+	{
+		logmsg("\tERROR: Invalid Internal Sync block move\n");
+		return 0;
+	}
+	ZeroSamples(&Signal->Samples, pos + signalLengthSamples, Signal->numSamples - (pos + signalLengthSamples));
 	return 1;
 }
 
@@ -878,16 +1083,20 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	syncLengthSamples = SecondsToSamples(Signal->header.fmt.SamplesPerSec, syncLenSeconds, Signal->AudioChannels, Signal->bytesPerSample, NULL, NULL, NULL);
 
 	// we send , syncLengthSamples/2 since it is half silence half pulse
-	internalSyncOffset = DetectSignalStart(Signal->Samples, Signal->header, pos, syncToneFreq, syncLengthSamples/2, &endPulseSamples, &toleranceIssue, config);
-	if(internalSyncOffset == -1)
+	if(!GetCachedInternalSync(Signal, element, pos, &internalSyncOffset, &endPulseSamples, &toleranceIssue))
 	{
-		logmsg("\tERROR: No signal found while in internal sync detection.\n");
-		return 0;  // Was warning with -1
+		internalSyncOffset = DetectSignalStart(&Signal->Samples, Signal->header, pos, syncToneFreq, syncLengthSamples/2, &endPulseSamples, &toleranceIssue, config);
+		if(internalSyncOffset == -1)
+		{
+			logmsg("\tERROR: No signal found while in internal sync detection.\n");
+			return 0;  // Was warning with -1
+		}
+		StoreCachedInternalSync(Signal, element, pos, internalSyncOffset, endPulseSamples, toleranceIssue, config);
 	}
 	*syncinternal = 1;
 
 	if(toleranceIssue)
-		config->internalSyncTolerance |= Signal->role;
+		SetRoleFlag(config->internalSyncTolerance, Signal->role);
 	
 	pulseLengthSamples = endPulseSamples - internalSyncOffset;
 	internalSyncOffset -= pos;
@@ -930,19 +1139,19 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 				return 0;
 		
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos), 
+					&Signal->Samples, pos, 
 					internalSyncOffset, 0, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset), 
+					&Signal->Samples, pos + internalSyncOffset, 
 					pulseLengthSamples, 1, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset + pulseLengthSamples), 
+					&Signal->Samples, pos + internalSyncOffset + pulseLengthSamples, 
 					syncLengthSamples/2, 2, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
@@ -1015,19 +1224,19 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 				return 0;
 		
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos), 
+					&Signal->Samples, pos, 
 					internalSyncOffset, 0, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset), 
+					&Signal->Samples, pos + internalSyncOffset, 
 					pulseLengthSamples, 1, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset + pulseLengthSamples), 
+					&Signal->Samples, pos + internalSyncOffset + pulseLengthSamples, 
 					silenceLengthSamples/2, 2, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
@@ -1035,7 +1244,7 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 			/*
 			oneframe = SecondsToBytes(Signal->header.fmt.SamplesPerSec, FramesToSeconds(1, config->referenceFramerate), Signal->AudioChannels, NULL, NULL, NULL);
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + signalStart), 
+					&Signal->Samples, pos + signalStart, 
 					(oneframe*2), 3, 
 					Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
@@ -1056,12 +1265,12 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	return 1;
 }
 
-int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *samples, size_t size, int slotForSamples, long samplerate, double *window, int AudioChannels, parameters *config)
+int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, sampleStore *store, long int pos, size_t size, int slotForSamples, long samplerate, sampleType *window, int AudioChannels, parameters *config)
 {
 	char			channel = 0;
 	long			stereoSignalSize = 0;	
 	long			i = 0, monoSignalSize = 0;
-	double			*signal = NULL, *window_samples = NULL;
+	sampleType			*signal = NULL, *window_samples = NULL, *samples = NULL;
 	
 	if(!AudioArray)
 	{
@@ -1090,23 +1299,38 @@ int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *sa
 	stereoSignalSize = (long)size;
 	monoSignalSize = stereoSignalSize/AudioChannels;	 /* 4 is 2 16 bit values */
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	signal = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 	if(!signal)
 	{
 		logmsg("Not enough memory [monoSignalSize]\n");
 		return(0);
 	}
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
+	memset(signal, 0, sizeof(sampleType)*(monoSignalSize+1));
+
+	samples = (sampleType*)malloc(sizeof(sampleType)*(stereoSignalSize+1));
+	if(!samples)
+	{
+		logmsg("Not enough memory [samples]\n");
+		free(signal);
+		return(0);
+	}
+	if(!CopySamples(store, pos, stereoSignalSize, samples))
+	{
+		logmsg("ERROR: Could not convert samples for plotting\n");
+		free(samples);
+		free(signal);
+		return(0);
+	}
 
 	if(config->plotAllNotesWindowed && window)
 	{
-		window_samples = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+		window_samples = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 		if(!window_samples)
 		{
 			logmsg("Not enough memory [window_samples]\n");
 			return(0);
 		}
-		memset(window_samples, 0, sizeof(double)*(monoSignalSize+1));
+		memset(window_samples, 0, sizeof(sampleType)*(monoSignalSize+1));
 	}
 
 	if(AudioChannels == 1)
@@ -1123,6 +1347,7 @@ int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *sa
 		if(channel == CHANNEL_STEREO)
 			signal[i] = (double)((double)samples[i*AudioChannels]+(double)samples[i*AudioChannels+1])/2.0;
 	}
+	free(samples);
 
 	AudioArray->internalSync[slotForSamples].samples = signal;
 	AudioArray->internalSync[slotForSamples].size = monoSignalSize;
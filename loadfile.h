@@ -28,8 +28,48 @@
 #ifndef MDFLOADFILE_H
 #define MDFLOADFILE_H
 
+#include <pthread.h>
+
+#define WAV_DECODE_CHUNK	1048576
+
+typedef struct mapped_file_st {
+	uint8_t		*data;
+	size_t		size;
+	int			mapped;
+} mappedFile;
+
+typedef struct wav_decode_jobs_st {
+	const uint8_t	*bytes;
+	sampleStore		*store;
+	long int		count;
+	int				bytesPerSample;
+} wavDecodeJobs;
+
+typedef struct audio_loader_st {
+	AudioSignal		*Signal;
+	char			*fileName;
+	parameters		*config;
+	int				isFlac;
+	int				ranges;
+	mappedFile		map;
+	wavDecodeJobs	wav;
+	logBuffer		log;
+	struct timespec	start;
+	pthread_t		thread;
+	int				started;
+	int				result;
+} audioLoader;
+
 int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config);
-int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config, char *fileName);
+int OpenAudioFile(audioLoader *loader);
+int StartAudioDecoder(audioLoader *loader);
+int DecodeAudioFile(audioLoader *loader);
+void *AudioDecoderThread(void *data);
+int StopAudioDecoder(audioLoader *loader, int cancel);
+int LoadWAVFile(mappedFile *map, AudioSignal *Signal, parameters *config, wavDecodeJobs *wd);
+int DecodeWAVFile(wavDecodeJobs *wd, parameters *config);
+int MapAudioFile(char *fileName, mappedFile *map);
+void UnmapAudioFile(mappedFile *map);
 int DetectSync(AudioSignal *Signal, parameters *config);
 int AdjustSignalValues(AudioSignal *Signal, parameters *config);
 
@@ -37,6 +77,6 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config);
 int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config);
 int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, long int internalSyncToneSize, parameters *config);
 int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int *syncinternal, long int *advanceBytes, int knownLength, parameters *config);
-int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *samples, size_t size, int slotForSamples, long samplerate, double *window, int AudioChannels, parameters *config);
+int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, sampleStore *store, long int pos, size_t size, int slotForSamples, long samplerate, sampleType *window, int AudioChannels, parameters *config);
 
 #endif
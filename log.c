@@ -38,12 +38,26 @@
 #endif
 #endif
 
+#include <pthread.h>
+
 #define	CONSOLE_ENABLED		1
 
+#define	LOG_CONSOLE			'c'
+#define	LOG_FILEONLY		'f'
+#define	LOG_BUFFER_CHUNK	8192
+
 int do_log = 0;
 char log_file[T_BUFFER_SIZE];
 FILE *logfile = NULL;
 
+/*
+	Output is serialized with a lock. Threads that process a
+	whole signal can bind their own buffer instead, so that
+	each signal log is kept together and flushed in order.
+*/
+pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+__thread logBuffer *threadLog = NULL;
+
 void EnableLog() { do_log = CONSOLE_ENABLED; }
 void DisableLog() { do_log = 0; }
 int IsLogEnabled() { return do_log; }
@@ -54,10 +68,53 @@ void initLog()
 	logfile = NULL;
 }
 
+int AppendLogBuffer(logBuffer *lb, char type, char *fmt, va_list arguments)
+{
+	va_list		arguments_len;
+	long int	len = 0;
+
+	va_copy(arguments_len, arguments);
+	len = vsnprintf(NULL, 0, fmt, arguments_len);
+	va_end(arguments_len);
+	if(len < 0)
+		return 0;
+
+	// type, text and terminator
+	if(lb->used + len + 2 > lb->size)
+	{
+		char		*text = NULL;
+		long int	size = 0;
+
+		size = lb->size + len + 2 + LOG_BUFFER_CHUNK;
+		text = (char*)realloc(lb->text, sizeof(char)*size);
+		if(!text)
+			return 0;
+		lb->text = text;
+		lb->size = size;
+	}
+
+	lb->text[lb->used++] = type;
+	vsnprintf(lb->text + lb->used, len + 1, fmt, arguments);
+	lb->used += len + 1;
+	return 1;
+}
+
 void logmsg(char *fmt, ... )
 {
 	va_list arguments;
 
+	if(threadLog)
+	{
+		int buffered = 0;
+
+		va_start(arguments, fmt);
+		buffered = AppendLogBuffer(threadLog, LOG_CONSOLE, fmt, arguments);
+		va_end(arguments);
+		if(buffered)
+			return;
+	}
+
+	pthread_mutex_lock(&logLock);
 	va_start(arguments, fmt);
 	vprintf(fmt, arguments);
 	fflush(stdout);  // output to Front end ASAP
@@ -74,21 +131,98 @@ void logmsg(char *fmt, ... )
 		fflush(logfile);
 #endif
 	}
+	pthread_mutex_unlock(&logLock);
 }
 
 void logmsgFileOnly(char *fmt, ... )
 {
-	if(do_log && logfile)
+	va_list arguments;
+
+	// buffers can be flushed once the log file is open
+	if(do_log && threadLog)
 	{
-		va_list arguments;
+		int buffered = 0;
+
+		va_start(arguments, fmt);
+		buffered = AppendLogBuffer(threadLog, LOG_FILEONLY, fmt, arguments);
+		va_end(arguments);
+		if(buffered)
+			return;
+	}
 
+	if(do_log && logfile)
+	{
+		pthread_mutex_lock(&logLock);
 		va_start(arguments, fmt);
 		vfprintf(logfile, fmt, arguments);
 		va_end(arguments);
 #ifdef DEBUG
 		fflush(logfile);
 #endif
+		pthread_mutex_unlock(&logLock);
+	}
+}
+
+void InitLogBuffer(logBuffer *lb)
+{
+	lb->text = NULL;
+	lb->used = 0;
+	lb->size = 0;
+}
+
+void SetThreadLogBuffer(logBuffer *lb)
+{
+	threadLog = lb;
+}
+
+void FlushLogBuffer(logBuffer *lb)
+{
+	long int pos = 0;
+
+	if(!lb->text)
+		return;
+
+	pthread_mutex_lock(&logLock);
+	while(pos < lb->used)
+	{
+		char	type = lb->text[pos++];
+		char	*text = lb->text + pos;
+
+		if(type == LOG_CONSOLE)
+			printf("%s", text);
+		if(do_log && logfile)
+			fprintf(logfile, "%s", text);
+		pos += strlen(text) + 1;
 	}
+	fflush(stdout);
+	pthread_mutex_unlock(&logLock);
+
+	free(lb->text);
+	InitLogBuffer(lb);
+}
+
+// Logs a buffer from a helper thread through the current thread log
+void ReplayLogBuffer(logBuffer *lb)
+{
+	long int pos = 0;
+
+	if(!lb->text)
+		return;
+
+	while(pos < lb->used)
+	{
+		char	type = lb->text[pos++];
+		char	*text = lb->text + pos;
+
+		if(type == LOG_CONSOLE)
+			logmsg("%s", text);
+		else
+			logmsgFileOnly("%s", text);
+		pos += strlen(text) + 1;
+	}
+
+	free(lb->text);
+	InitLogBuffer(lb);
 }
 
 #if defined (WIN32)
@@ -163,7 +297,7 @@ void ConvertPCMSampleToByteArray(double sample, char *bytes, int size)
 	return;
 }
 
-int SaveWAVEChunk(char *filename, AudioSignal *Signal, double *buffer, long int block, long int loadedBlockSize, int diff, parameters *config)
+int SaveWAVEChunk(char *filename, AudioSignal *Signal, sampleType *buffer, long int block, long int loadedBlockSize, int diff, parameters *config)
 {
 	FILE 		*chunk = NULL;
 	wav_hdr		cheader;
@@ -39,10 +39,15 @@ int IsLogEnabled();
 void logmsg(char *fmt, ... );
 void logmsgFileOnly(char *fmt, ... );
 
+void InitLogBuffer(logBuffer *lb);
+void SetThreadLogBuffer(logBuffer *lb);
+void FlushLogBuffer(logBuffer *lb);
+void ReplayLogBuffer(logBuffer *lb);
+
 int setLogName(char *name);
 void endLog();
 
 void ConvertSampleToByteArray(double sample, char *bytes, int size);
-int SaveWAVEChunk(char *filename, AudioSignal *Signal, double *buffer, long int block, long int loadedBlockSize, int diff, parameters *config);
+int SaveWAVEChunk(char *filename, AudioSignal *Signal, sampleType *buffer, long int block, long int loadedBlockSize, int diff, parameters *config);
 
 #endif
@@ -0,0 +1,158 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+/*
+	Sends one job to a running job server (mdfourier -6 socket) and
+	prints its output as it comes. The options are the same as for
+	mdfourier, relative paths are resolved from this folder.
+
+	usage: mdfclient socket -P profile.mdf -r reference.wav -c compare.wav
+*/
+
+#include "json.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int PrintServerLine(char *line)
+{
+	char	text[8192], status[16];
+	double	value = 0, average = 0;
+
+	if(JSONGetString(line, "log", text, sizeof(text)))
+	{
+		printf("%s", text);
+		fflush(stdout);
+		return -2;
+	}
+
+	if(!JSONGetString(line, "status", status, sizeof(status)))
+	{
+		printf("ERROR: Invalid reply from job server\n");
+		return -2;
+	}
+
+	if(JSONGetNumber(line, "matched", &value) && JSONGetNumber(line, "average", &average))
+		printf("* Job server: %0.4f%% of frequencies matched, average difference %g dBFS\n", value, average);
+	if(JSONGetString(line, "error", text, sizeof(text)))
+		printf("* Job server: %s\n", text);
+	if(!JSONGetNumber(line, "exit", &value))
+		value = 1;
+	return(value == 0 ? 0 : 1);
+}
+
+int main(int argc , char *argv[])
+{
+	struct sockaddr_un	address;
+	char				cwd[PATH_MAX];
+	char				*line = NULL;
+	size_t				size = 0;
+	int					fd = -1, result = -2;
+	FILE				*server = NULL;
+
+	if(argc < 3)
+	{
+		printf("usage: mdfclient socket [mdfourier options]\n");
+		printf("Sends a comparison to a job server started with mdfourier -6 socket\n");
+		return 1;
+	}
+
+	if(strlen(argv[1]) >= sizeof(address.sun_path))
+	{
+		printf("ERROR: Socket path %s is too long\n", argv[1]);
+		return 1;
+	}
+
+	if(!getcwd(cwd, sizeof(cwd)))
+	{
+		printf("ERROR: Could not get current path\n");
+		return 1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	sprintf(address.sun_path, "%s", argv[1]);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1 || connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+	{
+		printf("ERROR: Could not connect to job server on %s\n", argv[1]);
+		if(fd != -1)
+			close(fd);
+		return 1;
+	}
+
+	server = fdopen(fd, "r+");
+	if(!server)
+	{
+		close(fd);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(server, "{\"cwd\":");
+	JSONWriteString(server, cwd);
+	fprintf(server, ",\"args\":[");
+	for(int i = 2; i < argc; i++)
+	{
+		if(i > 2)
+			fputc(',', server);
+		JSONWriteString(server, argv[i]);
+	}
+	fprintf(server, "]}\n");
+	fflush(server);
+
+	// jobs are run one at a time, this waits for the ones queued before
+	while(result == -2 && getline(&line, &size, server) > 0)
+		result = PrintServerLine(line);
+
+	free(line);
+	fclose(server);
+	if(result == -2)
+	{
+		printf("ERROR: Job server closed the connection\n");
+		return 1;
+	}
+	return result;
+}
+
+#else
+
+int main(int argc , char *argv[])
+{
+	printf("ERROR: The job server needs Unix domain sockets, not available in this build\n");
+	return 1;
+}
+
+#endif
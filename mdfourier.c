@@ -37,13 +37,25 @@
 #include "balance.h"
 #include "loadfile.h"
 #include "profile.h"
+#include "plans.h"
+#include "threads.h"
+#include "kernels.h"
+#include "samples.h"
+#include "cache.h"
+#include "batch.h"
+#include "server.h"
 
 int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 int ProcessSignal(AudioSignal *Signal, parameters *config);
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, long samplerate, double *window, int AudioChannels, int ZeroPad, parameters *config);
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, long samplerate, double *window, char channel, int AudioChannels, int ZeroPad, parameters *config);
+int RunSignalPipelines(signalStep step, AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, int concurrent, parameters *config);
+int ProcessSignalBlock(long int block, int thread, void *data);
+sampleType **AllocateSampleBuffers(int count, long int size);
+void ReleaseSampleBuffers(sampleType **buffers, int count);
+int ExecuteDFFT(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, int AudioChannels, int ZeroPad, parameters *config);
+int ExecuteDFFTStereo(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, int ZeroPad, parameters *config);
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, char channel, int AudioChannels, int ZeroPad, parameters *config);
 int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
-int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_t size, size_t diff, long samplerate, double *window, int AudioChannels, parameters *config);
+int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, sampleStore *store, long int pos, size_t size, size_t diff, long samplerate, sampleType *window, int AudioChannels, parameters *config);
 void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 void NormalizeAudio(AudioSignal *Signal);
 void NormalizeTimeDomainByFrequencyRatio(AudioSignal *Signal, double normalizationRatio, parameters *config);
@@ -73,10 +85,7 @@ double FindFundamentalMagnitudeAverage(AudioSignal *Signal, parameters *config);
 
 int main(int argc , char *argv[])
 {
-	AudioSignal  		*ReferenceSignal = NULL;
-	AudioSignal  		*ComparisonSignal = NULL;
 	parameters			config;
-	struct	timespec	start, end;
 
 	if(!Header(0, argc, argv))
 		return 1;
@@ -87,50 +96,81 @@ int main(int argc , char *argv[])
 		return 1;
 	}
 
+	ImportWisdom(&config);
+
+	if(config.serverSocket[0])
+		return(RunJobServer(argv[0], &config) ? 0 : 1);
+
+	return(ExecuteMDFourier(argc, argv, NULL, NULL, &config));
+}
+
+/*
+	Runs a comparison with the parsed options. The job server can hand
+	over a Reference that was loaded with the same options, the profile
+	is already loaded then and its log is flushed into this one.
+*/
+int ExecuteMDFourier(int argc, char *argv[], AudioSignal *ReferenceSignal, logBuffer *referenceLog, parameters *config)
+{
+	AudioSignal  		*ComparisonSignal = NULL;
+	struct	timespec	start, end;
+
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
-	if(!LoadProfile(&config))
+	if(!ReferenceSignal && !LoadProfile(config))
 	{
 		logmsg("Aborting\n");
 		return 1;
 	}
 
-	if(!SetupFolders(config.outputFolder, "Log", &config))
+	if(!SetupFolders(config->outputFolder, config->batchSource[0] ? "Batch" : "Log", config))
 	{
 		logmsg("Aborting\n");
 		return 1;
 	}
 
-	if(!EndProfileLoad(&config))
+	if(ReferenceSignal)
+		FlushLogBuffer(referenceLog);
+	else if(!EndProfileLoad(config))
 	{
 		logmsg("Aborting\n");
 		return 1;
 	}
 
-	if(strcmp(config.referenceFile, config.comparisonFile) == 0)
+	if(config->batchSource[0])
+	{
+		int ok = 0;
+
+		ok = RunBatch(argc, argv, config);
+		if(IsLogEnabled())
+			endLog();
+		CleanUp(&ReferenceSignal, &ComparisonSignal, config);
+		return(ok ? 0 : 1);
+	}
+
+	if(strcmp(config->referenceFile, config->comparisonFile) == 0)
 	{
-		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
+		CleanUp(&ReferenceSignal, &ComparisonSignal, config);
 		logmsg("Both inputs are the same file %s, skipping to save time\n",
-			 config.referenceFile);
+			 config->referenceFile);
 		return 1;
 	}
 
-	if(!LoadAndProcessAudioFiles(&ReferenceSignal, &ComparisonSignal, &config))
+	if(!LoadAndProcessAudioFiles(&ReferenceSignal, &ComparisonSignal, config))
 	{
 		logmsg("Aborting\n");
-		if(config.debugSync)
+		if(config->debugSync)
 			printf("\nResults stored in %s%s\n",
-				config.outputPath,
-				config.folderName);
-		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
+				config->outputPath,
+				config->folderName);
+		CleanUp(&ReferenceSignal, &ComparisonSignal, config);
 		return 1;
 	}
 
-	if(!ReportClockResults(ReferenceSignal, ComparisonSignal, &config))
+	if(!ReportClockResults(ReferenceSignal, ComparisonSignal, config))
 	{
-		if(config.doClkAdjust)
+		if(config->doClkAdjust)
 		{
-			if(!RecalculateFrequencyStructures(ReferenceSignal, ComparisonSignal, &config))
+			if(!RecalculateFrequencyStructures(ReferenceSignal, ComparisonSignal, config))
 			{
 				logmsg("Could not recalculate frequencies, Aborting\n");
 				return 1;
@@ -139,27 +179,35 @@ int main(int argc , char *argv[])
 	}
 
 	logmsg("\n* Comparing frequencies: ");
-	if(!CompareAudioBlocks(ReferenceSignal, ComparisonSignal, &config))
+	if(!CompareAudioBlocks(ReferenceSignal, ComparisonSignal, config))
 	{
 		logmsg("Aborting\n");
 		return 1;
 	}
 
-	FindViewPort(&config);
+	FindViewPort(config);
+	ValidatePrecision(config);
 
-	logmsg("* Plotting results to PNGs:\n");
-	PlotResults(ReferenceSignal, ComparisonSignal, &config);
+	if(config->plotMatchLimit < 0 || MatchPercent(config->Differences.cntTotalCompared,
+			config->Differences.cntTotalAudioDiff) < config->plotMatchLimit)
+	{
+		logmsg("* Plotting results to PNGs:\n");
+		PlotResults(ReferenceSignal, ComparisonSignal, config);
+	}
+	else
+		logmsg("* Skipping plots, %0.4f%% of frequencies matched\n",
+			MatchPercent(config->Differences.cntTotalCompared, config->Differences.cntTotalAudioDiff));
 
 	if(IsLogEnabled())
 		endLog();
 
 	/* Clear up everything */
-	ReleaseDifferenceArray(&config);
+	ReleaseDifferenceArray(config);
 
-	CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
-	fftw_cleanup();
+	CleanUp(&ReferenceSignal, &ComparisonSignal, config);
+	FFTW(cleanup)();
 
-	//if(config.clock)
+	//if(config->clock)
 	{
 		int minutes = 0;
 		double	elapsedSeconds;
@@ -173,8 +221,8 @@ int main(int argc , char *argv[])
 	}
 
 	printf("\nResults stored in %s%s\n",
-			config.outputPath,
-			config.folderName);
+			config->outputPath,
+			config->folderName);
 
 	return(0);
 }
@@ -334,14 +382,74 @@ int ReportClockResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 	return 1;
 }
 
-int LoadAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+/*
+	Reference and Comparison are independent until they need to
+	be compared, so each step can run both signals in parallel.
+	Logs are buffered per signal and flushed in the usual order.
+*/
+
+int SignalPipelineJob(long int job, int thread, void *data)
 {
-	AudioSignal *higher = NULL;
+	signalPipeline	*sp = (signalPipeline*)data;
+	int				retval = 0;
+
+	SetThreadLogBuffer(&sp->logs[job]);
+	retval = sp->step(sp->Signals[job], job == 0 ? ROLE_REF : ROLE_COMP, sp->config);
+	SetThreadLogBuffer(NULL);
+	return retval;
+}
+
+int RunSignalPipelines(signalStep step, AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, int concurrent, parameters *config)
+{
+	signalPipeline	sp;
+	int				retval = 0;
+
+	if(!concurrent || GetThreadCount(2, config) < 2)
+	{
+		if(!step(ReferenceSignal, ROLE_REF, config))
+			return 0;
+		return(step(ComparisonSignal, ROLE_COMP, config));
+	}
 
-	if(!LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config))
+	sp.step = step;
+	sp.Signals[0] = ReferenceSignal;
+	sp.Signals[1] = ComparisonSignal;
+	sp.config = config;
+	InitLogBuffer(&sp.logs[0]);
+	InitLogBuffer(&sp.logs[1]);
+
+	retval = RunParallelJobs(2, 2, SignalPipelineJob, &sp);
+
+	FlushLogBuffer(&sp.logs[0]);
+	FlushLogBuffer(&sp.logs[1]);
+	return retval;
+}
+
+int LoadSignalStep(AudioSignal **Signal, int role, parameters *config)
+{
+	// Already loaded by the job server
+	if(*Signal)
+		return 1;
+	return(LoadFile(Signal, role == ROLE_REF ? config->referenceFile : config->comparisonFile, role, config));
+}
+
+int ProcessSignalStep(AudioSignal **Signal, int role, parameters *config)
+{
+	if(role == ROLE_REF)
+		logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
+	else
+		logmsg("* Executing Discrete Fast Fourier Transforms on 'Comparison' file\n");
+	if(!ProcessSignal(*Signal, config))
 		return 0;
+	return 1;
+}
+
+int LoadAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+{
+	AudioSignal *higher = NULL;
 
-	if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
+	// No-Sync profiles use the Reference results to load the Comparison
+	if(!RunSignalPipelines(LoadSignalStep, ReferenceSignal, ComparisonSignal, !config->noSyncProfile, config))
 		return 0;
 
 	if(GetSignalMaxInt(*ReferenceSignal) >= GetSignalMaxInt(*ComparisonSignal))
@@ -773,12 +881,8 @@ int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **Compar
 			return 0;
 	}
 
-	logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
-	if(!ProcessSignal(*ReferenceSignal, config))
-		return 0;
-
-	logmsg("* Executing Discrete Fast Fourier Transforms on 'Comparison' file\n");
-	if(!ProcessSignal(*ComparisonSignal, config))
+	// Window plots are shared by both signals
+	if(!RunSignalPipelines(ProcessSignalStep, ReferenceSignal, ComparisonSignal, !config->drawWindows, config))
 		return 0;
 
 	ReleasePCM(*ReferenceSignal);
@@ -899,10 +1003,10 @@ void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, para
 	ReleaseAudioBlockStructure(config);
 }
 
-int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, long samplerate, double *window, int AudioChannels, parameters *config)
+int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, long samplerate, sampleType *window, int AudioChannels, parameters *config)
 {
 	long			i = 0, monoSignalSize = 0, difference = 0;
-	double			*signal = NULL, *window_samples = NULL;
+	sampleType			*signal = NULL, *window_samples = NULL;
 
 	if(!AudioArray)
 	{
@@ -932,13 +1036,13 @@ int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, long sampler
 	monoSignalSize = AudioArray->audio.size;
 	difference = AudioArray->audio.difference;
 
-	window_samples = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	window_samples = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 	if(!window_samples)
 	{
 		logmsg("Not enough memory for window\n");
 		return(0);
 	}
-	memset(window_samples, 0, sizeof(double)*(monoSignalSize+1));
+	memset(window_samples, 0, sizeof(sampleType)*(monoSignalSize+1));
 
 	for(i = 0; i < monoSignalSize - difference; i++)
 		window_samples[i] = signal[i]*window[i];
@@ -962,13 +1066,13 @@ int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, long sampler
 		monoSignalSize = AudioArray->audioRight.size;
 		difference = AudioArray->audioRight.difference;
 
-		window_samples = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+		window_samples = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 		if(!window_samples)
 		{
 			logmsg("Not enough memory for window\n");
 			return(0);
 		}
-		memset(window_samples, 0, sizeof(double)*(monoSignalSize+1));
+		memset(window_samples, 0, sizeof(sampleType)*(monoSignalSize+1));
 
 		AudioArray->audioRight.size = monoSignalSize;
 		AudioArray->audioRight.difference = difference;
@@ -981,11 +1085,11 @@ int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, long sampler
 	return(1);
 }
 
-int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_t size, size_t diff, long samplerate, double *window, int AudioChannels, parameters *config)
+int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, sampleStore *store, long int pos, size_t size, size_t diff, long samplerate, sampleType *window, int AudioChannels, parameters *config)
 {
 	long			stereoSignalSize = 0;
 	long			i = 0, monoSignalSize = 0, diffSize = 0, difference = 0;
-	double			*signal = NULL, *signalRight = NULL, *window_samples = NULL;
+	sampleType			*signal = NULL, *signalRight = NULL, *window_samples = NULL, *samples = NULL;
 
 	if(!AudioArray)
 	{
@@ -1004,23 +1108,38 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 	diffSize = (long)diff;
 	difference = diffSize/AudioChannels;	 /* 4 is 2 16 bit values */
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	signal = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 	if(!signal)
 	{
 		logmsg("Not enough memory\n");
 		return(0);
 	}
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
+	memset(signal, 0, sizeof(sampleType)*(monoSignalSize+1));
+
+	samples = (sampleType*)malloc(sizeof(sampleType)*(stereoSignalSize+1));
+	if(!samples)
+	{
+		logmsg("Not enough memory\n");
+		free(signal);
+		return(0);
+	}
+	if(!CopySamples(store, pos, stereoSignalSize, samples))
+	{
+		logmsg("ERROR: Could not convert samples for plotting\n");
+		free(samples);
+		free(signal);
+		return(0);
+	}
 
 	if(config->plotAllNotesWindowed && window && !config->doClkAdjust)
 	{
-		window_samples = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+		window_samples = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 		if(!window_samples)
 		{
 			logmsg("Not enough memory\n");
 			return(0);
 		}
-		memset(window_samples, 0, sizeof(double)*(monoSignalSize+1));
+		memset(window_samples, 0, sizeof(sampleType)*(monoSignalSize+1));
 	}
 
 	for(i = 0; i < monoSignalSize; i++)
@@ -1032,13 +1151,13 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 
 	if(AudioChannels == 2)
 	{
-		signalRight = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+		signalRight = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 		if(!signalRight)
 		{
 			logmsg("Not enough memory for window\n");
 			return(0);
 		}
-		memset(signalRight, 0, sizeof(double)*(monoSignalSize+1));
+		memset(signalRight, 0, sizeof(sampleType)*(monoSignalSize+1));
 
 		for(i = 0; i < monoSignalSize; i++)
 			signalRight[i] = samples[i*AudioChannels+1];
@@ -1047,6 +1166,7 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 		AudioArray->audioRight.size = monoSignalSize;
 		AudioArray->audioRight.difference = difference;
 	}
+	free(samples);
 
 	if(config->plotAllNotesWindowed && window && !config->doClkAdjust)
 	{
@@ -1056,15 +1176,15 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 
 		if(AudioChannels == 2 && signalRight)
 		{
-			double *window_samplesRight = NULL;
+			sampleType *window_samplesRight = NULL;
 
-			window_samplesRight = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+			window_samplesRight = (sampleType*)malloc(sizeof(sampleType)*(monoSignalSize+1));
 			if(!window_samplesRight)
 			{
 				logmsg("Not enough memory for window\n");
 				return(0);
 			}
-			memset(window_samplesRight, 0, sizeof(double)*(monoSignalSize+1));
+			memset(window_samplesRight, 0, sizeof(sampleType)*(monoSignalSize+1));
 			for(i = 0; i < monoSignalSize - difference; i++)
 				window_samplesRight[i] = signalRight[i]*window[i];
 			AudioArray->audioRight.window_samples = window_samplesRight;
@@ -1077,7 +1197,7 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 {
 	long int		i = 0;
-	double			*windowUsed = NULL;
+	sampleType			*windowUsed = NULL;
 	windowManager	windows;
 
 	if(!config->doClkAdjust)
@@ -1222,7 +1342,7 @@ int RecalculateFrequencyStructures(AudioSignal *ReferenceSignal, AudioSignal *Co
 	return 1;
 }
 
-int DuplicateSamplesForWavefromPlots(AudioSignal *Signal, long int element, long int pos, long int loadedBlockSize, long int difference, double framerate, double *windowUsed, parameters *config, long int syncAdvance)
+int DuplicateSamplesForWavefromPlots(AudioSignal *Signal, long int element, long int pos, long int loadedBlockSize, long int difference, double framerate, sampleType *windowUsed, parameters *config, long int syncAdvance)
 {
 	if(config->timeDomainSync && Signal->Blocks[element].type == TYPE_SYNC)
 	{
@@ -1230,14 +1350,14 @@ int DuplicateSamplesForWavefromPlots(AudioSignal *Signal, long int element, long
 
 		oneFrameSamples = SecondsToSamples(Signal->header.fmt.SamplesPerSec, FramesToSeconds(framerate, 1), Signal->AudioChannels, Signal->bytesPerSample, NULL, NULL, NULL);
 		if(pos > oneFrameSamples) {
-			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], Signal->Samples + pos - oneFrameSamples, loadedBlockSize+oneFrameSamples, difference, Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
+			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], &Signal->Samples, pos - oneFrameSamples, loadedBlockSize+oneFrameSamples, difference, Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
 			Signal->Blocks[element].audio.sampleOffset = pos - oneFrameSamples + syncAdvance;
 			if(Signal->AudioChannels == 2)
 				Signal->Blocks[element].audioRight.sampleOffset = pos - oneFrameSamples + syncAdvance;
 		}
 		else {
-			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], Signal->Samples + pos, loadedBlockSize, difference, Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
+			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], &Signal->Samples, pos, loadedBlockSize, difference, Signal->header.fmt.SamplesPerSec, NULL, Signal->AudioChannels, config))
 				return 0;
 			Signal->Blocks[element].audio.sampleOffset = pos + syncAdvance;
 			if(Signal->AudioChannels == 2)
@@ -1249,7 +1369,7 @@ int DuplicateSamplesForWavefromPlots(AudioSignal *Signal, long int element, long
 		if(config->plotTimeDomainHiDiff || config->plotAllNotes ||
 				config->doClkAdjust || Signal->Blocks[element].type == TYPE_TIMEDOMAIN)
 		{
-			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], Signal->Samples + pos, loadedBlockSize, difference, Signal->header.fmt.SamplesPerSec, windowUsed, Signal->AudioChannels, config))
+			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], &Signal->Samples, pos, loadedBlockSize, difference, Signal->header.fmt.SamplesPerSec, windowUsed, Signal->AudioChannels, config))
 				return 0;
 			Signal->Blocks[element].audio.sampleOffset = pos + syncAdvance;
 			if(Signal->AudioChannels == 2)
@@ -1260,18 +1380,66 @@ int DuplicateSamplesForWavefromPlots(AudioSignal *Signal, long int element, long
 	return 1;
 }
 
+/*
+	Everything the FFT pass reads besides the file contents, used to key
+	the spectral cache. Hashing the resolved block positions and window
+	sizes instead of frame rates and profile values means a reference
+	keeps its cached spectra while the comparison files change, unless
+	they actually alter how the reference is cut.
+*/
+uint64_t HashSignalJobs(AudioSignal *Signal, blockJob *jobs, long int count, windowManager *windows, parameters *config)
+{
+	uint64_t	h = 0;
+	int			sampleBits = sizeof(sampleType)*8;
+	const char	*kernel = GetKernelName();
+
+	h = HashBytes(MDVERSION, strlen(MDVERSION), 0);
+	h = HashBytes(kernel, strlen(kernel), h);
+	h = HashBytes(&sampleBits, sizeof(int), h);
+	h = HashBytes(&Signal->header.fmt.SamplesPerSec, sizeof(Signal->header.fmt.SamplesPerSec), h);
+	h = HashBytes(&Signal->AudioChannels, sizeof(int), h);
+	h = HashBytes(&Signal->nyquistLimit, sizeof(int), h);
+	h = HashBytes(&Signal->Samples.format, sizeof(char), h);
+	h = HashBytes(Signal->Samples.gain, sizeof(double)*2, h);
+	h = HashBytes(&config->window, sizeof(char), h);
+	h = HashBytes(&config->ZeroPad, sizeof(int), h);
+	h = HashBytes(&config->MaxFreq, sizeof(int), h);
+	h = HashBytes(&config->startHz, sizeof(double), h);
+	h = HashBytes(&config->endHz, sizeof(double), h);
+	h = HashBytes(&config->clkMeasure, sizeof(int), h);
+	h = HashBytes(&config->clkBlock, sizeof(int), h);
+
+	for(long int i = 0; i < count; i++)
+	{
+		long int	windowSize = 0, windowPadding = 0;
+
+		getWindowSize(windows, jobs[i].window, &windowSize, &windowPadding);
+		h = HashBytes(&Signal->Blocks[i].type, sizeof(int), h);
+		h = HashBytes(&Signal->Blocks[i].channel, sizeof(char), h);
+		h = HashBytes(&jobs[i].pos, sizeof(long int), h);
+		h = HashBytes(&jobs[i].loadedBlockSize, sizeof(long int), h);
+		h = HashBytes(&jobs[i].difference, sizeof(long int), h);
+		h = HashBytes(&windowSize, sizeof(long int), h);
+		h = HashBytes(&windowPadding, sizeof(long int), h);
+	}
+	return h;
+}
+
 int ProcessSignal(AudioSignal *Signal, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*sampleBuffer;
 	long int		sampleBufferSize = 0;
 	windowManager	windows;
-	double			*windowUsed = NULL;
+	sampleType			*windowUsed = NULL;
 	long int		loadedBlockSize = 0, i = 0, syncAdvance = 0;
 	struct timespec	start, end;
 	int				leftover = 0, discardSamples = 0, syncinternal = 0;
+	int				threads = 0, ok = 1, cached = 0;
 	double			leftDecimals = 0;
+	blockJob		*jobs = NULL;
+	signalJobs		sj;
+	uint64_t		inputHash = 0;
 
 	pos = Signal->startOffset;
 
@@ -1283,22 +1451,31 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 	}
 
 	sampleBufferSize = SecondsToSamples(Signal->header.fmt.SamplesPerSec, longest, Signal->AudioChannels, Signal->bytesPerSample, NULL, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
+
+	jobs = (blockJob*)malloc(sizeof(blockJob)*config->types.totalBlocks);
+	if(!jobs)
 	{
 		logmsg("\tERROR: malloc failed.\n");
 		return(0);
 	}
+	memset(jobs, 0, sizeof(blockJob)*config->types.totalBlocks);
 
 	if(!initWindows(&windows, Signal->header.fmt.SamplesPerSec, config->window, config))
 	{
 		logmsg("\tERROR: Could not create FFTW windows.\n");
+		free(jobs);
 		return 0;
 	}
 
 	if(config->clock)
 		clock_gettime(CLOCK_MONOTONIC, &start);
 
+	/*
+		First pass: resolve the sample offset of every block. Internal
+		sync only moves samples after the current position, so every
+		block region is final once this loop ends and the FFTs can
+		run in any order.
+	*/
 	while(i < config->types.totalBlocks)
 	{
 		double duration = 0, framerate = 0;
@@ -1334,47 +1511,24 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		{
 			if(i != config->types.totalBlocks - 1)
 			{
-				config->smallFile |= Signal->role;
+				SetRoleFlag(config->smallFile, Signal->role);
 				logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite.\n");
 				if(config->verbose)
 					logmsg("load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n", loadedBlockSize, sampleBufferSize, pos + loadedBlockSize, pos, Signal->numSamples);
 			}
 			break;
 		}
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Signal->Samples + pos, (loadedBlockSize-difference)*sizeof(double));
 
-		if(!DuplicateSamplesForWavefromPlots(Signal, i, pos, loadedBlockSize, difference, framerate, windowUsed, config, syncAdvance))
-			return 0;
-
-		if(Signal->Blocks[i].type >= TYPE_SILENCE || Signal->Blocks[i].type == TYPE_WATERMARK)
-		{
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->header.fmt.SamplesPerSec, windowUsed, Signal->AudioChannels, config->ZeroPad, config))
-				return 0;
+		jobs[i].pos = pos;
+		jobs[i].loadedBlockSize = loadedBlockSize;
+		jobs[i].difference = difference;
+		jobs[i].window = windowUsed;
 
-			//logmsg("estimated %g (difference %ld)\n", Signal->Blocks[i].frames*Signal->framerate/1000.0, difference);
-			// uncomment in ExecuteDFFT as well
-			if(!FillFrequencyStructures(Signal, &Signal->Blocks[i], config))
-				return 0;
-		}
-
-		if(config->clkMeasure && config->clkBlock == i)
-		{
-			if(!ExecuteDFFT(&Signal->clkFrequencies, sampleBuffer, loadedBlockSize-difference, Signal->header.fmt.SamplesPerSec, windowUsed, Signal->AudioChannels, 1, config))
-				return 0;
-
-			if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
-				return 0;
-		}
-
-#ifdef CHECKWAV
-		// MDWAVE exists for this, but just in case it is ever needed within MDFourier
-		if(config->verbose)
+		if(!DuplicateSamplesForWavefromPlots(Signal, i, pos, loadedBlockSize, difference, framerate, windowUsed, config, syncAdvance))
 		{
-			SaveWAVEChunk(NULL, Signal, sampleBuffer, i, loadedBlockSize-difference, 0, config);
-			SaveWAVEChunk(NULL, Signal, Signal->Samples + pos + loadedBlockSize, i, difference, 1, config);
+			ok = 0;
+			break;
 		}
-#endif
 
 		pos += loadedBlockSize;
 		pos += discardSamples;
@@ -1382,18 +1536,60 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		if(Signal->Blocks[i].type == TYPE_INTERNAL_KNOWN)
 		{
 			if(!ProcessInternalSync(Signal, i, pos, &syncinternal, &syncAdvance, TYPE_INTERNAL_KNOWN, config))
-				return 0;
+			{
+				ok = 0;
+				break;
+			}
 		}
 
 		if(Signal->Blocks[i].type == TYPE_INTERNAL_UNKNOWN)
 		{
 			if(!ProcessInternalSync(Signal, i, pos, &syncinternal, &syncAdvance, TYPE_INTERNAL_UNKNOWN, config))
-				return 0;
+			{
+				ok = 0;
+				break;
+			}
 		}
 
 		i++;
 	}
 
+	if(ok && config->spectralCache)
+	{
+		inputHash = HashSignalJobs(Signal, jobs, i, &windows, config);
+		cached = LoadSpectralCache(Signal, i, inputHash, config);
+	}
+
+	// Second pass: FFTs are independent per block
+	if(ok && !cached)
+	{
+		threads = GetThreadCount(i, config);
+
+		sj.Signal = Signal;
+		sj.jobs = jobs;
+		sj.sampleBufferSize = sampleBufferSize;
+		sj.config = config;
+		sj.sampleBuffers = AllocateSampleBuffers(threads, sampleBufferSize);
+		if(!sj.sampleBuffers)
+			ok = 0;
+		else
+		{
+			ok = RunParallelJobs(i, threads, ProcessSignalBlock, &sj);
+			ReleaseSampleBuffers(sj.sampleBuffers, threads);
+			sj.sampleBuffers = NULL;
+		}
+
+		if(ok && config->spectralCache)
+			SaveSpectralCache(Signal, i, inputHash, config);
+	}
+
+	if(!ok)
+	{
+		free(jobs);
+		freeWindows(&windows);
+		return 0;
+	}
+
 	if(config->normType != max_frequency)
 		FindMaxMagnitude(Signal, config);
 
@@ -1402,7 +1598,10 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		double	elapsedSeconds;
 		clock_gettime(CLOCK_MONOTONIC, &end);
 		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
-		logmsg(" - clk: Processing took %0.2fs\n", elapsedSeconds);
+		if(cached)
+			logmsg(" - clk: Processing took %0.2fs (cached spectra)\n", elapsedSeconds);
+		else
+			logmsg(" - clk: Processing took %0.2fs (%d thread%s, %s kernels)\n", elapsedSeconds, threads, threads == 1 ? "" : "s", GetKernelName());
 	}
 
 	if(config->drawWindows)
@@ -1411,13 +1610,102 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		PlotBetaFunctions(config);
 	}
 
-	free(sampleBuffer);
+	free(jobs);
 	freeWindows(&windows);
 
 	return i;
 }
 
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, long samplerate, double *window, int AudioChannels, int ZeroPad, parameters *config)
+sampleType **AllocateSampleBuffers(int count, long int size)
+{
+	sampleType	**buffers = NULL;
+
+	buffers = (sampleType**)malloc(sizeof(sampleType*)*count);
+	if(!buffers)
+	{
+		logmsg("\tERROR: malloc failed.\n");
+		return NULL;
+	}
+	memset(buffers, 0, sizeof(sampleType*)*count);
+
+	for(int t = 0; t < count; t++)
+	{
+		buffers[t] = (sampleType*)malloc(size*sizeof(sampleType));
+		if(!buffers[t])
+		{
+			logmsg("\tERROR: malloc failed.\n");
+			ReleaseSampleBuffers(buffers, count);
+			return NULL;
+		}
+	}
+	return buffers;
+}
+
+void ReleaseSampleBuffers(sampleType **buffers, int count)
+{
+	if(!buffers)
+		return;
+
+	for(int t = 0; t < count; t++)
+	{
+		if(buffers[t])
+		{
+			free(buffers[t]);
+			buffers[t] = NULL;
+		}
+	}
+	free(buffers);
+}
+
+int ProcessSignalBlock(long int block, int thread, void *data)
+{
+	signalJobs	*sj = (signalJobs*)data;
+	AudioSignal	*Signal = sj->Signal;
+	parameters	*config = sj->config;
+	blockJob	*job = &sj->jobs[block];
+	sampleType		*sampleBuffer = sj->sampleBuffers[thread];
+	long int	size = 0;
+
+	size = job->loadedBlockSize - job->difference;
+
+	memset(sampleBuffer, 0, sj->sampleBufferSize*sizeof(sampleType));
+	if(!CopySamples(&Signal->Samples, job->pos, size, sampleBuffer))
+		return 0;
+
+	if(Signal->Blocks[block].type >= TYPE_SILENCE || Signal->Blocks[block].type == TYPE_WATERMARK)
+	{
+		if(!ExecuteDFFT(&Signal->Blocks[block], sampleBuffer, size, Signal->header.fmt.SamplesPerSec, job->window, Signal->AudioChannels, config->ZeroPad, config))
+			return 0;
+
+		//logmsg("estimated %g (difference %ld)\n", Signal->Blocks[block].frames*Signal->framerate/1000.0, job->difference);
+		// uncomment in ExecuteDFFT as well
+		if(!FillFrequencyStructures(Signal, &Signal->Blocks[block], config))
+			return 0;
+	}
+
+	if(config->clkMeasure && config->clkBlock == block)
+	{
+		if(!ExecuteDFFT(&Signal->clkFrequencies, sampleBuffer, size, Signal->header.fmt.SamplesPerSec, job->window, Signal->AudioChannels, 1, config))
+			return 0;
+
+		if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
+			return 0;
+	}
+
+#ifdef CHECKWAV
+	// MDWAVE exists for this, but just in case it is ever needed within MDFourier
+	if(config->verbose)
+	{
+		SaveWAVEChunk(NULL, Signal, sampleBuffer, block, size, 0, config);
+		// the block was already transformed, so its buffer is reused for the difference
+		if(CopySamples(&Signal->Samples, job->pos + job->loadedBlockSize, job->difference, sampleBuffer))
+			SaveWAVEChunk(NULL, Signal, sampleBuffer, block, job->difference, 1, config);
+	}
+#endif
+	return 1;
+}
+
+int ExecuteDFFT(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, int AudioChannels, int ZeroPad, parameters *config)
 {
 	char channel = CHANNEL_STEREO;
 
@@ -1429,24 +1717,19 @@ int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, long samp
 		if(AudioArray->channel == CHANNEL_MONO)
 			channel = CHANNEL_STEREO;
 
+		// Both channels are transformed with a single strided plan
 		if(AudioArray->channel == CHANNEL_STEREO)
-		{
-			channel = CHANNEL_RIGHT;
-			if(!ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, config))
-				return 0;
-			channel = CHANNEL_LEFT;
-		}
+			return(ExecuteDFFTStereo(AudioArray, samples, size, samplerate, window, ZeroPad, config));
 	}
 	return(ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, config));
 }
 
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, long samplerate, double *window, char channel, int AudioChannels, int ZeroPad, parameters *config)
+int ExecuteDFFTStereo(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, int ZeroPad, parameters *config)
 {
-	fftw_plan		p = NULL;
-	long			stereoSignalSize = 0;
-	long			i = 0, monoSignalSize = 0, zeropadding = 0;
-	double			*signal = NULL;
-	fftw_complex	*spectrum = NULL;
+	FFTWPlan		p = NULL;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0, spectrumSize = 0, used = 0;
+	sampleType			*signal = NULL;
+	FFTWComplex	*spectrum = NULL;
 	double			seconds = 0;
 
 	if(!AudioArray)
@@ -1455,49 +1738,109 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, l
 		return 0;
 	}
 
-	stereoSignalSize = (long)size;
-	monoSignalSize = stereoSignalSize/AudioChannels;
-	seconds = (double)size/((double)samplerate*AudioChannels);
+	monoSignalSize = (long)size/2;
+	seconds = (double)size/((double)samplerate*2);
 
 	if(ZeroPad)  /* disabled by default */
 		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate);
+	spectrumSize = monoSignalSize/2+1;
+	used = monoSignalSize - zeropadding;
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
+	p = getPlanBySize(&config->plans, monoSignalSize, FFTW_PLAN_R2C_STEREO);
+	if(!p)
+		return 0;
+
+	signal = (sampleType*)FFTW(malloc)(sizeof(sampleType)*2*(monoSignalSize+1));
 	if(!signal)
 	{
 		logmsg("Not enough memory\n");
 		return(0);
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	spectrum = (FFTWComplex*)FFTW(malloc)(sizeof(FFTWComplex)*2*spectrumSize);
 	if(!spectrum)
 	{
 		logmsg("Not enough memory\n");
+		FFTW(free)(signal);
 		return(0);
 	}
 
-	if(!config->model_plan)
+	// Samples stay interleaved, the plan reads each channel with stride 2
+	if(window)
 	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
+		for(i = 0; i < used; i++)
 		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
+			signal[i*2] = samples[i*2]*window[i];
+			signal[i*2+1] = samples[i*2+1]*window[i];
+#ifdef CHECKWAV
+			// for saving the wav with window
+			samples[i*2] *= window[i];
+			samples[i*2+1] *= window[i];
+#endif
 		}
 	}
+	else
+		memcpy(signal, samples, sizeof(sampleType)*2*used);
+	memset(signal+2*used, 0, sizeof(sampleType)*2*(monoSignalSize+1-used));
 
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
+	FFTW(execute_dft_r2c)(p, signal, spectrum);
+
+	AudioArray->fftwValues.spectrum = spectrum;
+	AudioArray->fftwValues.size = monoSignalSize;
+	AudioArray->fftwValues.shared = 0;
+
+	AudioArray->fftwValuesRight.spectrum = spectrum + spectrumSize;
+	AudioArray->fftwValuesRight.size = monoSignalSize;
+	AudioArray->fftwValuesRight.shared = 1;
+
+	AudioArray->seconds = seconds;
+	FFTW(free)(signal);
+	signal = NULL;
+
+	return(1);
+}
+
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, sampleType *samples, size_t size, long samplerate, sampleType *window, char channel, int AudioChannels, int ZeroPad, parameters *config)
+{
+	FFTWPlan		p = NULL;
+	long			stereoSignalSize = 0;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0;
+	sampleType			*signal = NULL;
+	FFTWComplex	*spectrum = NULL;
+	double			seconds = 0;
+
+	if(!AudioArray)
 	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
+		logmsg("No Array for results\n");
+		return 0;
+	}
+
+	stereoSignalSize = (long)size;
+	monoSignalSize = stereoSignalSize/AudioChannels;
+	seconds = (double)size/((double)samplerate*AudioChannels);
+
+	if(ZeroPad)  /* disabled by default */
+		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate);
+
+	p = getPlanBySize(&config->plans, monoSignalSize, FFTW_PLAN_R2C);
+	if(!p)
 		return 0;
+
+	signal = (sampleType*)FFTW(malloc)(sizeof(sampleType)*(monoSignalSize+1));
+	if(!signal)
+	{
+		logmsg("Not enough memory\n");
+		return(0);
+	}
+	spectrum = (FFTWComplex*)FFTW(malloc)(sizeof(FFTWComplex)*(monoSignalSize/2+1));
+	if(!spectrum)
+	{
+		logmsg("Not enough memory\n");
+		FFTW(free)(signal);
+		return(0);
 	}
 
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
+	memset(signal, 0, sizeof(sampleType)*(monoSignalSize+1));
+	memset(spectrum, 0, sizeof(FFTWComplex)*(monoSignalSize/2+1));
 
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
@@ -1519,9 +1862,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, l
 		}
 	}
 
-	fftw_execute(p);
-	fftw_destroy_plan(p);
-	p = NULL;
+	FFTW(execute_dft_r2c)(p, signal, spectrum);
 
 	//logmsg("Seconds %g was %g ", seconds, AudioArray->seconds); // uncomment estimated above as well
 	if(channel != CHANNEL_RIGHT)
@@ -1535,7 +1876,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, l
 		AudioArray->fftwValuesRight.size = monoSignalSize;
 	}
 	AudioArray->seconds = seconds;
-	free(signal);
+	FFTW(free)(signal);
 	signal = NULL;
 
 	return(1);
@@ -1576,6 +1917,8 @@ int CalculateMaxCompare(int block, AudioSignal *Signal, double significant, char
 int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, char channel, int block, int refSize, int testSize, parameters *config)
 {
 	Frequency	*freqRef = NULL, *freqComp = NULL;
+	int			*matches = NULL;
+	double		boxsize = 0;
 
 	if(channel == CHANNEL_LEFT)
 	{
@@ -1594,39 +1937,43 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		return 0;
 	}
 
+	if(refSize <= 0)
+		return 1;
+
+	matches = (int*)malloc(sizeof(int)*refSize);
+	if(!matches)
+	{
+		logmsg("ERROR: Not enough memory (matches)\n");
+		return 0;
+	}
+
+	boxsize = RoundFloat(ReferenceSignal->Blocks[block].seconds, 3);
+	if(!MatchFrequencies(freqRef, refSize, freqComp, testSize, boxsize, config->matchTolerance, matches))
+	{
+		free(matches);
+		return 0;
+	}
+
 	for(int freq = 0; freq < refSize; freq++)
 	{
-		int found = 0, index = 0;
+		int index = matches[freq];
 
 		if(!IncrementCompared(block, config))
 		{
 			logmsg("Internal consistency failure, please send error log (compare)\n");
+			free(matches);
 			return 0;
 		}
 
-		for(int comp = 0; comp < testSize; comp++)
-		{
-			if(!freqRef[freq].matched && !freqComp[comp].matched &&
-				areDoublesEqual(freqRef[freq].hertz, freqComp[comp].hertz))
-			{
-				freqComp[comp].matched = freq + 1;
-				freqRef[freq].matched = comp + 1;
-
-				found = 1;
-				index = comp;
-
-				break;
-			}
-		}
-
   		/* Now in either case, compare amplitude and phase */
-		if(found)
+		if(index != -1)
 		{
 			if(!areDoublesEqual(freqRef[freq].amplitude, freqComp[index].amplitude))
 			{
 				if(!InsertAmplDifference(block, freqRef[freq], freqComp[index], channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (AmplDiff)\n");
+					free(matches);
 					return 0;
 				}
 			}
@@ -1635,6 +1982,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!IncrementPerfectMatch(block, config))
 				{
 					logmsg("Internal consistency failure, please send error log (perfect)\n");
+					free(matches);
 					return 0;
 				}
 			}
@@ -1644,6 +1992,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!InsertPhaseDifference(block, freqRef[freq], freqComp[index], channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (PhaseDiff)\n");
+					free(matches);
 					return 0;
 				}
 			}
@@ -1656,10 +2005,12 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 			if(!InsertFreqNotFound(block, freqRef[freq].hertz, freqRef[freq].amplitude, channel, config))
 			{
 				logmsg("Internal consistency failure, please send error log (Not found)\n");
+				free(matches);
 				return 0;
 			}
 		}
 	}
+	free(matches);
 	return 1;
 }
 
@@ -1797,22 +2148,16 @@ void NormalizeAudio(AudioSignal *Signal)
 // These work in the time domain only, not during regular use
 void NormalizeAudioByRatio(AudioSignal *Signal, double ratio)
 {
-	long int 	i = 0, start = 0, end = 0;
-	double		*samples = NULL;
-
 	if(!Signal)
 		return;
 
 	if(!ratio)
 		return;
 
-	samples = Signal->Samples;
-	start = Signal->startOffset;
-	end = Signal->endOffset;
-
 	// improvement suggested by plgDavid
-	for(i = start; i < end; i++)
-		samples[i] = samples[i]*ratio;
+	// Applied as a conversion gain over the whole file, only the
+	// samples between startOffset and endOffset are ever processed
+	ApplySampleGain(&Signal->Samples, CHANNEL_STEREO, ratio);
 }
 
 // This is used to Normalize in the time domain, after finding the
@@ -1848,7 +2193,7 @@ double FindRatioForBlock(AudioBlocks *AudioArray, double ratio, AudioSignal *Sig
 	long int 	i = 0;
 	double		MaxSample = 0;
 	double		MaxSampleScaled = 0;
-	double		*samples = NULL;
+	sampleType		*samples = NULL;
 
 	if(!AudioArray || !ratio)
 		return 0;
@@ -1916,7 +2261,7 @@ double FindMaxSampleInBlock(AudioBlocks *AudioArray)
 {
 	long int 	i = 0;
 	double		MaxSample = 0;
-	double		*samples = NULL;
+	sampleType		*samples = NULL;
 
 	if(!AudioArray)
 		return 0;
@@ -2019,7 +2364,7 @@ void NormalizeTimeDomainByFrequencyRatio(AudioSignal *Signal, double normalizati
 void NormalizeBlockByRatio(AudioBlocks *AudioArray, double ratio, AudioSignal *Signal)
 {
 	long int 	i = 0;
-	double		*samples = NULL;
+	sampleType		*samples = NULL;
 
 	if(!AudioArray || !ratio)
 		return;
@@ -2071,8 +2416,7 @@ void NormalizeBlockByRatio(AudioBlocks *AudioArray, double ratio, AudioSignal *S
 // Find the Maximum Amplitude in the Audio File
 MaxSample FindMaxSampleAmplitude(AudioSignal *Signal)
 {
-	long int 		i = 0, start = 0, end = 0;
-	double			*samples = NULL;
+	long int 		offset = 0;
 	MaxSample		maxSampleValue;
 
 	maxSampleValue.maxSample = 0;
@@ -2083,20 +2427,9 @@ MaxSample FindMaxSampleAmplitude(AudioSignal *Signal)
 	if(!Signal)
 		return maxSampleValue;
 
-	samples = Signal->Samples;
-	start = Signal->startOffset;
-	end = Signal->endOffset;
-	for(i = start; i < end; i++)
-	{
-		double sample;
-
-		sample = fabs(samples[i]);
-		if(sample > maxSampleValue.maxSample)
-		{
-			maxSampleValue.maxSample = sample;
-			maxSampleValue.offset = i - start;
-		}
-	}
+	if(!FindMaxAbsSample(&Signal->Samples, Signal->startOffset, Signal->endOffset, &maxSampleValue.maxSample, &offset))
+		return maxSampleValue;
+	maxSampleValue.offset = offset - Signal->startOffset;
 
 	return(maxSampleValue);
 }
@@ -2104,8 +2437,8 @@ MaxSample FindMaxSampleAmplitude(AudioSignal *Signal)
 // Find the Maximum Amplitude in the Reference Audio File
 double FindLocalMaximumAroundSample(AudioSignal *Signal, MaxSample refMax)
 {
-	long int 		i, start = 0, end = 0, pos = 0;
-	double			*samples = NULL, MaxLocalSample = 0;
+	long int 		start = 0, end = 0, pos = 0;
+	double			MaxLocalSample = 0;
 	double			refSeconds = 0, refFrames = 0, tarSeconds = 0, fraction = 0;
 
 	if(!Signal)
@@ -2141,15 +2474,8 @@ double FindLocalMaximumAroundSample(AudioSignal *Signal, MaxSample refMax)
 	if(end >= pos + Signal->header.fmt.SamplesPerSec/fraction)
 		end = pos + Signal->header.fmt.SamplesPerSec/fraction;
 
-	samples = Signal->Samples;
-	for(i = start; i < end; i++)
-	{
-		double sample;
-
-		sample = fabs(samples[i]);
-		if(sample > MaxLocalSample)
-			MaxLocalSample = sample;
-	}
+	if(!FindMaxAbsSample(&Signal->Samples, start, end, &MaxLocalSample, NULL))
+		return 0;
 
 	return MaxLocalSample;
 }
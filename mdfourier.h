@@ -58,6 +58,27 @@
 #error Unknown pointer size or missing size macros!
 #endif
 
+/*
+	Building with SINGLE_PRECISION (make single) stores samples and
+	windows as float and runs fftwf plans, halving the memory traffic
+	of the FFT path. Frequencies, magnitudes and all results stay double.
+*/
+#ifdef SINGLE_PRECISION
+typedef float			sampleType;
+typedef fftwf_complex	FFTWComplex;
+typedef fftwf_plan		FFTWPlan;
+#define FFTW(name)		fftwf_##name
+#define	PRECISION_MDF	"single"
+#define	PRECISION_TITLE	" single precision"
+#else
+typedef double			sampleType;
+typedef fftw_complex	FFTWComplex;
+typedef fftw_plan		FFTWPlan;
+#define FFTW(name)		fftw_##name
+#define	PRECISION_MDF	"double"
+#define	PRECISION_TITLE	""
+#endif
+
 #define MAX_FREQ_COUNT		40000 	/* Number of frequencies to compare(MAX) */
 #define FREQ_COUNT			2000	/* Number of frequencies to compare(default) */
 
@@ -132,6 +153,9 @@
 #define	ROLE_REF	1
 #define	ROLE_COMP	2
 
+// Role flags can be set while both signals are processed in parallel
+#define SetRoleFlag(flag, role)	__sync_fetch_and_or(&(flag), (role))
+
 #define CHANNEL_NONE	'-'	//Invalid state
 #define	CHANNEL_MONO	'm'	//Is mono, used for balance
 #define	CHANNEL_STEREO	'S'	//Requires Stereo
@@ -354,14 +378,51 @@ typedef struct FrequencySt {
 	short	matched;
 } Frequency;
 
+typedef struct spectral_peak_st {
+	double		magnitude;
+	long int	bin;
+} SpectralPeak;
+
+typedef struct frequency_key_st {
+	long int	bin;
+	int			index;
+} frequencyKey;
+
+typedef struct peak_scratch_st {
+	SpectralPeak	*peaks;
+	long int		size;
+	double			*values;
+	long int		valuesSize;
+} peakScratch;
+
 typedef struct fftw_spectrum_st {
-	fftw_complex  	*spectrum;
+	FFTWComplex  	*spectrum;
 	size_t			size;
+	int				shared;		// part of the other channel allocation
 } FFTWSpectrum;
 
+/*
+	Whole file samples are kept in their native width, blocks are
+	converted to sampleType when read. gain holds channel balance and
+	time domain normalization, applied during conversion.
+*/
+#define SAMPLE_INT16	0
+#define SAMPLE_INT32	1	// 24 and 32 bit PCM
+#define SAMPLE_FLOAT	2	// 32 bit IEEE float
+#define SAMPLE_INTERNAL	3	// sampleType, for code that writes samples back
+
+typedef struct sample_store_st {
+	void		*data;
+	char		format;
+	long int	count;
+	int			channels;
+	double		gain[2];
+	struct sample_stream_st	*stream;	// set while the file is still being decoded
+} sampleStore;
+
 typedef struct samples_st {
-	double			*samples;
-	double			*window_samples;
+	sampleType		*samples;
+	sampleType		*window_samples;
 	long int		size;
 	long int		difference;
 	long int		sampleOffset;
@@ -399,12 +460,13 @@ typedef struct AudioSt {
 	double		floorFreq;
 	double		floorAmplitude;
 
-	double		*Samples;
+	sampleStore	Samples;
 	int			bytesPerSample;
 	long int	numSamples;
 	long int	SamplesStart;
 	long int	samplesPosFLAC;
 	int			errorFLAC;
+	int			errorFLACReported;
 	double		framerate;
 	wav_hdr		header;
 	uint8_t		fmtExtra[24];
@@ -445,13 +507,15 @@ typedef struct AudioSt {
 	int			originalSR;
 	double		originalFrameRate;
 
+	struct sync_cache_entry_st *syncCache;
+
 	AudioBlocks *Blocks;
 }  AudioSignal;
 
 /********************************************************/
 
 typedef struct window_unit_st {
-	double		*window;
+	sampleType	*window;
 	long int	frames;
 	double		seconds;
 	long int	size;
@@ -468,6 +532,38 @@ typedef struct window_st {
 
 /********************************************************/
 
+#define FFTW_PLAN_R2C			0
+#define FFTW_PLAN_C2R			1
+#define FFTW_PLAN_R2C_STEREO	2	// both channels from interleaved samples
+
+typedef struct plan_unit_st {
+	FFTWPlan	plan;
+	long int	size;
+	char		direction;
+} planUnit;
+
+typedef struct plan_st {
+	planUnit	*planArray;
+	int			planCount;
+	int			MaxPlan;
+
+	int			fromWisdom;
+	int			measured;
+	int			unsaved;
+	double		wisdomSeconds;
+	double		measureSeconds;
+} planManager;
+
+/********************************************************/
+
+typedef struct log_buffer_st {
+	char		*text;
+	long int	used;
+	long int	size;
+} logBuffer;
+
+/********************************************************/
+
 typedef struct freq_diff_st {
 	double	hertz;
 	double	amplitude;
@@ -529,6 +625,13 @@ typedef struct parameters_st {
 	char			profileFile[BUFFER_SIZE];
 	char			outputFolder[BUFFER_SIZE];
 	char			outputPath[BUFFER_SIZE];
+	char			batchSource[BUFFER_SIZE];
+	int				matrixMode;
+	double			plotMatchLimit;
+	char			serverSocket[BUFFER_SIZE];
+	int				serverMemory;
+	char			wisdomFile[BUFFER_SIZE];
+	char			precisionFile[BUFFER_SIZE];
 	double			startHz, endHz;
 	double			startHzPlot, endHzPlot;
 	double			maxDbPlotZC;
@@ -539,6 +642,12 @@ typedef struct parameters_st {
 	char			window;
 	int				MaxFreq;
 	int				clock;
+	int				threads;
+	int				plotThreads;
+	int				verifyFLAC;
+	int				matchTolerance;
+	int				syncCache;
+	int				spectralCache;
 	int				ignoreFloor;
 	int				outputFilterFunction;
 	AudioBlockDef	types;
@@ -619,9 +728,7 @@ typedef struct parameters_st {
 	double 			plotResX;
 	double			plotResY;
 
-	fftw_plan		sync_plan;
-	fftw_plan		model_plan;
-	fftw_plan		reverse_plan;
+	planManager		plans;
 
 	double			refNoiseMin;
 	double			refNoiseMax;
@@ -632,7 +739,7 @@ typedef struct parameters_st {
 	int				useExtraData;
 	int				compressToBlocks;
 	int				drawPerfect;
-	int				trimmingNeeded;
+	int				trimmingNeeded[ROLE_COMP+1];	// by role, each signal pipeline writes its own
 
 /* Values only used for clock frequency */
 	char		clkName[20];
@@ -659,5 +766,31 @@ typedef struct parameters_st {
 	int				executefft;
 } parameters;
 
+/********************************************************/
+
+typedef struct block_job_st {
+	long int	pos;
+	long int	loadedBlockSize;
+	long int	difference;
+	sampleType	*window;
+} blockJob;
+
+typedef struct signal_jobs_st {
+	AudioSignal	*Signal;
+	blockJob	*jobs;
+	sampleType	**sampleBuffers;
+	long int	sampleBufferSize;
+	parameters	*config;
+} signalJobs;
+
+typedef int (*signalStep)(AudioSignal **Signal, int role, parameters *config);
+
+typedef struct signal_pipeline_st {
+	signalStep	step;
+	AudioSignal	**Signals[2];
+	logBuffer	logs[2];
+	parameters	*config;
+} signalPipeline;
+
 
 #endif
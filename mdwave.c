@@ -40,10 +40,13 @@
 #include "balance.h"
 #include "loadfile.h"
 #include "profile.h"
+#include "plans.h"
+#include "kernels.h"
+#include "samples.h"
 
 int ProcessSignalMDW(AudioSignal *Signal, parameters *config);
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, long samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal);
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size, long samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal);
+int ExecuteDFFT(AudioBlocks *AudioArray, sampleType *samples, long int size, long samplerate, sampleType *window, parameters *config, int fftw_direction, AudioSignal *Signal);
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, sampleType *samples, long int size, long samplerate, sampleType *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal);
 int commandline_wave(int argc , char *argv[], parameters *config);
 void PrintUsage_wave();
 void Header_wave(int log);
@@ -62,6 +65,8 @@ int main(int argc , char *argv[])
 		return 1;
 	}
 
+	ImportWisdom(&config);
+
 	if(config.clock)
 		clock_gettime(CLOCK_MONOTONIC, &start);
 
@@ -112,7 +117,7 @@ int main(int argc , char *argv[])
 		logmsg(" - clk: MDWave took %0.2fs\n", elapsedSeconds);
 	}
 
-	fftw_cleanup();
+	FFTW(cleanup)();
 
         if(IsLogEnabled())
 	        endLog();
@@ -247,10 +252,10 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*sampleBuffer;
+	sampleType			*sampleBuffer, *samples = NULL;
 	long int		sampleBufferSize = 0;
 	windowManager	windows;
-	double			*windowUsed = NULL;
+	sampleType			*windowUsed = NULL;
 	long int		loadedBlockSize = 0, i = 0, syncAdvance = 0;
 	struct timespec	start, end;
 	char			Name[BUFFER_SIZE*2+256], tempName[BUFFER_SIZE];
@@ -268,7 +273,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 	}
 
 	sampleBufferSize = SecondsToSamples(Signal->header.fmt.SamplesPerSec, longest, Signal->AudioChannels, Signal->bytesPerSample, NULL, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
+	sampleBuffer = (sampleType*)malloc(sampleBufferSize*sizeof(sampleType));
 	if(!sampleBuffer)
 	{
 		logmsg("\tERROR: malloc failed.\n");
@@ -328,8 +333,9 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		}
 
 		// Clean Buffer and fill it
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
+		memset(sampleBuffer, 0, sampleBufferSize*sizeof(sampleType));
+		if(!CopySamples(&Signal->Samples, pos, loadedBlockSize, sampleBuffer))
+			return 0;
 
 		if(Signal->Blocks[i].type >= TYPE_SILENCE && config->executefft)
 		{
@@ -407,6 +413,11 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		if(config->clock)
 			clock_gettime(CLOCK_MONOTONIC, &start);
 	
+		// The processed signal is written back in place
+		if(!PromoteSamples(&Signal->Samples))
+			return 0;
+		samples = InternalSamples(&Signal->Samples);
+
 		// Clean up everything again
 		pos = Signal->startOffset;
 		leftover = 0;
@@ -451,13 +462,13 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 			}
 
 			// Clean Buffer and fill it
-			memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-			memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
+			memset(sampleBuffer, 0, sampleBufferSize*sizeof(sampleType));
+			memcpy(sampleBuffer, samples + pos, loadedBlockSize*sizeof(sampleType));
 			// Empty original signal, and overlap
 			if(pos > 4 && pos+loadedBlockSize+discardSamples+4 <= Signal->numSamples)
-				memset(Signal->Samples + pos-4, 0, (loadedBlockSize+discardSamples+4)*sizeof(double));
+				memset(samples + pos-4, 0, (loadedBlockSize+discardSamples+4)*sizeof(sampleType));
 			else
-				memset(Signal->Samples + pos, 0, loadedBlockSize*sizeof(double));
+				memset(samples + pos, 0, loadedBlockSize*sizeof(sampleType));
 		
 			if(Signal->Blocks[i].type >= TYPE_SILENCE)
 			{
@@ -468,11 +479,11 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 			if(Signal->Blocks[i].type < TYPE_SILENCE && !config->discardMDW)
 			{
 				if(Signal->Blocks[i].type != TYPE_SYNC)  // Copy control notes to discarded for reference
-					memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
+					memcpy(sampleBuffer, samples + pos, loadedBlockSize*sizeof(sampleType));
 			}
 
 			// Fill back original signal with whatever we have in sampleBuffer
-			memcpy(Signal->Samples + pos, sampleBuffer, loadedBlockSize*sizeof(double));
+			memcpy(samples + pos, sampleBuffer, loadedBlockSize*sizeof(sampleType));
 	
 			pos += loadedBlockSize;
 			pos += discardSamples;
@@ -494,7 +505,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		}
 
 		// clear the rest of the buffer
-		memset(Signal->Samples + pos, 0, (sizeof(double)*(Signal->numSamples - pos)));
+		memset(samples + pos, 0, (sizeof(sampleType)*(Signal->numSamples - pos)));
 
 		ComposeFileName(Name, GenerateFileNamePrefix(config), ".wav", config);
 		processed = fopen(Name, "wb");
@@ -504,7 +515,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 			return 0;
 		}
 	
-		SaveWAVEChunk(Name, Signal, Signal->Samples, 0, Signal->numSamples, 0, config);
+		SaveWAVEChunk(Name, Signal, samples, 0, Signal->numSamples, 0, config);
 		if(processed)
 		{
 			fclose(processed);
@@ -515,6 +526,10 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 	// save frequency unprocesed wav if requested with -n, for internal sync and verification
 	if(hadSync && !config->executefft)
 	{
+		if(!PromoteSamples(&Signal->Samples))
+			return 0;
+		samples = InternalSamples(&Signal->Samples);
+
 		ComposeFileName(Name, "SyncRemoved", ".wav", config);
 		processed = fopen(Name, "wb");
 		if(!processed)
@@ -523,7 +538,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 			return 0;
 		}
 	
-		SaveWAVEChunk(Name, Signal, Signal->Samples, 0, Signal->numSamples, 0, config);
+		SaveWAVEChunk(Name, Signal, samples, 0, Signal->numSamples, 0, config);
 		if(processed)
 		{
 			fclose(processed);
@@ -545,7 +560,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 	return 1;
 }
 
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, long samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal)
+int ExecuteDFFT(AudioBlocks *AudioArray, sampleType *samples, long int size, long samplerate, sampleType *window, parameters *config, int fftw_direction, AudioSignal *Signal)
 {
 	int AudioChannels = Signal->AudioChannels;
 	char channel = CHANNEL_STEREO;
@@ -579,13 +594,13 @@ int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, long sa
 	return 1;
 }
 
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size, long samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal)
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, sampleType *samples, long int size, long samplerate, sampleType *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal)
 {
-	fftw_plan		p = NULL, pBack = NULL;
+	FFTWPlan		p = NULL, pBack = NULL;
 	long int		stereoSignalSize = 0, blanked = 0;	
 	long int		i = 0, monoSignalSize = 0, zeropadding = 0; 
-	double			*signal = NULL;
-	fftw_complex	*spectrum = NULL;
+	sampleType			*signal = NULL;
+	FFTWComplex	*spectrum = NULL;
 	double			boxsize = 0, seconds = 0;
 	double			CutOff = 0;
 	long int		startBin = 0, endBin = 0;
@@ -614,65 +629,33 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 	if(Signal->nyquistLimit && endBin > size/2)
 		endBin = ceil(size/2);
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
-	if(!signal)
-	{
-		logmsg("Not enough memory (malloc)\n");
-		return(0);
-	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
-	if(!spectrum)
-	{
-		logmsg("Not enough memory (fftw_malloc)\n");
-		return(0);
-	}
+	p = getPlanBySize(&config->plans, monoSignalSize, FFTW_PLAN_R2C);
+	if(!p)
+		return 0;
 
-	if(!config->model_plan)
+	if(fftw_direction == REVERSE_FFTW)
 	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
+		pBack = getPlanBySize(&config->plans, monoSignalSize, FFTW_PLAN_C2R);
+		if(!pBack)
 			return 0;
-		}
 	}
 
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
+	signal = (sampleType*)FFTW(malloc)(sizeof(sampleType)*(monoSignalSize+1));
+	if(!signal)
 	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
-		return 0;
+		logmsg("Not enough memory (FFTW(malloc))\n");
+		return(0);
 	}
-
-	if(fftw_direction == REVERSE_FFTW)
+	spectrum = (FFTWComplex*)FFTW(malloc)(sizeof(FFTWComplex)*(monoSignalSize/2+1));
+	if(!spectrum)
 	{
-		if(!config->reverse_plan)
-		{
-			config->reverse_plan = fftw_plan_dft_c2r_1d(monoSignalSize, spectrum, signal, FFTW_MEASURE);
-			if(!config->reverse_plan)
-			{
-				logmsg("FFTW failed to create FFTW_MEASURE reverse plan\n");
-				free(signal);
-				signal = NULL;
-				return 0;
-			}
-		}
-		pBack = fftw_plan_dft_c2r_1d(monoSignalSize, spectrum, signal, FFTW_MEASURE);
-		if(!pBack)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
+		logmsg("Not enough memory (FFTW(malloc))\n");
+		FFTW(free)(signal);
+		return(0);
 	}
 
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
+	memset(signal, 0, sizeof(sampleType)*(monoSignalSize+1));
+	memset(spectrum, 0, sizeof(FFTWComplex)*(monoSignalSize/2+1));
 
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
@@ -687,9 +670,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 			signal[i] = signal[i]*window[i];
 	}
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
-	p = NULL;
+	FFTW(execute_dft_r2c)(p, signal, spectrum);
 
 	if(fftw_direction == FORWARD_FFTW)
 	{
@@ -709,7 +690,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 	if(fftw_direction == REVERSE_FFTW)
 	{
 		long int		endBinLimit = 0;
-		double			MinAmplitude = 0;
+		double			MinAmplitude = 0, *magnitudes = NULL, *amplitudes = NULL;
 		Frequency		*targetFreq = NULL;
 
 		// Find the Max magnitude for frequency at -f cuttoff
@@ -745,13 +726,24 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		if(endBinLimit > monoSignalSize/2)
 			endBinLimit = monoSignalSize/2;
 		
+		magnitudes = GetMagnitudeScratch(2*(monoSignalSize/2));
+		if(!magnitudes)
+		{
+			logmsg("Not enough memory (magnitudes)\n");
+			FFTW(free)(spectrum);
+			FFTW(free)(signal);
+			return 0;
+		}
+		amplitudes = magnitudes+monoSignalSize/2;
+		CalculateMagnitudes(spectrum+1, endBinLimit-1, monoSignalSize, magnitudes);
+		CalculateAmplitudesStrided(magnitudes, endBinLimit-1, 1, Signal->MaxMagnitude.magnitude, amplitudes);
+
 		for(i = 1; i < endBinLimit; i++)
 		{
-			double amplitude = 0, magnitude = 0;
+			double amplitude = 0;
 			int blank = 0;
 	
-			magnitude = CalculateMagnitude(spectrum[i], monoSignalSize);
-			amplitude = CalculateAmplitude(magnitude, Signal->MaxMagnitude.magnitude);
+			amplitude = amplitudes[i-1];
 
 			// limit by noise cut frequncy count/amplitude
 			if(amplitude <= CutOff)
@@ -766,7 +758,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 
 			if(blank)
 			{
-				fftw_complex filter;
+				FFTWComplex filter;
 
 				// This should never be done as such
 				// A proper filter shuld be used, or you'll get
@@ -780,9 +772,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		}
 		
 		// Magic! iFFTW
-		fftw_execute(pBack); 
-		fftw_destroy_plan(pBack);
-		pBack = NULL;
+		FFTW(execute_dft_c2r)(pBack, spectrum, signal);
 	
 		for(i = 0; i < monoSignalSize - zeropadding; i++)
 		{
@@ -804,10 +794,10 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		//logmsg("Blanked %ld frequencies from a total of %ld\n", blanked, monoSignalSize/2);
 		if(blanked > config->maxBlanked)
 			config->maxBlanked = blanked;
-		fftw_free(spectrum);
+		FFTW(free)(spectrum);
 	}
 
-	free(signal);
+	FFTW(free)(signal);
 	signal = NULL;
 
 	return(1);
@@ -828,7 +818,7 @@ int commandline_wave(int argc , char *argv[], parameters *config)
 	config->useCompProfile = 0;
 	config->executefft = 1;
 
-	while ((c = getopt (argc, argv, "qnhvzcklyCBis:e:f:t:p:w:r:P:IY:0:")) != -1)
+	while ((c = getopt (argc, argv, "qnhvzckK:lyCBis:e:f:t:p:w:r:P:IY:0:")) != -1)
 	switch (c)
 	  {
 	  case 'h':
@@ -847,6 +837,9 @@ int commandline_wave(int argc , char *argv[], parameters *config)
 	  case 'k':
 		config->clock = 1;
 		break;
+	  case 'K':
+		sprintf(config->wisdomFile, "%s", optarg);
+		break;
 	  case 'l':
 		EnableLog();
 		break;
@@ -1048,6 +1041,7 @@ void PrintUsage_wave()
 	logmsg("	 -v: Enable <v>erbose mode, spits all the FFTW results\n");
 	logmsg("	 -l: Do not <l>og output to file [reference]_vs_[compare].txt\n");
 	logmsg("	 -k: cloc<k> FFTW operations\n");
+	logmsg("	 -K: Use <K> as the FFTW wisdom file (default in user cache folder)\n");
 	logmsg("	 -0: Change output folder\n");
 }
 
@@ -0,0 +1,399 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "plans.h"
+#include "log.h"
+#include "cline.h"
+
+#include <pthread.h>
+
+#if !defined (WIN32)
+#include <sys/file.h>
+#include <fcntl.h>
+#endif
+
+#define MAX_PLANS		64
+#define WISDOM_FOLDER	"mdfourier"
+#ifdef SINGLE_PRECISION
+#define WISDOM_NAME		"wisdomf.fftw"
+#else
+#define WISDOM_NAME		"wisdom.fftw"
+#endif
+
+// The FFTW planner is not thread safe, executing plans is
+pthread_mutex_t planLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+	FFTW plans depend only on transform size, direction and buffer
+	alignment. Blocks in a profile share a handful of lengths, so each
+	distinct size is measured once and executed via the new-array
+	interface. All buffers passed to these plans must come from
+	FFTW(malloc) so they match the alignment of the planning buffers.
+*/
+
+int initPlans(planManager *pm)
+{
+	if(!pm)
+		return 0;
+
+	pm->planArray = (planUnit*)malloc(sizeof(planUnit)*MAX_PLANS);
+	if(!pm->planArray)
+	{
+		logmsg("Not enough memory for plan manager\n");
+		return 0;
+	}
+	pm->planCount = 0;
+	pm->MaxPlan = MAX_PLANS;
+
+	memset(pm->planArray, 0, sizeof(planUnit)*MAX_PLANS);
+	return 1;
+}
+
+FFTWPlan PlanBySizeInternal(long int size, char direction, sampleType *signal, FFTWComplex *spectrum, unsigned flags)
+{
+	int	n = (int)size;
+
+	if(direction == FFTW_PLAN_R2C)
+		return FFTW(plan_dft_r2c_1d)(size, signal, spectrum, flags);
+	if(direction == FFTW_PLAN_R2C_STEREO)  // stride 2 input, left spectrum followed by right
+		return FFTW(plan_many_dft_r2c)(1, &n, 2, signal, NULL, 2, 1, spectrum, NULL, 1, size/2+1, flags);
+	return FFTW(plan_dft_c2r_1d)(size, spectrum, signal, flags);
+}
+
+FFTWPlan CreatePlan(planManager *pm, long int size, char direction)
+{
+	FFTWPlan		plan = NULL;
+	sampleType			*signal = NULL;
+	FFTWComplex	*spectrum = NULL;
+	int				channels = 1;
+	struct timespec	start, end;
+
+	if(pm->planCount == pm->MaxPlan)
+	{
+		logmsg("ERROR: Reached Max FFTW plan limit %d\n", pm->MaxPlan);
+		return NULL;
+	}
+
+	if(direction == FFTW_PLAN_R2C_STEREO)
+		channels = 2;
+
+	// FFTW_MEASURE overwrites the arrays, so plan on scratch buffers
+	signal = (sampleType*)FFTW(malloc)(sizeof(sampleType)*channels*(size+1));
+	if(!signal)
+	{
+		logmsg("Not enough memory (FFTW(malloc))\n");
+		return NULL;
+	}
+	spectrum = (FFTWComplex*)FFTW(malloc)(sizeof(FFTWComplex)*channels*(size/2+1));
+	if(!spectrum)
+	{
+		logmsg("Not enough memory (FFTW(malloc))\n");
+		FFTW(free)(signal);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	plan = PlanBySizeInternal(size, direction, signal, spectrum, FFTW_MEASURE|FFTW_WISDOM_ONLY);
+	if(plan)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		pm->wisdomSeconds += TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
+		pm->fromWisdom ++;
+	}
+	else
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		plan = PlanBySizeInternal(size, direction, signal, spectrum, FFTW_MEASURE);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if(plan)
+		{
+			pm->measureSeconds += TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
+			pm->measured ++;
+			pm->unsaved ++;
+		}
+	}
+
+	FFTW(free)(spectrum);
+	FFTW(free)(signal);
+
+	if(!plan)
+	{
+		logmsg("FFTW failed to create FFTW_MEASURE %splan\n", direction == FFTW_PLAN_C2R ? "reverse " : "");
+		return NULL;
+	}
+
+	pm->planArray[pm->planCount].plan = plan;
+	pm->planArray[pm->planCount].size = size;
+	pm->planArray[pm->planCount].direction = direction;
+	pm->planCount++;
+
+	return plan;
+}
+
+FFTWPlan getPlanBySize(planManager *pm, long int size, char direction)
+{
+	FFTWPlan	plan = NULL;
+
+	if(!pm || size <= 0)
+		return NULL;
+
+	pthread_mutex_lock(&planLock);
+	if(!pm->planArray && !initPlans(pm))
+	{
+		pthread_mutex_unlock(&planLock);
+		return NULL;
+	}
+
+	for(int i = 0; i < pm->planCount; i++)
+	{
+		if(pm->planArray[i].size == size && pm->planArray[i].direction == direction)
+		{
+			plan = pm->planArray[i].plan;
+			break;
+		}
+	}
+
+	if(!plan)
+		plan = CreatePlan(pm, size, direction);
+	pthread_mutex_unlock(&planLock);
+
+	return plan;
+}
+
+void freePlans(planManager *pm)
+{
+	if(!pm)
+		return;
+
+	for(int i = 0; i < pm->planCount; i++)
+	{
+		if(pm->planArray[i].plan)
+		{
+			FFTW(destroy_plan)(pm->planArray[i].plan);
+			pm->planArray[i].plan = NULL;
+		}
+	}
+	if(pm->planArray)
+	{
+		free(pm->planArray);
+		pm->planArray = NULL;
+	}
+
+	pm->planCount = 0;
+	pm->MaxPlan = 0;
+
+	pm->fromWisdom = 0;
+	pm->measured = 0;
+	pm->unsaved = 0;
+	pm->wisdomSeconds = 0;
+	pm->measureSeconds = 0;
+}
+
+/*
+	Wisdom is kept in the user cache folder by default, so that
+	every run from any working folder benefits from it. Concurrent
+	batch jobs share the file, reads take a shared lock and writes
+	an exclusive one, merging what other processes saved meanwhile.
+*/
+
+int CreateWisdomFolder(char *path)
+{
+	char	folder[BUFFER_SIZE];
+	int		len = 0;
+
+	len = strlen(path);
+	if(len >= BUFFER_SIZE)
+		return 0;
+
+	sprintf(folder, "%s", path);
+	for(int i = 1; i < len; i++)
+	{
+		if(folder[i] == FOLDERCHAR)
+		{
+			folder[i] = '\0';
+			if(!CreateFolder(folder))
+				return 0;
+			folder[i] = FOLDERCHAR;
+		}
+	}
+	return 1;
+}
+
+void GetDefaultWisdomPath(char *path)
+{
+	char	*base = NULL;
+
+#if defined (WIN32)
+	base = getenv("LOCALAPPDATA");
+	if(base && strlen(base))
+	{
+		sprintf(path, "%s%c%s%c%s", base, FOLDERCHAR, WISDOM_FOLDER, FOLDERCHAR, WISDOM_NAME);
+		return;
+	}
+#else
+	base = getenv("XDG_CACHE_HOME");
+	if(base && strlen(base))
+	{
+		sprintf(path, "%s%c%s%c%s", base, FOLDERCHAR, WISDOM_FOLDER, FOLDERCHAR, WISDOM_NAME);
+		return;
+	}
+	base = getenv("HOME");
+	if(base && strlen(base))
+	{
+		sprintf(path, "%s%c.cache%c%s%c%s", base, FOLDERCHAR, FOLDERCHAR, WISDOM_FOLDER, FOLDERCHAR, WISDOM_NAME);
+		return;
+	}
+#endif
+	sprintf(path, "%s", WISDOM_NAME);
+}
+
+int LockWisdomFile(FILE *file, int exclusive)
+{
+#if defined (WIN32)
+	// Not locked, the Windows front end runs a single instance
+	return 1;
+#else
+	if(flock(fileno(file), exclusive ? LOCK_EX : LOCK_SH) != 0)
+		return 0;
+	return 1;
+#endif
+}
+
+void UnlockWisdomFile(FILE *file)
+{
+#if !defined (WIN32)
+	flock(fileno(file), LOCK_UN);
+#endif
+}
+
+int ImportWisdom(parameters *config)
+{
+	FILE	*file = NULL;
+	int		imported = 0;
+
+	if(!strlen(config->wisdomFile))
+		GetDefaultWisdomPath(config->wisdomFile);
+
+	file = fopen(config->wisdomFile, "r");
+	if(!file)
+		return 0;
+
+	if(!LockWisdomFile(file, 0))
+	{
+		fclose(file);
+		return 0;
+	}
+	imported = FFTW(import_wisdom_from_file)(file);
+	UnlockWisdomFile(file);
+	fclose(file);
+
+	if(!imported)
+		logmsgFileOnly("FFTW wisdom file %s is invalid, it will be replaced\n", config->wisdomFile);
+	return imported;
+}
+
+int ExportWisdom(parameters *config)
+{
+	FILE	*file = NULL;
+
+	if(!config->plans.unsaved || !strlen(config->wisdomFile))
+		return 1;
+
+	if(!CreateWisdomFolder(config->wisdomFile))
+	{
+		logmsgFileOnly("Could not create folder for FFTW wisdom %s\n", config->wisdomFile);
+		return 0;
+	}
+
+#if defined (WIN32)
+	file = fopen(config->wisdomFile, "w");
+#else
+	{
+		int fd = 0;
+
+		fd = open(config->wisdomFile, O_RDWR|O_CREAT, 0644);
+		if(fd != -1)
+		{
+			file = fdopen(fd, "r+");
+			if(!file)
+				close(fd);
+		}
+	}
+#endif
+	if(!file)
+	{
+		logmsgFileOnly("Could not save FFTW wisdom to %s\n", config->wisdomFile);
+		return 0;
+	}
+
+	if(!LockWisdomFile(file, 1))
+	{
+		fclose(file);
+		return 0;
+	}
+
+#if !defined (WIN32)
+	// merge plans saved by other instances since we started
+	FFTW(import_wisdom_from_file)(file);
+	rewind(file);
+	if(ftruncate(fileno(file), 0) != 0)
+	{
+		UnlockWisdomFile(file);
+		fclose(file);
+		return 0;
+	}
+#endif
+	FFTW(export_wisdom_to_file)(file);
+	fflush(file);
+	UnlockWisdomFile(file);
+	fclose(file);
+
+	config->plans.unsaved = 0;
+	return 1;
+}
+
+void ReportPlanTimes(parameters *config)
+{
+	planManager	*pm = &config->plans;
+
+	if(!config->clock || (!pm->fromWisdom && !pm->measured))
+		return;
+
+	logmsg(" - clk: FFTW plans %d from wisdom (%0.2fs), %d measured (%0.2fs)\n",
+		pm->fromWisdom, pm->wisdomSeconds, pm->measured, pm->measureSeconds);
+	if(pm->fromWisdom && pm->measured)
+	{
+		double	saved = 0;
+
+		saved = pm->fromWisdom*(pm->measureSeconds/pm->measured) - pm->wisdomSeconds;
+		logmsg(" - clk: FFTW wisdom saved an estimated %0.2fs\n", saved);
+	}
+	else if(pm->fromWisdom)
+		logmsg(" - clk: FFTW wisdom %s reused for all plans\n", config->wisdomFile);
+}
@@ -33,6 +33,8 @@
 #include "cline.h"
 #include "windows.h"
 #include "profile.h"
+#include "threads.h"
+#include "kernels.h"
 
 #define SORT_NAME AmplitudeDifferences
 #define SORT_TYPE FlatAmplDifference
@@ -139,6 +141,13 @@
 //#define TESTWARNINGS
 #define SYNC_DEBUG_SCALE	2
 
+/*
+	Plots run as parallel tasks, so subfolders are tracked as a
+	per thread prefix relative to the results folder instead of
+	changing the working directory of the whole process.
+*/
+static __thread char plotFolder[FILENAME_MAX];
+
 char *GetCurrentPathAndChangeToResultsFolder(parameters *config)
 {
 	char 	*CurrentPath = NULL;
@@ -175,60 +184,51 @@ void ReturnToMainPath(char **CurrentPath)
 	*CurrentPath = NULL;
 }
 
-void StartPlot(char *name, struct timespec* start, parameters *config)
-{
-	logmsg(name);
-	if(config->clock)
-		clock_gettime(CLOCK_MONOTONIC, start);
-}
-
-void EndPlot(char *name, struct timespec* start, struct timespec* end, parameters *config)
-{
-	logmsg("\n");
-
-	if(config->clock)
-	{
-		double	elapsedSeconds;
-		clock_gettime(CLOCK_MONOTONIC, end);
-		elapsedSeconds = TimeSpecToSeconds(end) - TimeSpecToSeconds(start);
-		logmsg(" - clk: %s took %0.2fs\n", name, elapsedSeconds);
-	}
-}
-
 char *PushFolder(char *name)
 {
-	char 	*CurrentPath = NULL;
+	char 	*previous = NULL;
+	char	folder[FILENAME_MAX];
+	int		len = 0;
 
-	CurrentPath = (char*)malloc(sizeof(char)*FILENAME_MAX);
-	if(!CurrentPath)
-		return NULL;
-
-	if(!GetCurrentDir(CurrentPath, sizeof(char)*FILENAME_MAX))
+	len = snprintf(folder, FILENAME_MAX, "%s%s", plotFolder, name);
+	if(len < 0 || len + 2 > FILENAME_MAX)
 	{
-		free(CurrentPath);
-		logmsg("Could not get current path\n");
+		logmsg("Path too long for %s subfolder\n", name);
 		return NULL;
 	}
 
-	if(!CreateFolder(name))
+	if(!CreateFolder(folder))
 	{
-		free(CurrentPath);
 		logmsg("Could not create %s subfolder\n", name);
 		return NULL;
 	}
-	if(chdir(name) == -1)
-	{
-		free(CurrentPath);
-		logmsg("Could not open folder %s for results\n", name);
+
+	previous = strdup(plotFolder);
+	if(!previous)
 		return NULL;
-	}
-	return CurrentPath;
+
+	// fits, checked above
+	memcpy(plotFolder, folder, len);
+	plotFolder[len] = FOLDERCHAR;
+	plotFolder[len+1] = '\0';
+	return previous;
+}
+
+void PopFolder(char **previous)
+{
+	if(!*previous)
+		return;
+
+	snprintf(plotFolder, FILENAME_MAX, "%s", *previous);
+	free(*previous);
+	*previous = NULL;
 }
 
 void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
 {
 	struct	timespec	start, end;
-	char 	*CurrentPath = NULL, *MainPath = NULL;
+	char 				*CurrentPath = NULL, *MainPath = NULL;
+	plotSchedule		schedule;
 
 	if(config->clock)
 		clock_gettime(CLOCK_MONOTONIC, &start);
@@ -236,145 +236,162 @@ void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, pa
 	MainPath = PushMainPath(config);
 	CurrentPath = GetCurrentPathAndChangeToResultsFolder(config);
 
-	if(config->plotDifferences || config->averagePlot)
-	{
-		struct	timespec lstart, lend;
+	memset(&schedule, 0, sizeof(plotSchedule));
+	if(CreatePlotSchedule(&schedule, ReferenceSignal, ComparisonSignal, config))
+		RunPlotSchedule(&schedule, config);
+	ReleasePlotSchedule(&schedule);
 
-		StartPlot(" - Difference", &lstart, config);
-		PlotAmpDifferences(config);
-		//PlotDifferenceTimeSpectrogram(config);
-		EndPlot("Differences", &lstart, &lend, config);
+	ReturnToMainPath(&CurrentPath);
+	PopMainPath(&MainPath);
 
-		printf(" - Preliminary results in %s%s\n",
-				config->outputPath,
-				config->folderName);
+	if(config->clock)
+	{
+		double	elapsedSeconds;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
+		logmsg(" - clk: Plotting PNGs took %0.2fs\n", elapsedSeconds);
 	}
+}
 
-	if(config->plotMissing)
-	{
-		if(!config->FullTimeSpectroScale)
-		{
-			struct	timespec	lstart, lend;
-	
-			StartPlot(" - Missing and Extra Frequencies", &lstart, config);
-	
-			if(config->usesStereo)
-			{
-				char	*returnFolder = NULL;
-			
-				returnFolder = PushFolder(MISSING_FOLDER);
-				if(!returnFolder)
-					return;
+plotTask *AddPlotTask(plotSchedule *schedule, plotTaskRun run, char *group, char *folder, AudioSignal *Signal, char channel)
+{
+	plotTask	*task = NULL;
 
-				if(ReferenceSignal->AudioChannels == 2)
-				{
-					PlotTimeSpectrogramUnMatchedContent(ReferenceSignal, CHANNEL_LEFT, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-					PlotTimeSpectrogramUnMatchedContent(ReferenceSignal, CHANNEL_RIGHT, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-				}
+	if(schedule->count == schedule->capacity)
+	{
+		long int	capacity = 0;
+		plotTask	*tasks = NULL;
 
-				if(ComparisonSignal->AudioChannels == 2)
-				{
-					PlotTimeSpectrogramUnMatchedContent(ComparisonSignal, CHANNEL_LEFT, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-					PlotTimeSpectrogramUnMatchedContent(ComparisonSignal, CHANNEL_RIGHT, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-				}
+		capacity = schedule->capacity ? schedule->capacity*2 : PLOT_TASK_BLOCK;
+		tasks = (plotTask*)realloc(schedule->tasks, sizeof(plotTask)*capacity);
+		if(!tasks)
+		{
+			logmsg("ERROR: Not enough memory (plot tasks)\n");
+			return NULL;
+		}
+		schedule->tasks = tasks;
+		schedule->capacity = capacity;
+	}
+
+	task = &schedule->tasks[schedule->count++];
+	memset(task, 0, sizeof(plotTask));
+	task->run = run;
+	task->group = group;
+	task->folder = folder;
+	task->Signal = Signal;
+	task->channel = channel;
+	task->block = -1;
+	return task;
+}
 
-				ReturnToMainPath(&returnFolder);
-			}
+int AddChannelPlotTasks(plotSchedule *schedule, plotTaskRun run, char *group, char *folder, AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	AudioSignal *Signals[2] = { ReferenceSignal, ComparisonSignal };
 
-			PlotTimeSpectrogramUnMatchedContent(ReferenceSignal, CHANNEL_STEREO, config);
-			logmsg(PLOT_ADVANCE_CHAR);
-			PlotTimeSpectrogramUnMatchedContent(ComparisonSignal, CHANNEL_STEREO, config);
-			logmsg(PLOT_ADVANCE_CHAR);
-	
-			EndPlot("Missing and Extra", &lstart, &lend, config);
+	if(config->usesStereo)
+	{
+		for(int s = 0; s < 2; s++)
+		{
+			if(Signals[s]->AudioChannels != 2)
+				continue;
+			if(!AddPlotTask(schedule, run, group, folder, Signals[s], CHANNEL_LEFT))
+				return 0;
+			if(!AddPlotTask(schedule, run, group, folder, Signals[s], CHANNEL_RIGHT))
+				return 0;
 		}
-		else
-			logmsg(" X Skipped: Missing and Extra Frequencies, due to range\n");
 	}
 
-	if(config->plotSpectrogram)
+	for(int s = 0; s < 2; s++)
 	{
-		struct	timespec	lstart, lend;
-
-		StartPlot(" - Spectrograms", &lstart, config);
-		PlotSpectrograms(ReferenceSignal, config);
-		PlotSpectrograms(ComparisonSignal, config);
-
-		EndPlot("Spectrogram", &lstart, &lend, config);
+		if(!AddPlotTask(schedule, run, group, NULL, Signals[s], CHANNEL_STEREO))
+			return 0;
 	}
+	return 1;
+}
 
-	if(config->clkMeasure)
+/*
+	Every PNG, or group of PNGs that share a private input, is queued
+	as a task. Inputs used by several tasks are flattened once here and
+	are read only while the tasks run. Tasks are queued with the
+	heaviest plots first, since they are handed out in order.
+*/
+int CreatePlotSchedule(plotSchedule *schedule, AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	AudioSignal *Signals[2] = { ReferenceSignal, ComparisonSignal };
+	plotTask	*task = NULL;
+
+	if(config->plotDifferences || config->averagePlot)
 	{
-		struct	timespec lstart, lend;
-		char	*returnFolder = NULL;
+		schedule->amplDiff = CreateFlatDifferences(config, &schedule->amplDiffSize, normalPlot);
+		if(!schedule->amplDiff)
+		{
+			logmsg("Not enough memory for plotting\n");
+			return 0;
+		}
 
-		StartPlot(" - Clocks", &lstart, config);
-	
-		returnFolder = PushFolder(CLK_FOLDER);
-		if(!returnFolder)
-			return;
-		PlotCLKSpectrogram(ReferenceSignal, config);
-		PlotCLKSpectrogram(ComparisonSignal, config);
+		if(config->outputCSV)
+			SaveCSVAmpDiff(schedule->amplDiff, schedule->amplDiffSize, config->compareName, config);
+
+		if(config->plotDifferences)
+		{
+			task = AddPlotTask(schedule, PlotDifferencesTask, "Differences", NULL, NULL, CHANNEL_STEREO);
+			if(!task)
+				return 0;
+			task->amplDiff = schedule->amplDiff;
+			task->size = schedule->amplDiffSize;
+		}
 
-		ReturnToMainPath(&returnFolder);
+		if(config->averagePlot)
+		{
+			task = AddPlotTask(schedule, PlotAveragedTask, "Differences", NULL, NULL, CHANNEL_STEREO);
+			if(!task)
+				return 0;
+			task->amplDiff = schedule->amplDiff;
+			task->size = schedule->amplDiffSize;
+		}
+	}
 
-		EndPlot("Clocks", &lstart, &lend, config);
+	if(config->plotMissing)
+	{
+		if(!config->FullTimeSpectroScale)
+		{
+			if(!AddChannelPlotTasks(schedule, PlotMissingTask, "Missing and Extra", MISSING_FOLDER, ReferenceSignal, ComparisonSignal, config))
+				return 0;
+		}
+		else
+			logmsg(" X Skipped: Missing and Extra Frequencies, due to range\n");
 	}
 
 	if(config->plotTimeSpectrogram)
 	{
-		struct	timespec	lstart, lend;
-
-		StartPlot(" - Time Spectrogram", &lstart, config);
+		if(!AddChannelPlotTasks(schedule, PlotTimeSpectrogramTask, "Time Spectrogram", T_SPECTR_FOLDER, ReferenceSignal, ComparisonSignal, config))
+			return 0;
+	}
 
-		if(config->usesStereo)
+	if(config->plotSpectrogram)
+	{
+		if(config->plotNoiseFloor)
+			SetReferenceNoiseRange(ReferenceSignal, config);
+		for(int s = 0; s < 2; s++)
 		{
-			char	*returnFolder = NULL;
-		
-			returnFolder = PushFolder(T_SPECTR_FOLDER);
-			if(!returnFolder)
-				return;
-
-			if(ReferenceSignal->AudioChannels == 2)
-			{
-				PlotTimeSpectrogram(ReferenceSignal, CHANNEL_LEFT, config);
-				logmsg(PLOT_ADVANCE_CHAR);
-				PlotTimeSpectrogram(ReferenceSignal, CHANNEL_RIGHT, config);
-				logmsg(PLOT_ADVANCE_CHAR);
-			}
-			if(ComparisonSignal->AudioChannels == 2)
-			{
-				PlotTimeSpectrogram(ComparisonSignal, CHANNEL_LEFT, config);
-				logmsg(PLOT_ADVANCE_CHAR);
-				PlotTimeSpectrogram(ComparisonSignal, CHANNEL_RIGHT, config);
-				logmsg(PLOT_ADVANCE_CHAR);
-			}
+			if(!AddPlotTask(schedule, PlotSpectrogramTask, "Spectrogram", NULL, Signals[s], CHANNEL_STEREO))
+				return 0;
+		}
+	}
 
-			ReturnToMainPath(&returnFolder);
+	if(config->clkMeasure)
+	{
+		for(int s = 0; s < 2; s++)
+		{
+			if(!AddPlotTask(schedule, PlotCLKTask, "Clocks", CLK_FOLDER, Signals[s], CHANNEL_STEREO))
+				return 0;
 		}
-		PlotTimeSpectrogram(ReferenceSignal, CHANNEL_STEREO, config);
-		logmsg(PLOT_ADVANCE_CHAR);
-		PlotTimeSpectrogram(ComparisonSignal, CHANNEL_STEREO, config);
-		logmsg(PLOT_ADVANCE_CHAR);
-		EndPlot("Time Spectrogram", &lstart, &lend, config);
 	}
 
 	if(config->plotPhase)
 	{
-		struct	timespec	lstart, lend;
-
-		StartPlot(" - Phase", &lstart, config);
-
-		PlotPhaseDifferences(config);
-		//PlotPhaseFromSignal(ReferenceSignal, config);
-		//PlotPhaseFromSignal(ComparisonSignal, config);
-		
-		logmsg(PLOT_ADVANCE_CHAR);
-		EndPlot("Phase", &lstart, &lend, config);
+		if(!AddPlotTask(schedule, PlotPhaseTask, "Phase", NULL, NULL, CHANNEL_STEREO))
+			return 0;
 	}
 
 	if(config->plotNoiseFloor)
@@ -383,12 +400,8 @@ void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, pa
 		{
 			if(ReferenceSignal->hasSilenceBlock && ComparisonSignal->hasSilenceBlock)
 			{
-				struct	timespec	lstart, lend;
-		
-				StartPlot(" - Noise Floor", &lstart, config);
-
-				PlotNoiseFloor(ReferenceSignal, config);
-				EndPlot("Noise Floor", &lstart, &lend, config);
+				if(!AddPlotTask(schedule, PlotNoiseFloorTask, "Noise Floor", NULL, ReferenceSignal, CHANNEL_STEREO))
+					return 0;
 			}
 			else
 				logmsg(" X Noise Floor graphs ommited: no noise floor value found.\n");
@@ -399,109 +412,238 @@ void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, pa
 
 	if((config->hasTimeDomain && config->plotTimeDomain) || config->plotAllNotes)
 	{
-		struct	timespec	lstart, lend;
-		char 				*returnFolder = NULL;
-
-		returnFolder = PushFolder(WAVEFORM_FOLDER);
-		if(!returnFolder)
+		for(int s = 0; s < 2; s++)
 		{
-			ReturnToMainPath(&CurrentPath);
-			return;
+			for(long int b = 0; b < config->types.totalBlocks; b++)
+			{
+				if(!IsTimeDomainPlotBlock(Signals[s], b, config))
+					continue;
+				task = AddPlotTask(schedule, PlotTimeDomainTask, "Waveform", WAVEFORM_FOLDER, Signals[s], CHANNEL_STEREO);
+				if(!task)
+					return 0;
+				task->block = b;
+			}
 		}
-
-		StartPlot(" - Waveform Graphs\n  ", &lstart, config);
-		PlotTimeDomainGraphs(ReferenceSignal, config);
-		PlotTimeDomainGraphs(ComparisonSignal, config);
-		EndPlot("Waveform", &lstart, &lend, config);
-
-		ReturnToMainPath(&returnFolder);
 	}
 
-	if(config->plotTimeDomainHiDiff)
+	if(config->plotTimeDomainHiDiff && config->Differences.BlockDiffArray)
 	{
 		if(FindDifferenceAveragesperBlock(config->thresholdAmplitudeHiDif, config->thresholdMissingHiDif, config->thresholdExtraHiDif, config))
 		{
-			struct	timespec	lstart, lend;
-
-			StartPlot(" - Time Domain Graphs from highly different notes\n  ", &lstart, config);
-			PlotTimeDomainHighDifferenceGraphs(ReferenceSignal, config);
-			PlotTimeDomainHighDifferenceGraphs(ComparisonSignal, config);
-			EndPlot("Time Domain Graphs", &lstart, &lend, config);
+			for(int s = 0; s < 2; s++)
+			{
+				for(long int b = 0; b < config->types.totalBlocks; b++)
+				{
+					if(!IsHighDifferencePlotBlock(Signals[s], b))
+						continue;
+					task = AddPlotTask(schedule, PlotHighDifferenceTask, "Time Domain Graphs", WAVEFORMDIFF_FOLDER, Signals[s], CHANNEL_STEREO);
+					if(!task)
+						return 0;
+					task->block = b;
+				}
+			}
 		}
 	}
+	return 1;
+}
 
-	ReturnToMainPath(&CurrentPath);
-	PopMainPath(&MainPath);
+int PlotScheduleJob(long int job, int thread, void *data)
+{
+	struct	timespec	start, end;
+	int					rc = 1;
+	char				*returnFolder = NULL;
+	plotSchedule		*schedule = (plotSchedule*)data;
+	plotTask			*task = &schedule->tasks[job];
 
-	if(config->clock)
+	(void)thread;
+	if(schedule->config->clock)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	plotFolder[0] = '\0';
+	if(task->folder)
+	{
+		returnFolder = PushFolder(task->folder);
+		if(!returnFolder)
+			return 0;
+	}
+
+	rc = task->run(task, schedule->config);
+
+	PopFolder(&returnFolder);
+	if(schedule->config->clock)
 	{
-		double	elapsedSeconds;
 		clock_gettime(CLOCK_MONOTONIC, &end);
-		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
-		logmsg(" - clk: Plotting PNGs took %0.2fs\n", elapsedSeconds);
+		task->seconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
 	}
+	return rc;
 }
 
-void PlotAmpDifferences(parameters *config)
+int RunPlotSchedule(plotSchedule *schedule, parameters *config)
 {
-	long int			size = 0;
-	FlatAmplDifference	*amplDiff = NULL;
-	
-	amplDiff = CreateFlatDifferences(config, &size, normalPlot);
-	if(!amplDiff)
-	{
-		logmsg("Not enough memory for plotting\n");
-		return;
-	}
+	int	threads = 0, rc = 0;
 
-	if(config->outputCSV)
-		SaveCSVAmpDiff(amplDiff, size, config->compareName, config);
+	if(!schedule->count)
+		return 1;
 
-	if(config->plotDifferences)
-	{
-		int typeCount = 0, plotAll = 0;
+	schedule->config = config;
+	threads = config->plotThreads;
+	if(threads <= 0)
+		threads = GetThreadCount(schedule->count, config);
+	if(threads > schedule->count)
+		threads = schedule->count;
+
+	logmsg(" - Plotting %ld PNG task%s with %d thread%s\n  ",
+		schedule->count, schedule->count == 1 ? "" : "s",
+		threads, threads == 1 ? "" : "s");
+	rc = RunParallelJobs(schedule->count, threads, PlotScheduleJob, schedule);
+	logmsg("\n");
 
-		typeCount = GetActiveBlockTypesNoRepeat(config);
-		if (typeCount > 1)
+	if(config->clock)
+	{
+		// Tasks of a group are consecutive, times are the sum of their tasks
+		for(long int i = 0; i < schedule->count; )
 		{
-			if (PlotEachTypeDifferentAmplitudes(amplDiff, size, config->compareName, config) > 1)
-				plotAll = 1;
+			long int	first = i;
+			double		elapsedSeconds = 0;
+
+			while(i < schedule->count && schedule->tasks[i].group == schedule->tasks[first].group)
+				elapsedSeconds += schedule->tasks[i++].seconds;
+			logmsg(" - clk: %s took %0.2fs in %ld task%s\n",
+				schedule->tasks[first].group, elapsedSeconds,
+				i - first, i - first == 1 ? "" : "s");
 		}
-		else
-			plotAll = 1;
+	}
+	return rc;
+}
 
-		if (plotAll)
-		{
-			PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_STEREO, config->compareName, config);
-			if(config->channelBalance == 0 && config->referenceSignal->AudioChannels == 2 && config->comparisonSignal->AudioChannels == 2)
-			{
-				char		name[BUFFER_SIZE];
-				char		*returnFolder = NULL;
+void ReleasePlotSchedule(plotSchedule *schedule)
+{
+	if(schedule->tasks)
+	{
+		free(schedule->tasks);
+		schedule->tasks = NULL;
+	}
+	if(schedule->amplDiff)
+	{
+		free(schedule->amplDiff);
+		schedule->amplDiff = NULL;
+	}
+	schedule->count = 0;
+	schedule->capacity = 0;
+}
 
-				returnFolder = PushFolder(DIFFERENCE_FOLDER);
-				if (!returnFolder)
-					return;
+void PrintPreliminaryResults(parameters *config)
+{
+	// Read by front ends, so it goes to stdout in one piece
+	printf("\n - Preliminary results in %s%s\n  ",
+			config->outputPath,
+			config->folderName);
+	fflush(stdout);
+}
 
-				sprintf(name, "%s_%c", config->compareName, CHANNEL_LEFT);
-				PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_LEFT, name, config);
-				logmsg(PLOT_ADVANCE_CHAR);
+int PlotDifferencesTask(plotTask *task, parameters *config)
+{
+	PlotDifferenceGraphs(task->amplDiff, task->size, config);
+	PrintPreliminaryResults(config);
+	return 1;
+}
 
-				sprintf(name, "%s_%c", config->compareName, CHANNEL_RIGHT);
-				PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_RIGHT, name, config);
-				logmsg(PLOT_ADVANCE_CHAR);
+int PlotAveragedTask(plotTask *task, parameters *config)
+{
+	PlotDifferentAmplitudesAveraged(task->amplDiff, task->size, config->compareName, config);
+	if(!config->plotDifferences)
+		PrintPreliminaryResults(config);
+	return 1;
+}
 
-				ReturnToMainPath(&returnFolder);
-			}
+int PlotMissingTask(plotTask *task, parameters *config)
+{
+	PlotTimeSpectrogramUnMatchedContent(task->Signal, task->channel, config);
+	logmsg(PLOT_ADVANCE_CHAR);
+	return 1;
+}
+
+int PlotTimeSpectrogramTask(plotTask *task, parameters *config)
+{
+	PlotTimeSpectrogram(task->Signal, task->channel, config);
+	logmsg(PLOT_ADVANCE_CHAR);
+	return 1;
+}
+
+int PlotSpectrogramTask(plotTask *task, parameters *config)
+{
+	PlotSpectrograms(task->Signal, config);
+	return 1;
+}
+
+int PlotCLKTask(plotTask *task, parameters *config)
+{
+	PlotCLKSpectrogram(task->Signal, config);
+	return 1;
+}
+
+int PlotPhaseTask(plotTask *task, parameters *config)
+{
+	(void)task;
+	PlotPhaseDifferences(config);
+	logmsg(PLOT_ADVANCE_CHAR);
+	return 1;
+}
+
+int PlotNoiseFloorTask(plotTask *task, parameters *config)
+{
+	PlotNoiseFloor(task->Signal, config);
+	return 1;
+}
+
+int PlotTimeDomainTask(plotTask *task, parameters *config)
+{
+	return(PlotBlockTimeDomainGraphs(task->Signal, task->block, config));
+}
+
+int PlotHighDifferenceTask(plotTask *task, parameters *config)
+{
+	return(PlotBlockHighDifferenceGraphs(task->Signal, task->block, config));
+}
+
+void PlotDifferenceGraphs(FlatAmplDifference *amplDiff, long int size, parameters *config)
+{
+	int typeCount = 0, plotAll = 0;
 
+	typeCount = GetActiveBlockTypesNoRepeat(config);
+	if (typeCount > 1)
+	{
+		if (PlotEachTypeDifferentAmplitudes(amplDiff, size, config->compareName, config) > 1)
+			plotAll = 1;
+	}
+	else
+		plotAll = 1;
+
+	if (plotAll)
+	{
+		PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_STEREO, config->compareName, config);
+		if(config->channelBalance == 0 && config->referenceSignal->AudioChannels == 2 && config->comparisonSignal->AudioChannels == 2)
+		{
+			char		name[BUFFER_SIZE];
+			char		*returnFolder = NULL;
+
+			returnFolder = PushFolder(DIFFERENCE_FOLDER);
+			if (!returnFolder)
+				return;
+
+			sprintf(name, "%s_%c", config->compareName, CHANNEL_LEFT);
+			PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_LEFT, name, config);
+			logmsg(PLOT_ADVANCE_CHAR);
+
+			sprintf(name, "%s_%c", config->compareName, CHANNEL_RIGHT);
+			PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_RIGHT, name, config);
 			logmsg(PLOT_ADVANCE_CHAR);
+
+			PopFolder(&returnFolder);
 		}
-	}
 
-	if(config->averagePlot)
-		PlotDifferentAmplitudesAveraged(amplDiff, size, config->compareName, config);
-	
-	free(amplDiff);
-	amplDiff = NULL;
+		logmsg(PLOT_ADVANCE_CHAR);
+	}
 }
 
 void PlotDifferentAmplitudesWithBetaFunctions(parameters *config)
@@ -599,7 +741,8 @@ int FillPlotExtra(PlotFile *plot, char *name, int sizex, int sizey, double x0, d
 
 int FillPlot(PlotFile *plot, char *name, double x0, double y0, double x1, double y1, double penWidth, double leftMarginSize, parameters *config)
 {
-	double dX = 0, dY = 0;
+	double	dX = 0, dY = 0;
+	char	fileName[T_BUFFER_SIZE];
 
 	if(!plot)
 		return 0;
@@ -607,8 +750,16 @@ int FillPlot(PlotFile *plot, char *name, double x0, double y0, double x1, double
 	plot->plotter = NULL;
 	plot->plotter_params = NULL;
 	plot->file = NULL;
+	plot->raster = NULL;
 
-	ComposeFileNameoPath(plot->FileName, name, ".png", config);
+	ComposeFileNameoPath(fileName, name, ".png", config);
+	if(snprintf(plot->FileName, T_BUFFER_SIZE, "%s%s", plotFolder, fileName) >= T_BUFFER_SIZE)
+	{
+		// CreatePlotFile refuses the empty name, so the plot is skipped
+		logmsg("ERROR: Path too long for plot %s%s\n", plotFolder, fileName);
+		plot->FileName[0] = '\0';
+		return 0;
+	}
 
 	plot->sizex = config->plotResX;
 	plot->sizey = config->plotResY;
@@ -642,6 +793,9 @@ int CreatePlotFile(PlotFile *plot, parameters *config)
 {
 	char		size[20];
 
+	if(!strlen(plot->FileName))
+		return 0;
+
 	plot->file = fopen(plot->FileName, "wb");
 	if(!plot->file)
 	{
@@ -680,6 +834,22 @@ int CreatePlotFile(PlotFile *plot, parameters *config)
 	return 1;
 }
 
+/*
+	Called after CreatePlotFile, the overlay is still drawn by
+	libplot and the framebuffer is blended over it when the plot
+	is closed. Plots fall back to libplot if there is no memory.
+*/
+int EnableRasterPlot(PlotFile *plot, parameters *config)
+{
+	plot->raster = CreateRaster(plot->sizex, plot->sizey, plot->x0, plot->y0, plot->x1, plot->y1, config->whiteBG);
+	if(!plot->raster)
+	{
+		logmsgFileOnly("Not enough memory for raster plot %s, using vectors\n", plot->FileName);
+		return 0;
+	}
+	return 1;
+}
+
 int ClosePlot(PlotFile *plot)
 {
 	if(pl_closepl_r(plot->plotter) < 0)
@@ -705,6 +875,15 @@ int ClosePlot(PlotFile *plot)
 	fclose(plot->file);
 	plot->file = NULL;
 
+	if(plot->raster)
+	{
+		int rt = 0;
+
+		rt = RasterComposePNG(plot->raster, plot->FileName);
+		ReleaseRaster(&plot->raster);
+		return rt;
+	}
+
 	return 1;
 }
 
@@ -2335,6 +2514,8 @@ void PlotAllDifferentAmplitudes(FlatAmplDifference *amplDiff, long int size, cha
 	char		name[BUFFER_SIZE];
 	char*		title = NULL;
 	double		dBFS = config->maxDbPlotZC;
+	long int	count = 0;
+	plotPoint	*points = NULL;
 
 	if(!config)
 		return;
@@ -2342,11 +2523,21 @@ void PlotAllDifferentAmplitudes(FlatAmplDifference *amplDiff, long int size, cha
 	if(!amplDiff)
 		return;
 
+	points = (plotPoint*)malloc(sizeof(plotPoint)*(size ? size : 1));
+	if(!points)
+	{
+		logmsg("ERROR: Not enough memory (plot points)\n");
+		return;
+	}
+
 	sprintf(name, "DA__ALL_%s", filename);
 	FillPlot(&plot, name, config->startHzPlot, -1*dBFS, config->endHzPlot, dBFS, 1, 1, config);
 
 	if(!CreatePlotFile(&plot, config))
+	{
+		free(points);
 		return;
+	}
 
 	DrawGridZeroDBCentered(&plot, dBFS, VERT_SCALE_STEP, config->endHzPlot, 1000, config);
 	DrawLabelsZeroDBCentered(&plot, dBFS, VERT_SCALE_STEP, config->endHzPlot, 1000, config);
@@ -2363,11 +2554,14 @@ void PlotAllDifferentAmplitudes(FlatAmplDifference *amplDiff, long int size, cha
 			{
 				intensity = CalculateWeightedError((fabs(config->significantAmplitude) - fabs(amplDiff[a].refAmplitude))/fabs(config->significantAmplitude), config)*0xffff;
 	
-				SetPenColor(amplDiff[a].color, intensity, &plot);
-				pl_fpoint_r(plot.plotter, transformtoLog(amplDiff[a].hertz, config), amplDiff[a].diffAmplitude);
+				AddPlotPoint(points, &count, transformtoLog(amplDiff[a].hertz, config), amplDiff[a].diffAmplitude, amplDiff[a].color, intensity);
 			}
 		}
 	}
+	count = ReducePlotPoints(&plot, points, count);
+	DrawPlotPoints(&plot, points, count);
+	free(points);
+	points = NULL;
 
 	if (channel == CHANNEL_STEREO)
 		title = DIFFERENCE_TITLE;
@@ -2419,7 +2613,7 @@ int PlotEachTypeDifferentAmplitudes(FlatAmplDifference *amplDiff, long int size,
 				logmsg(PLOT_ADVANCE_CHAR);
 			}
 			if(typeCount > 1)
-				ReturnToMainPath(&returnFolder);
+				PopFolder(&returnFolder);
 
 			types ++;
 		}
@@ -2432,6 +2626,8 @@ void PlotSingleTypeDifferentAmplitudes(FlatAmplDifference *amplDiff, long int si
 	PlotFile	plot;
 	char		*title = NULL;
 	double		dBFS = config->maxDbPlotZC;
+	long int	count = 0;
+	plotPoint	*points = NULL;
 
 	if(!config)
 		return;
@@ -2439,10 +2635,20 @@ void PlotSingleTypeDifferentAmplitudes(FlatAmplDifference *amplDiff, long int si
 	if(!amplDiff)
 		return;
 
+	points = (plotPoint*)malloc(sizeof(plotPoint)*(size ? size : 1));
+	if(!points)
+	{
+		logmsg("ERROR: Not enough memory (plot points)\n");
+		return;
+	}
+
 	FillPlot(&plot, filename, config->startHzPlot, -1*dBFS, config->endHzPlot, dBFS, 1, 1, config);
 
 	if(!CreatePlotFile(&plot, config))
+	{
+		free(points);
 		return;
+	}
 
 	DrawGridZeroDBCentered(&plot, dBFS, VERT_SCALE_STEP, config->endHzPlot, 1000, config);
 	DrawLabelsZeroDBCentered(&plot, dBFS, VERT_SCALE_STEP, config->endHzPlot, 1000, config);
@@ -2457,10 +2663,13 @@ void PlotSingleTypeDifferentAmplitudes(FlatAmplDifference *amplDiff, long int si
 
 			intensity = CalculateWeightedError((fabs(config->significantAmplitude) - fabs(amplDiff[a].refAmplitude))/fabs(config->significantAmplitude), config)*0xffff;
 
-			SetPenColor(amplDiff[a].color, intensity, &plot);
-			pl_fpoint_r(plot.plotter, transformtoLog(amplDiff[a].hertz, config), amplDiff[a].diffAmplitude);
+			AddPlotPoint(points, &count, transformtoLog(amplDiff[a].hertz, config), amplDiff[a].diffAmplitude, amplDiff[a].color, intensity);
 		}
 	}
+	count = ReducePlotPoints(&plot, points, count);
+	DrawPlotPoints(&plot, points, count);
+	free(points);
+	points = NULL;
 
 	if(channel == CHANNEL_STEREO)
 		title = DIFFERENCE_TITLE;
@@ -2564,9 +2773,11 @@ void PlotSilenceBlockDifferentAmplitudes(FlatAmplDifference *amplDiff, long int
 
 void PlotAllSpectrogram(FlatFrequency *freqs, long int size, char *filename, int signal, parameters *config)
 {
-	PlotFile plot;
-	char	 name[BUFFER_SIZE];
-	double	 significant = 0, abs_significant = 0;
+	PlotFile	plot;
+	char		name[BUFFER_SIZE];
+	double		significant = 0, abs_significant = 0;
+	long int	count = 0;
+	plotPoint	*points = NULL;
 
 	if(!config)
 		return;
@@ -2574,11 +2785,21 @@ void PlotAllSpectrogram(FlatFrequency *freqs, long int size, char *filename, int
 	significant = config->significantAmplitude;
 	abs_significant = fabs(significant);
 
+	points = (plotPoint*)malloc(sizeof(plotPoint)*(size ? size : 1));
+	if(!points)
+	{
+		logmsg("ERROR: Not enough memory (plot points)\n");
+		return;
+	}
+
 	sprintf(name, "SP__ALL_%c_%s", signal == ROLE_REF ? 'A' : 'B', filename);
 	FillPlot(&plot, name, config->startHzPlot, significant, config->endHzPlot, 0.0, 1, 1, config);
 
 	if(!CreatePlotFile(&plot, config))
+	{
+		free(points);
 		return;
+	}
 
 	DrawGridZeroToLimit(&plot, significant, VERT_SCALE_STEP, config->endHzPlot, 1000, 0, config);
 	DrawLabelsZeroToLimit(&plot, significant, VERT_SCALE_STEP, config->endHzPlot, 1000, 0, config);
@@ -2596,12 +2817,14 @@ void PlotAllSpectrogram(FlatFrequency *freqs, long int size, char *filename, int
 				y = freqs[f].amplitude;
 				intensity = CalculateWeightedError((abs_significant - fabs(y))/abs_significant, config)*0xffff;
 		
-				SetPenColor(freqs[f].color, intensity, &plot);
-				pl_fline_r(plot.plotter, x,	y, x, significant);
-				pl_endpath_r(plot.plotter);
+				AddPlotPoint(points, &count, x, y, freqs[f].color, intensity);
 			}
 		}
 	}
+	count = ReducePlotBars(&plot, points, count);
+	DrawPlotBars(&plot, points, count, significant);
+	free(points);
+	points = NULL;
 
 	DrawColorAllTypeScale(&plot, MODE_SPEC, LEFT_MARGIN, HEIGHT_MARGIN, config->plotResX/COLOR_BARS_WIDTH_SCALE, config->plotResY/1.15, significant, VERT_SCALE_STEP_BAR, DRAW_BARS, config);
 	DrawLabelsMDF(&plot, signal == ROLE_REF ? SPECTROGRAM_TITLE_REF : SPECTROGRAM_TITLE_COM, ALL_LABEL, signal == ROLE_REF ? PLOT_SINGLE_REF : PLOT_SINGLE_COM, config);
@@ -2649,7 +2872,7 @@ int PlotEachTypeSpectrogram(FlatFrequency *freqs, long int size, char *filename,
 			}
 
 			if(typeCount > 1)
-				ReturnToMainPath(&returnFolder);
+				PopFolder(&returnFolder);
 			types ++;
 		}
 
@@ -2680,7 +2903,7 @@ int PlotEachTypeSpectrogram(FlatFrequency *freqs, long int size, char *filename,
 				PlotNoiseSpectrogram(freqs, size, type, CHANNEL_RIGHT, name, signal, config, Signal);
 				logmsg(PLOT_ADVANCE_CHAR);
 
-				ReturnToMainPath(&returnFolder);
+				PopFolder(&returnFolder);
 			}
 			silence = 1;
 		}
@@ -2694,6 +2917,8 @@ void PlotSingleTypeSpectrogram(FlatFrequency *freqs, long int size, int type, ch
 	char		*title = NULL;
 	PlotFile	plot;
 	double		significant = 0, abs_significant = 0;
+	long int	count = 0;
+	plotPoint	*points = NULL;
 
 	if(!config)
 		return;
@@ -2701,10 +2926,20 @@ void PlotSingleTypeSpectrogram(FlatFrequency *freqs, long int size, int type, ch
 	significant = config->significantAmplitude;
 	abs_significant = fabs(significant);
 
+	points = (plotPoint*)malloc(sizeof(plotPoint)*(size ? size : 1));
+	if(!points)
+	{
+		logmsg("ERROR: Not enough memory (plot points)\n");
+		return;
+	}
+
 	FillPlot(&plot, filename, config->startHzPlot, significant, config->endHzPlot, 0.0, 1, 1, config);
 
 	if(!CreatePlotFile(&plot, config))
+	{
+		free(points);
 		return;
+	}
 
 	DrawGridZeroToLimit(&plot, significant, VERT_SCALE_STEP,config->endHzPlot, 1000, 0, config);
 	DrawLabelsZeroToLimit(&plot, significant, VERT_SCALE_STEP,config->endHzPlot, 1000, 0, config);
@@ -2721,11 +2956,13 @@ void PlotSingleTypeSpectrogram(FlatFrequency *freqs, long int size, int type, ch
 			intensity = CalculateWeightedError((abs_significant - fabs(y))/abs_significant, config)*0xffff;
 	
 			//pl_flinewidth_r(plot.plotter, 100*range_0_1);
-			SetPenColor(freqs[f].color, intensity, &plot);
-			pl_fline_r(plot.plotter, x,	y, x, significant);
-			pl_endpath_r(plot.plotter);
+			AddPlotPoint(points, &count, x, y, freqs[f].color, intensity);
 		}
 	}
+	count = ReducePlotBars(&plot, points, count);
+	DrawPlotBars(&plot, points, count, significant);
+	free(points);
+	points = NULL;
 	
 	if(signal == ROLE_REF)
 	{
@@ -2746,30 +2983,53 @@ void PlotSingleTypeSpectrogram(FlatFrequency *freqs, long int size, int type, ch
 	ClosePlot(&plot);
 }
 
+void FindNoiseAmplitudeRange(FlatFrequency *freqs, long int size, int type, double *startAmplitude, double *endAmplitude, parameters *config)
+{
+	*startAmplitude = config->significantAmplitude;
+	*endAmplitude = config->lowestDBFS;
+	for(int f = 0; f < size; f++)
+	{
+		if(freqs[f].type == type)
+		{
+			if(freqs[f].amplitude > *startAmplitude)
+				*startAmplitude = freqs[f].amplitude;
+			if(freqs[f].amplitude < *endAmplitude)
+				*endAmplitude = freqs[f].amplitude;
+		}
+	}
+
+	if(*endAmplitude < NS_LOWEST_AMPLITUDE)
+		*endAmplitude = NS_LOWEST_AMPLITUDE;
+}
+
+/*
+	The comparison noise floor spectrogram uses the scale of the
+	reference one. Both spectrograms are plotted in parallel, so the
+	reference range is found before the tasks start.
+*/
+void SetReferenceNoiseRange(AudioSignal *ReferenceSignal, parameters *config)
+{
+	long int		size = 0;
+	FlatFrequency	*frequencies = NULL;
+
+	frequencies = CreateFlatFrequencies(ReferenceSignal, &size, config);
+	if(!frequencies)
+		return;
+
+	FindNoiseAmplitudeRange(frequencies, size, TYPE_SILENCE, &config->refNoiseMin, &config->refNoiseMax, config);
+	free(frequencies);
+}
+
 void PlotNoiseSpectrogram(FlatFrequency *freqs, long int size, int type, char channel, char *filename, int signal, parameters *config, AudioSignal *Signal)
 {
 	PlotFile	plot;
 	char*		title = NULL;
-	double		startAmplitude = config->significantAmplitude, endAmplitude = config->lowestDBFS;
+	double		startAmplitude = 0, endAmplitude = 0;
 
 	if(!config)
 		return;
 
-	// Find limits
-	for(int f = 0; f < size; f++)
-	{
-		if(freqs[f].type == type)
-		{
-			if(freqs[f].amplitude > startAmplitude)
-				startAmplitude = freqs[f].amplitude;
-			if(freqs[f].amplitude < endAmplitude)
-				endAmplitude = freqs[f].amplitude;
-		}
-	}
-
-	if(endAmplitude < NS_LOWEST_AMPLITUDE)
-		endAmplitude = NS_LOWEST_AMPLITUDE;
-
+	FindNoiseAmplitudeRange(freqs, size, type, &startAmplitude, &endAmplitude, config);
 	if(Signal->role == ROLE_COMP)
 	{
 		if(config->refNoiseMax != 0)
@@ -2778,12 +3038,6 @@ void PlotNoiseSpectrogram(FlatFrequency *freqs, long int size, int type, char ch
 			logmsg("WARNING: Noise Floor Reference values were not set\n");
 	}
 
-	if(Signal->role == ROLE_REF)
-	{
-		config->refNoiseMin = startAmplitude;
-		config->refNoiseMax = endAmplitude;
-	}
-
 	if(config->significantAmplitude < endAmplitude)
 		endAmplitude = config->significantAmplitude;
 
@@ -2857,7 +3111,8 @@ void PlotWindow(windowUnit *windowUnit, parameters *config)
 {
 	PlotFile plot;
 	char	 name[BUFFER_SIZE];
-	double 	 *window = NULL, frames;
+	sampleType *window = NULL;
+	double 	 frames;
 	long int size;
 
 	if(!config || !windowUnit)
@@ -2984,46 +3239,241 @@ void SetPenColorStr(char *colorName, long int color, PlotFile *plot)
 	SetPenColor(MatchColor(colorName), color, plot);
 }
 
-void SetPenColor(int colorIndex, long int color, PlotFile *plot)
+void GetPenColor(int colorIndex, long int color, long int *red, long int *green, long int *blue)
 {
+	*red = *green = *blue = 0;
 	switch(colorIndex)
 	{
 		case COLOR_RED:
-			pl_pencolor_r(plot->plotter, color, 0, 0);
+			*red = color;
 			break;
 		case COLOR_GREEN:
-			pl_pencolor_r(plot->plotter, 0, color, 0);
+			*green = color;
 			break;
 		case COLOR_BLUE:
-			pl_pencolor_r(plot->plotter, 0, 0, color);
+			*blue = color;
 			break;
 		case COLOR_YELLOW:
-			pl_pencolor_r(plot->plotter, color, color, 0);
+			*red = *green = color;
 			break;
 		case COLOR_AQUA:
-			pl_pencolor_r(plot->plotter, 0, color, color);
+			*green = *blue = color;
 			break;
 		case COLOR_MAGENTA:
-			pl_pencolor_r(plot->plotter, color, 0, color);
+			*red = *blue = color;
 			break;
 		case COLOR_PURPLE:
-			pl_pencolor_r(plot->plotter, color/2, 0, color);
+			*red = color/2;
+			*blue = color;
 			break;
 		case COLOR_ORANGE:
-			pl_pencolor_r(plot->plotter, color, color/2, 0);
+			*red = color;
+			*green = color/2;
 			break;
 		case COLOR_GRAY:
-			pl_pencolor_r(plot->plotter, color, color, color);
+			*red = *green = *blue = color;
 			break;
 		case COLOR_NULL:
-			pl_pencolor_r(plot->plotter, 0, 0, 0);
 			break;
 		default:
-			pl_pencolor_r(plot->plotter, 0, color, 0);
+			*green = color;
 			break;
 	}
 }
 
+void SetPenColor(int colorIndex, long int color, PlotFile *plot)
+{
+	long int red = 0, green = 0, blue = 0;
+
+	GetPenColor(colorIndex, color, &red, &green, &blue);
+	pl_pencolor_r(plot->plotter, red, green, blue);
+}
+
+/*
+	For plots that are made of a dense grid of segments, these go
+	to the raster framebuffer when the plot has one.
+*/
+void DrawDenseSegment(PlotFile *plot, int colorIndex, long int color, double x0, double y0, double x1, double y1)
+{
+	if(plot->raster)
+	{
+		long int red = 0, green = 0, blue = 0;
+
+		GetPenColor(colorIndex, color, &red, &green, &blue);
+		RasterSegment(plot->raster, x0, y0, x1, y1, red, green, blue);
+		return;
+	}
+
+	SetPenColor(colorIndex, color, plot);
+	pl_fline_r(plot->plotter, x0, y0, x1, y1);
+	pl_endpath_r(plot->plotter);
+}
+
+/*
+	Level of detail for scatter and bar plots. Points are collected
+	in the order they would be drawn, then walked backwards so only
+	the last point drawn on each pixel is kept. Bars go from their
+	point down to the bottom of the plot, so a bar is only kept if
+	it reaches higher in its pixel column than every bar drawn after
+	it. What is drawn is then bounded by the plot resolution.
+*/
+int PlotPixelX(PlotFile *plot, double x)
+{
+	return (int)floor((x - plot->x0)/(plot->x1 - plot->x0)*plot->sizex);
+}
+
+int PlotPixelY(PlotFile *plot, double y)
+{
+	return (int)floor((plot->y1 - y)/(plot->y1 - plot->y0)*plot->sizey);
+}
+
+void AddPlotPoint(plotPoint *points, long int *count, double x, double y, int color, long int intensity)
+{
+	points[*count].x = x;
+	points[*count].y = y;
+	points[*count].color = color;
+	points[*count].intensity = intensity;
+	(*count)++;
+}
+
+long int ReducePlotPoints(PlotFile *plot, plotPoint *points, long int count)
+{
+	long int		next = 0;
+	unsigned char	*used = NULL;
+	char			*visible = NULL;
+
+	if(count <= plot->sizex)
+		return count;
+
+	used = (unsigned char*)calloc(((long int)plot->sizex*plot->sizey+7)/8, sizeof(unsigned char));
+	visible = (char*)calloc(count, sizeof(char));
+	if(!used || !visible)
+	{
+		if(used)
+			free(used);
+		if(visible)
+			free(visible);
+		return count;
+	}
+
+	for(long int p = count - 1; p >= 0; p--)
+	{
+		int			px, py;
+		long int	pixel;
+
+		px = PlotPixelX(plot, points[p].x);
+		py = PlotPixelY(plot, points[p].y);
+		if(px < 0 || px >= plot->sizex || py < 0 || py >= plot->sizey)
+		{
+			visible[p] = 1;
+			continue;
+		}
+		pixel = (long int)py*plot->sizex + px;
+		if(!(used[pixel/8] & (1 << (pixel % 8))))
+		{
+			used[pixel/8] |= 1 << (pixel % 8);
+			visible[p] = 1;
+		}
+	}
+
+	for(long int p = 0; p < count; p++)
+	{
+		if(visible[p])
+			points[next++] = points[p];
+	}
+
+	free(used);
+	free(visible);
+	return next;
+}
+
+long int ReducePlotBars(PlotFile *plot, plotPoint *points, long int count)
+{
+	long int	next = 0;
+	int			*columnTop = NULL;
+	char		*visible = NULL;
+
+	if(count <= plot->sizex)
+		return count;
+
+	columnTop = (int*)malloc(sizeof(int)*plot->sizex);
+	visible = (char*)calloc(count, sizeof(char));
+	if(!columnTop || !visible)
+	{
+		if(columnTop)
+			free(columnTop);
+		if(visible)
+			free(visible);
+		return count;
+	}
+
+	for(int x = 0; x < plot->sizex; x++)
+		columnTop[x] = plot->sizey;
+
+	for(long int p = count - 1; p >= 0; p--)
+	{
+		int px, py;
+
+		px = PlotPixelX(plot, points[p].x);
+		py = PlotPixelY(plot, points[p].y);
+		if(px < 0 || px >= plot->sizex)
+		{
+			visible[p] = 1;
+			continue;
+		}
+		if(py < columnTop[px])
+		{
+			columnTop[px] = py;
+			visible[p] = 1;
+		}
+	}
+
+	for(long int p = 0; p < count; p++)
+	{
+		if(visible[p])
+			points[next++] = points[p];
+	}
+
+	free(columnTop);
+	free(visible);
+	return next;
+}
+
+void DrawPlotPoints(PlotFile *plot, plotPoint *points, long int count)
+{
+	int			color = COLOR_NONE;
+	long int	intensity = -1;
+
+	for(long int p = 0; p < count; p++)
+	{
+		if(points[p].color != color || points[p].intensity != intensity)
+		{
+			color = points[p].color;
+			intensity = points[p].intensity;
+			SetPenColor(color, intensity, plot);
+		}
+		pl_fpoint_r(plot->plotter, points[p].x, points[p].y);
+	}
+}
+
+void DrawPlotBars(PlotFile *plot, plotPoint *points, long int count, double bottom)
+{
+	int			color = COLOR_NONE;
+	long int	intensity = -1;
+
+	for(long int p = 0; p < count; p++)
+	{
+		if(points[p].color != color || points[p].intensity != intensity)
+		{
+			color = points[p].color;
+			intensity = points[p].intensity;
+			SetPenColor(color, intensity, plot);
+		}
+		pl_fline_r(plot->plotter, points[p].x, points[p].y, points[p].x, bottom);
+		pl_endpath_r(plot->plotter);
+	}
+}
+
 void SetFillColor(int colorIndex, long int color, PlotFile *plot)
 {
 	switch(colorIndex)
@@ -3666,7 +4116,7 @@ int PlotDifferentAmplitudesAveraged(FlatAmplDifference *amplDiff, long int size,
 				}
 
 				if(typeCount > 1)
-					ReturnToMainPath(&returnFolder);
+					PopFolder(&returnFolder);
 			}
 
 			types ++;
@@ -4248,6 +4698,7 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 
 	if(!CreatePlotFile(&plot, config))
 		return;
+	EnableRasterPlot(&plot, config);
 
 	DrawFrequencyHorizontalGrid(&plot, config->endHzPlot, 1000, config);
 	DrawLabelsTimeSpectrogram(&plot, floor(config->endHzPlot/1000), 1, config);
@@ -4292,9 +4743,7 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 						amplitude = Signal->Blocks[block].freq[i].amplitude;
 						
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x,	y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawDenseSegment(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 
@@ -4312,9 +4761,7 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 						amplitude = Signal->Blocks[block].freqRight[i].amplitude;
 						
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x,	y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawDenseSegment(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 			}
@@ -4387,6 +4834,7 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 
 	if(!CreatePlotFile(&plot, config))
 		return;
+	EnableRasterPlot(&plot, config);
 
 	DrawFrequencyHorizontalGrid(&plot, config->endHzPlot, 1000, config);
 	DrawLabelsTimeSpectrogram(&plot, floor(config->endHzPlot/1000), 1, config);
@@ -4428,9 +4876,7 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 						amplitude = Signal->Blocks[block].freq[i].amplitude;
 						
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x,	y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawDenseSegment(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 
@@ -4449,9 +4895,7 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 						amplitude = Signal->Blocks[block].freqRight[i].amplitude;
 						
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x,	y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawDenseSegment(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 			}
@@ -4487,80 +4931,45 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 	ClosePlot(&plot);
 }
 
-void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
+int IsTimeDomainPlotBlock(AudioSignal *Signal, long int block, parameters *config)
+{
+	return(config->plotAllNotes || Signal->Blocks[block].type == TYPE_TIMEDOMAIN || 
+		(config->timeDomainSync && Signal->Blocks[block].type == TYPE_SYNC));
+}
+
+int PlotBlockTimeDomainGraphs(AudioSignal *Signal, long int block, parameters *config)
 {
-	long int	plots = 0, i = 0;
 	char		name[BUFFER_SIZE*2];
 
-	if(config->plotAllNotes)
+	sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
+		block, Signal->role == ROLE_REF ? "1" : "2",
+		GetBlockName(config, block), GetBlockSubIndex(config, block), config->compareName);
+
+	PlotBlockTimeDomainGraph(Signal, block, name, WAVEFORM_GENERAL, 0, config);
+	logmsg(PLOT_ADVANCE_CHAR);
+
+	if(Signal->Blocks[block].internalSyncCount)
 	{
-		for(i = 0; i < config->types.totalBlocks; i++)
+		for(int slot = 0; slot < Signal->Blocks[block].internalSyncCount; slot++)
 		{
-			if(config->plotAllNotes || Signal->Blocks[i].type == TYPE_TIMEDOMAIN)
-			{
-				plots++;
-				/*
-				if(config->plotPhase)
-					plots++;
-				*/
-				if(config->plotAllNotesWindowed && Signal->Blocks[i].audio.window_samples)
-					plots++;
-				if(Signal->Blocks[i].internalSyncCount)
-					plots += Signal->Blocks[i].internalSyncCount;
-			}
+			sprintf(name, "TD_%05ld_%s_%s_%05d_%s_%02d", 
+							block, Signal->role == ROLE_REF ? "1" : "2",
+							GetBlockName(config, block), GetBlockSubIndex(config, block), 
+							config->compareName, slot);
+			PlotBlockTimeDomainInternalSyncGraph(Signal, block, name, slot, config);
 		}
-		logmsg("\n  Creating %ld plots for %s:\n  ", plots, getRoleText(Signal));
 	}
-	plots = 0;
-	for(i = 0; i < config->types.totalBlocks; i++)
-	{
-		if(config->plotAllNotes || Signal->Blocks[i].type == TYPE_TIMEDOMAIN || (config->timeDomainSync && Signal->Blocks[i].type == TYPE_SYNC))
-		{
-			sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
-				i, Signal->role == ROLE_REF ? "1" : "2",
-				GetBlockName(config, i), GetBlockSubIndex(config, i), config->compareName);
-
-			PlotBlockTimeDomainGraph(Signal, i, name, WAVEFORM_GENERAL, 0, config);
-			logmsg(PLOT_ADVANCE_CHAR);
-			plots++;
-			if(plots == 80)
-			{
-				plots = 0;
-				logmsg("\n  ");
-			}
-
-			if(Signal->Blocks[i].internalSyncCount)
-			{
-				for(int slot = 0; slot < Signal->Blocks[i].internalSyncCount; slot++)
-				{
-					sprintf(name, "TD_%05ld_%s_%s_%05d_%s_%02d", 
-									i, Signal->role == ROLE_REF ? "1" : "2",
-									GetBlockName(config, i), GetBlockSubIndex(config, i), 
-									config->compareName, slot);
-					PlotBlockTimeDomainInternalSyncGraph(Signal, i, name, slot, config);
-				}
-			}
-
-			if(config->plotAllNotesWindowed && Signal->Blocks[i].audio.window_samples)
-			{
-				sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
-					i, Signal->role == ROLE_REF ? "3" : "4",
-					GetBlockName(config, i), GetBlockSubIndex(config, i), config->compareName);
 
-				PlotBlockTimeDomainGraph(Signal, i, name, WAVEFORM_WINDOW, 0, config);
+	if(config->plotAllNotesWindowed && Signal->Blocks[block].audio.window_samples)
+	{
+		sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
+			block, Signal->role == ROLE_REF ? "3" : "4",
+			GetBlockName(config, block), GetBlockSubIndex(config, block), config->compareName);
 
-				logmsg(PLOT_ADVANCE_CHAR);
-				plots++;
-				if(plots == 80)
-				{
-					plots = 0;
-					logmsg("\n  ");
-				}
-			}
-		}
+		PlotBlockTimeDomainGraph(Signal, block, name, WAVEFORM_WINDOW, 0, config);
+		logmsg(PLOT_ADVANCE_CHAR);
 	}
-	if(!config->plotAllNotes && plots > 40)
-		logmsg("\n  ");
+	return 1;
 }
 
 int ExecutePlotBlockTimeDomainGraph(int waveType, AudioSignal *Signal, long int block, double data, char *folder, parameters *config)
@@ -4578,85 +4987,50 @@ int ExecutePlotBlockTimeDomainGraph(int waveType, AudioSignal *Signal, long int
 
 	PlotBlockTimeDomainGraph(Signal, block, name, waveType, data, config);
 
-	ReturnToMainPath(&returnFolder);
+	PopFolder(&returnFolder);
 	return 1;
 }
 
-void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
+int IsHighDifferencePlotBlock(AudioSignal *Signal, long int block)
 {
-	int		plots = 0;
-	char	*returnFolder = NULL;
+	if(Signal->Blocks[block].type <= TYPE_CONTROL)
+		return 0;
+	return(Signal->Blocks[block].AverageDifference > 0 ||
+		Signal->Blocks[block].missingPercent > 0 ||
+		Signal->Blocks[block].extraPercent > 0);
+}
 
-	if(!config)
-		return;
+int PlotBlockHighDifferenceGraphs(AudioSignal *Signal, long int block, parameters *config)
+{
+	double diff = 0;
 
 	if(!config->Differences.BlockDiffArray)
-		return;
-
-	returnFolder = PushFolder(WAVEFORMDIFF_FOLDER);
-	if(!returnFolder)
-		return;
+		return 0;
 
-	for(long int b = 0; b < config->types.totalBlocks; b++)
+	diff = Signal->Blocks[block].AverageDifference;
+	if(diff > 0)
 	{
-		if(Signal->Blocks[b].type > TYPE_CONTROL)
-		{
-			double diff = 0;
-	
-			diff = Signal->Blocks[b].AverageDifference;
-			if(diff > 0)
-			{
-				if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_AMPDIFF, Signal, b, diff, WAVEFORMDIR_AMPL, config))
-				{
-					ReturnToMainPath(&returnFolder);
-					return;
-				}
-				logmsg(PLOT_ADVANCE_CHAR);
-				plots++;
-				if(plots == 80)
-				{
-					plots = 0;
-					logmsg("\n  ");
-				}
-			}
-			
-			diff = Signal->Blocks[b].missingPercent;
-			if(diff > 0)
-			{
-				if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_MISSING, Signal, b, diff, WAVEFORMDIR_MISS, config))
-				{
-					ReturnToMainPath(&returnFolder);
-					return;
-				}
-				logmsg(PLOT_ADVANCE_CHAR);
-				plots++;
-				if(plots == 80)
-				{
-					plots = 0;
-					logmsg("\n  ");
-				}
-			}
+		if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_AMPDIFF, Signal, block, diff, WAVEFORMDIR_AMPL, config))
+			return 0;
+		logmsg(PLOT_ADVANCE_CHAR);
+	}
 	
-			diff = Signal->Blocks[b].extraPercent;
-			if(diff > 0)
-			{
-				if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_EXTRA, Signal, b, diff, WAVEFORMDIR_EXTRA, config))
-				{
-					ReturnToMainPath(&returnFolder);
-					return;
-				}
-				logmsg(PLOT_ADVANCE_CHAR);
-				plots++;
-				if(plots == 80)
-				{
-					plots = 0;
-					logmsg("\n  ");
-				}
-			}
-		}
+	diff = Signal->Blocks[block].missingPercent;
+	if(diff > 0)
+	{
+		if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_MISSING, Signal, block, diff, WAVEFORMDIR_MISS, config))
+			return 0;
+		logmsg(PLOT_ADVANCE_CHAR);
 	}
-	logmsg("\n  ");
-	ReturnToMainPath(&returnFolder);
+
+	diff = Signal->Blocks[block].extraPercent;
+	if(diff > 0)
+	{
+		if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_EXTRA, Signal, block, diff, WAVEFORMDIR_EXTRA, config))
+			return 0;
+		logmsg(PLOT_ADVANCE_CHAR);
+	}
+	return 1;
 }
 
 void DrawVerticalFrameGrid(PlotFile *plot, AudioSignal *Signal, double frames, double frameIncrement, double MaxSamples, int forceDrawMS, parameters *config)
@@ -4881,13 +5255,105 @@ char *GetWFMTypeText(int wftype, char *buffer, double data, int role)
 	return buffer;
 }
 
+/*
+	With WAVEFORM_ENVELOPE or more samples per pixel column the
+	waveform is drawn as the min/max envelope of each column, which
+	is what the connected sample lines would cover. Zoomed plots
+	clip to MinY and MaxY and leave out what is fully outside.
+*/
+void DrawWaveformSamples(PlotFile *plot, sampleType *samples, long int numSamples, double MinY, double MaxY, int clip)
+{
+	long int	startColumn = 0, columns = 0, sample = 0;
+	long int	*first = NULL;
+	double		*minimum = NULL, *maximum = NULL, columnWidth = 0;
+
+	if(numSamples < 2)
+		return;
+
+	columnWidth = (plot->x1 - plot->x0)/plot->sizex;
+	if(columnWidth >= WAVEFORM_ENVELOPE)
+	{
+		startColumn = PlotPixelX(plot, 0);
+		columns = PlotPixelX(plot, numSamples - 1) - startColumn + 1;
+		first = (long int*)malloc(sizeof(long int)*(columns + 1));
+		minimum = (double*)malloc(sizeof(double)*columns);
+		maximum = (double*)malloc(sizeof(double)*columns);
+	}
+
+	if(!first || !minimum || !maximum)
+	{
+		if(first)
+			free(first);
+		if(minimum)
+			free(minimum);
+		if(maximum)
+			free(maximum);
+
+		for(sample = 0; sample < numSamples - 1; sample ++)
+		{
+			double s0 = samples[sample], s1 = samples[sample+1];
+
+			if(clip)
+			{
+				// draw samples outside zoom up to the zoom point
+				if(s0 > MaxY) s0 = MaxY;
+				if(s1 < MinY) s1 = MinY;
+
+				if(s0 < MinY) s0 = MinY;
+				if(s1 > MaxY) s1 = MaxY;
+
+				if(s0 == s1 && (s0 == MaxY || s0 == MinY))  // clear samples fully outside zoom
+					continue;
+			}
+			pl_fline_r(plot->plotter, sample, s0, sample+1, s1);
+		}
+		return;
+	}
+
+	first[0] = 0;
+	for(long int c = 1; c < columns; c++)
+	{
+		first[c] = (long int)ceil(plot->x0 + (startColumn + c)*columnWidth);
+		// match PlotPixelX where rounding puts a sample on the other side
+		while(first[c] > 0 && PlotPixelX(plot, first[c] - 1) >= startColumn + c)
+			first[c]--;
+		while(first[c] < numSamples - 1 && PlotPixelX(plot, first[c]) < startColumn + c)
+			first[c]++;
+		if(first[c] < first[c-1])
+			first[c] = first[c-1];
+		if(first[c] > numSamples - 1)
+			first[c] = numSamples - 1;
+	}
+	first[columns] = numSamples - 1;
+
+	CalculateEnvelope(samples, first, columns, minimum, maximum);
+
+	for(long int c = 0; c < columns; c++)
+	{
+		double low = minimum[c], high = maximum[c];
+
+		if(clip)
+		{
+			if(low < MinY) low = MinY;
+			if(high > MaxY) high = MaxY;
+			if(low > MaxY || high < MinY)
+				continue;
+		}
+		pl_fline_r(plot->plotter, first[c], low, first[c], high);
+	}
+
+	free(first);
+	free(minimum);
+	free(maximum);
+}
+
 void PlotBlockTimeDomainGraph(AudioSignal *Signal, int block, char *name, int wavetype, double data, parameters *config)
 {
 	int			forceMS = 0;
 	char		title[BUFFER_SIZE/2], buffer[BUFFER_SIZE];
 	PlotFile	plot;
-	long int	color = 0, sample = 0, numSamples = 0, difference = 0, plotSize = 0, sampleOffset = 0;
-	double		*samples = NULL;
+	long int	color = 0, numSamples = 0, difference = 0, plotSize = 0, sampleOffset = 0;
+	sampleType		*samples = NULL;
 	double		margin1 = 0, margin2 = 0, MaxY = config->highestValueBitDepth, MinY = config->lowestValueBitDepth;
 
 	if(config->zoomWaveForm != 0)
@@ -4959,28 +5425,7 @@ void PlotBlockTimeDomainGraph(AudioSignal *Signal, int block, char *name, int wa
 
 	// Draw samples
 	SetPenColor(color, 0xffff, &plot);
-	if(config->zoomWaveForm == 0)	// This is the regular plot
-	{
-		for(sample = 0; sample < numSamples - 1; sample ++)
-			pl_fline_r(plot.plotter, sample, samples[sample], sample+1, samples[sample+1]);
-	}
-	else	// This is for zoomed in plots
-	{
-		for(sample = 0; sample < numSamples - 1; sample ++)
-		{
-			double s0 = samples[sample], s1 = samples[sample+1];
-
-			// draw samples outside zoom up to the zoom point
-			if(s0 > MaxY) s0 = MaxY;
-			if(s1 < MinY) s1 = MinY;
-
-			if(s0 < MinY) s0 = MinY;
-			if(s1 > MaxY) s1 = MaxY;
-
-			if(!(s0 == s1 && (s0 == MaxY || s0 == MinY)))  // clear samples fully outside zoom
-				pl_fline_r(plot.plotter, sample, s0, sample+1, s1);
-		}
-	}
+	DrawWaveformSamples(&plot, samples, numSamples, MinY, MaxY, config->zoomWaveForm != 0);
 	pl_endpath_r(plot.plotter);
 
 	// Draw Extra Channel samples
@@ -4997,28 +5442,7 @@ void PlotBlockTimeDomainGraph(AudioSignal *Signal, int block, char *name, int wa
 		else
 			samples = Signal->Blocks[block].audioRight.samples;
 		SetPenColor(color, 0xffff, &plot);
-		if(config->zoomWaveForm == 0)	// This is the regular plot
-		{
-			for(sample = 0; sample < numSamples - 1; sample ++)
-				pl_fline_r(plot.plotter, sample, samples[sample], sample+1, samples[sample+1]);
-		}
-		else	// This is for zoomed in plots
-		{
-			for(sample = 0; sample < numSamples - 1; sample ++)
-			{
-				double s0 = samples[sample], s1 = samples[sample+1];
-	
-				// draw samples outside zoom up to the zoom point
-				if(s0 > MaxY) s0 = MaxY;
-				if(s1 < MinY) s1 = MinY;
-	
-				if(s0 < MinY) s0 = MinY;
-				if(s1 > MaxY) s1 = MaxY;
-	
-				if(!(s0 == s1 && (s0 == MaxY || s0 == MinY)))  // clear samples fully outside zoom
-					pl_fline_r(plot.plotter, sample, s0, sample+1, s1);
-			}
-		}
+		DrawWaveformSamples(&plot, samples, numSamples, MinY, MaxY, config->zoomWaveForm != 0);
 		pl_endpath_r(plot.plotter);
 		pl_restorestate_r(plot.plotter);
 	}
@@ -5036,8 +5460,8 @@ void PlotBlockTimeDomainInternalSyncGraph(AudioSignal *Signal, int block, char *
 {
 	char		title[1024];
 	PlotFile	plot;
-	long int	color = 0, sample = 0, numSamples = 0, difference = 0, plotSize = 0, frames = 0, sampleOffset = 0;
-	double		*samples = NULL;
+	long int	color = 0, numSamples = 0, difference = 0, plotSize = 0, frames = 0, sampleOffset = 0;
+	sampleType		*samples = NULL;
 	int			forceMS = 0;
 
 	if(!Signal || !config)
@@ -5096,8 +5520,7 @@ void PlotBlockTimeDomainInternalSyncGraph(AudioSignal *Signal, int block, char *
 
 	// Draw samples
 	SetPenColor(color, 0xffff, &plot);
-	for(sample = 0; sample < numSamples - 1; sample ++)
-		pl_fline_r(plot.plotter, sample, samples[sample], sample+1, samples[sample+1]);
+	DrawWaveformSamples(&plot, samples, numSamples, config->lowestValueBitDepth, config->highestValueBitDepth, 0);
 	pl_endpath_r(plot.plotter);
 
 	sprintf(title, "%s# %d-%d at %g (samples: %ld-%ld)", GetBlockName(config, block), GetBlockSubIndex(config, block),
@@ -5292,7 +5715,7 @@ int PlotEachTypePhase(FlatPhase *phaseDiff, long int size, char *filename, int p
 			logmsg(PLOT_ADVANCE_CHAR);
 
 			if(typeCount > 1)
-				ReturnToMainPath(&returnFolder);
+				PopFolder(&returnFolder);
 
 			types ++;
 		}
@@ -5600,6 +6023,7 @@ void PlotDifferenceTimeSpectrogram(parameters *config)
 
 	if(!CreatePlotFile(&plot, config))
 		return;
+	EnableRasterPlot(&plot, config);
 
 	DrawFrequencyHorizontalGrid(&plot, config->endHzPlot, 1000, config);
 	DrawLabelsTimeSpectrogram(&plot, floor(config->endHzPlot/1000), 1, config);
@@ -5657,9 +6081,7 @@ void PlotDifferenceTimeSpectrogram(parameters *config)
 						//if(1.0-(fabs(abs_significant - fabs(amplitude))/abs_significant) >= 0.5)
 							//logmsgFileOnly("%ghz: %g %g 0x%X [%g=1-(%g-%g)/%g]\n", y,
 								//amplitude, abs_significant, intensity, 1.0-(fabs(abs_significant - fabs(amplitude))/abs_significant), abs_significant, fabs(amplitude), abs_significant);
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x, y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawDenseSegment(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 
@@ -30,6 +30,7 @@
 #define MDFOURIER_PLOT_H
 
 #include "mdfourier.h"
+#include "raster.h"
 #include <plot.h>
 
 #define PLOT_PROCESS_CHAR "-"
@@ -50,6 +51,7 @@ typedef struct plot_st {
 	double			penWidth;
 	double			leftmargin;
 	char			*SpecialWarning;
+	plotRaster		*raster;
 } PlotFile;
 
 typedef struct averaged_freq{
@@ -122,6 +124,8 @@ typedef struct averaged_freq{
 #define	WAVEFORM_MISSING	3
 #define	WAVEFORM_EXTRA		4
 
+#define	WAVEFORM_ENVELOPE	2.0	// samples per pixel column to draw min/max envelopes
+
 typedef enum differencePlotType
 {
 	normalPlot,
@@ -153,8 +157,57 @@ typedef struct flat_phase_St {
 	char	channel;
 } FlatPhase;
 
+typedef struct plot_point_st {
+	double		x, y;
+	int			color;
+	long int	intensity;
+} plotPoint;
+
+#define	PLOT_TASK_BLOCK	64
+
+struct plot_task_st;
+typedef int (*plotTaskRun)(struct plot_task_st *task, parameters *config);
+
+typedef struct plot_task_st {
+	plotTaskRun			run;
+	char				*group;
+	char				*folder;
+	AudioSignal			*Signal;
+	char				channel;
+	long int			block;
+	FlatAmplDifference	*amplDiff;
+	long int			size;
+	double				seconds;
+} plotTask;
+
+typedef struct plot_schedule_st {
+	plotTask			*tasks;
+	long int			count;
+	long int			capacity;
+	FlatAmplDifference	*amplDiff;
+	long int			amplDiffSize;
+	parameters			*config;
+} plotSchedule;
+
 void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
-void PlotAmpDifferences(parameters *config);
+plotTask *AddPlotTask(plotSchedule *schedule, plotTaskRun run, char *group, char *folder, AudioSignal *Signal, char channel);
+int AddChannelPlotTasks(plotSchedule *schedule, plotTaskRun run, char *group, char *folder, AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+int CreatePlotSchedule(plotSchedule *schedule, AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+int PlotScheduleJob(long int job, int thread, void *data);
+int RunPlotSchedule(plotSchedule *schedule, parameters *config);
+void ReleasePlotSchedule(plotSchedule *schedule);
+void PrintPreliminaryResults(parameters *config);
+int PlotDifferencesTask(plotTask *task, parameters *config);
+int PlotAveragedTask(plotTask *task, parameters *config);
+int PlotMissingTask(plotTask *task, parameters *config);
+int PlotTimeSpectrogramTask(plotTask *task, parameters *config);
+int PlotSpectrogramTask(plotTask *task, parameters *config);
+int PlotCLKTask(plotTask *task, parameters *config);
+int PlotPhaseTask(plotTask *task, parameters *config);
+int PlotNoiseFloorTask(plotTask *task, parameters *config);
+int PlotTimeDomainTask(plotTask *task, parameters *config);
+int PlotHighDifferenceTask(plotTask *task, parameters *config);
+void PlotDifferenceGraphs(FlatAmplDifference *amplDiff, long int size, parameters *config);
 void PlotAllWeightedAmpDifferences(parameters *config);
 //void PlotFreqMissing(parameters *config);
 void PlotSpectrograms(AudioSignal *Signal, parameters *config);
@@ -165,6 +218,16 @@ int FillPlot(PlotFile *plot, char *name, double x0, double y0, double x1, double
 int FillPlotExtra(PlotFile *plot, char *name, int sizex, int sizey, double x0, double y0, double x1, double y1, double penWidth, double leftMarginSize, parameters *config);
 int CreatePlotFile(PlotFile *plot, parameters *config);
 int ClosePlot(PlotFile *plot);
+int EnableRasterPlot(PlotFile *plot, parameters *config);
+void GetPenColor(int colorIndex, long int color, long int *red, long int *green, long int *blue);
+void DrawDenseSegment(PlotFile *plot, int colorIndex, long int color, double x0, double y0, double x1, double y1);
+int PlotPixelX(PlotFile *plot, double x);
+int PlotPixelY(PlotFile *plot, double y);
+void AddPlotPoint(plotPoint *points, long int *count, double x, double y, int color, long int intensity);
+long int ReducePlotPoints(PlotFile *plot, plotPoint *points, long int count);
+long int ReducePlotBars(PlotFile *plot, plotPoint *points, long int count);
+void DrawPlotPoints(PlotFile *plot, plotPoint *points, long int count);
+void DrawPlotBars(PlotFile *plot, plotPoint *points, long int count, double bottom);
 void SetPenColorStr(char *colorName, long int color, PlotFile *plot);
 void SetPenColor(int colorIndex, long int color, PlotFile *plot);
 void SetFillColor(int colorIndex, long int color, PlotFile *plot);
@@ -212,9 +275,13 @@ void VisualizeWindows(windowManager *wm, parameters *config);
 
 char *GetCurrentPathAndChangeToResultsFolder(parameters *config);
 void ReturnToMainPath(char **CurrentPath);
+char *PushFolder(char *name);
+void PopFolder(char **previous);
 
 int PlotNoiseDifferentAmplitudesAveraged(FlatAmplDifference *amplDiff, long int size, char *filename, parameters *config, AudioSignal *Signal);
 void PlotNoiseDifferentAmplitudesAveragedInternal(FlatAmplDifference *amplDiff, long int size, int type, char *filename, AveragedFrequencies *averaged, long int avgsize, parameters *config, AudioSignal *Signal);
+void FindNoiseAmplitudeRange(FlatFrequency *freqs, long int size, int type, double *startAmplitude, double *endAmplitude, parameters *config);
+void SetReferenceNoiseRange(AudioSignal *ReferenceSignal, parameters *config);
 void PlotNoiseSpectrogram(FlatFrequency *freqs, long int size, int type, char channel, char *filename, int signal, parameters *config, AudioSignal *Signal);
 void SaveCSVAmpDiff(FlatAmplDifference *amplDiff, long int size, char *filename, parameters *config);
 
@@ -224,11 +291,14 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config);
 void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, parameters *config);
 
 void DrawLabelsTimeSpectrogram(PlotFile *plot, int khz, int khzIncrement, parameters *config);
-void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config);
+int IsTimeDomainPlotBlock(AudioSignal *Signal, long int block, parameters *config);
+int PlotBlockTimeDomainGraphs(AudioSignal *Signal, long int block, parameters *config);
+void DrawWaveformSamples(PlotFile *plot, sampleType *samples, long int numSamples, double MinY, double MaxY, int clip);
 void PlotBlockTimeDomainGraph(AudioSignal *Signal, int block, char *name, int window, double data, parameters *config);
 void PlotBlockPhaseGraph(AudioSignal *Signal, int block, char *name, parameters *config);
 void PlotBlockTimeDomainInternalSyncGraph(AudioSignal *Signal, int block, char *name, int slot, parameters *config);
-void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config);
+int IsHighDifferencePlotBlock(AudioSignal *Signal, long int block);
+int PlotBlockHighDifferenceGraphs(AudioSignal *Signal, long int block, parameters *config);
 
 FlatPhase *CreatePhaseFlatDifferences(parameters *config, long int *size);
 void PlotSingleTypePhase(FlatPhase *phaseDiff, long int size, int type, char *filename, int pType, char channel, parameters *config);
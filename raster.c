@@ -0,0 +1,322 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "raster.h"
+#include "log.h"
+#include <png.h>
+#include <setjmp.h>
+
+plotRaster *CreateRaster(int width, int height, double x0, double y0, double x1, double y1, int whiteBG)
+{
+	plotRaster	*raster = NULL;
+
+	if(width <= 0 || height <= 0 || x0 == x1 || y0 == y1)
+		return NULL;
+
+	raster = (plotRaster*)malloc(sizeof(plotRaster));
+	if(!raster)
+		return NULL;
+
+	memset(raster, 0, sizeof(plotRaster));
+	raster->pixels = (unsigned char*)malloc(sizeof(unsigned char)*3*width*height);
+	raster->covered = (unsigned char*)malloc(sizeof(unsigned char)*width*height);
+	if(!raster->pixels || !raster->covered)
+	{
+		if(raster->pixels)
+			free(raster->pixels);
+		if(raster->covered)
+			free(raster->covered);
+		free(raster);
+		return NULL;
+	}
+
+	memset(raster->pixels, 0, sizeof(unsigned char)*3*width*height);
+	memset(raster->covered, 0, sizeof(unsigned char)*width*height);
+	raster->width = width;
+	raster->height = height;
+	raster->x0 = x0;
+	raster->y0 = y0;
+	raster->x1 = x1;
+	raster->y1 = y1;
+	raster->scalex = width/(x1 - x0);
+	raster->scaley = height/(y1 - y0);
+	raster->whiteBG = whiteBG;
+	return raster;
+}
+
+void ReleaseRaster(plotRaster **raster)
+{
+	if(!*raster)
+		return;
+
+	if((*raster)->pixels)
+	{
+		free((*raster)->pixels);
+		(*raster)->pixels = NULL;
+	}
+	if((*raster)->covered)
+	{
+		free((*raster)->covered);
+		(*raster)->covered = NULL;
+	}
+	free(*raster);
+	*raster = NULL;
+}
+
+// Segment colours scale with intensity, so the brightest one wins on any background
+static inline void BlendPixel(plotRaster *raster, long int pos, unsigned char red, unsigned char green, unsigned char blue)
+{
+	unsigned char *pixel = raster->pixels + 3*pos;
+
+	raster->covered[pos] = 1;
+	if(red > pixel[0])
+		pixel[0] = red;
+	if(green > pixel[1])
+		pixel[1] = green;
+	if(blue > pixel[2])
+		pixel[2] = blue;
+}
+
+// The axes and labels go over the segments, darker on white and lighter on dark
+static inline void ComposePixel(plotRaster *raster, long int pos, const unsigned char *overlay)
+{
+	unsigned char *pixel = raster->pixels + 3*pos;
+
+	if(!raster->covered[pos])
+	{
+		memcpy(pixel, overlay, 3);
+		return;
+	}
+
+	for(int c = 0; c < 3; c++)
+	{
+		if(raster->whiteBG ? overlay[c] < pixel[c] : overlay[c] > pixel[c])
+			pixel[c] = overlay[c];
+	}
+}
+
+static inline int RasterX(plotRaster *raster, double x)
+{
+	return (int)floor((x - raster->x0)*raster->scalex);
+}
+
+static inline int RasterY(plotRaster *raster, double y)
+{
+	return (int)floor((raster->y1 - y)*raster->scaley);
+}
+
+/*
+	Colours are in libplot's 16 bit range, segments are one pixel
+	wide, which is what libplot draws for our pen widths.
+*/
+void RasterSegment(plotRaster *raster, double x0, double y0, double x1, double y1, long int red, long int green, long int blue)
+{
+	int				px0, py0, px1, py1, dx, dy, sx, sy, err;
+	unsigned char	r, g, b;
+
+	r = (unsigned char)(red >> 8);
+	g = (unsigned char)(green >> 8);
+	b = (unsigned char)(blue >> 8);
+
+	px0 = RasterX(raster, x0);
+	py0 = RasterY(raster, y0);
+	px1 = RasterX(raster, x1);
+	py1 = RasterY(raster, y1);
+
+	if(py0 == py1)
+	{
+		long int	row = 0;
+
+		if(py0 < 0 || py0 >= raster->height)
+			return;
+		if(px0 > px1)
+		{
+			int tmp = px0;
+
+			px0 = px1;
+			px1 = tmp;
+		}
+		if(px0 < 0)
+			px0 = 0;
+		if(px1 >= raster->width)
+			px1 = raster->width - 1;
+
+		row = (long int)py0*raster->width;
+		for(int x = px0; x <= px1; x++)
+			BlendPixel(raster, row + x, r, g, b);
+		return;
+	}
+
+	// Bresenham for anything else
+	dx = abs(px1 - px0);
+	dy = -abs(py1 - py0);
+	sx = px0 < px1 ? 1 : -1;
+	sy = py0 < py1 ? 1 : -1;
+	err = dx + dy;
+	while(1)
+	{
+		int e2 = 0;
+
+		if(px0 >= 0 && px0 < raster->width && py0 >= 0 && py0 < raster->height)
+			BlendPixel(raster, (long int)py0*raster->width + px0, r, g, b);
+		if(px0 == px1 && py0 == py1)
+			break;
+		e2 = 2*err;
+		if(e2 >= dy)
+		{
+			err += dy;
+			px0 += sx;
+		}
+		if(e2 <= dx)
+		{
+			err += dx;
+			py0 += sy;
+		}
+	}
+}
+
+/*
+	The PNG libplot wrote for the axes and labels is read back one
+	row at a time and blended into the framebuffer, which is then
+	written over it.
+*/
+int RasterComposePNG(plotRaster *raster, char *fileName)
+{
+	FILE			*file = NULL;
+	png_structp		png = NULL;
+	png_infop		info = NULL;
+	png_bytep		volatile row = NULL;
+	png_uint_32		width = 0, height = 0;
+	int				bitDepth = 0, colorType = 0, interlace = 0;
+
+	file = fopen(fileName, "rb");
+	if(!file)
+	{
+		logmsg("ERROR: Could not open %s for raster composition\n", fileName);
+		return 0;
+	}
+
+	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if(png)
+		info = png_create_info_struct(png);
+	if(!png || !info)
+	{
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(file);
+		logmsg("ERROR: Not enough memory (png read)\n");
+		return 0;
+	}
+
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_read_struct(&png, &info, NULL);
+		if(row)
+			free((void*)row);
+		fclose(file);
+		logmsg("ERROR: Invalid plot file %s\n", fileName);
+		return 0;
+	}
+
+	png_init_io(png, file);
+	png_read_info(png, info);
+	png_get_IHDR(png, info, &width, &height, &bitDepth, &colorType, &interlace, NULL, NULL);
+	if((int)width != raster->width || (int)height != raster->height)
+		png_error(png, "size mismatch");
+	// libplot only interlaces when asked to
+	if(interlace != PNG_INTERLACE_NONE)
+		png_error(png, "interlaced");
+
+	if(colorType == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if(colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+	{
+		if(bitDepth < 8)
+			png_set_expand_gray_1_2_4_to_8(png);
+		png_set_gray_to_rgb(png);
+	}
+	if(bitDepth == 16)
+		png_set_strip_16(png);
+	png_set_strip_alpha(png);
+	png_read_update_info(png, info);
+
+	row = (png_bytep)malloc(png_get_rowbytes(png, info));
+	if(!row)
+		png_error(png, "out of memory");
+
+	for(png_uint_32 y = 0; y < height; y++)
+	{
+		long int pos = (long int)y*raster->width;
+
+		png_read_row(png, row, NULL);
+		for(png_uint_32 x = 0; x < width; x++)
+			ComposePixel(raster, pos + x, row + 3*x);
+	}
+
+	free((void*)row);
+	row = NULL;
+	png_read_end(png, NULL);
+	png_destroy_read_struct(&png, &info, NULL);
+	fclose(file);
+
+	file = fopen(fileName, "wb");
+	if(!file)
+	{
+		logmsg("ERROR: Could not write %s\n", fileName);
+		return 0;
+	}
+
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if(png)
+		info = png_create_info_struct(png);
+	if(!png || !info)
+	{
+		png_destroy_write_struct(&png, &info);
+		fclose(file);
+		logmsg("ERROR: Not enough memory (png write)\n");
+		return 0;
+	}
+
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		fclose(file);
+		logmsg("ERROR: Could not write %s\n", fileName);
+		return 0;
+	}
+
+	png_init_io(png, file);
+	png_set_IHDR(png, info, raster->width, raster->height, 8, PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+	for(int y = 0; y < raster->height; y++)
+		png_write_row(png, raster->pixels + 3*(long int)y*raster->width);
+	png_write_end(png, NULL);
+	png_destroy_write_struct(&png, &info);
+	fclose(file);
+	return 1;
+}
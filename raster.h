@@ -0,0 +1,56 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_RASTER_H
+#define MDFOURIER_RASTER_H
+
+#include "mdfourier.h"
+
+/*
+	Framebuffer for plots that are a dense grid of coloured segments.
+	Segments are blended with max, which keeps the brightest
+	contribution of overlapping segments no matter the order they are
+	drawn in. Pixels no segment touched keep the background, and the
+	axes are composed over the rest with min on white backgrounds and
+	with max on dark ones.
+*/
+typedef struct raster_st {
+	unsigned char	*pixels;		// RGB, 8 bits per channel
+	unsigned char	*covered;		// set where a segment was drawn
+	int				width, height;
+	double			x0, y0, x1, y1;	// user space, as in pl_fspace_r
+	double			scalex, scaley;
+	int				whiteBG;
+} plotRaster;
+
+plotRaster *CreateRaster(int width, int height, double x0, double y0, double x1, double y1, int whiteBG);
+void ReleaseRaster(plotRaster **raster);
+void RasterSegment(plotRaster *raster, double x0, double y0, double x1, double y1, long int red, long int green, long int blue);
+int RasterComposePNG(plotRaster *raster, char *fileName);
+
+#endif
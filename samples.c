@@ -0,0 +1,475 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include <math.h>
+#include "mdfourier.h"
+#include "samples.h"
+#include "log.h"
+
+#define SAMPLE_CHUNK	4096
+
+/*
+	A 16 bit capture widened to double takes four times the memory it
+	needs. Samples stay as they came from the file and are converted
+	block by block into the caller's scratch buffer.
+*/
+
+void InitSamples(sampleStore *store)
+{
+	if(!store)
+		return;
+
+	store->data = NULL;
+	store->format = SAMPLE_INTERNAL;
+	store->count = 0;
+	store->channels = 1;
+	store->gain[0] = 1.0;
+	store->gain[1] = 1.0;
+	store->stream = NULL;
+}
+
+size_t SampleFormatWidth(char format)
+{
+	switch(format)
+	{
+		case SAMPLE_INT16:
+			return sizeof(int16_t);
+		case SAMPLE_INT32:
+			return sizeof(int32_t);
+		case SAMPLE_FLOAT:
+			return sizeof(float);
+		case SAMPLE_INTERNAL:
+			return sizeof(sampleType);
+	}
+	return 0;
+}
+
+int SampleFormatForBits(int bitsPerSample, int isFloat)
+{
+	if(isFloat)
+		return SAMPLE_FLOAT;
+	if(bitsPerSample <= 16)
+		return SAMPLE_INT16;
+	return SAMPLE_INT32;
+}
+
+int AllocateSamples(sampleStore *store, char format, long int count, int channels)
+{
+	size_t	width = 0;
+
+	if(!store)
+		return 0;
+
+	width = SampleFormatWidth(format);
+	if(!width || count <= 0)
+		return 0;
+
+	// calloc lets the OS hand out zeroed pages lazily, decoding can start sooner
+	store->data = calloc(count, width);
+	if(!store->data)
+		return 0;
+
+	store->format = format;
+	store->count = count;
+	store->channels = channels == 2 ? 2 : 1;
+	store->gain[0] = 1.0;
+	store->gain[1] = 1.0;
+	return 1;
+}
+
+void ReleaseSampleStore(sampleStore *store)
+{
+	if(!store)
+		return;
+
+	EndSampleStream(store);
+	if(store->data)
+		free(store->data);
+	InitSamples(store);
+}
+
+#define CONVERT_SAMPLES(type) \
+{ \
+	type *src = ((type*)store->data) + pos; \
+	if(store->gain[0] == 1.0 && store->gain[1] == 1.0) \
+	{ \
+		for(long int i = 0; i < available; i++) \
+			buffer[i] = (sampleType)src[i]; \
+	} \
+	else \
+	{ \
+		for(long int i = 0; i < available; i++) \
+			buffer[i] = (sampleType)((double)src[i]*store->gain[store->channels == 2 ? (pos+i) & 1 : 0]); \
+	} \
+}
+
+// Converts count samples at pos, zero filling past the end of the store
+int CopySamples(sampleStore *store, long int pos, long int count, sampleType *buffer)
+{
+	long int	available = count;
+
+	if(!store || !store->data || !buffer || pos < 0 || count < 0)
+		return 0;
+
+	if(store->stream && !WaitForSamples(store, pos, count))
+		return 0;
+
+	if(pos > store->count)
+		pos = store->count;
+	if(pos + available > store->count)
+		available = store->count - pos;
+
+	switch(store->format)
+	{
+		case SAMPLE_INT16:
+			CONVERT_SAMPLES(int16_t);
+			break;
+		case SAMPLE_INT32:
+			CONVERT_SAMPLES(int32_t);
+			break;
+		case SAMPLE_FLOAT:
+			CONVERT_SAMPLES(float);
+			break;
+		case SAMPLE_INTERNAL:
+			CONVERT_SAMPLES(sampleType);
+			break;
+		default:
+			return 0;
+	}
+
+	if(available < count)
+		memset(buffer+available, 0, sizeof(sampleType)*(count-available));
+	return 1;
+}
+
+double GetSample(sampleStore *store, long int pos)
+{
+	sampleType	value = 0;
+
+	if(!CopySamples(store, pos, 1, &value))
+		return 0;
+	return value;
+}
+
+int MoveSamples(sampleStore *store, long int dest, long int src, long int count)
+{
+	size_t	width = 0;
+
+	if(!store || !store->data || count <= 0)
+		return 0;
+	if(dest < 0 || src < 0 || dest + count > store->count || src + count > store->count)
+		return 0;
+	if(store->stream && !WaitForSamples(store, src, count))
+		return 0;
+
+	width = SampleFormatWidth(store->format);
+	memmove((char*)store->data + dest*width, (char*)store->data + src*width, count*width);
+	return 1;
+}
+
+int ZeroSamples(sampleStore *store, long int pos, long int count)
+{
+	size_t	width = 0;
+
+	if(!store || !store->data || count <= 0)
+		return 0;
+	if(pos < 0)
+	{
+		count += pos;
+		pos = 0;
+	}
+	if(pos + count > store->count)
+		count = store->count - pos;
+	if(count <= 0)
+		return 0;
+
+	width = SampleFormatWidth(store->format);
+	memset((char*)store->data + pos*width, 0, count*width);
+	return 1;
+}
+
+// Scaling is deferred to conversion, so integer samples are not requantized
+void ApplySampleGain(sampleStore *store, char channel, double ratio)
+{
+	if(!store)
+		return;
+
+	if(channel == CHANNEL_LEFT || channel == CHANNEL_STEREO || channel == CHANNEL_MONO)
+		store->gain[0] *= ratio;
+	if(channel == CHANNEL_RIGHT || channel == CHANNEL_STEREO)
+		store->gain[1] *= ratio;
+}
+
+// Converts the whole store to sampleType, for code that modifies samples in place
+int PromoteSamples(sampleStore *store)
+{
+	sampleType	*samples = NULL;
+
+	if(!store || !store->data)
+		return 0;
+
+	if(store->format == SAMPLE_INTERNAL && store->gain[0] == 1.0 && store->gain[1] == 1.0)
+		return 1;
+
+	samples = (sampleType*)malloc(sizeof(sampleType)*store->count);
+	if(!samples)
+	{
+		logmsg("\tERROR: Not enough memory to convert samples\n");
+		return 0;
+	}
+
+	if(!CopySamples(store, 0, store->count, samples))
+	{
+		free(samples);
+		return 0;
+	}
+
+	free(store->data);
+	store->data = samples;
+	store->format = SAMPLE_INTERNAL;
+	store->gain[0] = 1.0;
+	store->gain[1] = 1.0;
+	return 1;
+}
+
+sampleType *InternalSamples(sampleStore *store)
+{
+	if(!store || store->format != SAMPLE_INTERNAL)
+		return NULL;
+	return (sampleType*)store->data;
+}
+
+// Scans [start, end) in converted chunks, so callers see the applied gain
+int FindMaxAbsSample(sampleStore *store, long int start, long int end, double *maxValue, long int *maxPos)
+{
+	sampleType	chunk[SAMPLE_CHUNK];
+	long int	pos = 0;
+
+	if(!store || !store->data || !maxValue)
+		return 0;
+
+	*maxValue = 0;
+	if(maxPos)
+		*maxPos = start;
+	if(end > store->count)
+		end = store->count;
+
+	for(pos = start; pos < end; pos += SAMPLE_CHUNK)
+	{
+		long int	i = 0, count = SAMPLE_CHUNK;
+
+		if(pos + count > end)
+			count = end - pos;
+		if(!CopySamples(store, pos, count, chunk))
+			return 0;
+		for(i = 0; i < count; i++)
+		{
+			double sample;
+
+			sample = fabs(chunk[i]);
+			if(sample > *maxValue)
+			{
+				*maxValue = sample;
+				if(maxPos)
+					*maxPos = pos + i;
+			}
+		}
+	}
+	return 1;
+}
+
+int BeginSampleStream(sampleStore *store, int ranges)
+{
+	sampleStream	*stream = NULL;
+
+	if(!store || ranges < 1 || store->stream)
+		return 0;
+
+	stream = (sampleStream*)malloc(sizeof(sampleStream));
+	if(!stream)
+		return 0;
+	memset(stream, 0, sizeof(sampleStream));
+
+	stream->ranges = (sampleRange*)malloc(sizeof(sampleRange)*ranges);
+	if(!stream->ranges)
+	{
+		free(stream);
+		return 0;
+	}
+	memset(stream->ranges, 0, sizeof(sampleRange)*ranges);
+	stream->count = ranges;
+
+	// until the decoder splits the file, all of it is pending
+	stream->ranges[0].end = store->count;
+
+	if(pthread_mutex_init(&stream->lock, NULL) != 0)
+	{
+		free(stream->ranges);
+		free(stream);
+		return 0;
+	}
+	if(pthread_cond_init(&stream->ready, NULL) != 0)
+	{
+		pthread_mutex_destroy(&stream->lock);
+		free(stream->ranges);
+		free(stream);
+		return 0;
+	}
+
+	store->stream = stream;
+	return 1;
+}
+
+void SetStreamRange(sampleStore *store, int range, long int start, long int end)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+
+	if(!stream || range < 0 || range >= stream->count)
+		return;
+
+	pthread_mutex_lock(&stream->lock);
+	stream->ranges[range].start = start;
+	stream->ranges[range].end = end;
+	stream->ranges[range].ready = start;
+	pthread_mutex_unlock(&stream->lock);
+}
+
+void PublishSamples(sampleStore *store, int range, long int ready)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+
+	if(!stream || range < 0 || range >= stream->count)
+		return;
+
+	pthread_mutex_lock(&stream->lock);
+	stream->ranges[range].ready = ready;
+	pthread_cond_broadcast(&stream->ready);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+void FinishSampleStream(sampleStore *store, int failed)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+
+	if(!stream)
+		return;
+
+	pthread_mutex_lock(&stream->lock);
+	stream->finished = 1;
+	stream->failed = failed;
+	pthread_cond_broadcast(&stream->ready);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+// Called by the reader when the samples are no longer needed
+void CancelSampleStream(sampleStore *store)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+
+	if(!stream)
+		return;
+
+	pthread_mutex_lock(&stream->lock);
+	stream->cancelled = 1;
+	pthread_cond_broadcast(&stream->ready);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+int SampleStreamCancelled(sampleStore *store)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+	int				cancelled = 0;
+
+	if(!stream)
+		return 0;
+
+	pthread_mutex_lock(&stream->lock);
+	cancelled = stream->cancelled;
+	pthread_mutex_unlock(&stream->lock);
+	return cancelled;
+}
+
+int StreamRangeReady(sampleStream *stream, long int pos, long int end)
+{
+	for(int i = 0; i < stream->count; i++)
+	{
+		sampleRange	*range = &stream->ranges[i];
+		long int	needed = 0;
+
+		if(range->end <= pos || range->start >= end)
+			continue;
+
+		needed = end < range->end ? end : range->end;
+		if(range->ready < needed)
+			return 0;
+	}
+	return 1;
+}
+
+// Blocks until [pos, pos+count) has been decoded, returns 0 if it never will be
+int WaitForSamples(sampleStore *store, long int pos, long int count)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+	int				ok = 1;
+
+	if(!stream)
+		return 1;
+
+	pthread_mutex_lock(&stream->lock);
+	while(!StreamRangeReady(stream, pos, pos + count))
+	{
+		// a short decode leaves the rest of the store zeroed
+		if(stream->finished)
+			break;
+		if(stream->cancelled)
+		{
+			ok = 0;
+			break;
+		}
+		pthread_cond_wait(&stream->ready, &stream->lock);
+	}
+	if(stream->failed)
+		ok = 0;
+	pthread_mutex_unlock(&stream->lock);
+	return ok;
+}
+
+// Only once the decoder has been joined
+void EndSampleStream(sampleStore *store)
+{
+	sampleStream	*stream = store ? store->stream : NULL;
+
+	if(!stream)
+		return;
+
+	pthread_cond_destroy(&stream->ready);
+	pthread_mutex_destroy(&stream->lock);
+	free(stream->ranges);
+	free(stream);
+	store->stream = NULL;
+}
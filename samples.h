@@ -0,0 +1,80 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_SAMPLES_H
+#define MDFOURIER_SAMPLES_H
+
+#include "mdfourier.h"
+#include <pthread.h>
+
+/*
+	While a file is decoded in the background its store has a stream.
+	Decoders publish how far each of their ranges has been written,
+	and reads through CopySamples block until the samples they need
+	are there. Ranges are in interleaved samples.
+*/
+typedef struct sample_range_st {
+	long int	start;
+	long int	end;
+	long int	ready;
+} sampleRange;
+
+typedef struct sample_stream_st {
+	sampleRange		*ranges;
+	int				count;
+	int				finished;
+	int				failed;
+	int				cancelled;
+	pthread_mutex_t	lock;
+	pthread_cond_t	ready;
+} sampleStream;
+
+void InitSamples(sampleStore *store);
+int AllocateSamples(sampleStore *store, char format, long int count, int channels);
+void ReleaseSampleStore(sampleStore *store);
+int SampleFormatForBits(int bitsPerSample, int isFloat);
+int CopySamples(sampleStore *store, long int pos, long int count, sampleType *buffer);
+double GetSample(sampleStore *store, long int pos);
+int MoveSamples(sampleStore *store, long int dest, long int src, long int count);
+int ZeroSamples(sampleStore *store, long int pos, long int count);
+void ApplySampleGain(sampleStore *store, char channel, double ratio);
+int PromoteSamples(sampleStore *store);
+sampleType *InternalSamples(sampleStore *store);
+size_t SampleFormatWidth(char format);
+int BeginSampleStream(sampleStore *store, int ranges);
+void SetStreamRange(sampleStore *store, int range, long int start, long int end);
+void PublishSamples(sampleStore *store, int range, long int ready);
+void FinishSampleStream(sampleStore *store, int failed);
+void CancelSampleStream(sampleStore *store);
+int SampleStreamCancelled(sampleStore *store);
+int StreamRangeReady(sampleStream *stream, long int pos, long int end);
+int WaitForSamples(sampleStore *store, long int pos, long int count);
+void EndSampleStream(sampleStore *store);
+int FindMaxAbsSample(sampleStore *store, long int start, long int end, double *maxValue, long int *maxPos);
+
+#endif
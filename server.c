@@ -0,0 +1,679 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "server.h"
+#include "json.h"
+#include "log.h"
+#include "cline.h"
+#include "diff.h"
+#include "freq.h"
+#include "loadfile.h"
+#include "profile.h"
+#include "plans.h"
+#include "samples.h"
+#include "sync.h"
+#include "batch.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+
+/*
+	The job server (-6) listens on a Unix domain socket and runs one
+	comparison at a time. A request is a single line JSON object with
+	the client working folder and the same arguments as the command
+	line, {"cwd":"/path","args":["-P","p.mdf","-r","a.wav","-c","b.wav"]}.
+	Jobs run as the server user, so the socket is created private to it.
+
+	Each job runs in a child process, so a crash or a leak can't take
+	the server down, and the child inherits what the server keeps warm:
+	the FFTW wisdom, re-imported after every job, and the References
+	that were already loaded and synced with the same options. Those are
+	kept in memory up to -3 MB and the least recently used are released
+	first. Since the child gets a copy-on-write view, the server copy is
+	never changed by the comparison. Spectra come from the sidecar caches.
+
+	The output of the child is streamed back as {"log":"text"} lines,
+	and a last line has the status, results folder and match totals.
+*/
+
+static serverReference	references[SERVER_MAX_REFERENCES];
+static int				referenceCount = 0;
+static size_t			referenceMemory = 0;
+static unsigned long	referenceClock = 0;
+static unsigned long	jobCount = 0;
+static int				serverFd = -1;
+static volatile sig_atomic_t	serverQuit = 0;
+
+static void StopServer(int signum)
+{
+	serverQuit = 1;
+}
+
+static void ResetOptions()
+{
+#if defined(__GLIBC__)
+	optind = 0;
+#else
+	optind = 1;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+	optreset = 1;
+#endif
+#endif
+}
+
+static int AddServerArgument(serverJob *job, char *arg)
+{
+	if(job->argCount == SERVER_MAX_ARGS - 1)
+	{
+		sprintf(job->error, "Too many arguments");
+		return 0;
+	}
+	job->args[job->argCount] = strdup(arg);
+	if(!job->args[job->argCount])
+	{
+		sprintf(job->error, "Not enough memory");
+		return 0;
+	}
+	job->argCount++;
+	job->args[job->argCount] = NULL;
+	return 1;
+}
+
+static void ReleaseServerJob(serverJob *job)
+{
+	for(int i = 0; i < job->argCount; i++)
+	{
+		free(job->args[i]);
+		job->args[i] = NULL;
+	}
+	job->argCount = 0;
+}
+
+static int ParseServerJob(char *line, char *program, serverJob *job)
+{
+	char	*pos = NULL, arg[BUFFER_SIZE];
+
+	if(!JSONGetString(line, "cwd", job->cwd, BUFFER_SIZE))
+	{
+		sprintf(job->error, "Request needs a \"cwd\" string");
+		return 0;
+	}
+
+	pos = JSONFindKey(line, "args");
+	if(!pos || *pos != '[')
+	{
+		sprintf(job->error, "Request needs an \"args\" array");
+		return 0;
+	}
+
+	if(!AddServerArgument(job, program))
+		return 0;
+
+	pos = JSONSkipSpace(pos + 1);
+	if(*pos == ']')
+		return 1;
+	while(1)
+	{
+		pos = JSONReadString(pos, arg, BUFFER_SIZE);
+		if(!pos)
+		{
+			sprintf(job->error, "Invalid string in \"args\"");
+			return 0;
+		}
+		if(!AddServerArgument(job, arg))
+			return 0;
+		pos = JSONSkipSpace(pos);
+		if(*pos == ']')
+			return 1;
+		if(*pos != ',')
+		{
+			sprintf(job->error, "Invalid \"args\" array");
+			return 0;
+		}
+		pos++;
+	}
+	return 0;
+}
+
+/*
+	A loaded Reference can be used by any job with the same folder and
+	arguments, only the comparison file and summary may change. The
+	Reference and profile sizes and dates are added so edits are seen.
+*/
+static char *BuildReferenceKey(serverJob *job, parameters *config)
+{
+	batchRun	batch;
+	struct stat	refInfo, profileInfo;
+	char		*key = NULL, *pos = NULL;
+	size_t		size = 0;
+
+	if(stat(config->referenceFile, &refInfo) != 0 || stat(config->profileFile, &profileInfo) != 0)
+		return NULL;
+
+	memset(&batch, 0, sizeof(batchRun));
+	if(FilterBatchArguments(job->argCount, job->args, "cG", &batch))
+	{
+		size = strlen(job->cwd) + 128;
+		for(int i = 1; i < batch.argCount; i++)
+			size += strlen(batch.args[i]) + 1;
+
+		key = (char*)malloc(size);
+		if(key)
+		{
+			pos = key + sprintf(key, "%s\n%ld %ld\n%ld %ld", job->cwd,
+					(long int)refInfo.st_size, (long int)refInfo.st_mtime,
+					(long int)profileInfo.st_size, (long int)profileInfo.st_mtime);
+			for(int i = 1; i < batch.argCount; i++)
+				pos += sprintf(pos, "\n%s", batch.args[i]);
+		}
+	}
+
+	for(int i = 0; i < batch.argCount; i++)
+		free(batch.args[i]);
+	return key;
+}
+
+static void ReleaseServerReference(serverReference *ref)
+{
+	if(ref->Signal)
+	{
+		ReleaseAudio(ref->Signal, &ref->config);
+		free(ref->Signal);
+		ref->Signal = NULL;
+	}
+	ReleaseAudioBlockStructure(&ref->config);
+	if(ref->log.text)
+		free(ref->log.text);
+	InitLogBuffer(&ref->log);
+	if(ref->key)
+		free(ref->key);
+	ref->key = NULL;
+}
+
+static void ReleaseOldestReference()
+{
+	int	oldest = 0;
+
+	for(int i = 1; i < referenceCount; i++)
+	{
+		if(references[i].lastUsed < references[oldest].lastUsed)
+			oldest = i;
+	}
+
+	logmsg(" - Releasing Reference %s (%0.2f MB)\n",
+		references[oldest].config.referenceFile, references[oldest].size/(1024.0*1024.0));
+	referenceMemory -= references[oldest].size;
+	ReleaseServerReference(&references[oldest]);
+	references[oldest] = references[--referenceCount];
+}
+
+static void TrimServerReferences(size_t limit)
+{
+	while(referenceCount && referenceMemory > limit)
+		ReleaseOldestReference();
+}
+
+static size_t GetReferenceMemory(serverReference *ref)
+{
+	size_t	size = sizeof(AudioSignal);
+
+	size += SampleFormatWidth(ref->Signal->Samples.format)*ref->Signal->Samples.count;
+	size += sizeof(AudioBlocks)*ref->config.types.totalBlocks;
+	return size;
+}
+
+static serverReference *GetServerReference(char *key, parameters *jobConfig, parameters *config)
+{
+	serverReference	ref;
+	size_t			limit = (size_t)config->serverMemory*1024*1024;
+	int				loaded = 0;
+
+	for(int i = 0; i < referenceCount; i++)
+	{
+		if(strcmp(references[i].key, key) == 0)
+		{
+			references[i].lastUsed = ++referenceClock;
+			free(key);
+			logmsg(" - Using loaded Reference %s\n", references[i].config.referenceFile);
+			return &references[i];
+		}
+	}
+
+	memset(&ref, 0, sizeof(serverReference));
+	ref.config = *jobConfig;
+	InitLogBuffer(&ref.log);
+
+	// Keep the output for the log of each job that uses it
+	SetThreadLogBuffer(&ref.log);
+	loaded = LoadProfile(&ref.config) && EndProfileLoad(&ref.config) &&
+		LoadFile(&ref.Signal, ref.config.referenceFile, ROLE_REF, &ref.config);
+	SetThreadLogBuffer(NULL);
+
+	// Worker threads don't survive fork()
+	ReleaseSyncPool();
+
+	if(!loaded)
+	{
+		// The job runs as usual and reports the error
+		ReleaseServerReference(&ref);
+		free(key);
+		return NULL;
+	}
+
+	ref.key = key;
+	ref.size = GetReferenceMemory(&ref);
+	ref.lastUsed = ++referenceClock;
+
+	TrimServerReferences(ref.size < limit ? limit - ref.size : 0);
+	if(referenceCount == SERVER_MAX_REFERENCES)
+		ReleaseOldestReference();
+
+	references[referenceCount] = ref;
+	referenceMemory += ref.size;
+	logmsg(" - Loaded Reference %s (%0.2f MB, %d kept)\n",
+		ref.config.referenceFile, ref.size/(1024.0*1024.0), referenceCount + 1);
+	return &references[referenceCount++];
+}
+
+static int RunServerJob(serverJob *job, serverReference *ref)
+{
+	parameters	config;
+
+	if(!Header(0, job->argCount, job->args))
+		return 1;
+
+	ResetOptions();
+	if(!commandline(job->argCount, job->args, &config))
+		return 1;
+
+	if(!ref)
+		return(ExecuteMDFourier(job->argCount, job->args, NULL, NULL, &config));
+
+	sprintf(ref->config.comparisonFile, "%s", config.comparisonFile);
+	sprintf(ref->config.precisionFile, "%s", config.precisionFile);
+	return(ExecuteMDFourier(job->argCount, job->args, ref->Signal, &ref->log, &ref->config));
+}
+
+static void SendServerLog(FILE *client, char *text)
+{
+	fprintf(client, "{\"log\":");
+	JSONWriteString(client, text);
+	fprintf(client, "}\n");
+	fflush(client);
+}
+
+static int RunServerChild(serverJob *job, serverReference *ref, FILE *client)
+{
+	int		fds[2], status = 0;
+	pid_t	pid;
+	FILE	*output = NULL;
+	char	line[BUFFER_SIZE];
+	char	*results = "Results stored in ";
+
+	if(pipe(fds) == -1)
+	{
+		sprintf(job->error, "Could not start comparison");
+		return -1;
+	}
+
+	fflush(NULL);
+	pid = fork();
+	if(pid == -1)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		sprintf(job->error, "Could not start comparison");
+		return -1;
+	}
+
+	if(pid == 0)
+	{
+		close(serverFd);
+		close(fileno(client));
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[1]);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGPIPE, SIG_DFL);
+
+		status = RunServerJob(job, ref);
+		fflush(stdout);
+		fflush(stderr);
+		_exit(status);
+	}
+
+	close(fds[1]);
+	output = fdopen(fds[0], "r");
+	if(!output)
+		close(fds[0]);
+	while(output && fgets(line, BUFFER_SIZE, output))
+	{
+		char	text[BUFFER_SIZE];
+		int		len = 0;
+
+		// a client that went away doesn't stop the job
+		SendServerLog(client, line);
+
+		snprintf(text, sizeof(text), "%s", line);
+		len = strlen(text);
+		while(len && (text[len-1] == '\n' || text[len-1] == '\r'))
+			text[--len] = '\0';
+		if(strncmp(text, results, strlen(results)) == 0)
+			snprintf(job->resultFolder, sizeof(job->resultFolder), "%s", text + strlen(results));
+		if(strstr(text, "ERROR"))
+			snprintf(job->error, sizeof(job->error), "%s", text);
+	}
+	if(output)
+		fclose(output);
+
+	while(waitpid(pid, &status, 0) == -1)
+	{
+		if(errno != EINTR)
+			return -1;
+	}
+	if(WIFEXITED(status))
+		return(WEXITSTATUS(status));
+	sprintf(job->error, "Comparison was terminated");
+	return -1;
+}
+
+static void SendServerResult(FILE *client, serverJob *job, int status)
+{
+	AudioDifference	totals;
+	double			average = 0;
+	int				hasTotals = 0, blocks = 0;
+	char			precision[64];
+
+	if(job->ownSummary)
+	{
+		FILE *file = NULL;
+
+		file = fopen(job->summaryFile, "r");
+		if(file)
+		{
+			hasTotals = ReadPrecisionTotals(file, precision, &blocks, &totals, &average) == 1;
+			fclose(file);
+		}
+		remove(job->summaryFile);
+	}
+
+	fprintf(client, "{\"status\":\"%s\",\"exit\":%d", status == 0 ? "ok" : "failed", status);
+	if(job->resultFolder[0])
+	{
+		fprintf(client, ",\"results\":");
+		JSONWriteString(client, job->resultFolder);
+	}
+	if(status == 0 && hasTotals)
+	{
+		fprintf(client, ",\"compared\":%ld,\"different\":%ld,\"matched\":%.6f,\"average\":%.6f",
+			totals.cntTotalCompared, totals.cntTotalAudioDiff,
+			MatchPercent(totals.cntTotalCompared, totals.cntTotalAudioDiff), average);
+	}
+	if(status != 0 && job->error[0])
+	{
+		fprintf(client, ",\"error\":");
+		JSONWriteString(client, job->error);
+	}
+	fprintf(client, "}\n");
+	fflush(client);
+}
+
+static void RunServerRequest(char *line, char *program, FILE *client, parameters *config)
+{
+	serverJob		job;
+	serverReference	*ref = NULL;
+	parameters		jobConfig;
+	logBuffer		parseLog;
+	int				status = -1, parsed = 0;
+
+	memset(&job, 0, sizeof(serverJob));
+	jobCount++;
+
+	if(!ParseServerJob(line, program, &job))
+	{
+		logmsg(" - Job %lu: invalid request, %s\n", jobCount, job.error);
+		SendServerResult(client, &job, status);
+		ReleaseServerJob(&job);
+		return;
+	}
+
+	if(chdir(job.cwd) == -1)
+	{
+		snprintf(job.error, sizeof(job.error), "Could not open working folder %.*s", (int)sizeof(job.error) - 32, job.cwd);
+		SendServerResult(client, &job, status);
+		ReleaseServerJob(&job);
+		return;
+	}
+
+	// The child parses again and reports any errors to the client
+	ResetOptions();
+	InitLogBuffer(&parseLog);
+	SetThreadLogBuffer(&parseLog);
+	parsed = commandline(job.argCount, job.args, &jobConfig);
+	SetThreadLogBuffer(NULL);
+	if(parseLog.text)
+		free(parseLog.text);
+
+	if(parsed && jobConfig.serverSocket[0])
+	{
+		sprintf(job.error, "A job can't start another server");
+		logmsg(" - Job %lu: %s\n", jobCount, job.error);
+		SendServerResult(client, &job, status);
+		ReleaseServerJob(&job);
+		return;
+	}
+
+	logmsg(" - Job %lu: %s\n", jobCount, parsed ? (jobConfig.batchSource[0] ? jobConfig.batchSource : jobConfig.comparisonFile) : "invalid arguments");
+	if(parsed && !jobConfig.batchSource[0])
+	{
+		char	*key = NULL;
+
+		key = BuildReferenceKey(&job, &jobConfig);
+		if(key)
+			ref = GetServerReference(key, &jobConfig, config);
+
+		// Totals come back through a precision summary, like in batch mode
+		if(!jobConfig.precisionFile[0])
+		{
+			char	*tmp = getenv("TMPDIR");
+
+			snprintf(job.summaryFile, sizeof(job.summaryFile), "%s/mdfserver_%ld_%lu.txt",
+				tmp && tmp[0] ? tmp : "/tmp", (long int)getpid(), jobCount);
+			job.ownSummary = AddServerArgument(&job, "-G") && AddServerArgument(&job, job.summaryFile);
+		}
+	}
+
+	status = RunServerChild(&job, ref, client);
+	logmsg(" - Job %lu: %s\n", jobCount, status == 0 ? "done" : "failed");
+
+	// plans measured by the job are used by the next one
+	ImportWisdom(config);
+	TrimServerReferences((size_t)config->serverMemory*1024*1024);
+
+	SendServerResult(client, &job, status);
+	ReleaseServerJob(&job);
+}
+
+static void HandleServerClient(int fd, char *program, parameters *config)
+{
+	FILE	*input = NULL, *client = NULL;
+	char	*line = NULL;
+	size_t	size = 0;
+	int		copy = -1;
+
+	copy = dup(fd);
+	input = fdopen(fd, "r");
+	client = copy != -1 ? fdopen(copy, "w") : NULL;
+	if(!input || !client)
+	{
+		if(input)
+			fclose(input);
+		else
+			close(fd);
+		if(client)
+			fclose(client);
+		else if(copy != -1)
+			close(copy);
+		return;
+	}
+
+	if(getline(&line, &size, input) > 0)
+		RunServerRequest(line, program, client, config);
+
+	free(line);
+	fclose(input);
+	fclose(client);
+}
+
+int RunJobServer(char *program, parameters *config)
+{
+	struct sockaddr_un	address;
+	struct sigaction	action;
+	char				path[PATH_MAX], socketPath[BUFFER_SIZE*2];
+	int					bound = 0;
+
+	// Jobs change folders, batch jobs start this same executable
+	if(!strchr(program, FOLDERCHAR) || !realpath(program, path))
+		sprintf(path, "%s", program);
+
+	// and the FFTW wisdom has to stay the same file for all of them
+	if(config->wisdomFile[0] && config->wisdomFile[0] != FOLDERCHAR)
+	{
+		char	cwd[BUFFER_SIZE], wisdom[BUFFER_SIZE];
+		int		len = -1;
+
+		if(GetCurrentDir(cwd, BUFFER_SIZE))
+			len = snprintf(wisdom, BUFFER_SIZE, "%s%c%s", cwd, FOLDERCHAR, config->wisdomFile);
+		if(len < 0 || len >= BUFFER_SIZE)
+		{
+			logmsg("ERROR: Could not resolve FFTW wisdom path %s\n", config->wisdomFile);
+			return 0;
+		}
+		sprintf(config->wisdomFile, "%s", wisdom);
+	}
+
+	if(strlen(config->serverSocket) >= sizeof(address.sun_path))
+	{
+		logmsg("ERROR: Socket path %s is too long\n", config->serverSocket);
+		return 0;
+	}
+
+	if(config->serverSocket[0] == FOLDERCHAR || !GetCurrentDir(socketPath, BUFFER_SIZE))
+		sprintf(socketPath, "%s", config->serverSocket);
+	else
+		sprintf(socketPath+strlen(socketPath), "%c%s", FOLDERCHAR, config->serverSocket);
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, config->serverSocket, strlen(config->serverSocket));
+
+	serverFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(serverFd == -1)
+	{
+		logmsg("ERROR: Could not create socket\n");
+		return 0;
+	}
+
+	// A socket file left by a server that is gone can be replaced
+	if(connect(serverFd, (struct sockaddr*)&address, sizeof(address)) == 0)
+	{
+		logmsg("ERROR: A job server is already running on %s\n", config->serverSocket);
+		close(serverFd);
+		return 0;
+	}
+	close(serverFd);
+	unlink(config->serverSocket);
+
+	// Jobs run as this user, so only this user may connect
+	serverFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(serverFd != -1)
+	{
+		mode_t	mask = umask(077);
+
+		bound = bind(serverFd, (struct sockaddr*)&address, sizeof(address)) == 0;
+		umask(mask);
+	}
+	if(serverFd == -1 || !bound || listen(serverFd, SERVER_BACKLOG) == -1)
+	{
+		logmsg("ERROR: Could not listen on %s\n", config->serverSocket);
+		if(serverFd != -1)
+			close(serverFd);
+		return 0;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = StopServer;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	logmsg("* Job server listening on %s, up to %d MB for References\n",
+		socketPath, config->serverMemory);
+
+	while(!serverQuit)
+	{
+		int client = -1;
+
+		client = accept(serverFd, NULL, NULL);
+		if(client == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			logmsg("ERROR: Could not accept job connection\n");
+			break;
+		}
+		HandleServerClient(client, path, config);
+	}
+
+	close(serverFd);
+	unlink(socketPath);
+	while(referenceCount)
+		ReleaseOldestReference();
+	logmsg("* Job server stopped after %lu job%s\n", jobCount, jobCount == 1 ? "" : "s");
+	return 1;
+}
+
+#else
+
+int RunJobServer(char *program, parameters *config)
+{
+	logmsg("ERROR: The job server needs Unix domain sockets, not available in this build\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,62 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_SERVER_H
+#define MDFOURIER_SERVER_H
+
+#include "mdfourier.h"
+
+#define SERVER_MEMORY_MB		1024
+#define SERVER_MAX_ARGS			256
+#define SERVER_MAX_REFERENCES	32
+#define SERVER_BACKLOG			16
+
+typedef struct server_reference_st {
+	char			*key;
+	parameters		config;
+	AudioSignal		*Signal;
+	logBuffer		log;
+	size_t			size;
+	unsigned long	lastUsed;
+} serverReference;
+
+typedef struct server_job_st {
+	char			*args[SERVER_MAX_ARGS];
+	int				argCount;
+	char			cwd[BUFFER_SIZE];
+	char			summaryFile[BUFFER_SIZE];
+	char			resultFolder[BUFFER_SIZE];
+	char			error[BUFFER_SIZE];
+	int				ownSummary;
+} serverJob;
+
+int RunJobServer(char *program, parameters *config);
+// in mdfourier.c
+int ExecuteMDFourier(int argc, char *argv[], AudioSignal *ReferenceSignal, logBuffer *referenceLog, parameters *config);
+
+#endif
@@ -30,6 +30,12 @@
 #include "sync.h"
 #include "log.h"
 #include "freq.h"
+#include "plans.h"
+#include "kernels.h"
+#include "samples.h"
+#include "threads.h"
+
+#include <pthread.h>
 
 /*
 	There are the number of subdivisions to use. 
@@ -43,45 +49,61 @@
 // Cut off for harmonic search
 #define HARMONIC_TSHLD 6000
 
-long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *config)
+long int DetectPulse(sampleStore *AllSamples, wav_hdr header, int role, parameters *config)
 {
-	int			maxdetected = 0, AudioChannels = 0;
-	long int	sampleOffset = 0, searchOffset = 0;
-	double		seconds = 0;
+	int				maxdetected = 0, AudioChannels = 0, bytesPerSample = 0;
+	long int		sampleOffset = 0, searchOffset = 0, sampleBufferSize = 0, searchEnd = 0;
+	double			seconds = 0;
+	syncCoverage	coverage;
 
 	if(config->debugSync)
 		logmsgFileOnly("\nStarting Detect start pulse\n");
 
 	AudioChannels = header.fmt.NumOfChan;
+	bytesPerSample = header.fmt.bitsPerSample/8;
+
+	memset(&coverage, 0, sizeof(syncCoverage));
+	coverage.total = header.data.DataSize/bytesPerSample;
 
-	sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, config);
+	// Coarse search first, over the same range the full scan would cover
+	sampleBufferSize = SecondsToSamples(header.fmt.SamplesPerSec, 1.0/((double)FACTOR_EXPLORE*1000.0), AudioChannels, bytesPerSample, NULL, NULL, NULL);
+	if(sampleBufferSize > 0)
+		searchEnd = GetSyncSearchChunks(header, sampleBufferSize, coverage.total/sampleBufferSize-1, role, config)*sampleBufferSize;
+	sampleOffset = DetectPulseCandidates(AllSamples, header, FACTOR_EXPLORE, 0, searchEnd, &maxdetected, role, AudioChannels, &coverage, config);
 	if(sampleOffset == -1)
 	{
 		if(config->debugSync)
-			logmsgFileOnly("First round start pulse failed\n");
+			logmsgFileOnly("Coarse start pulse search failed, scanning the full range\n");
 
-		return DetectPulseSecondTry(AllSamples, header, role, config);
-	}
+		sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, &coverage, config);
+		if(sampleOffset != -1)
+		{
+			// Tight detect, in case of longer files
+			// start search close to the sync pulses in order to reduce
+			// false amplitude detection
+			seconds = SamplesToSeconds(header.fmt.SamplesPerSec, sampleOffset, AudioChannels);
+			if(seconds > 0.1)
+				searchOffset = sampleOffset - SecondsToSamples(header.fmt.SamplesPerSec, 0.1, AudioChannels, bytesPerSample, NULL, NULL, NULL);
+			else
+				searchOffset = sampleOffset/2;
+			searchOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, searchOffset, &maxdetected, role, AudioChannels, &coverage, config);
+			if(searchOffset == -1)
+				sampleOffset = -1;
+			else if(config->debugSync && searchOffset != sampleOffset)
+				logmsg("WARNING: Adjusted sync offset start from %ld to %ld\n", sampleOffset/AudioChannels, searchOffset/AudioChannels);
+		}
 
-	// Tight detect, in case of longer files
-	// start search close to the sync pulses in order to reduce
-	// false amplitude detection
-	seconds = SamplesToSeconds(header.fmt.SamplesPerSec, sampleOffset, AudioChannels);
-	if(seconds > 0.1)
-		searchOffset = sampleOffset - SecondsToSamples(header.fmt.SamplesPerSec, 0.1, AudioChannels, header.fmt.bitsPerSample/8, NULL, NULL, NULL);
-	else
-		searchOffset = sampleOffset/2;
-	searchOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, searchOffset, &maxdetected, role, AudioChannels, config);
-	if(searchOffset == -1)
-	{
-		if(config->debugSync)
-			logmsgFileOnly("First round start pulse failed\n");
+		if(sampleOffset == -1)
+		{
+			if(config->debugSync)
+				logmsgFileOnly("First round start pulse failed\n");
 
-		return DetectPulseSecondTry(AllSamples, header, role, config);
+			sampleOffset = DetectPulseSecondTry(AllSamples, header, role, &coverage, config);
+			ReportSyncCoverage("Start", &coverage, config);
+			return sampleOffset;
+		}
 	}
-
-	if(config->debugSync && searchOffset != sampleOffset)
-		logmsg("WARNING: Adjusted sync offset start from %ld to %ld\n", sampleOffset/AudioChannels, searchOffset/AudioChannels);
+	ReportSyncCoverage("Start", &coverage, config);
 
 	sampleOffset = AdjustPulseSampleStart(AllSamples, header, sampleOffset, role, AudioChannels, config);
 	if(sampleOffset != -1)
@@ -94,7 +116,7 @@ long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *c
 }
 
 /* only difference is that it auto detects the start first, helps in some cases with long silence and high noise floor */
-long int DetectPulseSecondTry(double *AllSamples, wav_hdr header, int role, parameters *config)
+long int DetectPulseSecondTry(sampleStore *AllSamples, wav_hdr header, int role, syncCoverage *coverage, parameters *config)
 {
 	int			maxdetected = 0, AudioChannels = 0, bytesPerSample = 0;
 	long int	sampleOffset = 0;
@@ -117,7 +139,7 @@ long int DetectPulseSecondTry(double *AllSamples, wav_hdr header, int role, para
 	else
 		sampleOffset = 0;
 
-	sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_LFEXPL, sampleOffset, &maxdetected, role, AudioChannels, config);
+	sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_LFEXPL, sampleOffset, &maxdetected, role, AudioChannels, coverage, config);
 	if(sampleOffset == -1)
 	{
 		if(config->debugSync)
@@ -152,14 +174,18 @@ long int DetectPulseSecondTry(double *AllSamples, wav_hdr header, int role, para
 								3.1, 3.2, 3.3, 3.4, 3.5, 3.5, 3.7, 3.8, 3.9, 4.0,\
 								-3.1, -3.2, -3.3, -3.4, -3.5, -3.5, -3.7, -3.8, -3.9, -4.0 }
 
-long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config)
+long int DetectEndPulse(sampleStore *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config)
 {
 	int			maxdetected = 0, frameAdjust = 0, tries = 0, maxtries = END_SYNC_MAX_TRIES;
 	int			factor = 0, AudioChannels = 0;
-	long int 	sampleOffset = 0;
-	double		silenceOffset[END_SYNC_MAX_TRIES] = END_SYNC_VALUES;
+	long int 	sampleOffset = 0, searchStart = 0, searchEnd = 0;
+	double		silenceOffset[END_SYNC_MAX_TRIES] = END_SYNC_VALUES, minOffset = 0, maxOffset = 0;
+	syncCoverage	coverage;
 
 	AudioChannels = header.fmt.NumOfChan;
+	memset(&coverage, 0, sizeof(syncCoverage));
+	coverage.total = header.data.DataSize/(header.fmt.bitsPerSample/8);
+
 	if(GetPulseSyncFreq(role, config) < HARMONIC_TSHLD)
 		factor = FACTOR_LFEXPL;
 	else
@@ -174,19 +200,45 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 	sampleOffset += startpulse;
 	if(config->debugSync)
 		logmsgFileOnly("\nStarting CLEAN Detect end pulse with sample offset %ld\n", SamplesForDisplay(sampleOffset, AudioChannels));
-	sampleOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
+	sampleOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, &coverage, config);
 	if(sampleOffset != -1)
 	{
 		sampleOffset = AdjustPulseSampleStart(AllSamples, header, sampleOffset, role, AudioChannels, config);
 		if(sampleOffset != -1)
+		{
+			ReportSyncCoverage("End", &coverage, config);
 			return sampleOffset;
+		}
 	}
 
-	
 	/* We try to figure out position of the pulses */
 	if(config->debugSync)
 		logmsgFileOnly("End pulse CLEAN detection failed started search at %ld samples\n", SamplesForDisplay(sampleOffset, AudioChannels));
 
+	/* Coarse search over the whole range the retries below would cover */
+	for(tries = 0; tries < maxtries; tries++)
+	{
+		if(silenceOffset[tries] < minOffset)
+			minOffset = silenceOffset[tries];
+		if(silenceOffset[tries] > maxOffset)
+			maxOffset = silenceOffset[tries];
+	}
+	tries = 0;
+	searchStart = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, 0, minOffset, config) + startpulse;
+	searchEnd = GetSecondSyncSilenceSampleOffset(GetMSPerFrameRole(role, config), header, 0, maxOffset, config) + startpulse;
+	searchEnd += SecondsToSamples(header.fmt.SamplesPerSec, 2*GetLastSyncDuration(GetMSPerFrameRole(role, config), config), AudioChannels, header.fmt.bitsPerSample/8, NULL, NULL, NULL);
+	sampleOffset = DetectPulseCandidates(AllSamples, header, factor, searchStart, searchEnd, &maxdetected, role, AudioChannels, &coverage, config);
+	if(sampleOffset != -1)
+	{
+		sampleOffset = AdjustPulseSampleStart(AllSamples, header, sampleOffset, role, AudioChannels, config);
+		if(sampleOffset != -1)
+		{
+			ReportSyncCoverage("End", &coverage, config);
+			return sampleOffset;
+		}
+	}
+	maxdetected = 0;
+
 	do
 	{
 		/* Use defaults to calculate real frame rate */
@@ -199,7 +251,7 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 		frameAdjust = 0;
 		maxdetected = 0;
 
-		sampleOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
+		sampleOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, &coverage, config);
 		if(sampleOffset == -1 && !maxdetected)
 		{
 			if(config->debugSync)
@@ -210,6 +262,7 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 		tries ++;
 	}while(sampleOffset == -1 && tries < maxtries);
 
+	ReportSyncCoverage("End", &coverage, config);
 	if(tries == maxtries)
 		return -1;
 
@@ -221,6 +274,167 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 }
 
 
+/*
+	Coarse level of the sync search. Instead of analyzing every chunk, it
+	probes one short chunk every quarter of a pulse, and returns the start of
+	the runs of probes that peak at the sync frequency. DetectPulseInternal
+	then only needs to run in a narrow window around each of them. If none
+	of them pans out, the callers fall back to the full scan.
+*/
+
+#define SYNC_COARSE_STEPS		4
+#define SYNC_COARSE_RUN			2
+#define SYNC_COARSE_DB			-20
+#define SYNC_COARSE_CANDIDATES	4
+
+int FindPulseCandidates(sampleStore *Samples, wav_hdr header, long int start, long int end, int role, int AudioChannels, long int *candidates, syncCoverage *coverage, parameters *config)
+{
+	int			bytesPerSample = 0, found = 0, run = 0;
+	long int	sampleBufferSize = 0, pulseSamples = 0, trainSamples = 0, step = 0;
+	long int	probes = 0, totalSamples = 0, runStart = 0;
+	double		targets[SYNC_BANK_TARGETS] = { NO_FREQ, NO_FREQ, NO_FREQ };
+	double		origFrequency = 0, MaxMagnitude = 0;
+	Pulses		*probeArray = NULL;
+	syncBank	bank;
+
+	bytesPerSample = header.fmt.bitsPerSample/8;
+	totalSamples = header.data.DataSize/bytesPerSample;
+	if(start < 0)
+		start = 0;
+	if(end > totalSamples)
+		end = totalSamples;
+
+	sampleBufferSize = SecondsToSamples(header.fmt.SamplesPerSec, 1.0/((double)FACTOR_LFEXPL*1000.0), AudioChannels, bytesPerSample, NULL, NULL, NULL);
+	pulseSamples = SecondsToSamples(header.fmt.SamplesPerSec, getPulseFrameLen(role, config)*GetMSPerFrameRole(role, config)/1000.0, AudioChannels, bytesPerSample, NULL, NULL, NULL);
+	trainSamples = pulseSamples*getPulseCount(role, config)*2;
+	step = pulseSamples/SYNC_COARSE_STEPS;
+	step -= step % AudioChannels;
+	if(sampleBufferSize < 4 || step < 2*sampleBufferSize || end - start < trainSamples)
+		return 0;
+
+	probes = (end - start - sampleBufferSize)/step;
+	if(probes <= 0)
+		return 0;
+
+	origFrequency = GetPulseSyncFreq(role, config);
+	targets[0] = FindFrequencyBracketForSync(origFrequency,
+					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
+	if(origFrequency < HARMONIC_TSHLD)
+	{
+		targets[1] = FindFrequencyBracketForSync(targets[0]*2,
+					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
+		targets[2] = FindFrequencyBracketForSync(targets[0]*3,
+					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
+	}
+
+	probeArray = (Pulses*)malloc(sizeof(Pulses)*probes);
+	if(!probeArray)
+	{
+		logmsgFileOnly("\tERROR: malloc failed during FindPulseCandidates\n");
+		return 0;
+	}
+	memset(probeArray, 0, sizeof(Pulses)*probes);
+
+	if(!InitSyncBank(&bank, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels, targets, SYNC_BANK_TARGETS, config))
+	{
+		free(probeArray);
+		return 0;
+	}
+
+	probes = ScanPulseChunks(Samples, probeArray, 0, probes, start, step, sampleBufferSize,
+				totalSamples, header.fmt.SamplesPerSec, AudioChannels, &bank, &MaxMagnitude, config);
+	if(probes == -1)
+	{
+		ReleaseSyncBank(&bank);
+		free(probeArray);
+		return 0;
+	}
+
+	// Only probes that peak at the sync frequencies count towards the maximum
+	MaxMagnitude = 0;
+	for(long int p = 0; p < probes; p++)
+	{
+		if(probeArray[p].hertz != targets[0] && probeArray[p].hertz != targets[1] && probeArray[p].hertz != targets[2])
+			probeArray[p].hertz = 0;
+		else if(probeArray[p].magnitude > MaxMagnitude)
+			MaxMagnitude = probeArray[p].magnitude;
+	}
+	if(coverage)
+		coverage->coarse += probes*sampleBufferSize;
+
+	for(long int p = 0; p < probes && found < SYNC_COARSE_CANDIDATES; p++)
+	{
+		if(!probeArray[p].hertz || CalculateAmplitude(probeArray[p].magnitude, MaxMagnitude) < SYNC_COARSE_DB)
+		{
+			run = 0;
+			continue;
+		}
+
+		if(!run)
+			runStart = p;
+		run++;
+		if(run == SYNC_COARSE_RUN)
+		{
+			candidates[found++] = probeArray[runStart].samples;
+			if(config->debugSync)
+				logmsgFileOnly("Coarse sync candidate at %ld samples\n", SamplesForDisplay(probeArray[runStart].samples, AudioChannels));
+
+			// Skip the rest of this pulse train
+			p = runStart + trainSamples/step;
+			run = 0;
+		}
+	}
+
+	ReleaseSyncBank(&bank);
+	free(probeArray);
+
+	return found;
+}
+
+// Runs the fine search around each coarse candidate, returns -1 if none is valid
+long int DetectPulseCandidates(sampleStore *Samples, wav_hdr header, int factor, long int start, long int end, int *maxdetected, int role, int AudioChannels, syncCoverage *coverage, parameters *config)
+{
+	int			count = 0;
+	long int	candidates[SYNC_COARSE_CANDIDATES], margin = 0, offset = -1;
+
+	// Tolerant detection accepts pulses at any frequency, keep the full scan
+	if(config->syncTolerance)
+		return -1;
+
+	count = FindPulseCandidates(Samples, header, start, end, role, AudioChannels, candidates, coverage, config);
+	if(!count)
+		return -1;
+
+	// Half a pulse before, since the probes can land anywhere within the first one
+	margin = SecondsToSamples(header.fmt.SamplesPerSec, getPulseFrameLen(role, config)*GetMSPerFrameRole(role, config)/2000.0,
+				AudioChannels, header.fmt.bitsPerSample/8, NULL, NULL, NULL);
+	for(int c = 0; c < count && offset == -1; c++)
+	{
+		long int searchOffset = 0;
+
+		searchOffset = candidates[c] - margin;
+		if(searchOffset < AudioChannels)  // 0 would trigger a full scan
+			searchOffset = AudioChannels;
+		offset = DetectPulseInternal(Samples, header, factor, searchOffset, maxdetected, role, AudioChannels, coverage, config);
+	}
+	return offset;
+}
+
+void ReportSyncCoverage(char *name, syncCoverage *coverage, parameters *config)
+{
+	double	coarse = 0, fine = 0;
+
+	if(!coverage || !coverage->total)
+		return;
+
+	coarse = (double)coverage->coarse/(double)coverage->total*100.0;
+	fine = (double)coverage->fine/(double)coverage->total*100.0;
+	if(config->verbose)
+		logmsg(" - %s sync search read %0.2f%% of the file at coarse level and %0.2f%% at fine level\n", name, coarse, fine);
+	else if(config->debugSync)
+		logmsgFileOnly("%s sync search read %0.2f%% of the file at coarse level and %0.2f%% at fine level\n", name, coarse, fine);
+}
+
 #define LOGCASE(x, y) { x; if(config->debugSync) logmsgFileOnly("Case #%d\n", y); }
 double findAverageAmplitudeForTarget(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, long int start, int factor, int AudioChannels, parameters *config)
 {
@@ -541,12 +755,13 @@ long int DetectPulseTrainSequence(Pulses *pulseArray, double targetFrequency, do
 #define SORT_CMP(x, y)  ((x).magnitude > (y).magnitude ? -1 : ((x).magnitude == (y).magnitude ? 0 : 1))
 #include "sort.h"  // https://github.com/swenson/sort/
 
-long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config)
+long int AdjustPulseSampleStart(sampleStore *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config)
 {
 	int			samplesNeeded = 0, frequency = 0, minDiffPos = -1, bytesPerSample = 0;
 	long int	startSearch = 0, endSearch = 0, pos = 0, count = 0, foundPos = -1, totalSamples = 0;
-	double		*buffer = NULL;
+	sampleType		*buffer = NULL;
 	Pulses		*pulseArray = NULL;
+	syncBank	bank;
 	double		targetFrequency = 0, minDiff = 1000;
 
 	frequency = GetPulseSyncFreq(role, config);
@@ -558,7 +773,7 @@ long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset
 		logmsgFileOnly("\nSearcing at %ld, looking for %ghz samples needed: %d\n",
 				SamplesForDisplay(offset, AudioChannels), targetFrequency, 
 				SamplesForDisplay(samplesNeeded, AudioChannels));
-	buffer = (double*)malloc(samplesNeeded*sizeof(double));
+	buffer = (sampleType*)malloc(samplesNeeded*sizeof(sampleType));
 	if(!buffer)
 	{
 		logmsgFileOnly("\tSync Adjust malloc failed\n");
@@ -580,12 +795,19 @@ long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset
 	}
 	memset(pulseArray, 0, sizeof(Pulses)*(endSearch-startSearch));
 
+	if(!InitSyncBank(&bank, samplesNeeded, header.fmt.SamplesPerSec, AudioChannels, &targetFrequency, 1, config))
+	{
+		free(buffer);
+		free(pulseArray);
+		return(foundPos);
+	}
+
 	bytesPerSample = header.fmt.bitsPerSample/8;
 	totalSamples = header.data.DataSize/bytesPerSample;
 
 	for(pos = startSearch; pos < endSearch; pos += AudioChannels)
 	{
-		memset(buffer, 0, samplesNeeded*sizeof(double));
+		memset(buffer, 0, samplesNeeded*sizeof(sampleType));
 		if(pos + samplesNeeded > totalSamples)
 		{
 			//logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite\n");
@@ -593,10 +815,10 @@ long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset
 		}
 
 		pulseArray[count].samples = pos;
-		memcpy(buffer, Samples + pos, samplesNeeded*sizeof(double));
+		CopySamples(Samples, pos, samplesNeeded, buffer);
 		ProcessChunkForSyncPulse(buffer, samplesNeeded, 
 			header.fmt.SamplesPerSec, &pulseArray[count], 
-			CHANNEL_LEFT, AudioChannels, config);
+			CHANNEL_LEFT, AudioChannels, &bank, config);
 		count ++;
 	}
 
@@ -630,6 +852,7 @@ long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset
 				pulseArray[minDiffPos].hertz, pulseArray[minDiffPos].magnitude, pulseArray[minDiffPos].phase, minDiff);
 	}
 
+	ReleaseSyncBank(&bank);
 	free(buffer);
 	free(pulseArray);
 
@@ -637,14 +860,43 @@ long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset
 }
 
 // Searches using 1ms/factor blocks
-long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long int offset, int *maxdetected, int role, int AudioChannels, parameters *config)
+// Length in chunks to search for the starting pulses from the start of the file
+long int GetSyncSearchChunks(wav_hdr header, long int sampleBufferSize, long int TotalMS, int role, parameters *config)
+{
+	int		bytesPerSample = 0;
+	double	expectedlen = 0, seconds = 0, syncLenSeconds = 0, syncLen = 0, silenceLen = 0, silenceLenSeconds = 0;
+
+	bytesPerSample = header.fmt.bitsPerSample/8;
+
+	seconds = GetSignalTotalDuration(GetMSPerFrameRole(role, config), config);
+	expectedlen = SecondsToSamples(header.fmt.SamplesPerSec, seconds, header.fmt.NumOfChan, bytesPerSample, NULL, NULL, NULL);
+	expectedlen = floor(expectedlen/sampleBufferSize) - 1;
+
+	syncLenSeconds = GetFirstSyncDuration(GetMSPerFrameRole(role, config), config);
+	syncLen = SecondsToSamples(header.fmt.SamplesPerSec, syncLenSeconds, header.fmt.NumOfChan, bytesPerSample, NULL, NULL, NULL);
+	syncLen = floor(syncLen/sampleBufferSize) - 1;
+
+	silenceLenSeconds = GetFirstSilenceDuration(GetMSPerFrameRole(role, config), config);
+	silenceLen = SecondsToSamples(header.fmt.SamplesPerSec, silenceLenSeconds, header.fmt.NumOfChan, bytesPerSample, NULL, NULL, NULL);
+	silenceLen = floor(silenceLen/sampleBufferSize) - 1;
+
+	TotalMS = TotalMS - expectedlen + syncLen + silenceLen/2;
+
+	if(expectedlen*1.5 < TotalMS && (role == ROLE_REF || role == ROLE_COMP))  // long file
+		config->trimmingNeeded[role] = 1;
+
+	return TotalMS;
+}
+
+long int DetectPulseInternal(sampleStore *Samples, wav_hdr header, int factor, long int offset, int *maxdetected, int role, int AudioChannels, syncCoverage *coverage, parameters *config)
 {
 	int					bytesPerSample = 0;
 	long int			i = 0, TotalMS = 0, totalSamples = 0;
-	double				*sampleBuffer = NULL;
-	long int		 	sampleBufferSize = 0, pos = 0, startPos = 0;
+	long int		 	sampleBufferSize = 0, pos = 0, startPos = 0, scanned = 0;
 	Pulses				*pulseArray = NULL;
+	syncBank			bank;
 	double				targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ }, origFrequency = 0, MaxMagnitude = 0;
+	double				targets[SYNC_BANK_TARGETS];
 
 	bytesPerSample = header.fmt.bitsPerSample/8;
 	/* Not a real ms, just approximate */
@@ -653,13 +905,6 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 		logmsg("ERROR: Invalid parameters for sync detection\n");
 		return -1;
 	}
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsgFileOnly("\tERROR: malloc failed for sample buffer during DetectPulseInternal\n");
-		return -1;
-	}
-
 	totalSamples = header.data.DataSize/bytesPerSample;
 	// calculate how many sampleBufferSize units fit in the available samples from the file
 	TotalMS = totalSamples/sampleBufferSize-1;
@@ -668,8 +913,8 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 	{
 		double syncLen = 0;
 
-		i = offset;
-		startPos = i;
+		i = 0;
+		startPos = 0;
 
 		/* check for the time duration in ms*factor of the sync pulses */
 		syncLen = GetLastSyncDuration(GetMSPerFrameRole(role, config), config)*1000*factor;
@@ -678,34 +923,15 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 		else
 			syncLen *= 1.2;  /* widen so that the silence offset is compensated for */
 		//if(i+syncLen > TotalMS)
-		TotalMS = i+syncLen;
+		TotalMS = syncLen;
 
 		if(config->debugSync)
 			logmsgFileOnly("Started detecting with offet %ld. Changed to:\n\tSamplesBufferSize: %ld, Samples:%ld-%ld/ms:%ld-%ld]\n\tms len: %g Bytes: %g Factor: %d\n", 
-				offset/AudioChannels, sampleBufferSize, i*factor, TotalMS*factor, i, TotalMS,
+				offset/AudioChannels, sampleBufferSize, offset, offset+TotalMS*sampleBufferSize, i, TotalMS,
 				syncLen, syncLen/factor, factor);
 	}
 	else
-	{
-		double expectedlen = 0, seconds = 0, syncLenSeconds = 0, syncLen = 0, silenceLen = 0, silenceLenSeconds = 0;
-
-		seconds = GetSignalTotalDuration(GetMSPerFrameRole(role, config), config);
-		expectedlen = SecondsToSamples(header.fmt.SamplesPerSec, seconds, header.fmt.NumOfChan, bytesPerSample, NULL, NULL, NULL);
-		expectedlen = floor(expectedlen/sampleBufferSize) - 1;
-
-		syncLenSeconds = GetFirstSyncDuration(GetMSPerFrameRole(role, config), config);
-		syncLen = SecondsToSamples(header.fmt.SamplesPerSec, syncLenSeconds, header.fmt.NumOfChan, bytesPerSample, NULL, NULL, NULL);
-		syncLen = floor(syncLen/sampleBufferSize) - 1;
-
-		silenceLenSeconds = GetFirstSilenceDuration(GetMSPerFrameRole(role, config), config);
-		silenceLen = SecondsToSamples(header.fmt.SamplesPerSec, silenceLenSeconds, header.fmt.NumOfChan, bytesPerSample, NULL, NULL, NULL);
-		silenceLen = floor(silenceLen/sampleBufferSize) - 1;
-
-		TotalMS = TotalMS - expectedlen + syncLen + silenceLen/2;
-
-		if(expectedlen*1.5 < TotalMS)  // long file
-			config->trimmingNeeded = 1;
-	}
+		TotalMS = GetSyncSearchChunks(header, sampleBufferSize, TotalMS, role, config);
 
 	pulseArray = (Pulses*)malloc(sizeof(Pulses)*TotalMS);
 	if(!pulseArray)
@@ -740,29 +966,25 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			 i, TotalMS-1, totalSamples/sampleBufferSize - 1);
 	}
 
-	while(i < TotalMS)
+	targets[0] = targetFrequency;
+	targets[1] = targetFrequencyHarmonic[0];
+	targets[2] = targetFrequencyHarmonic[1];
+	if(!InitSyncBank(&bank, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels, targets, SYNC_BANK_TARGETS, config))
 	{
-		if(pos + sampleBufferSize > totalSamples)
-		{
-			//logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite\n");
-			break;
-		}
-
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Samples + pos, sampleBufferSize*sizeof(double));
-		pulseArray[i].samples = pos;
-
-		pos += sampleBufferSize;
-
-		/* We use left channel by default, we don't know about channel imbalances yet */
-		ProcessChunkForSyncPulse(sampleBuffer, sampleBufferSize, 
-			header.fmt.SamplesPerSec, &pulseArray[i], 
-			CHANNEL_LEFT, AudioChannels, config);
+		free(pulseArray);
+		return -1;
+	}
 
-		if(pulseArray[i].magnitude > MaxMagnitude)
-			MaxMagnitude = pulseArray[i].magnitude;
-		i++;
+	scanned = ScanPulseChunks(Samples, pulseArray, i, TotalMS - i, pos, sampleBufferSize, sampleBufferSize,
+				totalSamples, header.fmt.SamplesPerSec, AudioChannels, &bank, &MaxMagnitude, config);
+	if(scanned == -1)
+	{
+		ReleaseSyncBank(&bank);
+		free(pulseArray);
+		return -1;
 	}
+	if(coverage)
+		coverage->fine += scanned*sampleBufferSize;
 
 
 	for(i = startPos; i < TotalMS; i++)
@@ -792,71 +1014,422 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 
 	offset = DetectPulseTrainSequence(pulseArray, targetFrequency, targetFrequencyHarmonic, TotalMS, factor, maxdetected, startPos, role, AudioChannels, config);
 
+	ReleaseSyncBank(&bank);
 	free(pulseArray);
-	free(sampleBuffer);
 
 	return offset;
 }
 
-double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config)
+/*
+	Sync chunks are 1ms/factor long, just a handful of samples. Instead of
+	running FFTW on each one, bins are evaluated directly against sine and
+	cosine tables built once per search. The pulse frequency and harmonics
+	are evaluated first; when they hold more energy than the rest of the
+	spectrum combined (Parseval), one of them is the peak and the other bins
+	are skipped. Otherwise, and always with -T since the pulse can be at any
+	frequency, the full spectrum is evaluated. Results match the FFTW path,
+	which is still used for chunks larger than SYNC_BANK_MAX_SIZE.
+*/
+
+#define SYNC_BANK_MAX_SIZE	256
+#define SYNC_BANK_EPSILON	1e-9
+
+int InitSyncBank(syncBank *bank, size_t size, long samplerate, int AudioChannels, double *targets, int targetCount, parameters *config)
 {
-	fftw_plan		p = NULL;
-	long		  	stereoSignalSize = 0;	
-	long		  	i = 0, monoSignalSize = 0; 
-	double		  	*signal = NULL;
-	fftw_complex  	*spectrum = NULL;
-	double		 	seconds = 0, boxsize = 0;
-	double			maxHertz = 0, maxMag = 0, maxPhase = 0;
+	long int	monoSize = 0;
+	double		seconds = 0;
+
+	if(!bank)
+		return 0;
+
+	memset(bank, 0, sizeof(syncBank));
+	monoSize = (long int)size/AudioChannels;
+	bank->size = monoSize;
+	bank->bins = monoSize/2;
+	bank->fullSpectrum = config->syncTolerance;
+
+	// Too large for direct evaluation, ProcessChunkForSyncPulse uses FFTW
+	if(monoSize < 2 || monoSize > SYNC_BANK_MAX_SIZE)
+		return 1;
+
+	bank->signal = (double*)malloc(sizeof(double)*monoSize);
+	bank->cosTable = (double*)malloc(sizeof(double)*monoSize*(bank->bins+1));
+	bank->sinTable = (double*)malloc(sizeof(double)*monoSize*(bank->bins+1));
+	if(!bank->signal || !bank->cosTable || !bank->sinTable)
+	{
+		logmsgFileOnly("\tERROR: malloc failed for sync filter bank\n");
+		ReleaseSyncBank(bank);
+		return 0;
+	}
+
+	for(long int k = 0; k <= bank->bins; k++)
+	{
+		for(long int n = 0; n < monoSize; n++)
+		{
+			double angle = 0;
+
+			angle = 2.0*M_PI*(double)((k*n) % monoSize)/(double)monoSize;
+			bank->cosTable[k*monoSize+n] = cos(angle);
+			bank->sinTable[k*monoSize+n] = sin(angle);
+		}
+	}
 
-	stereoSignalSize = (long)size;
-	monoSignalSize = stereoSignalSize/AudioChannels;	 /* is 1/2 16 bit values */
 	seconds = (double)size/((double)samplerate*AudioChannels);
-	boxsize = seconds;
+	for(int t = 0; t < targetCount && t < SYNC_BANK_TARGETS; t++)
+	{
+		long int	bin = 0;
+		int			pos = 0;
+
+		if(targets[t] <= 0)  // NO_FREQ
+			continue;
+		bin = lround(targets[t]*seconds);
+		if(bin < 1 || bin > bank->bins)
+			continue;
+
+		// keep them sorted by bin, so ties resolve as in a full scan
+		for(pos = 0; pos < bank->targetCount && bank->targets[pos] < bin; pos++);
+		if(pos < bank->targetCount && bank->targets[pos] == bin)
+			continue;
+		memmove(&bank->targets[pos+1], &bank->targets[pos], sizeof(long int)*(bank->targetCount-pos));
+		bank->targets[pos] = bin;
+		bank->targetCount++;
+	}
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
-	if(!signal)
+	if(!bank->targetCount)
+		bank->fullSpectrum = 1;
+	return 1;
+}
+
+void ReleaseSyncBank(syncBank *bank)
+{
+	if(!bank)
+		return;
+
+	if(bank->signal)
+		free(bank->signal);
+	if(!bank->shared)
 	{
-		logmsgFileOnly("Not enough memory\n");
-		return(0);
+		if(bank->cosTable)
+			free(bank->cosTable);
+		if(bank->sinTable)
+			free(bank->sinTable);
 	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
-	if(!spectrum)
+	memset(bank, 0, sizeof(syncBank));
+}
+
+// Shares the tables with the original, with its own scratch buffer
+int CloneSyncBank(syncBank *clone, syncBank *bank)
+{
+	*clone = *bank;
+	clone->shared = 1;
+	clone->signal = NULL;
+	if(!bank->signal)
+		return 1;
+
+	clone->signal = (double*)malloc(sizeof(double)*bank->size);
+	return clone->signal != NULL;
+}
+
+static inline double SyncBankPower(syncBank *bank, long int bin, double *re, double *im)
+{
+	double	*cosRow = NULL, *sinRow = NULL, r = 0, i = 0;
+
+	cosRow = bank->cosTable + bin*bank->size;
+	sinRow = bank->sinTable + bin*bank->size;
+	for(long int n = 0; n < bank->size; n++)
 	{
-		logmsgFileOnly("Not enough memory\n");
-		return(0);
+		r += bank->signal[n]*cosRow[n];
+		i -= bank->signal[n]*sinRow[n];
+	}
+	*re = r;
+	*im = i;
+	return r*r + i*i;
+}
+
+// Bins below Nyquist stand for their negative frequency pair as well
+static inline double SyncBankBinWeight(syncBank *bank, long int bin)
+{
+	if(bank->size % 2 == 0 && bin == bank->bins)
+		return 1.0;
+	return 2.0;
+}
+
+double ProcessChunkForSyncPulse(sampleType *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, syncBank *bank, parameters *config)
+{
+	long int	maxBin = 0;
+	double		energy = 0, dc = 0, maxPower = 0, maxRe = 0, maxIm = 0;
+	int			resolved = 0;
+
+	if(!bank || !bank->signal || bank->size != (long int)size/AudioChannels)
+		return ProcessChunkSpectrumForSyncPulse(samples, size, samplerate, pulse, channel, AudioChannels, config);
+
+	for(long int i = 0; i < bank->size; i++)
+	{
+		double value = 0;
+
+		if(channel == CHANNEL_LEFT)
+			value = (double)samples[i*AudioChannels];
+		if(channel == CHANNEL_RIGHT)
+			value = (double)samples[i*AudioChannels+1];
+		if(channel == CHANNEL_STEREO)
+			value = ((double)samples[i*AudioChannels]+(double)samples[i*AudioChannels+1])/2.0;
+		bank->signal[i] = value;
+		energy += value*value;
+		dc += value;
 	}
 
-	if(!config->sync_plan)
+	if(!bank->fullSpectrum)
 	{
- 		fftw_import_wisdom_from_filename("wisdom.fftw");
+		double	total = 0, remaining = 0;
+
+		total = remaining = (double)bank->size*energy - dc*dc;
+		for(int t = 0; t < bank->targetCount; t++)
+		{
+			double	power = 0, re = 0, im = 0;
+
+			power = SyncBankPower(bank, bank->targets[t], &re, &im);
+			remaining -= SyncBankBinWeight(bank, bank->targets[t])*power;
+			if(power > maxPower)
+			{
+				maxPower = power;
+				maxBin = bank->targets[t];
+				maxRe = re;
+				maxIm = im;
+			}
+		}
+		if(maxBin && maxPower > remaining + total*SYNC_BANK_EPSILON)
+			resolved = 1;
+	}
 
-		config->sync_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->sync_plan)
+	if(!resolved)
+	{
+		maxBin = 0;
+		maxPower = 0;
+		for(long int bin = 1; bin <= bank->bins; bin++)
 		{
-			logmsgFileOnly("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			fftw_free(spectrum);
-			spectrum = NULL;
+			double	power = 0, re = 0, im = 0;
+
+			power = SyncBankPower(bank, bin, &re, &im);
+			if(power > maxPower)
+			{
+				maxPower = power;
+				maxBin = bin;
+				maxRe = re;
+				maxIm = im;
+			}
+		}
+	}
+
+	if(!maxBin)
+	{
+		pulse->hertz = 0;
+		pulse->magnitude = 0;
+		pulse->phase = 0;
+		return 0;
+	}
+
+	pulse->hertz = CalculateFrequency(maxBin, (double)size/((double)samplerate*AudioChannels));
+	pulse->magnitude = sqrt(maxPower)/(double)size;
+	pulse->phase = atan2(maxIm, maxRe)*180/M_PI;
+
+	return(pulse->hertz);
+}
+
+/*
+	Pulse scans are split in jobs of consecutive chunks across a worker
+	pool. Each worker thread has its own bank scratch, sample buffer and
+	maximum magnitude, which is reduced once all jobs are done. The pool is
+	kept per calling thread, so start, end and internal sync detection
+	reuse the same workers.
+*/
+
+#define SYNC_SCAN_JOB	512
+
+pthread_key_t	syncPoolKey;
+pthread_once_t	syncPoolOnce = PTHREAD_ONCE_INIT;
+
+void FreeSyncPool(void *data)
+{
+	DestroyThreadPool((threadPool*)data);
+}
+
+void CreateSyncPoolKey()
+{
+	pthread_key_create(&syncPoolKey, FreeSyncPool);
+}
+
+threadPool *GetSyncPool(parameters *config)
+{
+	threadPool *pool = NULL;
+
+	pthread_once(&syncPoolOnce, CreateSyncPoolKey);
+	pool = (threadPool*)pthread_getspecific(syncPoolKey);
+	if(!pool)
+	{
+		pool = CreateThreadPool(GetThreadCount(MAX_THREADS, config));
+		if(pool)
+			pthread_setspecific(syncPoolKey, pool);
+	}
+	return pool;
+}
+
+void ReleaseSyncPool()
+{
+	pthread_once(&syncPoolOnce, CreateSyncPoolKey);
+	DestroyThreadPool((threadPool*)pthread_getspecific(syncPoolKey));
+	pthread_setspecific(syncPoolKey, NULL);
+}
+
+int ScanPulseJob(long int job, int thread, void *data)
+{
+	syncScan	*scan = (syncScan*)data;
+	long int	end = 0;
+
+	end = (job + 1)*SYNC_SCAN_JOB;
+	if(end > scan->count)
+		end = scan->count;
+	for(long int j = job*SYNC_SCAN_JOB; j < end; j++)
+	{
+		Pulses	*pulse = &scan->pulseArray[scan->first + j];
+
+		pulse->samples = scan->pos + j*scan->step;
+		memset(scan->buffers[thread], 0, scan->size*sizeof(sampleType));
+		if(!CopySamples(scan->Samples, pulse->samples, scan->size, scan->buffers[thread]))
 			return 0;
+
+		/* We use left channel by default, we don't know about channel imbalances yet */
+		ProcessChunkForSyncPulse(scan->buffers[thread], scan->size,
+			scan->samplerate, pulse,
+			CHANNEL_LEFT, scan->AudioChannels, &scan->banks[thread], scan->config);
+
+		if(pulse->magnitude > scan->maxMagnitude[thread])
+			scan->maxMagnitude[thread] = pulse->magnitude;
+	}
+	return 1;
+}
+
+void ReleaseSyncScan(syncScan *scan)
+{
+	for(int t = 0; t < scan->threads; t++)
+	{
+		if(scan->buffers && scan->buffers[t])
+			free(scan->buffers[t]);
+		if(scan->banks)
+			ReleaseSyncBank(&scan->banks[t]);
+	}
+	if(scan->buffers)
+		free(scan->buffers);
+	if(scan->banks)
+		free(scan->banks);
+	if(scan->maxMagnitude)
+		free(scan->maxMagnitude);
+}
+
+/*
+	Fills count entries of pulseArray starting at first, with chunks of
+	size samples every step samples from pos. Chunks that don't fit in the
+	file are left untouched, like the sequential scan did. Returns the
+	amount of chunks analyzed, or -1 on failure.
+*/
+long int ScanPulseChunks(sampleStore *Samples, Pulses *pulseArray, long int first, long int count, long int pos, long int step, long int size, long int totalSamples, long samplerate, int AudioChannels, syncBank *bank, double *MaxMagnitude, parameters *config)
+{
+	syncScan	scan;
+	threadPool	*pool = NULL;
+	long int	jobs = 0;
+	int			ok = 1;
+
+	if(pos + size > totalSamples || count <= 0 || step <= 0)
+		return 0;
+	if((totalSamples - size - pos)/step + 1 < count)
+		count = (totalSamples - size - pos)/step + 1;
+
+	memset(&scan, 0, sizeof(syncScan));
+	scan.Samples = Samples;
+	scan.pulseArray = pulseArray;
+	scan.first = first;
+	scan.count = count;
+	scan.pos = pos;
+	scan.step = step;
+	scan.size = size;
+	scan.samplerate = samplerate;
+	scan.AudioChannels = AudioChannels;
+	scan.config = config;
+
+	jobs = (count + SYNC_SCAN_JOB - 1)/SYNC_SCAN_JOB;
+	if(jobs > 1)
+		pool = GetSyncPool(config);
+	scan.threads = pool ? pool->threads : 1;
+
+	scan.buffers = (sampleType**)malloc(sizeof(sampleType*)*scan.threads);
+	scan.banks = (syncBank*)malloc(sizeof(syncBank)*scan.threads);
+	scan.maxMagnitude = (double*)malloc(sizeof(double)*scan.threads);
+	if(!scan.buffers || !scan.banks || !scan.maxMagnitude)
+	{
+		logmsgFileOnly("\tERROR: malloc failed for sync scan\n");
+		ReleaseSyncScan(&scan);
+		return -1;
+	}
+	memset(scan.buffers, 0, sizeof(sampleType*)*scan.threads);
+	memset(scan.banks, 0, sizeof(syncBank)*scan.threads);
+
+	for(int t = 0; t < scan.threads; t++)
+	{
+		scan.maxMagnitude[t] = 0;
+		scan.buffers[t] = (sampleType*)malloc(sizeof(sampleType)*size);
+		if(!scan.buffers[t] || !CloneSyncBank(&scan.banks[t], bank))
+		{
+			logmsgFileOnly("\tERROR: malloc failed for sync scan\n");
+			ReleaseSyncScan(&scan);
+			return -1;
 		}
 	}
 
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
+	ok = RunPoolJobs(pool, jobs, ScanPulseJob, &scan);
+	for(int t = 0; t < scan.threads; t++)
 	{
-		logmsgFileOnly("FFTW failed to create FFTW_MEASURE plan\n");
+		if(scan.maxMagnitude[t] > *MaxMagnitude)
+			*MaxMagnitude = scan.maxMagnitude[t];
+	}
+
+	ReleaseSyncScan(&scan);
+	return ok ? count : -1;
+}
 
-		free(signal);
-		signal = NULL;
+double ProcessChunkSpectrumForSyncPulse(sampleType *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config)
+{
+	FFTWPlan		p = NULL;
+	long		  	stereoSignalSize = 0;	
+	long		  	i = 0, monoSignalSize = 0; 
+	sampleType		  	*signal = NULL;
+	FFTWComplex  	*spectrum = NULL;
+	double		 	seconds = 0, boxsize = 0;
+	double			maxHertz = 0, maxMag = 0, maxPhase = 0, *magnitudes = NULL;
+
+	stereoSignalSize = (long)size;
+	monoSignalSize = stereoSignalSize/AudioChannels;	 /* is 1/2 16 bit values */
+	seconds = (double)size/((double)samplerate*AudioChannels);
+	boxsize = seconds;
 
-		fftw_free(spectrum);
-		spectrum = NULL;
+	p = getPlanBySize(&config->plans, monoSignalSize, FFTW_PLAN_R2C);
+	if(!p)
 		return 0;
+
+	signal = (sampleType*)FFTW(malloc)(sizeof(sampleType)*(monoSignalSize+1));
+	if(!signal)
+	{
+		logmsgFileOnly("Not enough memory\n");
+		return(0);
+	}
+	spectrum = (FFTWComplex*)FFTW(malloc)(sizeof(FFTWComplex)*(monoSignalSize/2+1));
+	if(!spectrum)
+	{
+		logmsgFileOnly("Not enough memory\n");
+		FFTW(free)(signal);
+		return(0);
 	}
 
-	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
+	memset(signal, 0, sizeof(sampleType)*(monoSignalSize+1));
+	memset(spectrum, 0, sizeof(FFTWComplex)*(monoSignalSize/2+1));
 
 	for(i = 0; i < monoSignalSize; i++)
 	{
@@ -868,27 +1441,32 @@ double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, P
 			signal[i] = ((double)samples[i*AudioChannels]+(double)samples[i*AudioChannels+1])/2.0;
 	}
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
-	p = NULL;
+	FFTW(execute_dft_r2c)(p, signal, spectrum);
 
-	for(i = 1; i < monoSignalSize/2+1; i++)
+	magnitudes = GetMagnitudeScratch(monoSignalSize/2);
+	if(!magnitudes)
 	{
-		double magnitude;
+		logmsgFileOnly("Not enough memory\n");
+		FFTW(free)(spectrum);
+		FFTW(free)(signal);
+		return(0);
+	}
 
-		magnitude = CalculateMagnitude(spectrum[i], size);
-		if(magnitude > maxMag)
+	CalculateMagnitudes(spectrum+1, monoSignalSize/2, size, magnitudes);
+	for(i = 1; i < monoSignalSize/2+1; i++)
+	{
+		if(magnitudes[i-1] > maxMag)
 		{
-			maxMag = magnitude;
+			maxMag = magnitudes[i-1];
 			maxHertz = CalculateFrequency(i, boxsize);
 			maxPhase = CalculatePhase(spectrum[i]);
 		}
 	}
 
-	fftw_free(spectrum);
+	FFTW(free)(spectrum);
 	spectrum = NULL;
 
-	free(signal);
+	FFTW(free)(signal);
 	signal = NULL;
 
 	pulse->hertz = maxHertz;
@@ -898,7 +1476,7 @@ double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, P
 	return(maxHertz);
 }
 
-long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config)
+long int DetectSignalStart(sampleStore *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config)
 {
 	int			maxdetected = 0, AudioChannels = 0;
 	long int	position = 0;
@@ -923,15 +1501,15 @@ long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset,
 
 // amount of full length pulses to use
 #define MIN_LEN 4
-long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, int *maxdetected, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config)
+long int DetectSignalStartInternal(sampleStore *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, int *maxdetected, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config)
 {
 	int					bytesPerSample;
 	long int			i = 0, TotalMS = 0, start = 0, totalSamples = 0;
-	double				*sampleBuffer = NULL;
 	long int		 	sampleBufferSize = 0;
 	long int			pos = 0;
 	double				MaxMagnitude = 0;
 	Pulses				*pulseArray;
+	syncBank			bank;
 	double 				total = 0;
 	long int 			count = 0, length = 0, tolerance = 0, toleranceIssueOffset = -1, MaxTolerance = 4;
 	double 				targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ }, averageAmplitude = 0;
@@ -943,13 +1521,6 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 		logmsg("ERROR: Invalid parameters for sync detection\n");
 		return -1;
 	}
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsgFileOnly("\tERROR: malloc failed for sample buffer during DetectPulseInternal\n");
-		return -1;
-	}
-
 	totalSamples = header.data.DataSize/bytesPerSample;
 	// calculate how many sampleBufferSize units fit in the available samples from the file
 	TotalMS = totalSamples/sampleBufferSize-1;
@@ -964,6 +1535,15 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	if(config->verbose)
 		logmsg(" - Starting Internal Sync detection at %ld samples\n", SamplesForDisplay(offset, AudioChannels));
 
+	if(syncKnown)
+		targetFrequency = FindFrequencyBracketForSync(syncKnown, 
+					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
+	if(!InitSyncBank(&bank, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels, &targetFrequency, syncKnown ? 1 : 0, config))
+	{
+		free(pulseArray);
+		return -1;
+	}
+
 	pos = offset;
 	if(offset)
 	{
@@ -973,28 +1553,12 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	else
 		TotalMS /= 6;
 
-	while(i < TotalMS)
+	if(ScanPulseChunks(Samples, pulseArray, i, TotalMS - i, pos, sampleBufferSize, sampleBufferSize,
+				totalSamples, header.fmt.SamplesPerSec, AudioChannels, &bank, &MaxMagnitude, config) == -1)
 	{
-		if(pos + sampleBufferSize > totalSamples)
-		{
-			//logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite\n");
-			break;
-		}
-
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Samples + pos, sampleBufferSize*sizeof(double));
-		pulseArray[i].samples = pos;
-
-		pos += sampleBufferSize;
-
-		/* We use left channel by default, we don't know about channel imbalances yet */
-		ProcessChunkForSyncPulse(sampleBuffer, sampleBufferSize, 
-			header.fmt.SamplesPerSec, &pulseArray[i], 
-			CHANNEL_LEFT, AudioChannels, config);
-
-		if(pulseArray[i].magnitude > MaxMagnitude)
-			MaxMagnitude = pulseArray[i].magnitude;
-		i++;
+		ReleaseSyncBank(&bank);
+		free(pulseArray);
+		return -1;
 	}
 
 	for(i = start; i < TotalMS; i++)
@@ -1027,8 +1591,6 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 
 	if(syncKnown)
 	{
-		targetFrequency = FindFrequencyBracketForSync(syncKnown, 
-					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
 		/*
 		targetFrequencyHarmonic[0] = FindFrequencyBracketForSync(syncKnown*2, 
 					millisecondSize/2, AudioChannels, header.fmt.SamplesPerSec, config);
@@ -1136,8 +1698,8 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 			*toleranceIssue = 1;
 	}
 
+	ReleaseSyncBank(&bank);
 	free(pulseArray);
-	free(sampleBuffer);
 
 	return offset;
 }
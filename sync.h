@@ -37,15 +37,62 @@ typedef struct pulses_st {
 	long int samples;
 } Pulses;
 
-long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *config);
-long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config);
-long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long int offset, int *maxDetected, int role, int AudioChannels, parameters *config);
-double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config);
+#define	SYNC_BANK_TARGETS	3
+
+typedef struct sync_bank_st {
+	long int	size;
+	long int	bins;
+	double		*cosTable;
+	double		*sinTable;
+	double		*signal;
+	long int	targets[SYNC_BANK_TARGETS];
+	int			targetCount;
+	int			fullSpectrum;
+	int			shared;
+} syncBank;
+
+typedef struct sync_coverage_st {
+	long int	coarse;
+	long int	fine;
+	long int	total;
+} syncCoverage;
+
+typedef struct sync_scan_st {
+	sampleStore	*Samples;
+	Pulses		*pulseArray;
+	long int	first;
+	long int	count;
+	long int	pos;
+	long int	step;
+	long int	size;
+	long int	samplerate;
+	int			AudioChannels;
+	int			threads;
+	syncBank	*banks;
+	sampleType	**buffers;
+	double		*maxMagnitude;
+	parameters	*config;
+} syncScan;
+
+long int DetectPulse(sampleStore *AllSamples, wav_hdr header, int role, parameters *config);
+long int DetectEndPulse(sampleStore *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config);
+long int DetectPulseInternal(sampleStore *Samples, wav_hdr header, int factor, long int offset, int *maxDetected, int role, int AudioChannels, syncCoverage *coverage, parameters *config);
+long int GetSyncSearchChunks(wav_hdr header, long int sampleBufferSize, long int TotalMS, int role, parameters *config);
+int FindPulseCandidates(sampleStore *Samples, wav_hdr header, long int start, long int end, int role, int AudioChannels, long int *candidates, syncCoverage *coverage, parameters *config);
+long int DetectPulseCandidates(sampleStore *Samples, wav_hdr header, int factor, long int start, long int end, int *maxdetected, int role, int AudioChannels, syncCoverage *coverage, parameters *config);
+void ReportSyncCoverage(char *name, syncCoverage *coverage, parameters *config);
+double ProcessChunkForSyncPulse(sampleType *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, syncBank *bank, parameters *config);
+double ProcessChunkSpectrumForSyncPulse(sampleType *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config);
+int InitSyncBank(syncBank *bank, size_t size, long samplerate, int AudioChannels, double *targets, int targetCount, parameters *config);
+void ReleaseSyncBank(syncBank *bank);
+int CloneSyncBank(syncBank *clone, syncBank *bank);
+long int ScanPulseChunks(sampleStore *Samples, Pulses *pulseArray, long int first, long int count, long int pos, long int step, long int size, long int totalSamples, long samplerate, int AudioChannels, syncBank *bank, double *MaxMagnitude, parameters *config);
+void ReleaseSyncPool();
 long int DetectPulseTrainSequence(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, int factor, int *maxdetected, long int start, int role, int AudioChannels, parameters *config);
-long int DetectPulseSecondTry(double *AllSamples, wav_hdr header, int role, parameters *config);
-long int AdjustPulseSampleStart(double *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config);
+long int DetectPulseSecondTry(sampleStore *AllSamples, wav_hdr header, int role, syncCoverage *coverage, parameters *config);
+long int AdjustPulseSampleStart(sampleStore *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config);
 
 double findAverageAmplitudeForTarget(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, long int start, int factor, int AudioChannels, parameters *config);
-long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config);
-long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, int *maxdetected, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config);
+long int DetectSignalStart(sampleStore *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config);
+long int DetectSignalStartInternal(sampleStore *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, int *maxdetected, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config);
 #endif
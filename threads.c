@@ -0,0 +1,301 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "threads.h"
+#include "log.h"
+
+int GetProcessorCount()
+{
+	long int	cpus = 0;
+
+#if defined (WIN32)
+	char		*env = NULL;
+
+	env = getenv("NUMBER_OF_PROCESSORS");
+	if(env)
+		cpus = atol(env);
+#else
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(cpus < 1)
+		cpus = 1;
+	if(cpus > MAX_THREADS)
+		cpus = MAX_THREADS;
+	return (int)cpus;
+}
+
+int GetThreadCount(long int jobs, parameters *config)
+{
+	int threads = 0;
+
+	threads = config->threads;
+	if(threads <= 0)
+		threads = GetProcessorCount();
+	if(threads > MAX_THREADS)
+		threads = MAX_THREADS;
+	if(jobs < threads)
+		threads = jobs;
+	if(threads < 1)
+		threads = 1;
+	return threads;
+}
+
+/*
+	Jobs are handed out in index order from a shared counter, each
+	worker thread receives its own index so it can use private
+	scratch buffers. The first failure stops the remaining jobs.
+*/
+
+void *ThreadJobLoop(void *args)
+{
+	threadArgs	*targs = (threadArgs*)args;
+	threadJobs	*tj = targs->jobs;
+
+	while(1)
+	{
+		long int job = 0;
+
+		pthread_mutex_lock(&tj->lock);
+		if(tj->failed || tj->next >= tj->jobs)
+		{
+			pthread_mutex_unlock(&tj->lock);
+			break;
+		}
+		job = tj->next++;
+		pthread_mutex_unlock(&tj->lock);
+
+		if(!tj->worker(job, targs->thread, tj->data))
+		{
+			pthread_mutex_lock(&tj->lock);
+			tj->failed = 1;
+			pthread_mutex_unlock(&tj->lock);
+		}
+	}
+	return NULL;
+}
+
+int RunParallelJobs(long int jobs, int threads, threadJob worker, void *data)
+{
+	threadJobs	tj;
+	threadArgs	targs[MAX_THREADS];
+	pthread_t	tid[MAX_THREADS];
+	int			created = 0;
+
+	if(!worker || jobs <= 0)
+		return 1;
+
+	if(threads > jobs)
+		threads = jobs;
+	if(threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	if(threads <= 1)
+	{
+		for(long int i = 0; i < jobs; i++)
+		{
+			if(!worker(i, 0, data))
+				return 0;
+		}
+		return 1;
+	}
+
+	memset(&tj, 0, sizeof(threadJobs));
+	tj.worker = worker;
+	tj.data = data;
+	tj.jobs = jobs;
+	tj.next = 0;
+	tj.failed = 0;
+	if(pthread_mutex_init(&tj.lock, NULL) != 0)
+	{
+		logmsg("ERROR: Could not create thread lock\n");
+		return 0;
+	}
+
+	// The calling thread works as thread 0
+	for(int t = 1; t < threads; t++)
+	{
+		targs[t].jobs = &tj;
+		targs[t].thread = t;
+		if(pthread_create(&tid[t], NULL, ThreadJobLoop, &targs[t]) != 0)
+			break;
+		created ++;
+	}
+
+	targs[0].jobs = &tj;
+	targs[0].thread = 0;
+	ThreadJobLoop(&targs[0]);
+
+	for(int t = 1; t <= created; t++)
+		pthread_join(tid[t], NULL);
+
+	pthread_mutex_destroy(&tj.lock);
+	return !tj.failed;
+}
+
+/*
+	Pools keep their worker threads waiting between batches, for callers
+	that run many short batches in a row. The calling thread works as
+	thread 0 of every batch. A pool runs one batch at a time, so jobs can't
+	submit to the pool they run in.
+*/
+
+void *ThreadPoolLoop(void *args)
+{
+	threadArgs	*targs = (threadArgs*)args;
+	threadPool	*pool = targs->pool;
+	long int	seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while(1)
+	{
+		while(!pool->quit && pool->batch == seen)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if(pool->quit)
+			break;
+		seen = pool->batch;
+		pthread_mutex_unlock(&pool->lock);
+
+		ThreadJobLoop(targs);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->active--;
+		if(!pool->active)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+threadPool *CreateThreadPool(int threads)
+{
+	threadPool	*pool = NULL;
+
+	pool = (threadPool*)malloc(sizeof(threadPool));
+	if(!pool)
+	{
+		logmsg("ERROR: Not enough memory for thread pool\n");
+		return NULL;
+	}
+	memset(pool, 0, sizeof(threadPool));
+
+	if(threads > MAX_THREADS)
+		threads = MAX_THREADS;
+	if(threads < 1)
+		threads = 1;
+	pool->threads = threads;
+
+	if(pthread_mutex_init(&pool->lock, NULL) != 0)
+	{
+		logmsg("ERROR: Could not create thread lock\n");
+		free(pool);
+		return NULL;
+	}
+	if(pthread_mutex_init(&pool->tj.lock, NULL) != 0)
+	{
+		logmsg("ERROR: Could not create thread lock\n");
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for(int t = 0; t < threads; t++)
+	{
+		pool->args[t].jobs = &pool->tj;
+		pool->args[t].thread = t;
+		pool->args[t].pool = pool;
+	}
+
+	for(int t = 1; t < threads; t++)
+	{
+		if(pthread_create(&pool->tid[t], NULL, ThreadPoolLoop, &pool->args[t]) != 0)
+			break;
+		pool->created ++;
+	}
+	// Thread indexes must stay below the count given to the workers
+	pool->threads = pool->created + 1;
+	return pool;
+}
+
+int RunPoolJobs(threadPool *pool, long int jobs, threadJob worker, void *data)
+{
+	if(!worker || jobs <= 0)
+		return 1;
+
+	if(!pool || !pool->created || jobs == 1)
+	{
+		for(long int i = 0; i < jobs; i++)
+		{
+			if(!worker(i, 0, data))
+				return 0;
+		}
+		return 1;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->tj.worker = worker;
+	pool->tj.data = data;
+	pool->tj.jobs = jobs;
+	pool->tj.next = 0;
+	pool->tj.failed = 0;
+	pool->active = pool->created;
+	pool->batch++;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	ThreadJobLoop(&pool->args[0]);
+
+	pthread_mutex_lock(&pool->lock);
+	while(pool->active)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	return !pool->tj.failed;
+}
+
+void DestroyThreadPool(threadPool *pool)
+{
+	if(!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(int t = 1; t <= pool->created; t++)
+		pthread_join(pool->tid[t], NULL);
+
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	pthread_mutex_destroy(&pool->tj.lock);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
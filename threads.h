@@ -0,0 +1,75 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_THREADS_H
+#define MDFOURIER_THREADS_H
+
+#include "mdfourier.h"
+#include <pthread.h>
+
+#define MAX_THREADS	128
+
+typedef int (*threadJob)(long int job, int thread, void *data);
+
+typedef struct thread_jobs_st {
+	threadJob		worker;
+	void			*data;
+	long int		jobs;
+	long int		next;
+	int				failed;
+	pthread_mutex_t	lock;
+} threadJobs;
+
+typedef struct thread_args_st {
+	threadJobs				*jobs;
+	int						thread;
+	struct thread_pool_st	*pool;
+} threadArgs;
+
+typedef struct thread_pool_st {
+	int				threads;
+	int				created;
+	int				active;
+	int				quit;
+	long int		batch;
+	threadJobs		tj;
+	threadArgs		args[MAX_THREADS];
+	pthread_t		tid[MAX_THREADS];
+	pthread_mutex_t	lock;
+	pthread_cond_t	work;
+	pthread_cond_t	done;
+} threadPool;
+
+int GetProcessorCount();
+int GetThreadCount(long int jobs, parameters *config);
+int RunParallelJobs(long int jobs, int threads, threadJob worker, void *data);
+threadPool *CreateThreadPool(int threads);
+int RunPoolJobs(threadPool *pool, long int jobs, threadJob worker, void *data);
+void DestroyThreadPool(threadPool *pool);
+
+#endif
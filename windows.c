@@ -66,9 +66,9 @@ int initWindows(windowManager *wm, int SamplesPerSec, char winType, parameters *
 	return 1;
 }
 
-double *CreateWindowInternal(windowManager *wm, double *(*creator)(long), char *name, double seconds, long size, long sizePadding, long clkAdjustBufferSize)
+sampleType *CreateWindowInternal(windowManager *wm, sampleType *(*creator)(long), char *name, double seconds, long size, long sizePadding, long clkAdjustBufferSize)
 {
-	double *window = NULL, *tmp = NULL;
+	sampleType *window = NULL, *tmp = NULL;
 
 	window = creator(size);
 	if(!window)
@@ -78,7 +78,7 @@ double *CreateWindowInternal(windowManager *wm, double *(*creator)(long), char *
 	}
 	if(sizePadding)
 	{
-		tmp = (double*)realloc(window, sizeof(double)*(size+sizePadding+clkAdjustBufferSize));
+		tmp = (sampleType*)realloc(window, sizeof(sampleType)*(size+sizePadding+clkAdjustBufferSize));
 		if(!tmp)
 		{
 			free(window);
@@ -86,7 +86,7 @@ double *CreateWindowInternal(windowManager *wm, double *(*creator)(long), char *
 			return NULL;
 		}
 		window = tmp;
-		memset(window+size, 0, sizeof(double)*(sizePadding+clkAdjustBufferSize));
+		memset(window+size, 0, sizeof(sampleType)*(sizePadding+clkAdjustBufferSize));
 	}
 	wm->windowArray[wm->windowCount].sizePadding = sizePadding;
 
@@ -97,7 +97,7 @@ double *CreateWindowInternal(windowManager *wm, double *(*creator)(long), char *
 	return window;
 }
 
-double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
+sampleType *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
 {
 	double		seconds = 0;
 	long int	size = 0;
@@ -158,7 +158,7 @@ double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, dou
 	return NULL;
 }
 
-double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
+sampleType *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config)
 {
 	double		seconds = 0;
 	long int	size = 0;
@@ -188,6 +188,23 @@ double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames
 	return CreateWindow(wm, frames, cutFrames, framerate, config);
 }
 
+int getWindowSize(windowManager *wm, sampleType *window, long int *size, long int *sizePadding)
+{
+	if(!wm || !window)
+		return 0;
+
+	for(int i = 0; i < wm->windowCount; i++)
+	{
+		if(wm->windowArray[i].window == window)
+		{
+			*size = wm->windowArray[i].size;
+			*sizePadding = wm->windowArray[i].sizePadding;
+			return 1;
+		}
+	}
+	return 0;
+}
+
 void freeWindows(windowManager *wm)
 {
 	if(!wm)
@@ -214,18 +231,18 @@ void freeWindows(windowManager *wm)
 }
 
 // reduce scalloping loss 
-double *flattopWindow(long int n)
+sampleType *flattopWindow(long int n)
 {
 	int half, i, idx;
-	double *w;
+	sampleType *w;
  
-	w = (double*) calloc(n, sizeof(double));
+	w = (sampleType*) calloc(n, sizeof(sampleType));
 	if(!w)
 	{
 		logmsg("Not enough memory for window\n");
 		return NULL;
 	}
-	memset(w, 0, n*sizeof(double));
+	memset(w, 0, n*sizeof(sampleType));
  
 	if(n%2==0)
 	{
@@ -265,18 +282,19 @@ double *flattopWindow(long int n)
 
 
 // Only attenuate the edges to reduce errors
-double *tukeyWindow(long int n)
+sampleType *tukeyWindow(long int n)
 {
 	long int i;
-	double *w, M = 0, alpha = 0;
+	sampleType *w;
+	double M = 0, alpha = 0;
  
-	w = (double*) calloc(n, sizeof(double));
+	w = (sampleType*) calloc(n, sizeof(sampleType));
 	if(!w)
 	{
 		logmsg("Not enough memory for window\n");
 		return NULL;
 	}
-	memset(w, 0, n*sizeof(double));
+	memset(w, 0, n*sizeof(sampleType));
  
 	alpha = 0.65;
 	M = (n-1)/2;
@@ -292,18 +310,18 @@ double *tukeyWindow(long int n)
 	return(w);
 }
 
-double *hannWindow(long int n)
+sampleType *hannWindow(long int n)
 {
 	long int half, i, idx;
-	double *w;
+	sampleType *w;
  
-	w = (double*) calloc(n, sizeof(double));
+	w = (sampleType*) calloc(n, sizeof(sampleType));
 	if(!w)
 	{
 		logmsg("Not enough memory for window\n");
 		return NULL;
 	}
-	memset(w, 0, n*sizeof(double));
+	memset(w, 0, n*sizeof(sampleType));
 
 	if(n%2==0)
 	{
@@ -333,18 +351,18 @@ double *hannWindow(long int n)
 	return(w);
 }
 
-double *hammingWindow(long int n)
+sampleType *hammingWindow(long int n)
 {
 	long int half, i, idx;
-	double *w;
+	sampleType *w;
  
-	w = (double*) calloc(n, sizeof(double));
+	w = (sampleType*) calloc(n, sizeof(sampleType));
 	if(!w)
 	{
 		logmsg("Not enough memory for window\n");
 		return NULL;
 	}
-	memset(w, 0, n*sizeof(double));
+	memset(w, 0, n*sizeof(sampleType));
 
 	if(n%2==0)
 	{
@@ -376,7 +394,7 @@ double *hammingWindow(long int n)
 
 double CalculateCorrectionFactor(windowManager *wm, long int frames)
 {
-	double		*window = NULL;
+	sampleType		*window = NULL;
 	double		factor = 0, sum = 0;
 	long int	size = 0;
 
@@ -31,14 +31,15 @@
 
 #include "mdfourier.h"
 
-double *hannWindow(long int n);
-double *flattopWindow(long int n);
-double *tukeyWindow(long int n);
-double *hammingWindow(long int n);
+sampleType *hannWindow(long int n);
+sampleType *flattopWindow(long int n);
+sampleType *tukeyWindow(long int n);
+sampleType *hammingWindow(long int n);
 
 int initWindows(windowManager *wm, int SamplesPerSec, char winType, parameters *config);
-double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
-double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
+sampleType *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
+int getWindowSize(windowManager *wm, sampleType *window, long int *size, long int *sizePadding);
+sampleType *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
 void freeWindows(windowManager *windows);
 double CompensateValueForWindow(double value, char winType);
 double CalculateCorrectionFactor(windowManager *wm, long int frames);